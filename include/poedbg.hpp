@@ -0,0 +1,860 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+// A header-only C++20 client for poedbg. Packets are read from the engine's
+// packet queue on a background thread and handed to coroutines, so consumer
+// logic runs on whatever executor you choose instead of on the debug thread.
+//
+//	poedbg::Library Poedbg(L"poedbg.dll");
+//	poedbg::Session Session(Poedbg, poedbg::ThreadPoolExecutor());
+//
+//	poedbg::Task Consume(poedbg::Session& Session)
+//	{
+//		auto Packets = Session.Packets();
+//
+//		for (auto It = co_await Packets.begin(); It != Packets.end(); co_await ++It)
+//		{
+//			printf("0x%02x %zu\n", It->Id, It->Data.size());
+//		}
+//	}
+//
+// Packets can also be handed straight to handlers chosen by packet ID, through
+// a table built at compile time. IDs without a handler are filtered out by the
+// engine, and every other packet costs a single indirect call.
+//
+//	void HandleChat(const poedbg::PacketView& Packet) { ... }
+//
+//	poedbg::Library Poedbg(L"poedbg.dll");
+//	poedbg::Dispatcher<poedbg::OnReceive<0x0a, HandleChat>> Handlers(Poedbg);
+//
+//	Poedbg.Initialize();
+
+#pragma once
+
+__pragma(warning(push, 0))
+#include <windows.h>
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+__pragma(warning(pop))
+
+namespace poedbg
+{
+	//////////////////////////////////////////////////////////////////////////
+	// Definitions
+	//////////////////////////////////////////////////////////////////////////
+
+	// Status codes used by the client. See the README for the full table.
+	constexpr int StatusSuccess = 0;
+	constexpr int StatusCallbackNotSupported = -15;
+	constexpr int StatusBufferTooSmall = -24;
+	constexpr int StatusQueueAlreadyEnabled = -26;
+	constexpr int StatusQueueNotEnabled = -27;
+
+	// Packet directions, and the number of packet IDs in each.
+	constexpr int DirectionSend = 0;
+	constexpr int DirectionReceive = 1;
+	constexpr int DirectionCount = 2;
+	constexpr int PacketIdCount = 0x100;
+
+	// The hooks a packet can come from.
+	constexpr int SourceSend = 0;
+	constexpr int SourceRecv = 1;
+	constexpr int SourceWsaRecv = 2;
+
+	// Default sizes of the engine queue and of each batch read from it.
+	constexpr DWORD DefaultQueueSize = 0x1000000;
+	constexpr DWORD DefaultBatchSize = 0x100000;
+
+	// How long the reader waits for packets before checking if it should stop.
+	constexpr DWORD ReaderTimeout = 100;
+
+	// The header in front of every packet read from the engine queue.
+	struct PacketRecord
+	{
+		DWORD Size;
+		DWORD Length;
+		BYTE Direction;
+		BYTE Id;
+		WORD Flags;
+		DWORD OriginalLength;
+		DWORD64 Timestamp;
+		DWORD64 Sequence;
+		DWORD Source;
+		DWORD Reserved;
+	};
+
+	// A captured packet, owned by the consumer. The timestamp is in nanoseconds
+	// since the engine was initialized; PoeDbgTimestampToSystemTime converts it
+	// to wall-clock time. OriginalLength is more than the size of Data when the
+	// packet was truncated by its capture policy. Sequence numbers packets in
+	// both directions in the order they were captured, and Source is the hook
+	// the packet came from.
+	struct Packet
+	{
+		int Direction;
+		BYTE Id;
+		std::vector<BYTE> Data;
+		DWORD64 Timestamp;
+		DWORD OriginalLength;
+		DWORD64 Sequence;
+		int Source;
+	};
+
+	// A packet handed to a dispatch table handler. Data belongs to whoever
+	// dispatched the packet, and is only valid until the handler returns.
+	struct PacketView
+	{
+		int Direction;
+		BYTE Id;
+		std::span<const BYTE> Data;
+		DWORD64 Timestamp;
+	};
+
+	// Runs a resumed coroutine. The reader thread hands every waiting consumer
+	// to the executor, so the executor decides which thread consumer logic
+	// runs on.
+	using Executor = std::function<void(std::coroutine_handle<>)>;
+
+	/*
+	Resumes consumers directly on the reader thread. This has the lowest latency,
+	but the next batch isn't read until the consumer suspends again.
+	*/
+	inline Executor InlineExecutor()
+	{
+		return [](std::coroutine_handle<> Handle) { Handle.resume(); };
+	}
+
+	/*
+	Resumes consumers on the default Windows thread pool.
+	*/
+	inline Executor ThreadPoolExecutor()
+	{
+		return [](std::coroutine_handle<> Handle)
+		{
+			auto Resume = [](PTP_CALLBACK_INSTANCE, PVOID Context)
+			{
+				std::coroutine_handle<>::from_address(Context).resume();
+			};
+
+			if (!TrySubmitThreadpoolCallback(Resume, Handle.address(), NULL))
+			{
+				// Better late on the wrong thread than never.
+				Handle.resume();
+			}
+		};
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Coroutine Types
+	//////////////////////////////////////////////////////////////////////////
+
+	/*
+	A fire-and-forget coroutine. It starts running immediately and frees itself
+	when it finishes.
+	*/
+	struct Task
+	{
+		struct promise_type
+		{
+			Task get_return_object() noexcept { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() noexcept {}
+			void unhandled_exception() noexcept { std::terminate(); }
+		};
+	};
+
+	/*
+	An asynchronous generator. Advancing the iterator resumes the generator,
+	and the consumer is resumed again once the generator yields a value or
+	finishes.
+	*/
+	template <typename T>
+	class AsyncGenerator
+	{
+	public:
+		struct promise_type
+		{
+			T* Value = nullptr;
+			std::coroutine_handle<> Consumer;
+			std::exception_ptr Exception;
+
+			// Hands control straight back to whoever is waiting on the generator.
+			struct ResumeConsumer
+			{
+				bool await_ready() const noexcept { return false; }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> Handle) noexcept { return Handle.promise().Consumer; }
+				void await_resume() noexcept {}
+			};
+
+			AsyncGenerator get_return_object() noexcept { return AsyncGenerator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			ResumeConsumer final_suspend() noexcept { Value = nullptr; return {}; }
+			void return_void() noexcept {}
+			void unhandled_exception() noexcept { Exception = std::current_exception(); }
+
+			ResumeConsumer yield_value(T& Yielded) noexcept
+			{
+				Value = std::addressof(Yielded);
+				return {};
+			}
+
+			ResumeConsumer yield_value(T&& Yielded) noexcept
+			{
+				Value = std::addressof(Yielded);
+				return {};
+			}
+		};
+
+		using Handle = std::coroutine_handle<promise_type>;
+
+		class Iterator
+		{
+		public:
+			Iterator() noexcept = default;
+			explicit Iterator(Handle Coroutine) noexcept : m_Coroutine(Coroutine) {}
+
+			T& operator*() const noexcept { return *m_Coroutine.promise().Value; }
+			T* operator->() const noexcept { return m_Coroutine.promise().Value; }
+
+			bool operator==(const Iterator& Other) const noexcept { return m_Coroutine == Other.m_Coroutine; }
+			bool operator!=(const Iterator& Other) const noexcept { return m_Coroutine != Other.m_Coroutine; }
+
+			// Resumes the generator and waits for its next value. The iterator
+			// becomes the end iterator once the generator finishes.
+			auto operator++() noexcept { return Advance{ m_Coroutine, this }; }
+
+		private:
+			Handle m_Coroutine;
+		};
+
+		AsyncGenerator(AsyncGenerator&& Other) noexcept : m_Coroutine(std::exchange(Other.m_Coroutine, {})) {}
+		AsyncGenerator(const AsyncGenerator&) = delete;
+		AsyncGenerator& operator=(const AsyncGenerator&) = delete;
+
+		~AsyncGenerator()
+		{
+			if (m_Coroutine)
+			{
+				m_Coroutine.destroy();
+			}
+		}
+
+		// Starts the generator and waits for its first value.
+		auto begin() noexcept { return Advance{ m_Coroutine, nullptr }; }
+		Iterator end() noexcept { return Iterator(); }
+
+	private:
+		explicit AsyncGenerator(Handle Coroutine) noexcept : m_Coroutine(Coroutine) {}
+
+		struct Advance
+		{
+			Handle Coroutine;
+			Iterator* Target;
+
+			bool await_ready() const noexcept { return !Coroutine || Coroutine.done(); }
+
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> Consumer) noexcept
+			{
+				Coroutine.promise().Consumer = Consumer;
+				return Coroutine;
+			}
+
+			Iterator await_resume()
+			{
+				Iterator Next = (!Coroutine || Coroutine.done()) ? Iterator() : Iterator(Coroutine);
+
+				if (nullptr != Target)
+				{
+					*Target = Next;
+				}
+
+				if (Coroutine && Coroutine.promise().Exception)
+				{
+					std::rethrow_exception(Coroutine.promise().Exception);
+				}
+
+				return Next;
+			}
+		};
+
+		Handle m_Coroutine;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// Library
+	//////////////////////////////////////////////////////////////////////////
+
+	/*
+	The engine module, with the exports the client uses resolved once when it
+	is loaded. A module loaded by path is freed again when the library is
+	destroyed, while one passed in by handle belongs to the caller.
+	*/
+	class Library
+	{
+	public:
+		explicit Library(const wchar_t* Path = L"poedbg.dll") : m_Module(LoadLibraryW(Path)), m_bIsOwner(true)
+		{
+			Resolve();
+		}
+
+		explicit Library(HMODULE Module) : m_Module(Module), m_bIsOwner(false)
+		{
+			Resolve();
+		}
+
+		Library(const Library&) = delete;
+		Library& operator=(const Library&) = delete;
+
+		~Library()
+		{
+			if (m_bIsOwner && NULL != m_Module)
+			{
+				FreeLibrary(m_Module);
+			}
+		}
+
+		/*
+		Returns true if the module was loaded and exports everything the client
+		uses. Until it does, every call returns StatusCallbackNotSupported.
+		*/
+		bool IsLoaded() const noexcept
+		{
+			return m_bIsLoaded;
+		}
+
+		HMODULE Module() const noexcept
+		{
+			return m_Module;
+		}
+
+		int Initialize() const
+		{
+			return m_bIsLoaded ? m_Initialize() : StatusCallbackNotSupported;
+		}
+
+		int Destroy() const
+		{
+			return m_bIsLoaded ? m_Destroy() : StatusCallbackNotSupported;
+		}
+
+		int RegisterErrorCallback(void(__stdcall *Callback)(int Status)) const
+		{
+			return m_bIsLoaded ? m_RegisterErrorCallback(reinterpret_cast<PVOID>(Callback)) : StatusCallbackNotSupported;
+		}
+
+		int SetPacketFilter(int Direction, PBYTE Filter) const
+		{
+			return m_bIsLoaded ? m_SetPacketFilter(Direction, Filter) : StatusCallbackNotSupported;
+		}
+
+		int AddPacketSubscriberEx(int Direction, void(__stdcall *Callback)(unsigned int Length, BYTE Id, PBYTE Data, DWORD64 Timestamp), PBYTE Filter, PDWORD Id) const
+		{
+			return m_bIsLoaded ? m_AddPacketSubscriberEx(Direction, reinterpret_cast<PVOID>(Callback), Filter, Id) : StatusCallbackNotSupported;
+		}
+
+		int RemovePacketSubscriber(DWORD Id) const
+		{
+			return m_bIsLoaded ? m_RemovePacketSubscriber(Id) : StatusCallbackNotSupported;
+		}
+
+		int EnablePacketQueue(DWORD Size) const
+		{
+			return m_bIsLoaded ? m_EnablePacketQueue(Size) : StatusCallbackNotSupported;
+		}
+
+		int DisablePacketQueue() const
+		{
+			return m_bIsLoaded ? m_DisablePacketQueue() : StatusCallbackNotSupported;
+		}
+
+		int ReadPackets(PBYTE Buffer, DWORD BufferSize, PDWORD BytesRead, DWORD Timeout) const
+		{
+			return m_bIsLoaded ? m_ReadPackets(Buffer, BufferSize, BytesRead, Timeout) : StatusCallbackNotSupported;
+		}
+
+	private:
+		typedef int(__stdcall *StandardRoutine)();
+		typedef int(__stdcall *RegisterCallbackRoutine)(PVOID Callback);
+		typedef int(__stdcall *SetPacketFilterRoutine)(int Direction, PBYTE Filter);
+		typedef int(__stdcall *AddPacketSubscriberRoutine)(int Direction, PVOID Callback, PBYTE Filter, PDWORD Id);
+		typedef int(__stdcall *RemovePacketSubscriberRoutine)(DWORD Id);
+		typedef int(__stdcall *EnablePacketQueueRoutine)(DWORD Size);
+		typedef int(__stdcall *ReadPacketsRoutine)(PBYTE Buffer, DWORD BufferSize, PDWORD BytesRead, DWORD Timeout);
+
+		/*
+		Looks up every export the client uses.
+		*/
+		void Resolve()
+		{
+			if (NULL == m_Module)
+			{
+				return;
+			}
+
+			m_Initialize = reinterpret_cast<StandardRoutine>(GetProcAddress(m_Module, "PoeDbgInitialize"));
+			m_Destroy = reinterpret_cast<StandardRoutine>(GetProcAddress(m_Module, "PoeDbgDestroy"));
+			m_RegisterErrorCallback = reinterpret_cast<RegisterCallbackRoutine>(GetProcAddress(m_Module, "PoeDbgRegisterErrorCallback"));
+			m_SetPacketFilter = reinterpret_cast<SetPacketFilterRoutine>(GetProcAddress(m_Module, "PoeDbgSetPacketFilter"));
+			m_AddPacketSubscriberEx = reinterpret_cast<AddPacketSubscriberRoutine>(GetProcAddress(m_Module, "PoeDbgAddPacketSubscriberEx"));
+			m_RemovePacketSubscriber = reinterpret_cast<RemovePacketSubscriberRoutine>(GetProcAddress(m_Module, "PoeDbgRemovePacketSubscriber"));
+			m_EnablePacketQueue = reinterpret_cast<EnablePacketQueueRoutine>(GetProcAddress(m_Module, "PoeDbgEnablePacketQueue"));
+			m_DisablePacketQueue = reinterpret_cast<StandardRoutine>(GetProcAddress(m_Module, "PoeDbgDisablePacketQueue"));
+			m_ReadPackets = reinterpret_cast<ReadPacketsRoutine>(GetProcAddress(m_Module, "PoeDbgReadPackets"));
+
+			m_bIsLoaded = (nullptr != m_Initialize && nullptr != m_Destroy && nullptr != m_RegisterErrorCallback && nullptr != m_SetPacketFilter &&
+				nullptr != m_AddPacketSubscriberEx && nullptr != m_RemovePacketSubscriber && nullptr != m_EnablePacketQueue &&
+				nullptr != m_DisablePacketQueue && nullptr != m_ReadPackets);
+		}
+
+		HMODULE m_Module;
+		bool m_bIsOwner;
+		bool m_bIsLoaded = false;
+
+		StandardRoutine m_Initialize = nullptr;
+		StandardRoutine m_Destroy = nullptr;
+		RegisterCallbackRoutine m_RegisterErrorCallback = nullptr;
+		SetPacketFilterRoutine m_SetPacketFilter = nullptr;
+		AddPacketSubscriberRoutine m_AddPacketSubscriberEx = nullptr;
+		RemovePacketSubscriberRoutine m_RemovePacketSubscriber = nullptr;
+		EnablePacketQueueRoutine m_EnablePacketQueue = nullptr;
+		StandardRoutine m_DisablePacketQueue = nullptr;
+		ReadPacketsRoutine m_ReadPackets = nullptr;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// Session
+	//////////////////////////////////////////////////////////////////////////
+
+	/*
+	Reads packets from the engine queue on a background thread and hands them to
+	consumers. The engine itself is still initialized and destroyed through the
+	library, which must outlive the session.
+	*/
+	class Session
+	{
+	public:
+		explicit Session(const Library& Poedbg, Executor Resume = InlineExecutor(), DWORD QueueSize = DefaultQueueSize, DWORD BatchSize = DefaultBatchSize)
+			: m_Library(Poedbg), m_Resume(std::move(Resume)), m_QueueSize(QueueSize), m_Batch(BatchSize)
+		{
+		}
+
+		Session(const Session&) = delete;
+		Session& operator=(const Session&) = delete;
+
+		~Session()
+		{
+			Stop();
+		}
+
+		/*
+		Enables the engine queue and starts the reader thread. Returns
+		StatusQueueNotEnabled if the library isn't loaded.
+		*/
+		int Start()
+		{
+			if (!m_Library.IsLoaded())
+			{
+				return StatusQueueNotEnabled;
+			}
+
+			if (m_Reader.joinable())
+			{
+				return StatusSuccess;
+			}
+
+			int Status = m_Library.EnablePacketQueue(m_QueueSize);
+
+			if (Status < 0 && StatusQueueAlreadyEnabled != Status)
+			{
+				return Status;
+			}
+
+			m_bIsQueueOwner = (StatusQueueAlreadyEnabled != Status);
+			m_bIsClosed = false;
+			m_bIsStopping = false;
+
+			m_Reader = std::thread([this] { ReadLoop(); });
+
+			return StatusSuccess;
+		}
+
+		/*
+		Stops the reader thread. Consumers still waiting for a packet are resumed
+		with no packet.
+		*/
+		void Stop()
+		{
+			if (!m_Reader.joinable())
+			{
+				return;
+			}
+
+			m_bIsStopping = true;
+			m_Reader.join();
+
+			if (m_bIsQueueOwner)
+			{
+				m_Library.DisablePacketQueue();
+			}
+		}
+
+		/*
+		Waits for the next packet. The result is empty once the session has
+		stopped and every packet read so far has been handed out.
+		*/
+		auto NextPacket()
+		{
+			struct Awaiter
+			{
+				Session& Owner;
+				std::optional<Packet> Result;
+
+				bool await_ready() const noexcept { return false; }
+
+				bool await_suspend(std::coroutine_handle<> Handle)
+				{
+					std::lock_guard<std::mutex> Lock(Owner.m_Lock);
+
+					if (!Owner.m_Pending.empty())
+					{
+						Result = std::move(Owner.m_Pending.front());
+						Owner.m_Pending.pop_front();
+						return false;
+					}
+
+					if (Owner.m_bIsClosed)
+					{
+						return false;
+					}
+
+					Owner.m_Waiters.push_back({ Handle, &Result });
+					return true;
+				}
+
+				std::optional<Packet> await_resume() noexcept { return std::move(Result); }
+			};
+
+			return Awaiter{ *this };
+		}
+
+		/*
+		Yields every packet until the session stops.
+		*/
+		AsyncGenerator<Packet> Packets()
+		{
+			for (;;)
+			{
+				std::optional<Packet> Next = co_await NextPacket();
+
+				if (!Next)
+				{
+					co_return;
+				}
+
+				co_yield std::move(*Next);
+			}
+		}
+
+	private:
+		struct Waiter
+		{
+			std::coroutine_handle<> Handle;
+			std::optional<Packet>* Result;
+		};
+
+		/*
+		Reads batches from the engine queue until the session is stopped or the
+		queue is closed, handing each packet to a waiting consumer if there is
+		one and keeping it for the next consumer otherwise.
+		*/
+		void ReadLoop()
+		{
+			std::vector<Waiter> Ready;
+
+			while (!m_bIsStopping)
+			{
+				DWORD BytesRead = 0;
+				int Status = m_Library.ReadPackets(m_Batch.data(), static_cast<DWORD>(m_Batch.size()), &BytesRead, ReaderTimeout);
+
+				if (StatusBufferTooSmall == Status)
+				{
+					m_Batch.resize(BytesRead);
+					continue;
+				}
+
+				if (Status < 0)
+				{
+					break;
+				}
+
+				{
+					std::lock_guard<std::mutex> Lock(m_Lock);
+
+					for (DWORD Offset = 0; Offset < BytesRead;)
+					{
+						const PacketRecord* Record = reinterpret_cast<const PacketRecord*>(m_Batch.data() + Offset);
+						const BYTE* Data = reinterpret_cast<const BYTE*>(Record + 1);
+
+						Packet Next{ Record->Direction, Record->Id, std::vector<BYTE>(Data, Data + Record->Length), Record->Timestamp, Record->OriginalLength, Record->Sequence, static_cast<int>(Record->Source) };
+
+						if (!m_Waiters.empty())
+						{
+							*m_Waiters.front().Result = std::move(Next);
+							Ready.push_back(m_Waiters.front());
+							m_Waiters.pop_front();
+						}
+						else
+						{
+							m_Pending.push_back(std::move(Next));
+						}
+
+						Offset += Record->Size;
+					}
+				}
+
+				// Resume consumers outside the lock, since they will usually ask
+				// for another packet straight away.
+
+				for (Waiter& Resumed : Ready)
+				{
+					m_Resume(Resumed.Handle);
+				}
+
+				Ready.clear();
+			}
+
+			std::deque<Waiter> Remaining;
+
+			{
+				std::lock_guard<std::mutex> Lock(m_Lock);
+
+				m_bIsClosed = true;
+				Remaining.swap(m_Waiters);
+			}
+
+			for (Waiter& Resumed : Remaining)
+			{
+				m_Resume(Resumed.Handle);
+			}
+		}
+
+		const Library& m_Library;
+		Executor m_Resume;
+		DWORD m_QueueSize;
+		std::vector<BYTE> m_Batch;
+
+		std::thread m_Reader;
+		std::atomic<bool> m_bIsStopping = false;
+		bool m_bIsQueueOwner = false;
+
+		std::mutex m_Lock;
+		std::deque<Packet> m_Pending;
+		std::deque<Waiter> m_Waiters;
+		bool m_bIsClosed = false;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// Dispatch
+	//////////////////////////////////////////////////////////////////////////
+
+	// An entry in a dispatch table.
+	using PacketHandler = void(*)(const PacketView& Packet);
+
+	/*
+	Names the handler for packets with the given ID travelling in the given
+	direction. The handler can be a function or a lambda without captures. It is
+	called directly from its table entry, so the compiler can inline it there.
+	*/
+	template <int Direction, BYTE Id, auto Handler>
+	struct On
+	{
+		static_assert(Direction >= 0 && Direction < DirectionCount, "The direction must be DirectionSend or DirectionReceive.");
+
+		static constexpr int HandledDirection = Direction;
+		static constexpr BYTE HandledId = Id;
+
+		static void Invoke(const PacketView& Packet)
+		{
+			Handler(Packet);
+		}
+	};
+
+	template <BYTE Id, auto Handler>
+	using OnSend = On<DirectionSend, Id, Handler>;
+
+	template <BYTE Id, auto Handler>
+	using OnReceive = On<DirectionReceive, Id, Handler>;
+
+	/*
+	A jump table for each direction with an entry for every packet ID, built at
+	compile time from a list of On handlers. IDs without a handler go to a
+	function that does nothing, so dispatching a packet never compares its ID.
+	*/
+	template <typename... Handlers>
+	class PacketTable
+	{
+	public:
+		using Entries = std::array<std::array<PacketHandler, PacketIdCount>, DirectionCount>;
+		using Filters = std::array<std::array<BYTE, PacketIdCount>, DirectionCount>;
+
+		static void Ignore(const PacketView&) noexcept {}
+
+	private:
+		static constexpr bool IsUnique()
+		{
+			std::array<std::array<bool, PacketIdCount>, DirectionCount> Seen{};
+			bool bIsUnique = true;
+
+			([&]
+			{
+				bIsUnique = bIsUnique && !Seen[Handlers::HandledDirection][Handlers::HandledId];
+				Seen[Handlers::HandledDirection][Handlers::HandledId] = true;
+			}(), ...);
+
+			return bIsUnique;
+		}
+
+		static_assert(IsUnique(), "Each packet ID can only have one handler in each direction.");
+
+		static constexpr Entries BuildTable()
+		{
+			Entries Built{};
+
+			for (auto& Direction : Built)
+			{
+				Direction.fill(&Ignore);
+			}
+
+			((Built[Handlers::HandledDirection][Handlers::HandledId] = &Handlers::Invoke), ...);
+
+			return Built;
+		}
+
+		static constexpr Filters BuildFilter()
+		{
+			Filters Built{};
+
+			for (auto& Direction : Built)
+			{
+				Direction.fill(1);
+			}
+
+			((Built[Handlers::HandledDirection][Handlers::HandledId] = 0), ...);
+
+			return Built;
+		}
+
+	public:
+		// The jump tables, indexed by direction and then packet ID.
+		static constexpr Entries Table = BuildTable();
+
+		// Packet filters in the engine's format, with a non-zero entry for every
+		// ID that has no handler.
+		static constexpr Filters Filter = BuildFilter();
+
+		// Does the given direction have any handlers at all?
+		static constexpr bool HasHandlers(int Direction)
+		{
+			return ((Handlers::HandledDirection == Direction) || ...);
+		}
+
+		/*
+		Hands a packet to its handler. This is the entry point the engine calls
+		for the given direction, as a POEDBG_PACKET_EX_CALLBACK.
+		*/
+		template <int Direction>
+		static void __stdcall Dispatch(unsigned int Length, BYTE Id, PBYTE Data, DWORD64 Timestamp)
+		{
+			Table[Direction][Id](PacketView{ Direction, Id, std::span<const BYTE>(Data, Length), Timestamp });
+		}
+
+		/*
+		Hands a packet read from the queue, such as one from a Session, to its
+		handler.
+		*/
+		static void Dispatch(const Packet& Next)
+		{
+			Table[Next.Direction][Next.Id](PacketView{ Next.Direction, Next.Id, std::span<const BYTE>(Next.Data), Next.Timestamp });
+		}
+	};
+
+	/*
+	Subscribes a dispatch table to the engine for as long as it exists. Only the
+	directions that have handlers are subscribed to, and unless told otherwise,
+	the engine filters out the IDs without one before calling the table.
+	*/
+	template <typename... Handlers>
+	class Dispatcher
+	{
+	public:
+		using Table = PacketTable<Handlers...>;
+
+		explicit Dispatcher(const Library& Poedbg, bool bFilterUnhandled = true) : m_Library(Poedbg)
+		{
+			m_Status = Subscribe<DirectionSend>(bFilterUnhandled);
+
+			if (m_Status >= 0)
+			{
+				m_Status = Subscribe<DirectionReceive>(bFilterUnhandled);
+			}
+		}
+
+		Dispatcher(const Dispatcher&) = delete;
+		Dispatcher& operator=(const Dispatcher&) = delete;
+
+		~Dispatcher()
+		{
+			for (int Direction = 0; Direction < DirectionCount; Direction++)
+			{
+				if (m_bIsSubscribed[Direction])
+				{
+					m_Library.RemovePacketSubscriber(m_Ids[Direction]);
+				}
+			}
+		}
+
+		/*
+		Returns the status of subscribing the table to the engine.
+		*/
+		int Status() const noexcept
+		{
+			return m_Status;
+		}
+
+	private:
+		template <int Direction>
+		int Subscribe(bool bFilterUnhandled)
+		{
+			if constexpr (!Table::HasHandlers(Direction))
+			{
+				return StatusSuccess;
+			}
+			else
+			{
+				// The engine copies the filter, so it can point into the table.
+				PBYTE Filter = bFilterUnhandled ? const_cast<PBYTE>(Table::Filter[Direction].data()) : nullptr;
+
+				int Result = m_Library.AddPacketSubscriberEx(Direction, &Table::template Dispatch<Direction>, Filter, &m_Ids[Direction]);
+
+				m_bIsSubscribed[Direction] = (Result >= 0);
+
+				return Result;
+			}
+		}
+
+		const Library& m_Library;
+		int m_Status = StatusSuccess;
+		DWORD m_Ids[DirectionCount] = {};
+		bool m_bIsSubscribed[DirectionCount] = {};
+	};
+}
@@ -4,6 +4,32 @@ import ctypes
 import time
 import sys
 
+# Packet formatting styles.
+POEDBG_FORMAT_HEX = 0
+
+# The loaded instance of poedbg, which our callbacks use to format packets.
+poedbg_dll = None
+
+def poedbg_format_packet(packet_length, packet_data):
+    # Builds of poedbg from before the formatter don't have the export, so we
+    # format each byte ourselves in that case.
+
+    if not hasattr(poedbg_dll, "PoeDbgFormatPacket"):
+        data = ctypes.cast(packet_data, ctypes.POINTER(ctypes.c_ubyte * packet_length))
+        return " ".join("{:02x}".format(b) for b in data.contents)
+
+    # The formatter reports exactly how large the output buffer must be, so
+    # we ask it first and then format into a buffer of that size.
+
+    output_length = ctypes.c_uint32(0)
+    poedbg_dll.PoeDbgFormatPacket(ctypes.c_void_p(packet_data), packet_length, POEDBG_FORMAT_HEX, None, ctypes.byref(output_length))
+
+    output = ctypes.create_string_buffer(output_length.value)
+    if poedbg_dll.PoeDbgFormatPacket(ctypes.c_void_p(packet_data), packet_length, POEDBG_FORMAT_HEX, output, ctypes.byref(output_length)) < 0:
+        return ""
+
+    return output.value.decode("ascii")
+
 # First, we need to specify the types of our callbacks so that the ctypes
 # module knows what to do with them when we pass them to poedbg.
 
@@ -14,23 +40,17 @@ def poedbg_error_callback(error_code):
 @ctypes.WINFUNCTYPE(None, ctypes.c_int, ctypes.c_byte, ctypes.c_void_p)
 def poedbg_packet_receive_callback(packet_length, packet_id, packet_data):
     print("[RECEIVED] Packet with ID of '{}' and length of '{}'.".format(packet_id, packet_length))
-
-    data = ctypes.cast(packet_data, ctypes.POINTER(ctypes.c_char * packet_length))
-    for b in data.contents:
-        sys.stdout.write("{:02x} ".format(ord(b)))
-    print("")
+    print(poedbg_format_packet(packet_length, packet_data))
 
 @ctypes.WINFUNCTYPE(None, ctypes.c_int, ctypes.c_byte, ctypes.c_void_p)
 def poedbg_packet_send_callback(packet_length, packet_id, packet_data):
     print("[SENT] Packet with ID of '{}' and length of '{}'.".format(packet_id, packet_length))
-    
-    data = ctypes.cast(packet_data, ctypes.POINTER(ctypes.c_char * packet_length))
-    for b in data.contents:
-        sys.stdout.write("{:02x} ".format(ord(b)))
-    print("")
+    print(poedbg_format_packet(packet_length, packet_data))
 
 
 def main():
+    global poedbg_dll
+
     print("Starting 'poedbg' Python sample...")
 
     # Load an instance of poedbg.
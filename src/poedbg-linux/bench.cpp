@@ -0,0 +1,355 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+// Measures how many hook events the engine can take per second, built against
+// the fake platform from platform_fake.hpp. The real debug loop runs on this
+// thread, and every event goes through the hooks, the packet copy and the
+// callbacks as it would with the game. Exits with a non-zero status if the
+// engine mishandled any event, allocated while running, or fell short of the
+// given rate. Given a path, every packet is also written to a pcapng file
+// there, which measures the rate with the pcapng writer running, and given a
+// trace path, the run is traced and the trace written there afterwards. A
+// path of '-' is skipped. Afterwards, the packet formatter is measured at each
+// instruction set this processor has against the sprintf loop the samples
+// used before it, and must produce the same text faster.
+//
+//	./poedbg-bench [events] [minimum events/s] [packet size] [pcapng path] [trace path]
+
+#include "../poedbg/common.h"
+#include "../poedbg/globals.h"
+#include "../poedbg/callbacks.h"
+#include "../poedbg/platform.hpp"
+#include "../poedbg/clock.hpp"
+#include "../poedbg/format.hpp"
+
+// Exports of the engine, which is built into this program.
+POEDBG_EXPORT PoeDbgRegisterErrorCallback(PVOID Callback);
+POEDBG_EXPORT PoeDbgRegisterPacketSendExCallback(PVOID Callback);
+POEDBG_EXPORT PoeDbgRegisterPacketReceiveExCallback(PVOID Callback);
+POEDBG_EXPORT PoeDbgStartPcapng(const wchar_t* Path, DWORD64 RotateSize, DWORD RotateSeconds);
+POEDBG_EXPORT PoeDbgStopPcapng();
+POEDBG_EXPORT PoeDbgGetPcapngStats(PPOEDBG_PCAPNG_STATS Stats);
+POEDBG_EXPORT PoeDbgStartTrace(DWORD Events, const wchar_t* Path);
+POEDBG_EXPORT PoeDbgStopTrace();
+POEDBG_EXPORT PoeDbgFormatPacket(PBYTE Data, DWORD Length, int Style, PCHAR Output, PDWORD OutputLength);
+
+// The payload the formatter is measured on, and how many times it is formatted
+// by each. The largest packet the engine copies is the fairest size to use.
+#define BENCH_FORMAT_BYTES DEFAULT_BUFFER_SIZE
+#define BENCH_FORMAT_ROUNDS 20
+
+// Heap allocations made by the whole process. malloc and friends are replaced
+// here and passed through to the C library's own, which lets every allocation
+// be counted, including those made by the standard containers.
+static volatile uint64_t s_AllocationCount;
+
+extern "C"
+{
+	void* __libc_malloc(size_t Size);
+	void* __libc_calloc(size_t Count, size_t Size);
+	void* __libc_realloc(void* Memory, size_t Size);
+	void __libc_free(void* Memory);
+
+	void* malloc(size_t Size)
+	{
+		s_AllocationCount = s_AllocationCount + 1;
+		return __libc_malloc(Size);
+	}
+
+	void* calloc(size_t Count, size_t Size)
+	{
+		s_AllocationCount = s_AllocationCount + 1;
+		return __libc_calloc(Count, Size);
+	}
+
+	void* realloc(void* Memory, size_t Size)
+	{
+		s_AllocationCount = s_AllocationCount + 1;
+		return __libc_realloc(Memory, Size);
+	}
+
+	void free(void* Memory)
+	{
+		__libc_free(Memory);
+	}
+}
+
+// Packets seen by the callbacks.
+static uint64_t s_PacketCount;
+static uint64_t s_PacketBytes;
+static uint64_t s_PacketChecksum;
+
+void HandlePacket(unsigned int Length, uint8_t Id, uint8_t* Data, uint64_t Timestamp)
+{
+	(void)Timestamp;
+
+	s_PacketCount++;
+	s_PacketBytes += Length;
+	s_PacketChecksum += Id + ((Length > 0) ? Data[Length - 1] : 0);
+}
+
+void HandleError(int Status)
+{
+	printf("[ERROR] The 'poedbg' module reported an error code of '%i'.\n", Status);
+}
+
+/*
+Returns the CPU time used by this thread, in nanoseconds.
+*/
+uint64_t GetThreadCpuTime()
+{
+	struct timespec Time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Time);
+
+	return static_cast<uint64_t>(Time.tv_sec) * 1000000000ULL + static_cast<uint64_t>(Time.tv_nsec);
+}
+
+/*
+Formats bytes as "xx " triples one at a time, the way the samples did before
+PoeDbgFormatPacket.
+*/
+void FormatWithSprintf(const uint8_t* Data, size_t Length, char* Output)
+{
+	size_t Written = 0;
+
+	for (size_t i = 0; i < Length; i++)
+	{
+		Written += static_cast<size_t>(sprintf(Output + Written, "%02x ", Data[i]));
+	}
+}
+
+/*
+Formats the payload the given number of times, in the given style and at the
+given instruction set level, or with the sprintf loop if the level is
+FORMAT_LEVEL_UNKNOWN. Returns the rate, in megabytes of payload per second.
+*/
+double MeasureFormat(const uint8_t* Data, char* Output, DWORD OutputSize, int Style, int Level)
+{
+	LARGE_INTEGER Frequency;
+	LARGE_INTEGER Start;
+	LARGE_INTEGER End;
+
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Start);
+
+	for (int Round = 0; Round < BENCH_FORMAT_ROUNDS; Round++)
+	{
+		if (FORMAT_LEVEL_UNKNOWN == Level)
+		{
+			FormatWithSprintf(Data, BENCH_FORMAT_BYTES, Output);
+		}
+		else
+		{
+			DWORD OutputLength = OutputSize;
+
+			_g_FormatLevel = Level;
+			PoeDbgFormatPacket(const_cast<PBYTE>(Data), BENCH_FORMAT_BYTES, Style, Output, &OutputLength);
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	double Seconds = static_cast<double>(End.QuadPart - Start.QuadPart) / static_cast<double>(Frequency.QuadPart);
+
+	return (static_cast<double>(BENCH_FORMAT_BYTES) * BENCH_FORMAT_ROUNDS / 1048576.0) / Seconds;
+}
+
+/*
+Runs the debug loop until the fake game has raised the given number of hook
+events.
+*/
+void RunEvents(uint64_t Events)
+{
+	_g_FakeEventLimit = Events;
+	DllDebugEventHandler(NULL);
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t Events = (argc > 1) ? strtoull(argv[1], NULL, 10) : 3000000;
+	double MinimumRate = (argc > 2) ? atof(argv[2]) : 0;
+	DWORD PacketSize = (argc > 3) ? static_cast<DWORD>(atoi(argv[3])) : 0;
+	const char* PcapngPath = (argc > 4 && 0 != strcmp(argv[4], "-")) ? argv[4] : NULL;
+	const char* TracePath = (argc > 5 && 0 != strcmp(argv[5], "-")) ? argv[5] : NULL;
+
+	if (0 == Events)
+	{
+		printf("The number of events must be above zero.\n");
+		return 1;
+	}
+
+	PoeDbgRegisterErrorCallback(reinterpret_cast<PVOID>(HandleError));
+	PoeDbgRegisterPacketSendExCallback(reinterpret_cast<PVOID>(HandlePacket));
+	PoeDbgRegisterPacketReceiveExCallback(reinterpret_cast<PVOID>(HandlePacket));
+
+	_PoeDbgClockInitialize();
+
+	_g_FakePacketSize = PacketSize;
+
+	// A short run first, so that the signatures have been found and every
+	// table has been filled before anything is measured.
+	RunEvents(10000);
+
+	if (NULL != PcapngPath)
+	{
+		wchar_t Path[PCAPNG_PATH_MAXIMUM];
+
+		if (static_cast<size_t>(-1) == mbstowcs(Path, PcapngPath, PCAPNG_PATH_MAXIMUM) || POEDBG_FAILURE(PoeDbgStartPcapng(Path, 0, 0)))
+		{
+			printf("Couldn't start writing to '%s'.\n", PcapngPath);
+			return 1;
+		}
+	}
+
+	if (NULL != TracePath)
+	{
+		wchar_t Path[TRACE_PATH_MAXIMUM];
+
+		if (static_cast<size_t>(-1) == mbstowcs(Path, TracePath, TRACE_PATH_MAXIMUM) || POEDBG_FAILURE(PoeDbgStartTrace(0, Path)))
+		{
+			printf("Couldn't start tracing to '%s'.\n", TracePath);
+			return 1;
+		}
+	}
+
+	s_PacketCount = 0;
+	s_PacketBytes = 0;
+
+	uint64_t StartAllocations = s_AllocationCount;
+	uint64_t StartCpu = GetThreadCpuTime();
+
+	LARGE_INTEGER Frequency;
+	LARGE_INTEGER Start;
+	LARGE_INTEGER End;
+
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Start);
+
+	RunEvents(Events);
+
+	QueryPerformanceCounter(&End);
+
+	uint64_t Cpu = GetThreadCpuTime() - StartCpu;
+	uint64_t Allocations = s_AllocationCount - StartAllocations;
+
+	POEDBG_PCAPNG_STATS PcapngStats = { 0 };
+	POEDBG_STATUS PcapngStatus = POEDBG_STATUS_SUCCESS;
+
+	if (NULL != PcapngPath)
+	{
+		PcapngStatus = PoeDbgStopPcapng();
+		PoeDbgGetPcapngStats(&PcapngStats);
+	}
+
+	POEDBG_STATUS TraceStatus = (NULL != TracePath) ? PoeDbgStopTrace() : POEDBG_STATUS_SUCCESS;
+
+	double Seconds = static_cast<double>(End.QuadPart - Start.QuadPart) / static_cast<double>(Frequency.QuadPart);
+	double Rate = static_cast<double>(_g_FakeEventCount) / Seconds;
+
+	printf("events        %llu in %.3f s, %.0f events/s\n", static_cast<unsigned long long>(_g_FakeEventCount), Seconds, Rate);
+	printf("cpu           %.1f ns per event\n", static_cast<double>(Cpu) / static_cast<double>(_g_FakeEventCount));
+	printf("packets       %llu, %.1f bytes on average\n", static_cast<unsigned long long>(s_PacketCount),
+		(0 != s_PacketCount) ? static_cast<double>(s_PacketBytes) / static_cast<double>(s_PacketCount) : 0.0);
+	printf("allocations   %llu\n", static_cast<unsigned long long>(Allocations));
+	printf("missed        %llu\n", static_cast<unsigned long long>(_g_FakeMissedCount));
+	printf("bad resumes   %llu\n", static_cast<unsigned long long>(_g_FakeBadResumeCount));
+
+	if (NULL != PcapngPath)
+	{
+		printf("pcapng        %llu packets, %.1f MB, %llu dropped\n", static_cast<unsigned long long>(PcapngStats.Packets),
+			static_cast<double>(PcapngStats.Bytes) / 1048576.0, static_cast<unsigned long long>(PcapngStats.Dropped));
+	}
+
+	// The formatter, against the sprintf loop it replaced. Only the hex style
+	// has an sprintf equivalent, so the others are measured for their rate.
+
+	static uint8_t FormatData[BENCH_FORMAT_BYTES];
+	static char Expected[BENCH_FORMAT_BYTES * FORMAT_HEX_WIDTH + 1];
+	static char Formatted[(BENCH_FORMAT_BYTES / FORMAT_XXD_LINE_BYTES) * (FORMAT_XXD_LINE_OVERHEAD + FORMAT_XXD_LINE_BYTES) + 1];
+
+	for (DWORD i = 0; i < BENCH_FORMAT_BYTES; i++)
+	{
+		FormatData[i] = static_cast<uint8_t>(i * 131 + (i >> 8));
+	}
+
+	const char* LevelNames[] = { "scalar", "ssse3", "avx2" };
+	const char* StyleNames[] = { "hex", "ascii", "xxd" };
+
+	int BestLevel = _PoeDbgFormatGetLevel();
+	double SprintfRate = MeasureFormat(FormatData, Expected, sizeof(Expected), POEDBG_FORMAT_HEX, FORMAT_LEVEL_UNKNOWN);
+	double SlowestHexRate = 0;
+	bool bIsFormatMismatched = false;
+
+	printf("format        sprintf hex %.1f MB/s\n", SprintfRate);
+
+	for (int Style = POEDBG_FORMAT_HEX; Style <= POEDBG_FORMAT_XXD; Style++)
+	{
+		printf("format        %-6s", StyleNames[Style]);
+
+		for (int Level = FORMAT_LEVEL_SCALAR; Level <= BestLevel; Level++)
+		{
+			double FormatRate = MeasureFormat(FormatData, Formatted, sizeof(Formatted), Style, Level);
+
+			printf("  %s %.1f MB/s", LevelNames[Level], FormatRate);
+
+			if (POEDBG_FORMAT_HEX == Style)
+			{
+				bIsFormatMismatched |= (0 != strcmp(Expected, Formatted));
+
+				if (0 == SlowestHexRate || FormatRate < SlowestHexRate)
+				{
+					SlowestHexRate = FormatRate;
+				}
+			}
+		}
+
+		printf("\n");
+	}
+
+	_g_FormatLevel = BestLevel;
+
+	int Result = 0;
+
+	if (bIsFormatMismatched)
+	{
+		printf("FAILED: the formatter's hex output differs from the sprintf loop's.\n");
+		Result = 1;
+	}
+
+	if (SlowestHexRate < SprintfRate)
+	{
+		printf("FAILED: the formatter was slower than the sprintf loop.\n");
+		Result = 1;
+	}
+
+	if (0 != _g_FakeMissedCount || 0 != _g_FakeBadResumeCount || s_PacketCount != _g_FakeEventCount || s_PacketBytes != _g_FakeByteCount)
+	{
+		printf("FAILED: not every event was handled as the game expects.\n");
+		Result = 1;
+	}
+
+	if (0 != Allocations)
+	{
+		printf("FAILED: the engine allocated memory while handling events.\n");
+		Result = 1;
+	}
+
+	if (POEDBG_FAILURE(PcapngStatus) || PcapngStats.Packets + PcapngStats.Dropped != ((NULL != PcapngPath) ? s_PacketCount : 0))
+	{
+		printf("FAILED: the pcapng writer lost packets or reported an error.\n");
+		Result = 1;
+	}
+
+	if (POEDBG_FAILURE(TraceStatus))
+	{
+		printf("FAILED: the trace couldn't be written.\n");
+		Result = 1;
+	}
+
+	if (Rate < MinimumRate)
+	{
+		printf("FAILED: below the minimum of %.0f events/s.\n", MinimumRate);
+		Result = 1;
+	}
+
+	return Result;
+}
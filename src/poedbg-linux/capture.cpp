@@ -0,0 +1,196 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+// Captures packets from the game, or the stand-in from target.cpp, and prints
+// how many arrive each second in each direction. Stops after the given number
+// of seconds, or on Ctrl+C. Given a spin maximum in microseconds, the debug
+// loop spins for events before blocking, optionally pinned to a processor,
+// and how long it waited for events is printed at the end.
+//
+//	./poedbg-capture [seconds] [spin maximum] [processor]
+
+#include <dlfcn.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Function pointer types for the functions we take from the module.
+typedef int(*POEDBG_STANDARD_ROUTINE)();
+typedef int(*POEDBG_REGISTER_CALLBACK_ROUTINE)(void* Callback);
+typedef int(*POEDBG_POINTER_ROUTINE)(void* Pointer);
+
+// Mirrors of the engine's debug loop settings and statistics.
+#define LOOP_HISTOGRAM_BUCKETS 32
+
+struct LoopSettings
+{
+	uint32_t Mode;
+	uint32_t SpinMaximum;
+	uint64_t Affinity;
+	int32_t Priority;
+	uint32_t Reserved;
+};
+
+struct LoopStats
+{
+	uint64_t SpinEvents;
+	uint64_t BlockEvents;
+	uint64_t SpinTime;
+	uint32_t SpinBudget;
+	int32_t Status;
+	uint64_t Gap[LOOP_HISTOGRAM_BUCKETS];
+	uint64_t SpinLatency[LOOP_HISTOGRAM_BUCKETS];
+};
+
+// Callback function pointer types that we'll be using.
+typedef void(*POEDBG_ERROR_CALLBACK)(int Status);
+typedef void(*POEDBG_PACKET_EX_CALLBACK)(unsigned int Length, uint8_t Id, uint8_t* Data, uint64_t Timestamp);
+
+// Packet counts. Only the debug loop writes these.
+static volatile uint64_t s_SendCount;
+static volatile uint64_t s_ReceiveCount;
+static volatile uint64_t s_ByteCount;
+static volatile uint64_t s_LastTimestamp;
+
+static volatile sig_atomic_t s_bIsStopping;
+
+void HandleError(int Status)
+{
+	printf("[ERROR] The 'poedbg' module reported an error code of '%i'.\n", Status);
+}
+
+void HandlePacketSend(unsigned int Length, uint8_t Id, uint8_t* Data, uint64_t Timestamp)
+{
+	(void)Id;
+	(void)Data;
+
+	s_SendCount = s_SendCount + 1;
+	s_ByteCount = s_ByteCount + Length;
+	s_LastTimestamp = Timestamp;
+}
+
+void HandlePacketReceive(unsigned int Length, uint8_t Id, uint8_t* Data, uint64_t Timestamp)
+{
+	(void)Id;
+	(void)Data;
+
+	s_ReceiveCount = s_ReceiveCount + 1;
+	s_ByteCount = s_ByteCount + Length;
+	s_LastTimestamp = Timestamp;
+}
+
+void PrintHistogram(const char* Name, const uint64_t* Buckets)
+{
+	printf("%s\n", Name);
+
+	for (int Index = 0; Index < LOOP_HISTOGRAM_BUCKETS; Index++)
+	{
+		if (0 != Buckets[Index])
+		{
+			printf("  >= %10llu ns  %10llu\n", 1ULL << Index, static_cast<unsigned long long>(Buckets[Index]));
+		}
+	}
+}
+
+void HandleInterrupt(int Signal)
+{
+	(void)Signal;
+	s_bIsStopping = 1;
+}
+
+int main(int argc, char** argv)
+{
+	int Seconds = (argc > 1) ? atoi(argv[1]) : 0;
+	bool bIsSpinning = (argc > 2);
+
+	void* Module = dlopen("./libpoedbg.so", RTLD_NOW);
+
+	if (NULL == Module)
+	{
+		printf("Could not load the 'poedbg' module: %s\n", dlerror());
+		return 1;
+	}
+
+	POEDBG_STANDARD_ROUTINE PoeDbgInitialize = reinterpret_cast<POEDBG_STANDARD_ROUTINE>(dlsym(Module, "PoeDbgInitialize"));
+	POEDBG_STANDARD_ROUTINE PoeDbgDestroy = reinterpret_cast<POEDBG_STANDARD_ROUTINE>(dlsym(Module, "PoeDbgDestroy"));
+	POEDBG_REGISTER_CALLBACK_ROUTINE PoeDbgRegisterErrorCallback = reinterpret_cast<POEDBG_REGISTER_CALLBACK_ROUTINE>(dlsym(Module, "PoeDbgRegisterErrorCallback"));
+	POEDBG_REGISTER_CALLBACK_ROUTINE PoeDbgRegisterPacketSendExCallback = reinterpret_cast<POEDBG_REGISTER_CALLBACK_ROUTINE>(dlsym(Module, "PoeDbgRegisterPacketSendExCallback"));
+	POEDBG_REGISTER_CALLBACK_ROUTINE PoeDbgRegisterPacketReceiveExCallback = reinterpret_cast<POEDBG_REGISTER_CALLBACK_ROUTINE>(dlsym(Module, "PoeDbgRegisterPacketReceiveExCallback"));
+
+	POEDBG_POINTER_ROUTINE PoeDbgSetLoopSettings = reinterpret_cast<POEDBG_POINTER_ROUTINE>(dlsym(Module, "PoeDbgSetLoopSettings"));
+	POEDBG_POINTER_ROUTINE PoeDbgGetLoopStats = reinterpret_cast<POEDBG_POINTER_ROUTINE>(dlsym(Module, "PoeDbgGetLoopStats"));
+
+	if (bIsSpinning)
+	{
+		LoopSettings Settings = { 1, static_cast<uint32_t>(atoi(argv[2])), (argc > 3) ? (1ULL << atoi(argv[3])) : 0, 0, 0 };
+
+		if (PoeDbgSetLoopSettings(&Settings) < 0)
+		{
+			printf("Could not set the debug loop to spin for %s us.\n", argv[2]);
+			return 1;
+		}
+	}
+
+	PoeDbgRegisterErrorCallback(reinterpret_cast<void*>(HandleError));
+	PoeDbgRegisterPacketSendExCallback(reinterpret_cast<void*>(HandlePacketSend));
+	PoeDbgRegisterPacketReceiveExCallback(reinterpret_cast<void*>(HandlePacketReceive));
+
+	int Status = PoeDbgInitialize();
+
+	if (Status < 0)
+	{
+		printf("Could not initialize 'poedbg', error code '%i'.\n", Status);
+		return 1;
+	}
+
+	signal(SIGINT, HandleInterrupt);
+
+	uint64_t LastSend = 0;
+	uint64_t LastReceive = 0;
+	uint64_t LastBytes = 0;
+
+	for (int Elapsed = 0; !s_bIsStopping && (0 == Seconds || Elapsed < Seconds); Elapsed++)
+	{
+		sleep(1);
+
+		uint64_t Send = s_SendCount;
+		uint64_t Receive = s_ReceiveCount;
+		uint64_t Bytes = s_ByteCount;
+
+		printf("send %8llu/s  receive %8llu/s  %10llu bytes/s  last at %.3f s\n",
+			static_cast<unsigned long long>(Send - LastSend),
+			static_cast<unsigned long long>(Receive - LastReceive),
+			static_cast<unsigned long long>(Bytes - LastBytes),
+			s_LastTimestamp / 1e9);
+
+		fflush(stdout);
+
+		LastSend = Send;
+		LastReceive = Receive;
+		LastBytes = Bytes;
+	}
+
+	LoopStats Stats;
+	PoeDbgGetLoopStats(&Stats);
+
+	Status = PoeDbgDestroy();
+
+	printf("Detached with status '%i' after %llu sent and %llu received.\n", Status,
+		static_cast<unsigned long long>(s_SendCount),
+		static_cast<unsigned long long>(s_ReceiveCount));
+
+	if (bIsSpinning)
+	{
+		printf("%llu events caught spinning, %llu blocked, %.3f s spent spinning, budget now %u ns\n",
+			static_cast<unsigned long long>(Stats.SpinEvents),
+			static_cast<unsigned long long>(Stats.BlockEvents),
+			Stats.SpinTime / 1e9,
+			Stats.SpinBudget);
+
+		PrintHistogram("wait for each event", Stats.Gap);
+		PrintHistogram("latency of events caught spinning", Stats.SpinLatency);
+	}
+
+	return 0;
+}
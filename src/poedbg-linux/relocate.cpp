@@ -0,0 +1,631 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+// Finds where the packet hooks went after a game patch, offline, from the code
+// sections of the old and new executables dumped to files. Each hook site is
+// found in the old section with its signature from globals.h, and the code
+// around it is matched against the new section with a rolling hash. The hash
+// is taken over normalized bytes, which leave out the operands that a rebuild
+// moves about: branch targets, RIP-relative addresses and 32-bit field
+// offsets. Every stretch of the old neighborhood found in the new section
+// votes for where the site now is, nearer stretches counting for more, and
+// the best scoring site gets a new signature, offset and size for review.
+//
+//	./poedbg-relocate <old section> <new section> [old base] [new base]
+//
+// The bases, in hex, are added to the offsets printed, so that they read as
+// RVAs or addresses if the bases of code are given.
+
+#include "../poedbg/common.h"
+#include "../poedbg/globals.h"
+#include "../poedbg/callbacks.h"
+#include "../poedbg/platform.hpp"
+#include "../poedbg/memory.hpp"
+
+#include <time.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// Bytes in each hashed stretch of code.
+#define RELOCATE_GRAM 16
+
+// Bytes either side of a hook site that are matched.
+#define RELOCATE_RADIUS 0x200
+
+// Stretches found more often than this in the old section say little about
+// where a site is, so they don't vote.
+#define RELOCATE_COMMON_MAXIMUM 4
+
+// The best voted sites are compared byte by byte with the old one, over this
+// many bytes either side, and the closest match is taken.
+#define RELOCATE_CANDIDATE_COUNT 16
+#define RELOCATE_NEAR 0x40
+
+// Slots in the table of stretches, which must be a power of two and well
+// above the number of stretches in every neighborhood together.
+#define RELOCATE_TABLE_SIZE 0x4000
+
+// Longest signature proposed, in bytes. Sections are padded by this much, so
+// that a signature tested near the end never reads past it.
+#define RELOCATE_PATTERN_MAXIMUM 0x40
+
+// Multiplier of the rolling hash.
+#define RELOCATE_HASH_BASE 0x100000001B3ULL
+
+// A dumped code section. Bytes that normalization leaves out are masked.
+typedef struct _RELOCATE_SECTION
+{
+	std::vector<BYTE> Data;
+	std::vector<BYTE> Mask;
+	SIZE_T Size;
+	DWORD64 Base;
+} RELOCATE_SECTION, *PRELOCATE_SECTION;
+
+// A hook to relocate, as globals.h describes it, and what was found.
+typedef struct _RELOCATE_HOOK
+{
+	const char* Name;
+	const char* Globals;
+	PBYTE Pattern;
+	ULONG_PTR Offset;
+	ULONG_PTR Size;
+	SIZE_T OldSite;
+	bool bIsFound;
+	std::unordered_map<SIZE_T, DWORD64> Votes;
+} RELOCATE_HOOK, *PRELOCATE_HOOK;
+
+// A stretch of code near one of the old hook sites.
+typedef struct _RELOCATE_GRAM_ENTRY
+{
+	DWORD64 Hash;
+	DWORD Hook;
+	DWORD Count;
+	SIZE_T Position;
+	bool bIsUsed;
+} RELOCATE_GRAM_ENTRY, *PRELOCATE_GRAM_ENTRY;
+
+static RELOCATE_HOOK s_Hooks[] =
+{
+	{ "send", "PacketSender", _g_PacketSenderPattern, _g_PacketSenderHookOffset, _g_PacketSenderHookSize },
+	{ "recv", "PacketRecv", _g_PacketRecvPattern, _g_PacketRecvHookOffset, _g_PacketRecvHookSize },
+	{ "WSARecv", "PacketWsaRecv", _g_PacketWsaRecvPattern, _g_PacketWsaRecvHookOffset, _g_PacketWsaRecvHookSize },
+};
+
+#define RELOCATE_HOOK_COUNT (sizeof(s_Hooks) / sizeof(s_Hooks[0]))
+
+static RELOCATE_GRAM_ENTRY s_Grams[RELOCATE_TABLE_SIZE];
+
+// Opcodes that are followed by a ModRM byte, and so may carry a RIP-relative
+// address or a 32-bit displacement.
+static const BYTE s_ModRmOpcodes[] =
+{
+	0x01, 0x03, 0x09, 0x0B, 0x21, 0x23, 0x29, 0x2B, 0x31, 0x33, 0x39, 0x3B, 0x63, 0x69, 0x6B,
+	0x80, 0x81, 0x83, 0x84, 0x85, 0x87, 0x88, 0x89, 0x8A, 0x8B, 0x8D, 0xC6, 0xC7, 0xF6, 0xF7, 0xFE, 0xFF,
+};
+
+static bool s_bIsModRmOpcode[0x100];
+
+/*
+Reads a dumped section into memory, padded with zeroes.
+*/
+bool LoadSection(const char* Path, const char* Base, PRELOCATE_SECTION Section)
+{
+	FILE* File = fopen(Path, "rb");
+
+	if (NULL == File)
+	{
+		printf("Couldn't open '%s'.\n", Path);
+		return false;
+	}
+
+	fseek(File, 0, SEEK_END);
+	long Size = ftell(File);
+	fseek(File, 0, SEEK_SET);
+
+	if (Size <= RELOCATE_GRAM)
+	{
+		printf("'%s' is too small to be a code section.\n", Path);
+		fclose(File);
+		return false;
+	}
+
+	Section->Size = static_cast<SIZE_T>(Size);
+	Section->Data.assign(Section->Size + RELOCATE_PATTERN_MAXIMUM, 0);
+	Section->Mask.assign(Section->Size + RELOCATE_PATTERN_MAXIMUM, 0);
+	Section->Base = (NULL != Base) ? strtoull(Base, NULL, 16) : 0;
+
+	bool bIsRead = (fread(&Section->Data[0], 1, Section->Size, File) == Section->Size);
+
+	fclose(File);
+
+	if (!bIsRead)
+	{
+		printf("Couldn't read '%s'.\n", Path);
+	}
+
+	return bIsRead;
+}
+
+/*
+Masks the operand of the given size at the given position, if it is in the
+section.
+*/
+void MaskOperand(PRELOCATE_SECTION Section, const SIZE_T Position, const SIZE_T Size)
+{
+	for (SIZE_T Index = Position; Index < Position + Size && Index < Section->Size; Index++)
+	{
+		Section->Mask[Index] = 1;
+	}
+}
+
+/*
+Masks the operands that change whenever the code around them does. Nothing is
+disassembled: every byte is looked at as if an instruction started there,
+which masks a few bytes too many, but never leaves out one that moved.
+*/
+void NormalizeSection(PRELOCATE_SECTION Section)
+{
+	const PBYTE Data = &Section->Data[0];
+
+	for (SIZE_T Index = 0; Index + 1 < Section->Size; Index++)
+	{
+		BYTE Opcode = Data[Index];
+
+		if (0xE8 == Opcode || 0xE9 == Opcode)
+		{
+			// call and jmp, to a relative target.
+			MaskOperand(Section, Index + 1, 4);
+		}
+		else if (0xEB == Opcode || 0x70 == (Opcode & 0xF0))
+		{
+			// Short jmp and jcc.
+			MaskOperand(Section, Index + 1, 1);
+		}
+		else if (0x0F == Opcode && 0x80 == (Data[Index + 1] & 0xF0))
+		{
+			// Near jcc.
+			MaskOperand(Section, Index + 2, 4);
+		}
+		else if (s_bIsModRmOpcode[Opcode])
+		{
+			BYTE ModRm = Data[Index + 1];
+			BYTE Mod = ModRm >> 6;
+			BYTE Rm = ModRm & 7;
+
+			if (0 == Mod && 5 == Rm)
+			{
+				// RIP-relative address.
+				MaskOperand(Section, Index + 2, 4);
+			}
+			else if (2 == Mod)
+			{
+				// 32-bit displacement, after the SIB byte if there is one.
+				MaskOperand(Section, Index + ((4 == Rm) ? 3 : 2), 4);
+			}
+		}
+	}
+}
+
+/*
+Hashes every stretch of the section in turn, calling the given routine with
+its position and hash. Stretches that are mostly masked, or all one byte, such
+as padding, are skipped.
+*/
+template <typename ROUTINE>
+void HashSection(PRELOCATE_SECTION Section, const SIZE_T Start, const SIZE_T End, ROUTINE Routine)
+{
+	if (End < Start + RELOCATE_GRAM)
+	{
+		return;
+	}
+
+	DWORD64 Power = 1;
+
+	for (DWORD Index = 0; Index < RELOCATE_GRAM; Index++)
+	{
+		Power *= RELOCATE_HASH_BASE;
+	}
+
+	DWORD64 Hash = 0;
+	DWORD Masked = 0;
+	DWORD Repeats = 0;
+
+	for (SIZE_T Index = Start; Index < End; Index++)
+	{
+		BYTE In = Section->Mask[Index] ? 0 : Section->Data[Index];
+
+		Hash = Hash * RELOCATE_HASH_BASE + In + 1;
+		Masked += Section->Mask[Index];
+		Repeats += (Index > Start && Section->Data[Index] == Section->Data[Index - 1]) ? 1 : 0;
+
+		if (Index >= Start + RELOCATE_GRAM)
+		{
+			SIZE_T Out = Index - RELOCATE_GRAM;
+
+			Hash -= (static_cast<DWORD64>(Section->Mask[Out] ? 0 : Section->Data[Out]) + 1) * Power;
+			Masked -= Section->Mask[Out];
+			Repeats -= (Out > Start && Section->Data[Out] == Section->Data[Out - 1]) ? 1 : 0;
+		}
+
+		if (Index + 1 >= Start + RELOCATE_GRAM && Masked <= RELOCATE_GRAM / 2 && Repeats < RELOCATE_GRAM - 2)
+		{
+			Routine(Index + 1 - RELOCATE_GRAM, Hash);
+		}
+	}
+}
+
+/*
+Calls the given routine for every stretch in the table with the given hash.
+*/
+template <typename ROUTINE>
+void FindGrams(const DWORD64 Hash, ROUTINE Routine)
+{
+	for (SIZE_T Slot = Hash & (RELOCATE_TABLE_SIZE - 1); s_Grams[Slot].bIsUsed; Slot = (Slot + 1) & (RELOCATE_TABLE_SIZE - 1))
+	{
+		if (Hash == s_Grams[Slot].Hash)
+		{
+			Routine(&s_Grams[Slot]);
+		}
+	}
+}
+
+/*
+Adds every stretch of code around each old hook site to the table, then
+counts how often each one turns up anywhere in the old section.
+*/
+bool IndexOldSites(PRELOCATE_SECTION Old)
+{
+	DWORD Entries = 0;
+
+	for (DWORD Hook = 0; Hook < RELOCATE_HOOK_COUNT; Hook++)
+	{
+		PRELOCATE_HOOK This = &s_Hooks[Hook];
+
+		if (!This->bIsFound)
+		{
+			continue;
+		}
+
+		SIZE_T Start = (This->OldSite > RELOCATE_RADIUS) ? This->OldSite - RELOCATE_RADIUS : 0;
+		SIZE_T End = (This->OldSite + RELOCATE_RADIUS < Old->Size) ? This->OldSite + RELOCATE_RADIUS : Old->Size;
+
+		HashSection(Old, Start, End, [&](SIZE_T Position, DWORD64 Hash)
+		{
+			if (Entries >= RELOCATE_TABLE_SIZE / 2)
+			{
+				return;
+			}
+
+			SIZE_T Slot = Hash & (RELOCATE_TABLE_SIZE - 1);
+
+			while (s_Grams[Slot].bIsUsed)
+			{
+				Slot = (Slot + 1) & (RELOCATE_TABLE_SIZE - 1);
+			}
+
+			s_Grams[Slot] = { Hash, Hook, 0, Position, true };
+			Entries++;
+		});
+	}
+
+	if (0 == Entries)
+	{
+		return false;
+	}
+
+	HashSection(Old, 0, Old->Size, [](SIZE_T Position, DWORD64 Hash)
+	{
+		(void)Position;
+
+		FindGrams(Hash, [](PRELOCATE_GRAM_ENTRY Entry)
+		{
+			Entry->Count++;
+		});
+	});
+
+	return true;
+}
+
+/*
+Looks for every stretch of the old neighborhoods in the new section. Each one
+found votes for the new site it implies, by how close it was to the old site.
+*/
+void VoteNewSites(PRELOCATE_SECTION New)
+{
+	HashSection(New, 0, New->Size, [](SIZE_T Position, DWORD64 Hash)
+	{
+		FindGrams(Hash, [Position](PRELOCATE_GRAM_ENTRY Entry)
+		{
+			if (Entry->Count > RELOCATE_COMMON_MAXIMUM)
+			{
+				return;
+			}
+
+			PRELOCATE_HOOK This = &s_Hooks[Entry->Hook];
+
+			if (Position + This->OldSite < Entry->Position)
+			{
+				return;
+			}
+
+			SIZE_T Candidate = Position + This->OldSite - Entry->Position;
+			SIZE_T Middle = Entry->Position + RELOCATE_GRAM / 2;
+			SIZE_T Distance = (Middle > This->OldSite) ? Middle - This->OldSite : This->OldSite - Middle;
+
+			This->Votes[Candidate] += (Distance < RELOCATE_RADIUS) ? RELOCATE_RADIUS - Distance : 1;
+		});
+	});
+}
+
+/*
+Scores how closely the code around a new site matches the code around the old
+one, by the normalized bytes that are the same at the same distance from each
+site. Nearer bytes count for more.
+*/
+DWORD64 CompareSites(PRELOCATE_SECTION Old, const SIZE_T OldSite, PRELOCATE_SECTION New, const SIZE_T NewSite)
+{
+	DWORD64 Score = 0;
+
+	for (LONG64 Distance = -RELOCATE_NEAR; Distance < RELOCATE_NEAR; Distance++)
+	{
+		LONG64 OldIndex = static_cast<LONG64>(OldSite) + Distance;
+		LONG64 NewIndex = static_cast<LONG64>(NewSite) + Distance;
+
+		if (OldIndex < 0 || NewIndex < 0 || OldIndex >= static_cast<LONG64>(Old->Size) || NewIndex >= static_cast<LONG64>(New->Size))
+		{
+			continue;
+		}
+
+		BYTE OldByte = Old->Mask[OldIndex] ? 0 : Old->Data[OldIndex];
+		BYTE NewByte = New->Mask[NewIndex] ? 0 : New->Data[NewIndex];
+
+		if (OldByte == NewByte && Old->Mask[OldIndex] == New->Mask[NewIndex])
+		{
+			Score += RELOCATE_NEAR - ((Distance < 0) ? -Distance - 1 : Distance);
+		}
+	}
+
+	return Score;
+}
+
+/*
+Checks whether the given signature is found at the given position of the
+section, and nowhere else.
+*/
+bool IsPatternUnique(PRELOCATE_SECTION Section, PBYTE Pattern, const SIZE_T Position)
+{
+	ULONG_PTR Start = reinterpret_cast<ULONG_PTR>(&Section->Data[0]);
+	ULONG_PTR First = _PoeDbgMemoryFindPattern(Pattern, Start, Section->Size);
+
+	if (Start + Position != First)
+	{
+		return false;
+	}
+
+	return (NULL == _PoeDbgMemoryFindPattern(Pattern, First + 1, Section->Size - Position - 1));
+}
+
+/*
+Builds a signature of the given length starting at the given position, with
+masked bytes left as wildcards. The hooked bytes are always required.
+*/
+void BuildPattern(PRELOCATE_SECTION Section, const SIZE_T Position, const SIZE_T Length, const SIZE_T Site, const SIZE_T Size, PBYTE Pattern)
+{
+	PBYTE Cursor = Pattern;
+
+	for (SIZE_T Index = Position; Index < Position + Length; Index++)
+	{
+		if (Section->Mask[Index] && (Index < Site || Index >= Site + Size))
+		{
+			*Cursor++ = '?';
+		}
+		else
+		{
+			*Cursor++ = '_';
+			*Cursor++ = Section->Data[Index];
+		}
+	}
+
+	*Cursor = 0x00;
+}
+
+/*
+Prints the given bytes of a section as hex.
+*/
+void PrintBytes(PRELOCATE_SECTION Section, const SIZE_T Position, const SIZE_T Length)
+{
+	for (SIZE_T Index = Position; Index < Position + Length; Index++)
+	{
+		printf(" %02x", Section->Data[Index]);
+	}
+}
+
+/*
+Picks the best scoring new site for a hook, proposes a signature for it that
+is unique in the new section, and prints what should change in globals.h.
+*/
+void ProposeHook(PRELOCATE_SECTION Old, PRELOCATE_SECTION New, PRELOCATE_HOOK This)
+{
+	printf("%s hook\n", This->Name);
+
+	if (!This->bIsFound)
+	{
+		printf("  The signature wasn't found in the old section, so there is nothing to relocate from.\n\n");
+		return;
+	}
+
+	printf("  old site      0x%llx\n", static_cast<unsigned long long>(Old->Base + This->OldSite));
+
+	// Votes find the right stretch of code, but code added or removed near the
+	// site splits them between a few sites. The best voted are compared with
+	// the old site up close to pick between them.
+
+	std::vector<std::pair<DWORD64, SIZE_T>> Candidates;
+
+	for (auto& Vote : This->Votes)
+	{
+		if (Vote.first + This->Size <= New->Size)
+		{
+			Candidates.push_back(std::make_pair(Vote.second, Vote.first));
+		}
+	}
+
+	if (Candidates.empty())
+	{
+		printf("  No part of the code around the site was found in the new section.\n\n");
+		return;
+	}
+
+	SIZE_T Count = (Candidates.size() < RELOCATE_CANDIDATE_COUNT) ? Candidates.size() : RELOCATE_CANDIDATE_COUNT;
+
+	std::partial_sort(Candidates.begin(), Candidates.begin() + Count, Candidates.end(), std::greater<std::pair<DWORD64, SIZE_T>>());
+
+	SIZE_T Best = 0;
+	DWORD64 BestScore = 0;
+	DWORD64 NextScore = 0;
+
+	for (SIZE_T Index = 0; Index < Count; Index++)
+	{
+		DWORD64 Score = CompareSites(Old, This->OldSite, New, Candidates[Index].second);
+
+		if (0 == Index || Score > BestScore)
+		{
+			NextScore = BestScore;
+			BestScore = Score;
+			Best = Candidates[Index].second;
+		}
+		else if (Score > NextScore)
+		{
+			NextScore = Score;
+		}
+	}
+
+	// The most a site can score is every byte matching.
+	DWORD64 Perfect = static_cast<DWORD64>(RELOCATE_NEAR) * (RELOCATE_NEAR + 1);
+
+	printf("  new site      0x%llx, moved by %+lld, matching %.0f%% against %.0f%% for the next best\n",
+		static_cast<unsigned long long>(New->Base + Best), static_cast<long long>(Best) - static_cast<long long>(This->OldSite),
+		100.0 * static_cast<double>(BestScore) / static_cast<double>(Perfect), 100.0 * static_cast<double>(NextScore) / static_cast<double>(Perfect));
+
+	if (0 == memcmp(&Old->Data[This->OldSite], &New->Data[Best], This->Size))
+	{
+		printf("  hooked bytes ");
+		PrintBytes(New, Best, This->Size);
+		printf(", unchanged\n");
+	}
+	else
+	{
+		printf("  hooked bytes ");
+		PrintBytes(Old, This->OldSite, This->Size);
+		printf(" are now");
+		PrintBytes(New, Best, This->Size);
+		printf(". Check the size, and what the hook emulates in game.hpp.\n");
+	}
+
+	// Keep the signature's offset where the site allows it, and grow the
+	// signature until it is unique.
+
+	SIZE_T Offset = (Best >= This->Offset) ? This->Offset : Best;
+	SIZE_T Start = Best - Offset;
+	SIZE_T Length = _PoeDbgMemoryPatternLength(This->Pattern);
+
+	if (Length < Offset + This->Size)
+	{
+		Length = Offset + This->Size;
+	}
+
+	BYTE Pattern[RELOCATE_PATTERN_MAXIMUM * 2 + 1];
+
+	for (;; Length++)
+	{
+		if (Length > RELOCATE_PATTERN_MAXIMUM || Start + Length > New->Size)
+		{
+			printf("  No signature of up to %u bytes from the site is unique in the new section.\n\n", RELOCATE_PATTERN_MAXIMUM);
+			return;
+		}
+
+		BuildPattern(New, Start, Length, Best, This->Size, Pattern);
+
+		if (IsPatternUnique(New, Pattern, Start))
+		{
+			break;
+		}
+	}
+
+	printf("  _g_%sPattern\n   ", This->Globals);
+
+	for (PBYTE Cursor = Pattern; 0x00 != *Cursor; Cursor++)
+	{
+		if ('_' == *Cursor)
+		{
+			printf(" '_', 0x%02x,", Cursor[1]);
+			Cursor++;
+		}
+		else
+		{
+			printf(" '?',");
+		}
+	}
+
+	printf(" 0x00\n");
+	printf("  _g_%sHookOffset = %llu\n", This->Globals, static_cast<unsigned long long>(Offset));
+	printf("  _g_%sHookSize = %llu\n\n", This->Globals, static_cast<unsigned long long>(This->Size));
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		printf("Usage: %s <old section> <new section> [old base] [new base]\n", argv[0]);
+		return 1;
+	}
+
+	clock_t Started = clock();
+
+	RELOCATE_SECTION Old;
+	RELOCATE_SECTION New;
+
+	if (!LoadSection(argv[1], (argc > 3) ? argv[3] : NULL, &Old) || !LoadSection(argv[2], (argc > 4) ? argv[4] : NULL, &New))
+	{
+		return 1;
+	}
+
+	for (SIZE_T Index = 0; Index < sizeof(s_ModRmOpcodes); Index++)
+	{
+		s_bIsModRmOpcode[s_ModRmOpcodes[Index]] = true;
+	}
+
+	// Find the old sites with the signatures as they are.
+
+	for (DWORD Hook = 0; Hook < RELOCATE_HOOK_COUNT; Hook++)
+	{
+		PRELOCATE_HOOK This = &s_Hooks[Hook];
+
+		ULONG_PTR Start = reinterpret_cast<ULONG_PTR>(&Old.Data[0]);
+		ULONG_PTR Found = _PoeDbgMemoryFindPattern(This->Pattern, Start, Old.Size);
+
+		if (NULL != Found)
+		{
+			This->OldSite = Found - Start + This->Offset;
+			This->bIsFound = true;
+		}
+	}
+
+	NormalizeSection(&Old);
+	NormalizeSection(&New);
+
+	if (IndexOldSites(&Old))
+	{
+		VoteNewSites(&New);
+	}
+
+	for (DWORD Hook = 0; Hook < RELOCATE_HOOK_COUNT; Hook++)
+	{
+		ProposeHook(&Old, &New, &s_Hooks[Hook]);
+	}
+
+	printf("Matched %.1f MB against %.1f MB in %.2f s.\n", static_cast<double>(Old.Size) / 1048576.0, static_cast<double>(New.Size) / 1048576.0,
+		static_cast<double>(clock() - Started) / CLOCKS_PER_SEC);
+
+	return 0;
+}
@@ -0,0 +1,263 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+// A stand-in for the game, for running poedbg on Linux without it. It is built
+// as 'PathOfExile_x64.exe' so that the engine finds it by name, and it sends
+// packets to itself over a socket pair through three functions that contain the
+// same code the engine's signatures match in the game. Each packet is framed
+// as it is in the game, with a zero byte followed by the packet ID.
+//
+//	./PathOfExile_x64.exe [packets per second]
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+// The game's connection object. The receive hooks expect it in RBX, and the
+// WSARecv hook updates the received byte count at offset 0x198.
+struct Connection
+{
+	int Socket;
+	uint8_t Reserved[0x198 - sizeof(int)];
+	uint64_t ReceivedCount;
+	uint8_t Padding[0x60];
+};
+
+// The object passed to the send function. The function it ends up calling is
+// found through the table at offset 0x10, and is passed the object at that
+// offset, which holds the socket.
+struct Sender
+{
+	uint64_t Reserved[2];
+	void** Table;
+	int Socket;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Hook Sites
+//////////////////////////////////////////////////////////////////////////
+
+extern "C"
+{
+	void TargetSend(Sender* Object, const uint8_t* Buffer, uint64_t Length);
+	void TargetSendThunk();
+	int TargetRecv(Connection* Connection, uint8_t* Buffer, uint64_t Capacity);
+	int TargetWsaRecv(Connection* Connection, uint8_t* Buffer, uint64_t Capacity);
+
+	void TargetSendImpl(void** Inner, const uint8_t* Buffer, uint64_t Length);
+	int TargetRecvData(Connection* Connection, uint8_t* Buffer, uint64_t Capacity);
+}
+
+// The bytes at each hook site are written out, since the assembler is free to
+// pick other encodings of the same instructions.
+
+__asm__(R"(
+	.intel_syntax noprefix
+	.text
+
+	# rdi = object, rsi = buffer, rdx = length. The packet encryption function
+	# takes them as rcx, rdx and r8.
+	.globl TargetSend
+	.type TargetSend, @function
+TargetSend:
+	mov rcx, rdi
+	mov r8, rdx
+	mov rdx, rsi
+	.byte 0x48, 0x8b, 0x41, 0x10            # mov rax, [rcx+10h]
+	.byte 0x48, 0x83, 0xc1, 0x10            # add rcx, 10h <- hook
+	.byte 0x4d, 0x8b, 0xc8                  # mov r9, r8
+	.byte 0x4c, 0x8b, 0xc2                  # mov r8, rdx
+	.byte 0x48, 0xff, 0x60, 0x38            # jmp [rax+38h]
+
+	# Called through the table with rcx = object + 10h, r8 = buffer and
+	# r9 = length.
+	.globl TargetSendThunk
+	.type TargetSendThunk, @function
+TargetSendThunk:
+	mov rdi, rcx
+	mov rsi, r8
+	mov rdx, r9
+	jmp TargetSendImpl
+
+	# rdi = connection, rsi = buffer, rdx = capacity. The hook reads the
+	# buffer from r9 and the length from rax.
+	.globl TargetRecv
+	.type TargetRecv, @function
+TargetRecv:
+	push rbx
+	push r12
+	sub rsp, 8
+	mov rbx, rdi
+	mov r12, rsi
+	call TargetRecvData
+	mov r9, r12
+	.byte 0x8b, 0xf8                        # mov edi, eax <- hook
+	.byte 0xeb, 0x78                        # jmp +78h
+	.byte 0x4a, 0x8d, 0x04, 0x32            # lea rax, [rdx+r14]
+	.fill 0x74, 1, 0xcc
+	mov eax, edi
+	add rsp, 8
+	pop r12
+	pop rbx
+	ret
+
+	# The same, except the hook reads the buffer from the stack at rsp+48h and
+	# the length from rdi.
+	.globl TargetWsaRecv
+	.type TargetWsaRecv, @function
+TargetWsaRecv:
+	push rbx
+	push rdi
+	push r12
+	sub rsp, 0x50
+	mov rbx, rdi
+	mov [rsp+0x48], rsi
+	mov [rsp+0x40], rdx
+	call TargetRecvData
+	mov edi, eax
+	.byte 0x48, 0x63, 0xc7                  # movsxd rax, edi <- hook
+	.byte 0x48, 0x01, 0x83, 0x98, 0x01, 0x00, 0x00  # add [rbx+198h], rax
+	mov eax, edi
+	add rsp, 0x50
+	pop r12
+	pop rdi
+	pop rbx
+	ret
+
+	.att_syntax prefix
+)");
+
+//////////////////////////////////////////////////////////////////////////
+// Game Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Writes a whole packet to the socket.
+*/
+extern "C" void TargetSendImpl(void** Inner, const uint8_t* Buffer, uint64_t Length)
+{
+	int Socket = reinterpret_cast<Sender*>(reinterpret_cast<uint8_t*>(Inner) - 0x10)->Socket;
+
+	while (Length > 0)
+	{
+		ssize_t Written = send(Socket, Buffer, Length, MSG_NOSIGNAL);
+
+		if (Written <= 0)
+		{
+			return;
+		}
+
+		Buffer += Written;
+		Length -= static_cast<uint64_t>(Written);
+	}
+}
+
+/*
+Reads whatever has arrived on the connection.
+*/
+extern "C" int TargetRecvData(Connection* Connection, uint8_t* Buffer, uint64_t Capacity)
+{
+	return static_cast<int>(recv(Connection->Socket, Buffer, Capacity, 0));
+}
+
+/*
+Echoes everything it receives back, as the server.
+*/
+void* EchoServer(void* Parameter)
+{
+	int Socket = static_cast<int>(reinterpret_cast<intptr_t>(Parameter));
+	uint8_t Buffer[0x10000];
+
+	for (;;)
+	{
+		ssize_t Length = recv(Socket, Buffer, sizeof(Buffer), 0);
+
+		if (Length <= 0)
+		{
+			return NULL;
+		}
+
+		send(Socket, Buffer, static_cast<size_t>(Length), MSG_NOSIGNAL);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	// Let any process trace us, since the capture host isn't our parent.
+	prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
+
+	long Rate = (argc > 1) ? atol(argv[1]) : 1000;
+
+	int Sockets[2];
+
+	if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, Sockets))
+	{
+		perror("socketpair");
+		return 1;
+	}
+
+	pthread_t Server;
+	pthread_create(&Server, NULL, EchoServer, reinterpret_cast<void*>(static_cast<intptr_t>(Sockets[1])));
+
+	void* Table[8] = { NULL };
+	Table[7] = reinterpret_cast<void*>(TargetSendThunk);
+
+	Sender Object = { { 0 }, Table, Sockets[0] };
+
+	static Connection Client;
+	Client.Socket = Sockets[0];
+
+	uint8_t Packet[64];
+	uint8_t Buffer[0x10000];
+
+	uint64_t Sent = 0;
+	uint64_t Received = 0;
+
+	struct timespec Delay = { 0, (Rate > 0) ? 1000000000L / Rate : 0 };
+
+	printf("pid %d, %ld packets per second\n", getpid(), Rate);
+
+	for (uint64_t Sequence = 0;; Sequence++)
+	{
+		// A zero byte, then the ID, then the sequence number.
+
+		uint32_t Length = 2 + static_cast<uint32_t>(Sequence % 48);
+
+		memset(Packet, 0, sizeof(Packet));
+		Packet[1] = static_cast<uint8_t>(Sequence);
+		memcpy(Packet + 2, &Sequence, (Length - 2 < sizeof(Sequence)) ? Length - 2 : sizeof(Sequence));
+
+		TargetSend(&Object, Packet, Length);
+		Sent++;
+
+		// Alternate between the two receive functions, as the game does.
+
+		int Read = (0 == (Sequence & 1)) ? TargetRecv(&Client, Buffer, Length) : TargetWsaRecv(&Client, Buffer, Length);
+
+		if (Read > 0)
+		{
+			Received++;
+		}
+
+		if (0 == Sequence % 100000 && 0 != Sequence)
+		{
+			printf("sent %llu, received %llu\n", static_cast<unsigned long long>(Sent), static_cast<unsigned long long>(Received));
+			fflush(stdout);
+		}
+
+		if (Rate > 0)
+		{
+			nanosleep(&Delay, NULL);
+		}
+	}
+}
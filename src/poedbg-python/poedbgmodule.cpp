@@ -0,0 +1,796 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+// A native Python module for reading packets from poedbg in batches. Packets
+// are delivered as memoryviews over the batch they were read into, so nothing
+// is copied per packet and no Python code runs on the debug thread. The same
+// batches can be read back from a recorded capture, which is the capture
+// header followed by the raw bytes of every batch written one after another.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// Definitions
+//////////////////////////////////////////////////////////////////////////
+
+// Status codes used by the module. See the README for the full table.
+#define POEDBG_STATUS_SUCCESS 0
+#define POEDBG_STATUS_BUFFER_TOO_SMALL -24
+#define POEDBG_STATUS_QUEUE_ALREADY_ENABLED -26
+#define POEDBG_STATUS_QUEUE_NOT_ENABLED -27
+
+// Recorded captures start with the magic and the version of the record layout,
+// which changes whenever the record does.
+#define CAPTURE_MAGIC "POEDBGCP"
+#define CAPTURE_VERSION 1
+
+// Sizes.
+#define DEFAULT_QUEUE_SIZE 0x1000000
+#define DEFAULT_BATCH_SIZE 0x100000
+#define QUEUE_RECORD_ALIGNMENT 0x10
+
+// The header in front of every packet, both in the engine queue and in
+// recorded captures.
+typedef struct _POEDBG_PACKET_RECORD
+{
+	uint32_t Size;
+	uint32_t Length;
+	uint8_t Direction;
+	uint8_t Id;
+	uint16_t Flags;
+	uint32_t OriginalLength;
+	uint64_t Timestamp;
+	uint64_t Sequence;
+	uint32_t Source;
+	uint32_t Reserved;
+} POEDBG_PACKET_RECORD, *PPOEDBG_PACKET_RECORD;
+
+// The header at the start of every recorded capture.
+typedef struct _POEDBG_CAPTURE_HEADER
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t RecordSize;
+} POEDBG_CAPTURE_HEADER, *PPOEDBG_CAPTURE_HEADER;
+
+// Where each packet is within a batch. This is also the layout of the array
+// returned by Batch.headers().
+typedef struct _POEDBG_PACKET_INDEX
+{
+	uint32_t Offset;
+	uint32_t Length;
+	uint8_t Direction;
+	uint8_t Id;
+	uint16_t Flags;
+	uint64_t Timestamp;
+	uint64_t Sequence;
+	uint32_t Source;
+	uint32_t Reserved;
+} POEDBG_PACKET_INDEX, *PPOEDBG_PACKET_INDEX;
+
+//////////////////////////////////////////////////////////////////////////
+// Batch
+//////////////////////////////////////////////////////////////////////////
+
+// A batch of whole packet records, which owns the memory they were read into.
+typedef struct _POEDBG_BATCH_OBJECT
+{
+	PyObject_HEAD
+	char* Buffer;
+	Py_ssize_t Length;
+	PPOEDBG_PACKET_INDEX Index;
+	Py_ssize_t Count;
+} POEDBG_BATCH_OBJECT, *PPOEDBG_BATCH_OBJECT;
+
+static PyTypeObject _g_BatchType;
+
+/*
+Takes ownership of the given records and creates a batch over them. The
+records must already have been validated. Frees the buffer on failure.
+*/
+static PyObject* _PoeDbgBatchCreate(char* Buffer, Py_ssize_t Length)
+{
+	PPOEDBG_BATCH_OBJECT Batch = PyObject_New(POEDBG_BATCH_OBJECT, &_g_BatchType);
+
+	if (NULL == Batch)
+	{
+		PyMem_Free(Buffer);
+		return NULL;
+	}
+
+	Batch->Buffer = Buffer;
+	Batch->Length = Length;
+	Batch->Index = NULL;
+	Batch->Count = 0;
+
+	// Index the records once so packets can be reached in constant time.
+
+	Py_ssize_t Count = 0;
+
+	for (Py_ssize_t Offset = 0; Offset < Length; Offset += reinterpret_cast<PPOEDBG_PACKET_RECORD>(Buffer + Offset)->Size)
+	{
+		Count++;
+	}
+
+	if (Count > 0)
+	{
+		Batch->Index = reinterpret_cast<PPOEDBG_PACKET_INDEX>(PyMem_Malloc(Count * sizeof(POEDBG_PACKET_INDEX)));
+
+		if (NULL == Batch->Index)
+		{
+			Py_DECREF(Batch);
+			return PyErr_NoMemory();
+		}
+	}
+
+	for (Py_ssize_t Offset = 0; Offset < Length;)
+	{
+		PPOEDBG_PACKET_RECORD Record = reinterpret_cast<PPOEDBG_PACKET_RECORD>(Buffer + Offset);
+		PPOEDBG_PACKET_INDEX Entry = &Batch->Index[Batch->Count++];
+
+		Entry->Offset = static_cast<uint32_t>(Offset + sizeof(POEDBG_PACKET_RECORD));
+		Entry->Length = Record->Length;
+		Entry->Direction = Record->Direction;
+		Entry->Id = Record->Id;
+		Entry->Flags = Record->Flags;
+		Entry->Timestamp = Record->Timestamp;
+		Entry->Sequence = Record->Sequence;
+		Entry->Source = Record->Source;
+		Entry->Reserved = 0;
+
+		Offset += Record->Size;
+	}
+
+	return reinterpret_cast<PyObject*>(Batch);
+}
+
+/*
+Returns the number of bytes at the start of the data that make up whole,
+valid records. If the data starts with a record that isn't complete, Required
+is set to its size.
+*/
+static Py_ssize_t _PoeDbgBatchMeasure(const char* Data, Py_ssize_t Length, Py_ssize_t* Required, bool* bIsCorrupt)
+{
+	Py_ssize_t Offset = 0;
+
+	*Required = 0;
+	*bIsCorrupt = false;
+
+	while (Length - Offset >= static_cast<Py_ssize_t>(sizeof(POEDBG_PACKET_RECORD)))
+	{
+		const POEDBG_PACKET_RECORD* Record = reinterpret_cast<const POEDBG_PACKET_RECORD*>(Data + Offset);
+
+		if (Record->Size < sizeof(POEDBG_PACKET_RECORD) || 0 != (Record->Size % QUEUE_RECORD_ALIGNMENT) || Record->Length > Record->Size - sizeof(POEDBG_PACKET_RECORD))
+		{
+			*bIsCorrupt = true;
+			break;
+		}
+
+		if (Record->Size > Length - Offset)
+		{
+			if (0 == Offset)
+			{
+				*Required = Record->Size;
+			}
+
+			break;
+		}
+
+		Offset += Record->Size;
+	}
+
+	if (0 == Offset && 0 == *Required && !*bIsCorrupt && Length > 0)
+	{
+		*Required = sizeof(POEDBG_PACKET_RECORD);
+	}
+
+	return Offset;
+}
+
+static void _PoeDbgBatchDealloc(PyObject* Self)
+{
+	PPOEDBG_BATCH_OBJECT Batch = reinterpret_cast<PPOEDBG_BATCH_OBJECT>(Self);
+
+	PyMem_Free(Batch->Index);
+	PyMem_Free(Batch->Buffer);
+
+	PyObject_Free(Self);
+}
+
+static Py_ssize_t _PoeDbgBatchLength(PyObject* Self)
+{
+	return reinterpret_cast<PPOEDBG_BATCH_OBJECT>(Self)->Count;
+}
+
+/*
+Returns the packet at the given index as (direction, id, memoryview, timestamp,
+sequence, source). The view keeps the batch alive for as long as it is held.
+*/
+static PyObject* _PoeDbgBatchItem(PyObject* Self, Py_ssize_t Position)
+{
+	PPOEDBG_BATCH_OBJECT Batch = reinterpret_cast<PPOEDBG_BATCH_OBJECT>(Self);
+
+	if (Position < 0 || Position >= Batch->Count)
+	{
+		PyErr_SetString(PyExc_IndexError, "packet index out of range");
+		return NULL;
+	}
+
+	PPOEDBG_PACKET_INDEX Entry = &Batch->Index[Position];
+
+	PyObject* View = PyMemoryView_FromObject(Self);
+
+	if (NULL == View)
+	{
+		return NULL;
+	}
+
+	PyObject* Payload = PySequence_GetSlice(View, Entry->Offset, static_cast<Py_ssize_t>(Entry->Offset) + Entry->Length);
+	Py_DECREF(View);
+
+	if (NULL == Payload)
+	{
+		return NULL;
+	}
+
+	return Py_BuildValue("(iiNKKi)", Entry->Direction, Entry->Id, Payload, static_cast<unsigned long long>(Entry->Timestamp), static_cast<unsigned long long>(Entry->Sequence), static_cast<int>(Entry->Source));
+}
+
+/*
+Exposes the raw records, so that a batch can be written straight to a capture
+file or wrapped by NumPy.
+*/
+static int _PoeDbgBatchGetBuffer(PyObject* Self, Py_buffer* View, int Flags)
+{
+	PPOEDBG_BATCH_OBJECT Batch = reinterpret_cast<PPOEDBG_BATCH_OBJECT>(Self);
+
+	return PyBuffer_FillInfo(View, Self, Batch->Buffer, Batch->Length, 1, Flags);
+}
+
+/*
+Returns the packet headers as a NumPy structured array with the fields offset,
+length, direction, id, flags, timestamp, sequence and source. Offsets are into the raw records,
+so payloads can be sliced out of numpy.frombuffer(batch, numpy.uint8) without
+copying.
+*/
+static PyObject* _PoeDbgBatchHeaders(PyObject* Self, PyObject* Unused)
+{
+	PPOEDBG_BATCH_OBJECT Batch = reinterpret_cast<PPOEDBG_BATCH_OBJECT>(Self);
+
+	PyObject* NumPy = PyImport_ImportModule("numpy");
+
+	if (NULL == NumPy)
+	{
+		return NULL;
+	}
+
+	PyObject* Result = NULL;
+	PyObject* Headers = PyBytes_FromStringAndSize(reinterpret_cast<const char*>(Batch->Index), Batch->Count * sizeof(POEDBG_PACKET_INDEX));
+	PyObject* Type = Py_BuildValue("{s[ssssssss]s[ssssssss]s[nnnnnnnn]sn}",
+		"names", "offset", "length", "direction", "id", "flags", "timestamp", "sequence", "source",
+		"formats", "<u4", "<u4", "u1", "u1", "<u2", "<u8", "<u8", "<u4",
+		"offsets", offsetof(POEDBG_PACKET_INDEX, Offset), offsetof(POEDBG_PACKET_INDEX, Length), offsetof(POEDBG_PACKET_INDEX, Direction), offsetof(POEDBG_PACKET_INDEX, Id), offsetof(POEDBG_PACKET_INDEX, Flags), offsetof(POEDBG_PACKET_INDEX, Timestamp), offsetof(POEDBG_PACKET_INDEX, Sequence), offsetof(POEDBG_PACKET_INDEX, Source),
+		"itemsize", sizeof(POEDBG_PACKET_INDEX));
+
+	if (NULL != Headers && NULL != Type)
+	{
+		Result = PyObject_CallMethod(NumPy, "frombuffer", "OO", Headers, Type);
+	}
+
+	Py_XDECREF(Type);
+	Py_XDECREF(Headers);
+	Py_DECREF(NumPy);
+
+	return Result;
+}
+
+static PyMethodDef _g_BatchMethods[] =
+{
+	{ "headers", _PoeDbgBatchHeaders, METH_NOARGS, "Returns the packet headers as a NumPy structured array." },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PySequenceMethods _g_BatchSequence = {};
+static PyBufferProcs _g_BatchBuffer = {};
+
+//////////////////////////////////////////////////////////////////////////
+// Capture
+//////////////////////////////////////////////////////////////////////////
+
+// A recorded capture being read back in batches.
+typedef struct _POEDBG_CAPTURE_OBJECT
+{
+	PyObject_HEAD
+	FILE* File;
+} POEDBG_CAPTURE_OBJECT, *PPOEDBG_CAPTURE_OBJECT;
+
+static PyTypeObject _g_CaptureType;
+
+/*
+Fills in the header for a capture recorded by this version of the module.
+*/
+static void _PoeDbgCaptureBuildHeader(PPOEDBG_CAPTURE_HEADER Header)
+{
+	memcpy(Header->Magic, CAPTURE_MAGIC, sizeof(Header->Magic));
+	Header->Version = CAPTURE_VERSION;
+	Header->RecordSize = sizeof(POEDBG_PACKET_RECORD);
+}
+
+/*
+Opens a recorded capture, and checks its header so that a file recorded with
+another record layout is rejected rather than misread.
+*/
+static int _PoeDbgCaptureInit(PyObject* Self, PyObject* Args, PyObject* Keywords)
+{
+	PPOEDBG_CAPTURE_OBJECT Capture = reinterpret_cast<PPOEDBG_CAPTURE_OBJECT>(Self);
+	static const char* KeywordList[] = { "path", NULL };
+	PyObject* Path = NULL;
+
+	if (!PyArg_ParseTupleAndKeywords(Args, Keywords, "O&", const_cast<char**>(KeywordList), PyUnicode_FSConverter, &Path))
+	{
+		return -1;
+	}
+
+	if (NULL != Capture->File)
+	{
+		fclose(Capture->File);
+	}
+
+	Capture->File = fopen(PyBytes_AS_STRING(Path), "rb");
+
+	if (NULL == Capture->File)
+	{
+		PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, Path);
+		Py_DECREF(Path);
+		return -1;
+	}
+
+	Py_DECREF(Path);
+
+	POEDBG_CAPTURE_HEADER Expected;
+	POEDBG_CAPTURE_HEADER Header;
+
+	_PoeDbgCaptureBuildHeader(&Expected);
+
+	if (1 != fread(&Header, sizeof(Header), 1, Capture->File) || 0 != memcmp(Header.Magic, Expected.Magic, sizeof(Header.Magic)))
+	{
+		PyErr_SetString(PyExc_ValueError, "not a poedbg capture, or one recorded before captures had a header");
+	}
+	else if (Header.Version != Expected.Version || Header.RecordSize != Expected.RecordSize)
+	{
+		PyErr_Format(PyExc_ValueError, "capture version %u is not supported, only version %u is", Header.Version, Expected.Version);
+	}
+	else
+	{
+		return 0;
+	}
+
+	fclose(Capture->File);
+	Capture->File = NULL;
+
+	return -1;
+}
+
+static void _PoeDbgCaptureDealloc(PyObject* Self)
+{
+	PPOEDBG_CAPTURE_OBJECT Capture = reinterpret_cast<PPOEDBG_CAPTURE_OBJECT>(Self);
+
+	if (NULL != Capture->File)
+	{
+		fclose(Capture->File);
+	}
+
+	Py_TYPE(Self)->tp_free(Self);
+}
+
+/*
+Reads up to the given number of bytes of whole records from the capture. A
+record larger than that is still returned on its own. Returns None at the end
+of the capture.
+*/
+static PyObject* _PoeDbgCaptureRead(PyObject* Self, PyObject* Args, PyObject* Keywords)
+{
+	PPOEDBG_CAPTURE_OBJECT Capture = reinterpret_cast<PPOEDBG_CAPTURE_OBJECT>(Self);
+	static const char* KeywordList[] = { "size", NULL };
+	Py_ssize_t Size = DEFAULT_BATCH_SIZE;
+
+	if (!PyArg_ParseTupleAndKeywords(Args, Keywords, "|n", const_cast<char**>(KeywordList), &Size))
+	{
+		return NULL;
+	}
+
+	if (NULL == Capture->File)
+	{
+		PyErr_SetString(PyExc_ValueError, "capture is closed");
+		return NULL;
+	}
+
+	if (Size < static_cast<Py_ssize_t>(sizeof(POEDBG_PACKET_RECORD)))
+	{
+		Size = sizeof(POEDBG_PACKET_RECORD);
+	}
+
+	char* Buffer = reinterpret_cast<char*>(PyMem_Malloc(Size));
+
+	if (NULL == Buffer)
+	{
+		return PyErr_NoMemory();
+	}
+
+	Py_ssize_t Length = 0;
+	Py_ssize_t Whole = 0;
+	Py_ssize_t Required = 0;
+	bool bIsCorrupt = false;
+
+	for (;;)
+	{
+		size_t Read = 0;
+
+		Py_BEGIN_ALLOW_THREADS
+		Read = fread(Buffer + Length, 1, Size - Length, Capture->File);
+		Py_END_ALLOW_THREADS
+
+		Length += Read;
+		Whole = _PoeDbgBatchMeasure(Buffer, Length, &Required, &bIsCorrupt);
+
+		if (0 != Whole || bIsCorrupt || 0 == Read)
+		{
+			break;
+		}
+
+		if (Required <= Size)
+		{
+			continue;
+		}
+
+		// The first record is larger than the batch, so make room for it.
+
+		char* Larger = reinterpret_cast<char*>(PyMem_Realloc(Buffer, Required));
+
+		if (NULL == Larger)
+		{
+			PyMem_Free(Buffer);
+			return PyErr_NoMemory();
+		}
+
+		Buffer = Larger;
+		Size = Required;
+	}
+
+	if (0 == Whole)
+	{
+		PyMem_Free(Buffer);
+
+		if (bIsCorrupt || 0 != Length)
+		{
+			PyErr_SetString(PyExc_ValueError, bIsCorrupt ? "capture contains an invalid record" : "capture ends with a partial record");
+			return NULL;
+		}
+
+		Py_RETURN_NONE;
+	}
+
+	// Step back over any partial record so the next read starts with it.
+
+	if (Whole < Length && 0 != fseek(Capture->File, -static_cast<long>(Length - Whole), SEEK_CUR))
+	{
+		PyMem_Free(Buffer);
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+
+	return _PoeDbgBatchCreate(Buffer, Whole);
+}
+
+static PyObject* _PoeDbgCaptureClose(PyObject* Self, PyObject* Unused)
+{
+	PPOEDBG_CAPTURE_OBJECT Capture = reinterpret_cast<PPOEDBG_CAPTURE_OBJECT>(Self);
+
+	if (NULL != Capture->File)
+	{
+		fclose(Capture->File);
+		Capture->File = NULL;
+	}
+
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef _g_CaptureMethods[] =
+{
+	{ "read", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(_PoeDbgCaptureRead)), METH_VARARGS | METH_KEYWORDS, "Reads the next batch of packets, or None at the end of the capture." },
+	{ "close", _PoeDbgCaptureClose, METH_NOARGS, "Closes the capture." },
+	{ NULL, NULL, 0, NULL }
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Session
+//////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+
+typedef int(__stdcall *POEDBG_ENABLE_PACKET_QUEUE_ROUTINE)(DWORD Size);
+typedef int(__stdcall *POEDBG_DISABLE_PACKET_QUEUE_ROUTINE)();
+typedef int(__stdcall *POEDBG_READ_PACKETS_ROUTINE)(PBYTE Buffer, DWORD BufferSize, PDWORD BytesRead, DWORD Timeout);
+
+// A live connection to the packet queue of a loaded poedbg module.
+typedef struct _POEDBG_SESSION_OBJECT
+{
+	PyObject_HEAD
+	HMODULE Module;
+	POEDBG_ENABLE_PACKET_QUEUE_ROUTINE EnablePacketQueue;
+	POEDBG_DISABLE_PACKET_QUEUE_ROUTINE DisablePacketQueue;
+	POEDBG_READ_PACKETS_ROUTINE ReadPackets;
+} POEDBG_SESSION_OBJECT, *PPOEDBG_SESSION_OBJECT;
+
+static PyTypeObject _g_SessionType;
+
+/*
+Loads poedbg and enables its packet queue. The module must still be
+initialized with PoeDbgInitialize to start capturing.
+*/
+static int _PoeDbgSessionInit(PyObject* Self, PyObject* Args, PyObject* Keywords)
+{
+	PPOEDBG_SESSION_OBJECT Session = reinterpret_cast<PPOEDBG_SESSION_OBJECT>(Self);
+	static const char* KeywordList[] = { "path", "queue_size", NULL };
+	wchar_t* Path = NULL;
+	PyObject* PathObject = NULL;
+	unsigned long QueueSize = DEFAULT_QUEUE_SIZE;
+
+	if (!PyArg_ParseTupleAndKeywords(Args, Keywords, "|Uk", const_cast<char**>(KeywordList), &PathObject, &QueueSize))
+	{
+		return -1;
+	}
+
+	if (NULL != PathObject)
+	{
+		Path = PyUnicode_AsWideCharString(PathObject, NULL);
+
+		if (NULL == Path)
+		{
+			return -1;
+		}
+	}
+
+	Session->Module = LoadLibraryW(NULL != Path ? Path : L"poedbg.dll");
+	PyMem_Free(Path);
+
+	if (NULL == Session->Module)
+	{
+		PyErr_SetFromWindowsErr(0);
+		return -1;
+	}
+
+	Session->EnablePacketQueue = reinterpret_cast<POEDBG_ENABLE_PACKET_QUEUE_ROUTINE>(GetProcAddress(Session->Module, "PoeDbgEnablePacketQueue"));
+	Session->DisablePacketQueue = reinterpret_cast<POEDBG_DISABLE_PACKET_QUEUE_ROUTINE>(GetProcAddress(Session->Module, "PoeDbgDisablePacketQueue"));
+	Session->ReadPackets = reinterpret_cast<POEDBG_READ_PACKETS_ROUTINE>(GetProcAddress(Session->Module, "PoeDbgReadPackets"));
+
+	if (NULL == Session->EnablePacketQueue || NULL == Session->DisablePacketQueue || NULL == Session->ReadPackets)
+	{
+		PyErr_SetString(PyExc_OSError, "poedbg does not export the packet queue API");
+		return -1;
+	}
+
+	int Status = Session->EnablePacketQueue(QueueSize);
+
+	if (Status < 0 && POEDBG_STATUS_QUEUE_ALREADY_ENABLED != Status)
+	{
+		PyErr_Format(PyExc_OSError, "could not enable the packet queue (status %d)", Status);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void _PoeDbgSessionDealloc(PyObject* Self)
+{
+	PPOEDBG_SESSION_OBJECT Session = reinterpret_cast<PPOEDBG_SESSION_OBJECT>(Self);
+
+	if (NULL != Session->Module)
+	{
+		FreeLibrary(Session->Module);
+	}
+
+	Py_TYPE(Self)->tp_free(Self);
+}
+
+/*
+Reads up to the given number of bytes of whole records from the queue, waiting
+up to the timeout in milliseconds if it is empty. The GIL is released while
+waiting. Returns an empty batch on timeout, and None once the queue has been
+disabled and read to the end.
+*/
+static PyObject* _PoeDbgSessionRead(PyObject* Self, PyObject* Args, PyObject* Keywords)
+{
+	PPOEDBG_SESSION_OBJECT Session = reinterpret_cast<PPOEDBG_SESSION_OBJECT>(Self);
+	static const char* KeywordList[] = { "size", "timeout", NULL };
+	unsigned long Size = DEFAULT_BATCH_SIZE;
+	unsigned long Timeout = INFINITE;
+
+	if (!PyArg_ParseTupleAndKeywords(Args, Keywords, "|kk", const_cast<char**>(KeywordList), &Size, &Timeout))
+	{
+		return NULL;
+	}
+
+	if (NULL == Session->ReadPackets)
+	{
+		PyErr_SetString(PyExc_ValueError, "session is not open");
+		return NULL;
+	}
+
+	if (Size < sizeof(POEDBG_PACKET_RECORD))
+	{
+		Size = sizeof(POEDBG_PACKET_RECORD);
+	}
+
+	char* Buffer = NULL;
+	DWORD BytesRead = 0;
+	int Status = POEDBG_STATUS_SUCCESS;
+
+	for (;;)
+	{
+		char* Larger = reinterpret_cast<char*>(PyMem_Realloc(Buffer, Size));
+
+		if (NULL == Larger)
+		{
+			PyMem_Free(Buffer);
+			return PyErr_NoMemory();
+		}
+
+		Buffer = Larger;
+
+		Py_BEGIN_ALLOW_THREADS
+		Status = Session->ReadPackets(reinterpret_cast<PBYTE>(Buffer), Size, &BytesRead, Timeout);
+		Py_END_ALLOW_THREADS
+
+		if (POEDBG_STATUS_BUFFER_TOO_SMALL != Status)
+		{
+			break;
+		}
+
+		// The next record is larger than the batch, so make room for it.
+		Size = BytesRead;
+	}
+
+	if (POEDBG_STATUS_QUEUE_NOT_ENABLED == Status)
+	{
+		PyMem_Free(Buffer);
+		Py_RETURN_NONE;
+	}
+
+	if (Status < 0)
+	{
+		PyMem_Free(Buffer);
+		return PyErr_Format(PyExc_OSError, "could not read packets (status %d)", Status);
+	}
+
+	return _PoeDbgBatchCreate(Buffer, BytesRead);
+}
+
+/*
+Disables the packet queue. Packets already queued can still be read.
+*/
+static PyObject* _PoeDbgSessionClose(PyObject* Self, PyObject* Unused)
+{
+	PPOEDBG_SESSION_OBJECT Session = reinterpret_cast<PPOEDBG_SESSION_OBJECT>(Self);
+
+	if (NULL != Session->DisablePacketQueue)
+	{
+		Session->DisablePacketQueue();
+	}
+
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef _g_SessionMethods[] =
+{
+	{ "read", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(_PoeDbgSessionRead)), METH_VARARGS | METH_KEYWORDS, "Reads the next batch of packets, or None once the queue is disabled and empty." },
+	{ "close", _PoeDbgSessionClose, METH_NOARGS, "Disables the packet queue." },
+	{ NULL, NULL, 0, NULL }
+};
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// Module
+//////////////////////////////////////////////////////////////////////////
+
+static PyModuleDef _g_Module =
+{
+	PyModuleDef_HEAD_INIT,
+	"poedbg",
+	"Batched access to packets captured by poedbg, live or from a recorded capture.",
+	-1,
+	NULL
+};
+
+/*
+Fills in a type object. Done at runtime, since C++ doesn't allow designated
+initializers for the many fields of PyTypeObject.
+*/
+static int _PoeDbgModuleAddType(PyObject* Module, PyTypeObject* Type, const char* Name, const char* FullName, Py_ssize_t Size, destructor Dealloc, PyMethodDef* Methods)
+{
+	Type->tp_name = FullName;
+	Type->tp_basicsize = Size;
+	Type->tp_flags = Py_TPFLAGS_DEFAULT;
+	Type->tp_dealloc = Dealloc;
+	Type->tp_methods = Methods;
+
+	if (PyType_Ready(Type) < 0)
+	{
+		return -1;
+	}
+
+	Py_INCREF(Type);
+
+	if (PyModule_AddObject(Module, Name, reinterpret_cast<PyObject*>(Type)) < 0)
+	{
+		Py_DECREF(Type);
+		return -1;
+	}
+
+	return 0;
+}
+
+PyMODINIT_FUNC PyInit_poedbg()
+{
+	PyObject* Module = PyModule_Create(&_g_Module);
+
+	if (NULL == Module)
+	{
+		return NULL;
+	}
+
+	_g_BatchSequence.sq_length = _PoeDbgBatchLength;
+	_g_BatchSequence.sq_item = _PoeDbgBatchItem;
+	_g_BatchBuffer.bf_getbuffer = _PoeDbgBatchGetBuffer;
+
+	_g_BatchType.tp_as_sequence = &_g_BatchSequence;
+	_g_BatchType.tp_as_buffer = &_g_BatchBuffer;
+	_g_BatchType.tp_doc = "A batch of packets. Indexing yields (direction, id, memoryview, timestamp, sequence, source) tuples.";
+
+	_g_CaptureType.tp_init = _PoeDbgCaptureInit;
+	_g_CaptureType.tp_new = PyType_GenericNew;
+	_g_CaptureType.tp_doc = "Capture(path) reads a recorded capture, which starts with CAPTURE_HEADER, in batches.";
+
+	if (_PoeDbgModuleAddType(Module, &_g_BatchType, "Batch", "poedbg.Batch", sizeof(POEDBG_BATCH_OBJECT), _PoeDbgBatchDealloc, _g_BatchMethods) < 0 ||
+		_PoeDbgModuleAddType(Module, &_g_CaptureType, "Capture", "poedbg.Capture", sizeof(POEDBG_CAPTURE_OBJECT), _PoeDbgCaptureDealloc, _g_CaptureMethods) < 0)
+	{
+		Py_DECREF(Module);
+		return NULL;
+	}
+
+#ifdef _WIN32
+	_g_SessionType.tp_init = _PoeDbgSessionInit;
+	_g_SessionType.tp_new = PyType_GenericNew;
+	_g_SessionType.tp_doc = "Session(path='poedbg.dll', queue_size=16 MiB) reads live packets in batches.";
+
+	if (_PoeDbgModuleAddType(Module, &_g_SessionType, "Session", "poedbg.Session", sizeof(POEDBG_SESSION_OBJECT), _PoeDbgSessionDealloc, _g_SessionMethods) < 0)
+	{
+		Py_DECREF(Module);
+		return NULL;
+	}
+#endif
+
+	PyModule_AddIntConstant(Module, "DIRECTION_SEND", 0);
+	PyModule_AddIntConstant(Module, "DIRECTION_RECEIVE", 1);
+
+	// Written at the start of a capture file, before any batch.
+	POEDBG_CAPTURE_HEADER Header;
+	_PoeDbgCaptureBuildHeader(&Header);
+
+	if (PyModule_AddObject(Module, "CAPTURE_HEADER", PyBytes_FromStringAndSize(reinterpret_cast<const char*>(&Header), sizeof(Header))) < 0)
+	{
+		Py_DECREF(Module);
+		return NULL;
+	}
+
+	return Module;
+}
@@ -0,0 +1,13 @@
+# Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+# Builds the native 'poedbg' Python module with "python setup.py build_ext --inplace".
+# Live sessions are only available on Windows; recorded captures can be read anywhere.
+
+from setuptools import setup, Extension
+
+setup(
+    name="poedbg",
+    version="1.0",
+    description="Batched access to packets captured by poedbg.",
+    ext_modules=[Extension("poedbg", ["poedbgmodule.cpp"])],
+)
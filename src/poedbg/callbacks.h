@@ -20,11 +20,11 @@ the callback with the given name and type.
 #define POEDBG_CREATE_CALLBACK_EXPORTS(name, type) \
 	POEDBG_EXPORT PoeDbgRegister##name##Callback(PVOID Callback) \
 	{ \
-		if (NULL != _g_Callback##name##) \
+		if (NULL != _g_Callback##name) \
 		{ \
 			return POEDBG_STATUS_CALLBACK_ALREADY_REGISTERED; \
 		} \
-		_g_Callback##name = reinterpret_cast<##type##>(Callback); \
+		_g_Callback##name = reinterpret_cast<type>(Callback); \
 		return POEDBG_STATUS_SUCCESS; \
 	} \
 	POEDBG_EXPORT PoeDbgUnregister##name##Callback() \
@@ -38,9 +38,9 @@ Calls the given callback, forwarding the parameters. If no callback
 has been registered, this will do nothing.
 */
 #define POEDBG_NOTIFY_CALLBACK(name, ...) \
-	if (NULL != _g_Callback##name##) \
+	if (NULL != _g_Callback##name) \
 	{ \
-		_g_Callback##name##(__VA_ARGS__); \
+		_g_Callback##name(__VA_ARGS__); \
 	}
 
 //////////////////////////////////////////////////////////////////////////
@@ -49,6 +49,25 @@ has been registered, this will do nothing.
 
 typedef void(__stdcall *POEDBG_ERROR_CALLBACK)(int Status);
 typedef void(__stdcall *POEDBG_PACKET_CALLBACK)(unsigned int Length, BYTE Id, PBYTE Data);
+typedef void(__stdcall *POEDBG_PACKET_EX_CALLBACK)(unsigned int Length, BYTE Id, PBYTE Data, DWORD64 Timestamp);
+
+// Sees every packet in both directions, in the order they were dispatched,
+// with the original length, sequence number and source hook that the packet
+// queue records.
+typedef void(__stdcall *POEDBG_PACKET_EVENT_CALLBACK)(int Direction, unsigned int Length, unsigned int OriginalLength, BYTE Id, PBYTE Data, DWORD64 Timestamp, DWORD64 Sequence, int Source);
+
+// Sees what a capture point captured, on the thread that hit it. The sequence
+// number is shared with packets.
+typedef void(__stdcall *POEDBG_CAPTURE_POINT_CALLBACK)(DWORD Id, DWORD ThreadId, unsigned int Length, PBYTE Data, DWORD64 Timestamp, DWORD64 Sequence);
+
+// Pipeline callbacks. The key callback runs on the debug loop and picks the
+// shard for a packet. The worker callback runs on the packet's worker, and
+// what it returns is handed to the merge callback, along with the packet's
+// sequence number. The merge callback sees every packet in the order the
+// debug loop dispatched them.
+typedef DWORD(__stdcall *POEDBG_PIPELINE_KEY_CALLBACK)(int Direction, unsigned int Length, BYTE Id, PBYTE Data);
+typedef ULONG_PTR(__stdcall *POEDBG_PIPELINE_WORKER_CALLBACK)(DWORD Worker, int Direction, unsigned int Length, unsigned int OriginalLength, BYTE Id, PBYTE Data, DWORD64 Timestamp, DWORD64 Sequence, int Source);
+typedef void(__stdcall *POEDBG_PIPELINE_MERGE_CALLBACK)(DWORD64 Sequence, ULONG_PTR Result);
 
 //////////////////////////////////////////////////////////////////////////
 // Callback Function Pointers
@@ -56,4 +75,56 @@ typedef void(__stdcall *POEDBG_PACKET_CALLBACK)(unsigned int Length, BYTE Id, PB
 
 POEDBG_CREATE_CALLBACK_POINTER(Error, POEDBG_ERROR_CALLBACK)
 POEDBG_CREATE_CALLBACK_POINTER(PacketSend, POEDBG_PACKET_CALLBACK)
-POEDBG_CREATE_CALLBACK_POINTER(PacketReceive, POEDBG_PACKET_CALLBACK)
\ No newline at end of file
+POEDBG_CREATE_CALLBACK_POINTER(PacketReceive, POEDBG_PACKET_CALLBACK)
+POEDBG_CREATE_CALLBACK_POINTER(PacketSendEx, POEDBG_PACKET_EX_CALLBACK)
+POEDBG_CREATE_CALLBACK_POINTER(PacketReceiveEx, POEDBG_PACKET_EX_CALLBACK)
+POEDBG_CREATE_CALLBACK_POINTER(PacketEvent, POEDBG_PACKET_EVENT_CALLBACK)
+POEDBG_CREATE_CALLBACK_POINTER(CapturePoint, POEDBG_CAPTURE_POINT_CALLBACK)
+
+//////////////////////////////////////////////////////////////////////////
+// Subscriber Types
+//////////////////////////////////////////////////////////////////////////
+
+// A packet callback added with PoeDbgAddPacketSubscriber, or with
+// PoeDbgAddPacketSubscriberEx if it also takes the timestamp. Packet IDs
+// with a non-zero filter entry are not delivered to it.
+typedef struct _POEDBG_SUBSCRIBER
+{
+	DWORD Id;
+	bool bIsFiltered;
+	bool bIsExtended;
+	union
+	{
+		POEDBG_PACKET_CALLBACK Callback;
+		POEDBG_PACKET_EX_CALLBACK CallbackEx;
+	};
+	BYTE Filter[PACKET_ID_COUNT];
+} POEDBG_SUBSCRIBER, *PPOEDBG_SUBSCRIBER;
+
+// The subscribers for a direction. A published list is never changed; it is
+// copied, changed and swapped in, and the old one is freed once the debug
+// loop can no longer be reading it.
+typedef struct _POEDBG_SUBSCRIBER_LIST
+{
+	struct _POEDBG_SUBSCRIBER_LIST* Retired;
+	DWORD Count;
+	POEDBG_SUBSCRIBER Subscribers[1];
+} POEDBG_SUBSCRIBER_LIST, *PPOEDBG_SUBSCRIBER_LIST;
+
+//////////////////////////////////////////////////////////////////////////
+// Subscriber Globals
+//////////////////////////////////////////////////////////////////////////
+
+// Published subscriber lists, indexed by direction. NULL when empty.
+__declspec(selectany) PPOEDBG_SUBSCRIBER_LIST volatile _g_SubscriberLists[POEDBG_DIRECTION_COUNT];
+
+// Odd while the debug loop is calling subscribers.
+__declspec(selectany) volatile LONG _g_SubscriberReadSequence;
+
+// Lists replaced by a subscriber running on the debug loop itself, which are
+// freed once it has finished calling subscribers.
+__declspec(selectany) PPOEDBG_SUBSCRIBER_LIST _g_SubscriberRetired;
+
+// Serializes changes to the subscriber lists.
+__declspec(selectany) SRWLOCK _g_SubscriberLock = SRWLOCK_INIT;
+__declspec(selectany) DWORD _g_SubscriberNextId = 1;
\ No newline at end of file
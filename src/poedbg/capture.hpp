@@ -0,0 +1,265 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Capture Point Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Returns the value of the given register in the context.
+*/
+POEDBG_INLINE DWORD64 _PoeDbgCaptureGetRegister(const PCONTEXT Context, const BYTE Register)
+{
+	static const SIZE_T Offsets[POEDBG_REGISTER_COUNT] =
+	{
+		offsetof(CONTEXT, Rax), offsetof(CONTEXT, Rcx), offsetof(CONTEXT, Rdx), offsetof(CONTEXT, Rbx),
+		offsetof(CONTEXT, Rsp), offsetof(CONTEXT, Rbp), offsetof(CONTEXT, Rsi), offsetof(CONTEXT, Rdi),
+		offsetof(CONTEXT, R8), offsetof(CONTEXT, R9), offsetof(CONTEXT, R10), offsetof(CONTEXT, R11),
+		offsetof(CONTEXT, R12), offsetof(CONTEXT, R13), offsetof(CONTEXT, R14), offsetof(CONTEXT, R15),
+		offsetof(CONTEXT, Rip),
+	};
+
+	return *reinterpret_cast<const DWORD64*>(reinterpret_cast<const BYTE*>(Context) + Offsets[Register]);
+}
+
+/*
+Checks that a recipe only names registers that exist, and that everything it
+captures fits into the capture buffer at once.
+*/
+inline bool _PoeDbgCaptureIsRecipeValid(const POEDBG_CAPTURE_RECIPE* Recipe)
+{
+	if (0 == Recipe->Count || Recipe->Count > CAPTURE_ITEM_MAXIMUM)
+	{
+		return false;
+	}
+
+	SIZE_T Size = 0;
+
+	for (DWORD Index = 0; Index < Recipe->Count; Index++)
+	{
+		const POEDBG_CAPTURE_ITEM* Item = &Recipe->Items[Index];
+
+		if (Item->Register >= POEDBG_REGISTER_COUNT)
+		{
+			return false;
+		}
+
+		switch (Item->Type)
+		{
+		case POEDBG_CAPTURE_ITEM_REGISTER:
+			Size += sizeof(DWORD) + sizeof(DWORD64);
+			break;
+		case POEDBG_CAPTURE_ITEM_MEMORY_SIZED:
+			if (Item->LengthRegister >= POEDBG_REGISTER_COUNT)
+			{
+				return false;
+			}
+			// Fall through.
+		case POEDBG_CAPTURE_ITEM_MEMORY:
+			if (0 == Item->Length || Item->Length > DEFAULT_BUFFER_SIZE)
+			{
+				return false;
+			}
+			Size += sizeof(DWORD) + Item->Length;
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return (Size <= DEFAULT_BUFFER_SIZE);
+}
+
+/*
+Adds a capture point at the given address in the first free breakpoint slot,
+and applies it to every game thread. The ID of the capture point is the slot
+it was given.
+*/
+inline POEDBG_STATUS _PoeDbgCaptureAdd(const ULONG_PTR Address, const DWORD ResumeBytes, const POEDBG_CAPTURE_RECIPE* Recipe, PDWORD Id)
+{
+	if (!_PoeDbgCaptureIsRecipeValid(Recipe))
+	{
+		return POEDBG_STATUS_CAPTURE_POINT_INVALID;
+	}
+
+	POEDBG_STATUS Status = POEDBG_STATUS_CAPTURE_POINT_SLOTS_FULL;
+
+	AcquireSRWLockExclusive(&_g_WatchLock);
+
+	for (USHORT Index = 0; Index < BP_SLOT_COUNT; Index++)
+	{
+		if (_g_CapturePoints[Index].bIsActive && Address == _g_CapturePoints[Index].Address)
+		{
+			// Only one capture point can decide how the thread resumes.
+			ReleaseSRWLockExclusive(&_g_WatchLock);
+			return POEDBG_STATUS_CAPTURE_POINT_INVALID;
+		}
+	}
+
+	// Take slots from the top down, the same as watchpoints.
+
+	for (USHORT Index = BP_SLOT_COUNT; Index-- > 0;)
+	{
+		if (_g_Breakpoints[Index].bIsEnabled)
+		{
+			continue;
+		}
+
+		PPOEDBG_CAPTURE_POINT Point = &_g_CapturePoints[Index];
+
+		Point->Address = Address;
+		Point->ResumeBytes = ResumeBytes;
+		Point->Recipe = *Recipe;
+		Point->bIsActive = true;
+
+		_PoeDbgMemoryDefineBreakpoint(Index, Address, BP_LENGTH_ONE, BP_CONDITION_EXECUTION);
+
+		if (!_PoeDbgMemoryApplyBreakpointsToAll())
+		{
+			// A thread that did get the breakpoint would stop on it with
+			// nobody to hand its capture to, so it comes off them all.
+			Point->bIsActive = false;
+			_PoeDbgMemoryClearBreakpoint(Index);
+			_PoeDbgMemoryApplyBreakpointsToAll();
+
+			Status = POEDBG_STATUS_HOOK_THREAD_FAILED;
+			break;
+		}
+
+		Status = POEDBG_STATUS_SUCCESS;
+		*Id = Index;
+		break;
+	}
+
+	ReleaseSRWLockExclusive(&_g_WatchLock);
+
+	return Status;
+}
+
+/*
+Removes the capture point with the given ID from every game thread.
+*/
+inline POEDBG_STATUS _PoeDbgCaptureRemove(const DWORD Id)
+{
+	if (Id >= BP_SLOT_COUNT)
+	{
+		return POEDBG_STATUS_CAPTURE_POINT_INVALID;
+	}
+
+	POEDBG_STATUS Status = POEDBG_STATUS_SUCCESS;
+
+	AcquireSRWLockExclusive(&_g_WatchLock);
+
+	if (!_g_CapturePoints[Id].bIsActive)
+	{
+		Status = POEDBG_STATUS_CAPTURE_POINT_INVALID;
+	}
+	else
+	{
+		_g_CapturePoints[Id].bIsActive = false;
+
+		_PoeDbgMemoryClearBreakpoint(static_cast<USHORT>(Id));
+
+		if (!_PoeDbgMemoryApplyBreakpointsToAll())
+		{
+			Status = POEDBG_STATUS_HOOK_THREAD_FAILED;
+		}
+	}
+
+	ReleaseSRWLockExclusive(&_g_WatchLock);
+
+	return Status;
+}
+
+/*
+Captures everything in a capture point's recipe into the capture buffer, and
+returns the number of bytes used. Each item is written as its length, then
+its bytes. Memory that can't be read is written with a length of zero.
+*/
+inline DWORD _PoeDbgCaptureRun(const PPOEDBG_CAPTURE_POINT Point, const PCONTEXT Context)
+{
+	PBYTE Cursor = _g_CapturePointBuffer;
+
+	for (DWORD Index = 0; Index < Point->Recipe.Count; Index++)
+	{
+		const POEDBG_CAPTURE_ITEM* Item = &Point->Recipe.Items[Index];
+
+		DWORD64 Value = _PoeDbgCaptureGetRegister(Context, Item->Register);
+		DWORD Length = sizeof(DWORD64);
+
+		if (POEDBG_CAPTURE_ITEM_REGISTER == Item->Type)
+		{
+			memcpy(Cursor + sizeof(DWORD), &Value, sizeof(DWORD64));
+		}
+		else
+		{
+			Length = Item->Length;
+
+			if (POEDBG_CAPTURE_ITEM_MEMORY_SIZED == Item->Type)
+			{
+				DWORD64 Wanted = _PoeDbgCaptureGetRegister(Context, Item->LengthRegister);
+
+				if (Wanted < Length)
+				{
+					Length = static_cast<DWORD>(Wanted);
+				}
+			}
+
+			ULONG_PTR Address = static_cast<ULONG_PTR>(Value + static_cast<DWORD64>(static_cast<LONG64>(Item->Displacement)));
+
+			if (0 != Length && !_PoeDbgMemoryRead(Address, Cursor + sizeof(DWORD), Length))
+			{
+				Length = 0;
+			}
+		}
+
+		memcpy(Cursor, &Length, sizeof(DWORD));
+		Cursor += sizeof(DWORD) + Length;
+	}
+
+	return static_cast<DWORD>(Cursor - _g_CapturePointBuffer);
+}
+
+/*
+Runs the capture point at the address the given thread stopped at, hands what
+it captured to the capture point callback, and sets the thread up to resume.
+Capture points only read the thread, so it either runs the instruction it
+stopped at, or skips the number of bytes the capture point was given. A hook
+at the same address still decides where the thread resumes.
+*/
+inline void _PoeDbgCaptureProcessHits(const DWORD ThreadId, const ULONG_PTR Address, const PCONTEXT Context)
+{
+	for (DWORD Index = 0; Index < BP_SLOT_COUNT; Index++)
+	{
+		PPOEDBG_CAPTURE_POINT Point = &_g_CapturePoints[Index];
+
+		if (!Point->bIsActive || Address != Point->Address)
+		{
+			continue;
+		}
+
+		DWORD64 Begin = _PoeDbgTraceBegin();
+
+		DWORD Length = _PoeDbgCaptureRun(Point, Context);
+
+		// Captures are numbered along with packets, so the two can be put in
+		// order together.
+		DWORD64 Sequence = ++_g_EventSequence;
+
+		POEDBG_NOTIFY_CALLBACK(CapturePoint, Index, ThreadId, Length, _g_CapturePointBuffer, _g_EventTimestamp, Sequence);
+
+		_PoeDbgTraceEnd(TRACE_RING_DEBUG, TRACE_SPAN_CAPTURE, Begin, ThreadId, 0, static_cast<BYTE>(Index), 0, Sequence);
+
+		if (0 != Point->ResumeBytes)
+		{
+			Context->Rip += Point->ResumeBytes;
+		}
+		else
+		{
+			Context->EFlags |= BP_EFLAGS_RESUME;
+		}
+
+		break;
+	}
+}
@@ -0,0 +1,110 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Clock Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Checks whether the processor's time stamp counter runs at a constant rate in
+every power state, so that it can be used as a clock.
+*/
+POEDBG_INLINE bool _PoeDbgClockIsTscInvariant()
+{
+	int Info[4] = { 0 };
+
+	__cpuid(Info, 0x80000000);
+
+	if (static_cast<unsigned int>(Info[0]) < 0x80000007)
+	{
+		return false;
+	}
+
+	__cpuid(Info, 0x80000007);
+
+	// EDX bit 8 is the invariant TSC flag.
+	return 0 != (Info[3] & (1 << 8));
+}
+
+/*
+Reads the raw clock, in ticks. This is the time stamp counter when it is
+invariant, and the performance counter otherwise.
+*/
+POEDBG_INLINE DWORD64 _PoeDbgClockReadTicks()
+{
+	if (_g_bIsClockTscInvariant)
+	{
+		return __rdtsc();
+	}
+
+	LARGE_INTEGER Counter;
+	QueryPerformanceCounter(&Counter);
+
+	return static_cast<DWORD64>(Counter.QuadPart);
+}
+
+/*
+Returns the number of nanoseconds since the clock was calibrated. This costs a
+read of the time stamp counter and a multiply.
+*/
+POEDBG_INLINE DWORD64 _PoeDbgClockNow()
+{
+	DWORD64 Ticks = _PoeDbgClockReadTicks() - _g_ClockBaseTicks;
+	DWORD64 High = 0;
+	DWORD64 Low = _umul128(Ticks, _g_ClockMultiplier, &High);
+
+	return __shiftright128(Low, High, CLOCK_MULTIPLIER_SHIFT);
+}
+
+/*
+Measures the rate of the clock against the performance counter, and records
+the wall-clock time that timestamp zero corresponds to. This spins for a few
+milliseconds, so it is only done once, when the engine is initialized.
+*/
+inline void _PoeDbgClockInitialize()
+{
+	if (0 != _g_ClockMultiplier)
+	{
+		return;
+	}
+
+	_g_bIsClockTscInvariant = _PoeDbgClockIsTscInvariant();
+
+	LARGE_INTEGER Frequency;
+	LARGE_INTEGER Start;
+	LARGE_INTEGER End;
+
+	QueryPerformanceFrequency(&Frequency);
+
+	DWORD64 TicksPerSecond = static_cast<DWORD64>(Frequency.QuadPart);
+
+	if (_g_bIsClockTscInvariant)
+	{
+		LONGLONG Duration = Frequency.QuadPart * CLOCK_CALIBRATION_MILLISECONDS / 1000;
+
+		QueryPerformanceCounter(&Start);
+		DWORD64 StartTicks = __rdtsc();
+
+		do
+		{
+			YieldProcessor();
+			QueryPerformanceCounter(&End);
+		} while (End.QuadPart - Start.QuadPart < Duration);
+
+		DWORD64 EndTicks = __rdtsc();
+
+		TicksPerSecond = static_cast<DWORD64>((EndTicks - StartTicks) * static_cast<double>(Frequency.QuadPart) / (End.QuadPart - Start.QuadPart));
+	}
+
+	// Nanoseconds per tick, as a fixed point number.
+	_g_ClockMultiplier = static_cast<DWORD64>(1000000000.0 * (static_cast<DWORD64>(1) << CLOCK_MULTIPLIER_SHIFT) / TicksPerSecond);
+
+	// Take the base as close to the system time as we can.
+
+	FILETIME SystemTime;
+	GetSystemTimePreciseAsFileTime(&SystemTime);
+	_g_ClockBaseTicks = _PoeDbgClockReadTicks();
+
+	_g_ClockBaseSystemTime = (static_cast<DWORD64>(SystemTime.dwHighDateTime) << 32) | SystemTime.dwLowDateTime;
+}
@@ -0,0 +1,748 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+// The engine is written against the Windows API. When it is built for Linux,
+// this provides the small part of that API it uses, so that the same dispatch
+// code runs on both. Only what the engine needs is here, and the debugging
+// API itself is implemented separately by the platform layer.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+#include <wctype.h>
+#include <linux/io_uring.h>
+#include <linux/membarrier.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <x86intrin.h>
+#include <deque>
+#include <map>
+
+//////////////////////////////////////////////////////////////////////////
+// Compiler
+//////////////////////////////////////////////////////////////////////////
+
+// Each __declspec is mapped onto its GCC equivalent. Selectany globals are
+// C++17 inline variables, so they are shared by every translation unit.
+#define __declspec(x) POEDBG_DECLSPEC_##x
+#define POEDBG_DECLSPEC_selectany inline
+#define POEDBG_DECLSPEC_dllexport __attribute__((visibility("default")))
+#define POEDBG_DECLSPEC_align(n) __attribute__((aligned(n)))
+
+#define DECLSPEC_ALIGN(n) __attribute__((aligned(n)))
+#define __forceinline inline __attribute__((always_inline))
+#define __stdcall
+#define __pragma(x)
+
+#define POEDBG_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define POEDBG_TARGET_AVX2 __attribute__((target("avx2")))
+
+#define UNREFERENCED_PARAMETER(p) (void)(p)
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+typedef int BOOL;
+typedef uint8_t BYTE, *PBYTE;
+typedef uint16_t WORD, USHORT;
+typedef uint32_t DWORD, *PDWORD, ULONG;
+typedef int32_t LONG, *PLONG;
+typedef int64_t LONG64, LONGLONG;
+typedef uint64_t DWORD64, *PDWORD64, ULONGLONG;
+typedef uintptr_t ULONG_PTR, *PULONG_PTR, DWORD_PTR;
+typedef size_t SIZE_T, *PSIZE_T;
+typedef char CHAR, *PCHAR;
+typedef void *PVOID, *LPVOID, *HANDLE, *HMODULE;
+typedef const void* LPCVOID;
+typedef DWORD(*LPTHREAD_START_ROUTINE)(LPVOID Parameter);
+
+typedef union _LARGE_INTEGER
+{
+	LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _FILETIME
+{
+	DWORD dwLowDateTime;
+	DWORD dwHighDateTime;
+} FILETIME, *LPFILETIME;
+
+typedef pthread_rwlock_t SRWLOCK, *PSRWLOCK;
+
+#define TRUE 1
+#define FALSE 0
+#define MAXLONG 0x7FFFFFFF
+#define MAXDWORD 0xFFFFFFFF
+#define INFINITE 0xFFFFFFFF
+#define SRWLOCK_INIT PTHREAD_RWLOCK_INITIALIZER
+
+//////////////////////////////////////////////////////////////////////////
+// Debugging Types
+//////////////////////////////////////////////////////////////////////////
+
+// Thread registers, laid out by name as on Windows. Only the registers the
+// engine reads and writes are present.
+typedef struct _CONTEXT
+{
+	DWORD ContextFlags;
+	DWORD EFlags;
+	DWORD64 Dr0;
+	DWORD64 Dr1;
+	DWORD64 Dr2;
+	DWORD64 Dr3;
+	DWORD64 Dr6;
+	DWORD64 Dr7;
+	DWORD64 Rax;
+	DWORD64 Rcx;
+	DWORD64 Rdx;
+	DWORD64 Rbx;
+	DWORD64 Rsp;
+	DWORD64 Rbp;
+	DWORD64 Rsi;
+	DWORD64 Rdi;
+	DWORD64 R8;
+	DWORD64 R9;
+	DWORD64 R10;
+	DWORD64 R11;
+	DWORD64 R12;
+	DWORD64 R13;
+	DWORD64 R14;
+	DWORD64 R15;
+	DWORD64 Rip;
+} CONTEXT, *PCONTEXT;
+
+typedef struct _EXCEPTION_RECORD
+{
+	DWORD ExceptionCode;
+	DWORD ExceptionFlags;
+	PVOID ExceptionAddress;
+} EXCEPTION_RECORD;
+
+typedef struct _EXCEPTION_DEBUG_INFO
+{
+	EXCEPTION_RECORD ExceptionRecord;
+	DWORD dwFirstChance;
+} EXCEPTION_DEBUG_INFO;
+
+typedef struct _CREATE_THREAD_DEBUG_INFO
+{
+	HANDLE hThread;
+} CREATE_THREAD_DEBUG_INFO;
+
+typedef struct _CREATE_PROCESS_DEBUG_INFO
+{
+	HANDLE hProcess;
+	HANDLE hThread;
+	LPVOID lpBaseOfImage;
+} CREATE_PROCESS_DEBUG_INFO;
+
+typedef struct _LOAD_DLL_DEBUG_INFO
+{
+	HANDLE hFile;
+	LPVOID lpBaseOfDll;
+} LOAD_DLL_DEBUG_INFO;
+
+typedef struct _UNLOAD_DLL_DEBUG_INFO
+{
+	LPVOID lpBaseOfDll;
+} UNLOAD_DLL_DEBUG_INFO;
+
+typedef struct _DEBUG_EVENT
+{
+	DWORD dwDebugEventCode;
+	DWORD dwProcessId;
+	DWORD dwThreadId;
+	union
+	{
+		EXCEPTION_DEBUG_INFO Exception;
+		CREATE_THREAD_DEBUG_INFO CreateThread;
+		CREATE_PROCESS_DEBUG_INFO CreateProcessInfo;
+		LOAD_DLL_DEBUG_INFO LoadDll;
+		UNLOAD_DLL_DEBUG_INFO UnloadDll;
+	} u;
+} DEBUG_EVENT, *LPDEBUG_EVENT;
+
+#define CONTEXT_AMD64 0x00100000
+#define CONTEXT_CONTROL (CONTEXT_AMD64 | 0x01)
+#define CONTEXT_INTEGER (CONTEXT_AMD64 | 0x02)
+#define CONTEXT_DEBUG_REGISTERS (CONTEXT_AMD64 | 0x10)
+#define CONTEXT_ALL (CONTEXT_CONTROL | CONTEXT_INTEGER | CONTEXT_DEBUG_REGISTERS)
+
+#define EXCEPTION_DEBUG_EVENT 1
+#define CREATE_THREAD_DEBUG_EVENT 2
+#define CREATE_PROCESS_DEBUG_EVENT 3
+#define EXIT_THREAD_DEBUG_EVENT 4
+#define EXIT_PROCESS_DEBUG_EVENT 5
+#define LOAD_DLL_DEBUG_EVENT 6
+#define UNLOAD_DLL_DEBUG_EVENT 7
+
+#define EXCEPTION_SINGLE_STEP 0x80000004
+#define EXCEPTION_NONCONTINUABLE 0x1
+
+#define DBG_CONTINUE 0x00010002
+#define DBG_EXCEPTION_NOT_HANDLED 0x80010001
+
+//////////////////////////////////////////////////////////////////////////
+// Image Types
+//////////////////////////////////////////////////////////////////////////
+
+// The PE headers of a 64-bit image, as laid out on disk and in memory.
+
+typedef struct _IMAGE_DOS_HEADER
+{
+	WORD e_magic;
+	WORD e_cblp;
+	WORD e_cp;
+	WORD e_crlc;
+	WORD e_cparhdr;
+	WORD e_minalloc;
+	WORD e_maxalloc;
+	WORD e_ss;
+	WORD e_sp;
+	WORD e_csum;
+	WORD e_ip;
+	WORD e_cs;
+	WORD e_lfarlc;
+	WORD e_ovno;
+	WORD e_res[4];
+	WORD e_oemid;
+	WORD e_oeminfo;
+	WORD e_res2[10];
+	LONG e_lfanew;
+} IMAGE_DOS_HEADER, *PIMAGE_DOS_HEADER;
+
+typedef struct _IMAGE_FILE_HEADER
+{
+	WORD Machine;
+	WORD NumberOfSections;
+	DWORD TimeDateStamp;
+	DWORD PointerToSymbolTable;
+	DWORD NumberOfSymbols;
+	WORD SizeOfOptionalHeader;
+	WORD Characteristics;
+} IMAGE_FILE_HEADER, *PIMAGE_FILE_HEADER;
+
+typedef struct _IMAGE_DATA_DIRECTORY
+{
+	DWORD VirtualAddress;
+	DWORD Size;
+} IMAGE_DATA_DIRECTORY, *PIMAGE_DATA_DIRECTORY;
+
+typedef struct _IMAGE_OPTIONAL_HEADER64
+{
+	WORD Magic;
+	BYTE MajorLinkerVersion;
+	BYTE MinorLinkerVersion;
+	DWORD SizeOfCode;
+	DWORD SizeOfInitializedData;
+	DWORD SizeOfUninitializedData;
+	DWORD AddressOfEntryPoint;
+	DWORD BaseOfCode;
+	ULONGLONG ImageBase;
+	DWORD SectionAlignment;
+	DWORD FileAlignment;
+	WORD MajorOperatingSystemVersion;
+	WORD MinorOperatingSystemVersion;
+	WORD MajorImageVersion;
+	WORD MinorImageVersion;
+	WORD MajorSubsystemVersion;
+	WORD MinorSubsystemVersion;
+	DWORD Win32VersionValue;
+	DWORD SizeOfImage;
+	DWORD SizeOfHeaders;
+	DWORD CheckSum;
+	WORD Subsystem;
+	WORD DllCharacteristics;
+	ULONGLONG SizeOfStackReserve;
+	ULONGLONG SizeOfStackCommit;
+	ULONGLONG SizeOfHeapReserve;
+	ULONGLONG SizeOfHeapCommit;
+	DWORD LoaderFlags;
+	DWORD NumberOfRvaAndSizes;
+	IMAGE_DATA_DIRECTORY DataDirectory[16];
+} IMAGE_OPTIONAL_HEADER64, *PIMAGE_OPTIONAL_HEADER64;
+
+typedef struct _IMAGE_NT_HEADERS64
+{
+	DWORD Signature;
+	IMAGE_FILE_HEADER FileHeader;
+	IMAGE_OPTIONAL_HEADER64 OptionalHeader;
+} IMAGE_NT_HEADERS64, *PIMAGE_NT_HEADERS64, IMAGE_NT_HEADERS, *PIMAGE_NT_HEADERS;
+
+typedef struct _IMAGE_SECTION_HEADER
+{
+	BYTE Name[8];
+	union
+	{
+		DWORD PhysicalAddress;
+		DWORD VirtualSize;
+	} Misc;
+	DWORD VirtualAddress;
+	DWORD SizeOfRawData;
+	DWORD PointerToRawData;
+	DWORD PointerToRelocations;
+	DWORD PointerToLinenumbers;
+	WORD NumberOfRelocations;
+	WORD NumberOfLinenumbers;
+	DWORD Characteristics;
+} IMAGE_SECTION_HEADER, *PIMAGE_SECTION_HEADER;
+
+#define IMAGE_DOS_SIGNATURE 0x5A4D
+#define IMAGE_NT_SIGNATURE 0x00004550
+#define IMAGE_NT_OPTIONAL_HDR64_MAGIC 0x20B
+#define IMAGE_FILE_MACHINE_AMD64 0x8664
+#define IMAGE_SCN_CNT_CODE 0x00000020
+#define IMAGE_SCN_MEM_EXECUTE 0x20000000
+#define IMAGE_SCN_MEM_READ 0x40000000
+
+#define IMAGE_FIRST_SECTION(headers) reinterpret_cast<PIMAGE_SECTION_HEADER>( \
+	reinterpret_cast<ULONG_PTR>(headers) + offsetof(IMAGE_NT_HEADERS, OptionalHeader) + (headers)->FileHeader.SizeOfOptionalHeader)
+
+//////////////////////////////////////////////////////////////////////////
+// Intrinsics
+//////////////////////////////////////////////////////////////////////////
+
+#define _ReadWriteBarrier() __asm__ __volatile__("" ::: "memory")
+#define YieldProcessor() _mm_pause()
+
+inline LONG _InterlockedIncrement(volatile LONG* Value)
+{
+	return __atomic_add_fetch(Value, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG _InterlockedDecrement(volatile LONG* Value)
+{
+	return __atomic_sub_fetch(Value, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG _InterlockedExchange(volatile LONG* Target, LONG Value)
+{
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 _InterlockedExchange64(volatile LONG64* Target, LONG64 Value)
+{
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+inline PVOID _InterlockedExchangePointer(PVOID volatile* Target, PVOID Value)
+{
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+inline DWORD64 _umul128(DWORD64 Multiplier, DWORD64 Multiplicand, DWORD64* High)
+{
+	unsigned __int128 Product = static_cast<unsigned __int128>(Multiplier) * Multiplicand;
+	*High = static_cast<DWORD64>(Product >> 64);
+	return static_cast<DWORD64>(Product);
+}
+
+inline DWORD64 __shiftright128(DWORD64 Low, DWORD64 High, BYTE Shift)
+{
+	return static_cast<DWORD64>(((static_cast<unsigned __int128>(High) << 64) | Low) >> (Shift & 63));
+}
+
+inline void __cpuidex(int Info[4], int Leaf, int Subleaf)
+{
+	__asm__ __volatile__("cpuid" : "=a"(Info[0]), "=b"(Info[1]), "=c"(Info[2]), "=d"(Info[3]) : "a"(Leaf), "c"(Subleaf));
+}
+
+inline void __cpuid(int Info[4], int Leaf)
+{
+	__cpuidex(Info, Leaf, 0);
+}
+
+// GCC only allows its own version where XSAVE is enabled at compile time.
+#define _xgetbv(r) _PoeDbgXgetbv(r)
+
+inline DWORD64 _PoeDbgXgetbv(DWORD Register)
+{
+	DWORD Low = 0;
+	DWORD High = 0;
+	__asm__ __volatile__("xgetbv" : "=a"(Low), "=d"(High) : "c"(Register));
+	return (static_cast<DWORD64>(High) << 32) | Low;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Threads and Synchronization
+//////////////////////////////////////////////////////////////////////////
+
+inline DWORD GetCurrentThreadId()
+{
+	return static_cast<DWORD>(syscall(SYS_gettid));
+}
+
+inline void Sleep(DWORD Milliseconds)
+{
+	if (0 == Milliseconds)
+	{
+		sched_yield();
+		return;
+	}
+
+	struct timespec Duration = { static_cast<time_t>(Milliseconds / 1000), static_cast<long>(Milliseconds % 1000) * 1000000 };
+	nanosleep(&Duration, NULL);
+}
+
+// Threads are started detached, and the handle returned only says whether
+// one was started.
+inline HANDLE CreateThread(PVOID Attributes, SIZE_T StackSize, LPTHREAD_START_ROUTINE Routine, LPVOID Parameter, DWORD Flags, PDWORD ThreadId)
+{
+	UNREFERENCED_PARAMETER(Attributes);
+	UNREFERENCED_PARAMETER(StackSize);
+	UNREFERENCED_PARAMETER(Flags);
+	UNREFERENCED_PARAMETER(ThreadId);
+
+	struct Start
+	{
+		LPTHREAD_START_ROUTINE Routine;
+		LPVOID Parameter;
+
+		static void* Run(void* Context)
+		{
+			Start Copy = *static_cast<Start*>(Context);
+			delete static_cast<Start*>(Context);
+			Copy.Routine(Copy.Parameter);
+			return NULL;
+		}
+	};
+
+	pthread_t Thread;
+	pthread_attr_t ThreadAttributes;
+
+	pthread_attr_init(&ThreadAttributes);
+	pthread_attr_setdetachstate(&ThreadAttributes, PTHREAD_CREATE_DETACHED);
+
+	Start* Context = new Start{ Routine, Parameter };
+	int Result = pthread_create(&Thread, &ThreadAttributes, Start::Run, Context);
+
+	pthread_attr_destroy(&ThreadAttributes);
+
+	if (0 != Result)
+	{
+		delete Context;
+		return NULL;
+	}
+
+	return reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(1));
+}
+
+// The handle of the current thread is a pseudo handle, as on Windows, and is
+// the only thread handle the functions below accept.
+inline HANDLE GetCurrentThread()
+{
+	return reinterpret_cast<HANDLE>(~static_cast<ULONG_PTR>(1));
+}
+
+// Only the first 64 processors can be named in a mask.
+inline DWORD_PTR SetThreadAffinityMask(HANDLE Thread, DWORD_PTR Mask)
+{
+	UNREFERENCED_PARAMETER(Thread);
+
+	cpu_set_t Previous;
+	cpu_set_t Processors;
+	CPU_ZERO(&Processors);
+
+	for (DWORD Index = 0; Index < 64; Index++)
+	{
+		if (0 != (Mask & (static_cast<DWORD_PTR>(1) << Index)))
+		{
+			CPU_SET(Index, &Processors);
+		}
+	}
+
+	if (0 != pthread_getaffinity_np(pthread_self(), sizeof(Previous), &Previous) || 0 != pthread_setaffinity_np(pthread_self(), sizeof(Processors), &Processors))
+	{
+		return 0;
+	}
+
+	DWORD_PTR PreviousMask = 0;
+
+	for (DWORD Index = 0; Index < 64; Index++)
+	{
+		if (CPU_ISSET(Index, &Previous))
+		{
+			PreviousMask |= static_cast<DWORD_PTR>(1) << Index;
+		}
+	}
+
+	return (0 != PreviousMask) ? PreviousMask : 1;
+}
+
+#define THREAD_PRIORITY_IDLE -15
+#define THREAD_PRIORITY_LOWEST -2
+#define THREAD_PRIORITY_NORMAL 0
+#define THREAD_PRIORITY_HIGHEST 2
+#define THREAD_PRIORITY_TIME_CRITICAL 15
+
+// Priorities are mapped onto nice values, from 19 for idle to -20 for time
+// critical. Raising a thread above normal needs CAP_SYS_NICE.
+inline BOOL SetThreadPriority(HANDLE Thread, int Priority)
+{
+	UNREFERENCED_PARAMETER(Thread);
+
+	int Nice = -5 * Priority;
+
+	if (Priority <= THREAD_PRIORITY_IDLE)
+	{
+		Nice = 19;
+	}
+	else if (Priority >= THREAD_PRIORITY_TIME_CRITICAL)
+	{
+		Nice = -20;
+	}
+
+	return (0 == setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), Nice)) ? TRUE : FALSE;
+}
+
+// Handles are process and thread IDs, which need no closing, or semaphores,
+// which live as long as the engine.
+inline BOOL CloseHandle(HANDLE Handle)
+{
+	UNREFERENCED_PARAMETER(Handle);
+	return TRUE;
+}
+
+inline void InitializeSRWLock(PSRWLOCK Lock)
+{
+	pthread_rwlock_init(Lock, NULL);
+}
+
+inline void AcquireSRWLockShared(PSRWLOCK Lock)
+{
+	pthread_rwlock_rdlock(Lock);
+}
+
+inline void ReleaseSRWLockShared(PSRWLOCK Lock)
+{
+	pthread_rwlock_unlock(Lock);
+}
+
+inline void AcquireSRWLockExclusive(PSRWLOCK Lock)
+{
+	pthread_rwlock_wrlock(Lock);
+}
+
+inline void ReleaseSRWLockExclusive(PSRWLOCK Lock)
+{
+	pthread_rwlock_unlock(Lock);
+}
+
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+
+inline HANDLE CreateSemaphoreW(PVOID Attributes, LONG InitialCount, LONG MaximumCount, const wchar_t* Name)
+{
+	UNREFERENCED_PARAMETER(Attributes);
+	UNREFERENCED_PARAMETER(MaximumCount);
+	UNREFERENCED_PARAMETER(Name);
+
+	sem_t* Semaphore = new sem_t;
+
+	if (0 != sem_init(Semaphore, 0, static_cast<unsigned int>(InitialCount)))
+	{
+		delete Semaphore;
+		return NULL;
+	}
+
+	return Semaphore;
+}
+
+inline BOOL ReleaseSemaphore(HANDLE Semaphore, LONG ReleaseCount, PLONG PreviousCount)
+{
+	UNREFERENCED_PARAMETER(PreviousCount);
+
+	while (ReleaseCount-- > 0)
+	{
+		sem_post(static_cast<sem_t*>(Semaphore));
+	}
+
+	return TRUE;
+}
+
+inline DWORD WaitForSingleObject(HANDLE Semaphore, DWORD Milliseconds)
+{
+	if (INFINITE == Milliseconds)
+	{
+		while (0 != sem_wait(static_cast<sem_t*>(Semaphore)) && EINTR == errno)
+		{
+		}
+
+		return WAIT_OBJECT_0;
+	}
+
+	struct timespec Deadline;
+	clock_gettime(CLOCK_MONOTONIC, &Deadline);
+
+	Deadline.tv_sec += Milliseconds / 1000;
+	Deadline.tv_nsec += static_cast<long>(Milliseconds % 1000) * 1000000;
+
+	if (Deadline.tv_nsec >= 1000000000)
+	{
+		Deadline.tv_sec++;
+		Deadline.tv_nsec -= 1000000000;
+	}
+
+	while (0 != sem_clockwait(static_cast<sem_t*>(Semaphore), CLOCK_MONOTONIC, &Deadline))
+	{
+		if (EINTR != errno)
+		{
+			return WAIT_TIMEOUT;
+		}
+	}
+
+	return WAIT_OBJECT_0;
+}
+
+/*
+Makes sure every thread's earlier stores are visible to the caller. This is
+a single system call, unless the kernel doesn't support it, in which case it
+is only a full barrier on this thread.
+*/
+inline void FlushProcessWriteBuffers()
+{
+	static volatile LONG s_bIsRegistered = 0;
+
+	if (0 == s_bIsRegistered)
+	{
+		s_bIsRegistered = (0 == syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0)) ? 1 : -1;
+	}
+
+	if (1 != s_bIsRegistered || 0 != syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0))
+	{
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Memory
+//////////////////////////////////////////////////////////////////////////
+
+#define MEM_COMMIT 0x1000
+#define MEM_RESERVE 0x2000
+#define MEM_RELEASE 0x8000
+#define MEM_FREE 0x10000
+#define PAGE_READWRITE 0x04
+#define HEAP_ZERO_MEMORY 0x08
+
+// Mappings are released whole, so the size of each is kept in a page in
+// front of it.
+inline LPVOID VirtualAlloc(LPVOID Address, SIZE_T Size, DWORD AllocationType, DWORD Protect)
+{
+	UNREFERENCED_PARAMETER(Address);
+	UNREFERENCED_PARAMETER(AllocationType);
+	UNREFERENCED_PARAMETER(Protect);
+
+	SIZE_T PageSize = static_cast<SIZE_T>(sysconf(_SC_PAGESIZE));
+	SIZE_T Total = PageSize + ((Size + PageSize - 1) & ~(PageSize - 1));
+
+	PBYTE Base = static_cast<PBYTE>(mmap(NULL, Total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+	if (MAP_FAILED == Base)
+	{
+		return NULL;
+	}
+
+	*reinterpret_cast<PSIZE_T>(Base) = Total;
+
+	return Base + PageSize;
+}
+
+inline BOOL VirtualFree(LPVOID Address, SIZE_T Size, DWORD FreeType)
+{
+	UNREFERENCED_PARAMETER(Size);
+	UNREFERENCED_PARAMETER(FreeType);
+
+	if (NULL == Address)
+	{
+		return FALSE;
+	}
+
+	PBYTE Base = static_cast<PBYTE>(Address) - sysconf(_SC_PAGESIZE);
+
+	return (0 == munmap(Base, *reinterpret_cast<PSIZE_T>(Base))) ? TRUE : FALSE;
+}
+
+inline HANDLE GetProcessHeap()
+{
+	return NULL;
+}
+
+inline LPVOID HeapAlloc(HANDLE Heap, DWORD Flags, SIZE_T Size)
+{
+	UNREFERENCED_PARAMETER(Heap);
+
+	return (0 != (Flags & HEAP_ZERO_MEMORY)) ? calloc(1, Size) : malloc(Size);
+}
+
+inline BOOL HeapFree(HANDLE Heap, DWORD Flags, LPVOID Address)
+{
+	UNREFERENCED_PARAMETER(Heap);
+	UNREFERENCED_PARAMETER(Flags);
+
+	free(Address);
+	return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Time
+//////////////////////////////////////////////////////////////////////////
+
+// Difference between the Windows and Unix epochs, in 100 nanosecond units.
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+
+inline ULONGLONG GetTickCount64()
+{
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+
+	return static_cast<ULONGLONG>(Now.tv_sec) * 1000 + static_cast<ULONGLONG>(Now.tv_nsec) / 1000000;
+}
+
+inline BOOL QueryPerformanceFrequency(PLARGE_INTEGER Frequency)
+{
+	Frequency->QuadPart = 1000000000;
+	return TRUE;
+}
+
+inline BOOL QueryPerformanceCounter(PLARGE_INTEGER Counter)
+{
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+
+	Counter->QuadPart = static_cast<LONGLONG>(Now.tv_sec) * 1000000000 + Now.tv_nsec;
+	return TRUE;
+}
+
+inline void GetSystemTimePreciseAsFileTime(LPFILETIME SystemTime)
+{
+	struct timespec Now;
+	clock_gettime(CLOCK_REALTIME, &Now);
+
+	ULONGLONG Time = FILETIME_UNIX_EPOCH + static_cast<ULONGLONG>(Now.tv_sec) * 10000000 + static_cast<ULONGLONG>(Now.tv_nsec) / 100;
+
+	SystemTime->dwLowDateTime = static_cast<DWORD>(Time);
+	SystemTime->dwHighDateTime = static_cast<DWORD>(Time >> 32);
+}
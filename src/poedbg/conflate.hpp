@@ -0,0 +1,272 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Type Definitions
+//////////////////////////////////////////////////////////////////////////
+
+// Called once for every held packet when the slot table is flushed.
+typedef void(*POEDBG_CONFLATION_DELIVER_ROUTINE)(const int Direction, const BYTE Id, PBYTE Data, const DWORD Length, const DWORD OriginalLength, const DWORD64 Timestamp, const DWORD64 Sequence, const BYTE Source);
+
+// The latest packet held for a single ID and key. Each keeps its own
+// timestamp, sequence number and source, so consumers see exactly what they
+// would have seen had it been delivered when it arrived. A slot whose packet
+// was overtaken by one too long to hold is stale, and stays in the table until
+// the next flush without being delivered.
+typedef struct _POEDBG_CONFLATION_SLOT
+{
+	DWORD64 Key;
+	DWORD64 Timestamp;
+	DWORD64 Sequence;
+	DWORD Length;
+	DWORD OriginalLength;
+	BYTE Direction;
+	BYTE Id;
+	BYTE Source;
+	bool bIsUsed;
+	bool bIsStale;
+	BYTE Data[CONFLATION_PAYLOAD_MAXIMUM];
+} POEDBG_CONFLATION_SLOT, *PPOEDBG_CONFLATION_SLOT;
+
+//////////////////////////////////////////////////////////////////////////
+// Globals
+//////////////////////////////////////////////////////////////////////////
+
+// The rule for each packet ID, and whether it has one. Rules are written
+// under the lock, and only read by the debug loop.
+__declspec(selectany) POEDBG_CONFLATION_RULE _g_ConflationRules[POEDBG_DIRECTION_COUNT][PACKET_ID_COUNT];
+__declspec(selectany) volatile bool _g_bIsConflated[POEDBG_DIRECTION_COUNT][PACKET_ID_COUNT];
+__declspec(selectany) volatile bool _g_bIsConflationActive[POEDBG_DIRECTION_COUNT];
+
+// The slot table, allocated the first time a rule is set and kept for the
+// life of the process, and the order its slots were first filled in since
+// the last flush. Only the debug loop touches either.
+__declspec(selectany) PPOEDBG_CONFLATION_SLOT _g_ConflationSlots;
+__declspec(selectany) PDWORD _g_ConflationOrder;
+__declspec(selectany) DWORD _g_ConflationCount;
+
+// When the held packets are next due to be flushed, and how long after the
+// first of them arrives that is, in milliseconds.
+__declspec(selectany) DWORD64 _g_ConflationDeadline;
+__declspec(selectany) volatile DWORD _g_ConflationInterval = CONFLATION_DEFAULT_INTERVAL;
+
+// Progress, for PoeDbgGetConflationStats.
+__declspec(selectany) POEDBG_CONFLATION_STATS _g_ConflationStats[POEDBG_DIRECTION_COUNT][PACKET_ID_COUNT];
+
+// Serializes setting rules.
+__declspec(selectany) SRWLOCK _g_ConflationLock = SRWLOCK_INIT;
+
+//////////////////////////////////////////////////////////////////////////
+// Debug Loop Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Hands every held packet to the routine, in the order their keys were first
+seen since the last flush, and empties the slot table.
+*/
+inline void _PoeDbgConflationFlush(POEDBG_CONFLATION_DELIVER_ROUTINE Routine)
+{
+	DWORD Count = _g_ConflationCount;
+
+	if (0 == Count)
+	{
+		return;
+	}
+
+	DWORD64 Begin = _PoeDbgTraceBegin();
+	DWORD Delivered = 0;
+
+	// Empty the table first, in case a consumer is slow enough for the flush
+	// to be due again by the time it returns.
+	_g_ConflationCount = 0;
+
+	for (DWORD i = 0; i < Count; i++)
+	{
+		PPOEDBG_CONFLATION_SLOT Slot = &_g_ConflationSlots[_g_ConflationOrder[i]];
+
+		if (!Slot->bIsStale)
+		{
+			_g_ConflationStats[Slot->Direction][Slot->Id].Delivered++;
+			Delivered++;
+
+			Routine(Slot->Direction, Slot->Id, Slot->Data, Slot->Length, Slot->OriginalLength, Slot->Timestamp, Slot->Sequence, Slot->Source);
+		}
+
+		Slot->bIsUsed = false;
+		Slot->bIsStale = false;
+	}
+
+	_PoeDbgTraceEnd(TRACE_RING_DEBUG, TRACE_SPAN_FLUSH, Begin, Delivered, 0, 0, 0, 0);
+}
+
+/*
+Is there anything held that is due to be flushed? A full table is due at
+once, so that it is emptied as soon as the event that filled it is over.
+*/
+POEDBG_INLINE bool _PoeDbgConflationIsDue()
+{
+	return (0 != _g_ConflationCount && (_g_ConflationCount >= CONFLATION_SLOT_LIMIT || _PoeDbgClockNow() >= _g_ConflationDeadline));
+}
+
+/*
+Retrieves when the held packets are due to be flushed, for the debug loop to
+stop waiting for events then. Returns zero if nothing is held.
+*/
+POEDBG_INLINE DWORD64 _PoeDbgConflationGetDeadline()
+{
+	return (0 != _g_ConflationCount) ? _g_ConflationDeadline : 0;
+}
+
+/*
+Holds a packet back in the slot table, replacing any held packet with the
+same ID and key. Returns false, without holding it, if the packet is too long
+to hold, too short for its key, or has a new key while the table is full, in
+which case it should be delivered now. A packet too long to hold still
+replaces the one held for its key, which is then never delivered.
+*/
+inline bool _PoeDbgConflationHold(const int Direction, const BYTE Id, PBYTE Data, const DWORD Length, const DWORD OriginalLength, const DWORD64 Timestamp, const DWORD64 Sequence, const BYTE Source)
+{
+	PPOEDBG_CONFLATION_RULE Rule = &_g_ConflationRules[Direction][Id];
+
+	if (static_cast<DWORD>(Rule->KeyOffset) + Rule->KeyLength > Length)
+	{
+		return false;
+	}
+
+	DWORD64 Key = 0;
+	memcpy(&Key, Data + Rule->KeyOffset, Rule->KeyLength);
+
+	// Find the key's slot, or the free slot it belongs in. The table is never
+	// more than three quarters full, so the probe always ends.
+	DWORD64 Hash = (Key ^ (static_cast<DWORD64>(Id) << 1) ^ static_cast<DWORD64>(Direction)) * 0x9E3779B97F4A7C15ULL;
+	DWORD Index = static_cast<DWORD>(Hash >> 32) & (CONFLATION_SLOT_COUNT - 1);
+
+	PPOEDBG_CONFLATION_SLOT Slot = &_g_ConflationSlots[Index];
+
+	while (Slot->bIsUsed && (Slot->Key != Key || Slot->Id != Id || Slot->Direction != Direction))
+	{
+		Index = (Index + 1) & (CONFLATION_SLOT_COUNT - 1);
+		Slot = &_g_ConflationSlots[Index];
+	}
+
+	PPOEDBG_CONFLATION_STATS Stats = &_g_ConflationStats[Direction][Id];
+
+	if (Length > CONFLATION_PAYLOAD_MAXIMUM)
+	{
+		// The packet goes out now, so whatever is held for its key is older
+		// and mustn't follow it at the next flush. Taking the slot out of the
+		// table would break the probe for keys after it, so it is marked
+		// stale instead.
+		if (Slot->bIsUsed && !Slot->bIsStale)
+		{
+			Slot->bIsStale = true;
+			Stats->Overwritten++;
+		}
+
+		return false;
+	}
+
+	if (Slot->bIsUsed)
+	{
+		if (!Slot->bIsStale)
+		{
+			Stats->Overwritten++;
+		}
+
+		Slot->bIsStale = false;
+	}
+	else
+	{
+		// The table is only flushed once the game is running again, so until
+		// then new keys go straight through. None of them has an older packet
+		// held that it could overtake.
+		if (_g_ConflationCount >= CONFLATION_SLOT_LIMIT)
+		{
+			return false;
+		}
+
+		if (0 == _g_ConflationCount)
+		{
+			_g_ConflationDeadline = Timestamp + static_cast<DWORD64>(_g_ConflationInterval) * 1000000;
+		}
+
+		_g_ConflationOrder[_g_ConflationCount++] = Index;
+
+		Slot->Key = Key;
+		Slot->Direction = static_cast<BYTE>(Direction);
+		Slot->Id = Id;
+		Slot->bIsUsed = true;
+	}
+
+	Stats->Packets++;
+
+	Slot->Timestamp = Timestamp;
+	Slot->Sequence = Sequence;
+	Slot->Length = Length;
+	Slot->OriginalLength = OriginalLength;
+	Slot->Source = Source;
+	memcpy(Slot->Data, Data, Length);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Control Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Sets the conflation rule for the given ID, or stops conflating it if Rule is
+NULL. Packets already held for it are still delivered at the next flush.
+*/
+inline POEDBG_STATUS _PoeDbgConflationSetRule(const int Direction, const int Id, const PPOEDBG_CONFLATION_RULE Rule)
+{
+	if (NULL != Rule && (Rule->KeyLength > CONFLATION_KEY_MAXIMUM || static_cast<DWORD>(Rule->KeyOffset) + Rule->KeyLength > CONFLATION_PAYLOAD_MAXIMUM))
+	{
+		return POEDBG_STATUS_CONFLATION_INVALID;
+	}
+
+	AcquireSRWLockExclusive(&_g_ConflationLock);
+
+	if (NULL != Rule && NULL == _g_ConflationSlots)
+	{
+		SIZE_T SlotsSize = sizeof(POEDBG_CONFLATION_SLOT) * CONFLATION_SLOT_COUNT;
+		PBYTE Data = reinterpret_cast<PBYTE>(VirtualAlloc(NULL, SlotsSize + sizeof(DWORD) * CONFLATION_SLOT_COUNT, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+		if (NULL == Data)
+		{
+			ReleaseSRWLockExclusive(&_g_ConflationLock);
+			return POEDBG_STATUS_CONFLATION_ALLOCATION_FAILED;
+		}
+
+		// The memory starts out zeroed, so every slot is free.
+		_g_ConflationOrder = reinterpret_cast<PDWORD>(Data + SlotsSize);
+		_g_ConflationSlots = reinterpret_cast<PPOEDBG_CONFLATION_SLOT>(Data);
+	}
+
+	// The debug loop may pick up the new key part way through being changed,
+	// which at worst holds a packet or two under a key of neither rule.
+	if (NULL != Rule)
+	{
+		_g_ConflationRules[Direction][Id].KeyOffset = Rule->KeyOffset;
+		_g_ConflationRules[Direction][Id].KeyLength = Rule->KeyLength;
+	}
+
+	_g_bIsConflated[Direction][Id] = (NULL != Rule);
+
+	bool bIsActive = false;
+
+	for (int i = 0; i < PACKET_ID_COUNT; i++)
+	{
+		if (_g_bIsConflated[Direction][i])
+		{
+			bIsActive = true;
+		}
+	}
+
+	_g_bIsConflationActive[Direction] = bIsActive;
+
+	ReleaseSRWLockExclusive(&_g_ConflationLock);
+
+	return POEDBG_STATUS_SUCCESS;
+}
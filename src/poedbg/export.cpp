@@ -3,8 +3,24 @@
 #include "common.h"
 #include "globals.h"
 #include "callbacks.h"
+#include "platform.hpp"
 #include "security.hpp"
+#include "clock.hpp"
+#include "loop.hpp"
 #include "memory.hpp"
+#include "module.hpp"
+#include "trace.hpp"
+#include "filter.hpp"
+#include "stream.hpp"
+#include "format.hpp"
+#include "queue.hpp"
+#include "pcapng.hpp"
+#include "pipeline.hpp"
+#include "conflate.hpp"
+#include "stats.hpp"
+#include "watch.hpp"
+#include "capture.hpp"
+#include "subscribers.hpp"
 #include "game.hpp"
 
 //////////////////////////////////////////////////////////////////////////
@@ -20,6 +36,9 @@ POEDBG_EXPORT PoeDbgInitialize()
 	POEDBG_RETURN_STATUS_ON_FAILURE(_PoeDbgSecurityGetPrivileges());
 	POEDBG_RETURN_STATUS_ON_FAILURE(_PoeDbgSecurityChangePrivileges());
 
+	// Calibrate the clock before anything can be timestamped.
+	_PoeDbgClockInitialize();
+
 	// Try to get the PID of the game.
 	_g_GameId = _PoeDbgSecurityGetGameId(GAME_PROCESS_NAME);
 
@@ -57,35 +76,857 @@ POEDBG_EXPORT PoeDbgDestroy()
 		return POEDBG_STATUS_GAME_NOT_FOUND;
 	}
 
-	// Remove hooks.
-	_PoeDbgMemoryModifyGlobalBreakpoint(NULL, 0, 0, 0, false);
-	_PoeDbgMemoryModifyGlobalBreakpoint(NULL, 0, 0, 1, false);
-	_PoeDbgMemoryModifyGlobalBreakpoint(NULL, 0, 0, 2, false);
+	// Remove hooks, watchpoints and capture points from every thread in one
+	// pass.
+	for (USHORT Index = 0; Index < BP_SLOT_COUNT; Index++)
+	{
+		_g_Watchpoints[Index].bIsActive = false;
+		_g_CapturePoints[Index].bIsActive = false;
+		_PoeDbgMemoryClearBreakpoint(Index);
+	}
+
+	_PoeDbgMemoryApplyBreakpointsToAll();
+
+	// Stop the debugger, which also releases the game handle.
+	_PoeDbgPlatformDetach(_g_GameId);
+
+	// The thread handles belonged to the debugger.
+	AcquireSRWLockExclusive(&_g_GameThreadsLock);
+	_g_GameThreads.clear();
+	ReleaseSRWLockExclusive(&_g_GameThreadsLock);
+
+	// Let queue readers know that no more packets are coming.
+	_PoeDbgQueueClose();
+
+	// Finish writing any capture file.
+	_PoeDbgPcapngStop();
+
+	// Let the pipeline finish with the packets it already has.
+	_PoeDbgPipelineStop();
+
+	// Stop tracing, which writes the trace out if it was started with a path.
+	_PoeDbgTraceStop();
+
+	// Free our code copy, or unmap the game executable, and forget the
+	// game's modules.
+	AcquireSRWLockExclusive(&_g_GameModulesLock);
+	_PoeDbgMemoryReleaseCache();
+	ReleaseSRWLockExclusive(&_g_GameModulesLock);
+
+	_PoeDbgModuleReset();
+
+	// Reset pointers, etc.
+	_g_GameBaseAddress = NULL;
+
+	// Reset state.
+	_g_bIsSteamClient = false;
+	_g_bIsGameHooked = false;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Sets where the game's code is searched for the hook signatures, which is
+either a copy of the game's code or the game's executable file. Searching the
+file avoids copying the code out of the game, and any signature found in it is
+checked against the game before it is used. This must be called before
+PoeDbgInitialize to take effect.
+*/
+POEDBG_EXPORT PoeDbgSetSignatureSource(int Source)
+{
+	if (POEDBG_SIGNATURE_SOURCE_GAME != Source && POEDBG_SIGNATURE_SOURCE_FILE != Source)
+	{
+		return POEDBG_STATUS_SIGNATURE_SOURCE_INVALID;
+	}
+
+	_g_SignatureSource = Source;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Finds the first instance of a signature in a module loaded in the game, and
+returns its address in the game. A NULL module name searches the game's own
+image. Modules are only copied out of the game the first time a signature is
+searched for in them, and results are cached, so searching again is cheap.
+*/
+POEDBG_EXPORT PoeDbgFindPattern(const wchar_t* ModuleName, PBYTE Pattern, PDWORD64 Address)
+{
+	if (NULL == Pattern || NULL == Address)
+	{
+		return POEDBG_STATUS_PATTERN_NOT_FOUND;
+	}
+
+	*Address = NULL;
+
+	if (NULL == _g_GameBaseAddress)
+	{
+		return POEDBG_STATUS_GAME_NOT_FOUND;
+	}
+
+	ULONG_PTR FoundAddress = NULL;
+	POEDBG_STATUS Status = _PoeDbgModuleFindPattern(ModuleName, Pattern, &FoundAddress);
+
+	*Address = FoundAddress;
+
+	return Status;
+}
+
+/*
+Finds the module loaded in the game that contains the given address, and
+retrieves its base, size and file name. Any of the outputs may be NULL.
+*/
+POEDBG_EXPORT PoeDbgGetModuleByAddress(DWORD64 Address, PDWORD64 Base, PDWORD64 Size, wchar_t* Name, DWORD NameLength)
+{
+	POEDBG_STATUS Status = POEDBG_STATUS_SUCCESS;
+
+	AcquireSRWLockShared(&_g_GameModulesLock);
+
+	PPOEDBG_MODULE Module = _PoeDbgModuleFindByAddress(static_cast<ULONG_PTR>(Address));
+
+	if (NULL == Module)
+	{
+		Status = POEDBG_STATUS_MODULE_NOT_FOUND;
+	}
+	else
+	{
+		if (NULL != Base)
+		{
+			*Base = Module->Base;
+		}
+
+		if (NULL != Size)
+		{
+			*Size = Module->Size;
+		}
+
+		if (NULL != Name && !_PoeDbgModuleCopyName(Name, Module->Name, NameLength))
+		{
+			Status = POEDBG_STATUS_BUFFER_TOO_SMALL;
+		}
+	}
+
+	ReleaseSRWLockShared(&_g_GameModulesLock);
+
+	return Status;
+}
+
+/*
+Sets the packet filter for the given direction. The filter is an array of 256
+entries indexed by packet ID, and packets whose entry is non-zero are dropped
+before their payload is copied from the game. Passing NULL clears the filter.
+*/
+POEDBG_EXPORT PoeDbgSetPacketFilter(int Direction, PBYTE Filter)
+{
+	if (Direction < 0 || Direction >= POEDBG_DIRECTION_COUNT)
+	{
+		return POEDBG_STATUS_DIRECTION_INVALID;
+	}
+
+	bool bIsActive = false;
+
+	for (int Id = 0; Id < PACKET_ID_COUNT; Id++)
+	{
+		_g_PacketFilters[Direction][Id] = (NULL != Filter && 0 != Filter[Id]) ? 1 : 0;
+
+		if (0 != _g_PacketFilters[Direction][Id])
+		{
+			bIsActive = true;
+		}
+	}
+
+	_g_bIsPacketFilterActive[Direction] = bIsActive;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Sets the payload filter for packets with the given ID in the given direction,
+or for every packet with POEDBG_CAPTURE_ALL_IDS. The expression is compiled
+once, here, and packets it rejects are dropped on the debug loop before any
+consumer sees them. Passing NULL or an empty expression clears the filter.
+*/
+POEDBG_EXPORT PoeDbgSetPayloadFilter(int Direction, int Id, const char* Expression)
+{
+	if (Direction < 0 || Direction >= POEDBG_DIRECTION_COUNT)
+	{
+		return POEDBG_STATUS_DIRECTION_INVALID;
+	}
+
+	if (POEDBG_CAPTURE_ALL_IDS != Id && (Id < 0 || Id >= PACKET_ID_COUNT))
+	{
+		return POEDBG_STATUS_FILTER_INVALID;
+	}
+
+	DWORD Slot = (POEDBG_CAPTURE_ALL_IDS == Id) ? PACKET_ID_COUNT : static_cast<DWORD>(Id);
+
+	return _PoeDbgFilterSet(Direction, Slot, Expression);
+}
+
+/*
+Retrieves the number of packets that have been dropped by the packet filter
+or a payload filter for the given direction.
+*/
+POEDBG_EXPORT PoeDbgGetFilteredPacketCount(int Direction, PDWORD64 Count)
+{
+	if (Direction < 0 || Direction >= POEDBG_DIRECTION_COUNT)
+	{
+		return POEDBG_STATUS_DIRECTION_INVALID;
+	}
+
+	if (NULL != Count)
+	{
+		*Count = _g_PacketFilteredCount[Direction];
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Sets how packets with the given ID are captured in the given direction, or
+every ID with POEDBG_CAPTURE_ALL_IDS. Truncated packets keep the first
+Parameter bytes, which must cover the ID, and sampled packets keep one in
+every Parameter. The policy is applied before the payload is copied from the
+game, except for received messages when the receive stream is being framed.
+*/
+POEDBG_EXPORT PoeDbgSetCapturePolicy(int Direction, int Id, int Mode, DWORD Parameter)
+{
+	if (Direction < 0 || Direction >= POEDBG_DIRECTION_COUNT)
+	{
+		return POEDBG_STATUS_DIRECTION_INVALID;
+	}
+
+	if (POEDBG_CAPTURE_ALL_IDS != Id && (Id < 0 || Id >= PACKET_ID_COUNT))
+	{
+		return POEDBG_STATUS_CAPTURE_POLICY_INVALID;
+	}
+
+	switch (Mode)
+	{
+	case POEDBG_CAPTURE_FULL:
+	case POEDBG_CAPTURE_COUNT:
+		Parameter = 0;
+		break;
+	case POEDBG_CAPTURE_TRUNCATE:
+		if (Parameter < PACKET_ID_SIZE)
+		{
+			return POEDBG_STATUS_CAPTURE_POLICY_INVALID;
+		}
+		break;
+	case POEDBG_CAPTURE_SAMPLE:
+		if (0 == Parameter)
+		{
+			return POEDBG_STATUS_CAPTURE_POLICY_INVALID;
+		}
+		break;
+	default:
+		return POEDBG_STATUS_CAPTURE_POLICY_INVALID;
+	}
+
+	int FirstId = (POEDBG_CAPTURE_ALL_IDS == Id) ? 0 : Id;
+	int LastId = (POEDBG_CAPTURE_ALL_IDS == Id) ? (PACKET_ID_COUNT - 1) : Id;
+
+	for (int i = FirstId; i <= LastId; i++)
+	{
+		_g_CapturePolicies[Direction][i].Parameter = Parameter;
+		_g_CapturePolicies[Direction][i].Mode = static_cast<DWORD>(Mode);
+		_g_CaptureSampleCounts[Direction][i] = 0;
+	}
+
+	bool bIsActive = false;
+
+	for (int i = 0; i < PACKET_ID_COUNT; i++)
+	{
+		if (POEDBG_CAPTURE_FULL != _g_CapturePolicies[Direction][i].Mode)
+		{
+			bIsActive = true;
+		}
+	}
+
+	_g_bIsCapturePolicyActive[Direction] = bIsActive;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Sets how received messages with the given ID are framed. Once any rule has
+been set, data from both receive hooks is reassembled per connection and the
+receive callback is called once for every whole message. Passing NULL resets
+the ID to unknown framing, where a message runs to the end of the data read.
+*/
+POEDBG_EXPORT PoeDbgSetReceiveFrameRule(int Id, PPOEDBG_FRAME_RULE Rule)
+{
+	if (Id < 0 || Id >= PACKET_ID_COUNT)
+	{
+		return POEDBG_STATUS_FRAME_RULE_INVALID;
+	}
+
+	if (NULL != Rule)
+	{
+		switch (Rule->Type)
+		{
+		case POEDBG_FRAME_UNKNOWN:
+			break;
+		case POEDBG_FRAME_FIXED:
+			if (Rule->Size < PACKET_ID_SIZE || Rule->Size > DEFAULT_BUFFER_SIZE)
+			{
+				return POEDBG_STATUS_FRAME_RULE_INVALID;
+			}
+			break;
+		case POEDBG_FRAME_PREFIXED:
+			if (Rule->LengthSize < 1 || Rule->LengthSize > sizeof(DWORD) || Rule->LengthOffset < PACKET_ID_SIZE || Rule->Size > DEFAULT_BUFFER_SIZE)
+			{
+				return POEDBG_STATUS_FRAME_RULE_INVALID;
+			}
+			break;
+		default:
+			return POEDBG_STATUS_FRAME_RULE_INVALID;
+		}
+
+		_g_ReceiveFrameRules[Id] = *Rule;
+	}
+	else
+	{
+		_g_ReceiveFrameRules[Id] = { 0 };
+	}
+
+	bool bIsActive = false;
+
+	for (int i = 0; i < PACKET_ID_COUNT; i++)
+	{
+		if (POEDBG_FRAME_UNKNOWN != _g_ReceiveFrameRules[i].Type)
+		{
+			bIsActive = true;
+		}
+	}
+
+	_g_bIsStreamFramingActive = bIsActive;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Formats packet data as text in the given style. On input, OutputLength holds
+the size of the output buffer; on return it holds the exact size required,
+including the terminating null. If the output buffer is NULL or too small,
+nothing is written, so this can be called once to size the buffer.
+*/
+POEDBG_EXPORT PoeDbgFormatPacket(PBYTE Data, DWORD Length, int Style, PCHAR Output, PDWORD OutputLength)
+{
+	if (NULL == OutputLength || (NULL == Data && 0 != Length))
+	{
+		return POEDBG_STATUS_BUFFER_TOO_SMALL;
+	}
+
+	SIZE_T RequiredLength = _PoeDbgFormatGetRequiredLength(Style, Length);
+
+	if (0 == RequiredLength)
+	{
+		return POEDBG_STATUS_FORMAT_STYLE_INVALID;
+	}
+
+	if (RequiredLength > MAXDWORD)
+	{
+		return POEDBG_STATUS_BUFFER_TOO_SMALL;
+	}
+
+	DWORD OutputSize = *OutputLength;
+
+	// Always report the size required.
+	*OutputLength = static_cast<DWORD>(RequiredLength);
+
+	if (NULL == Output || OutputSize < RequiredLength)
+	{
+		return POEDBG_STATUS_BUFFER_TOO_SMALL;
+	}
+
+	_PoeDbgFormatPacket(Data, Length, Style, Output);
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Enables the packet queue, which keeps a copy of every captured packet until it
+is read with PoeDbgReadPackets. This lets consumers process packets on their
+own threads without holding up the game. The size of the queue is only used
+the first time it is enabled.
+*/
+POEDBG_EXPORT PoeDbgEnablePacketQueue(DWORD Size)
+{
+	if (Size > QUEUE_MAXIMUM_SIZE)
+	{
+		Size = QUEUE_MAXIMUM_SIZE;
+	}
+
+	return _PoeDbgQueueInitialize(Size);
+}
+
+/*
+Disables the packet queue. Readers will still receive anything already queued,
+after which PoeDbgReadPackets reports that the queue is not enabled.
+*/
+POEDBG_EXPORT PoeDbgDisablePacketQueue()
+{
+	_PoeDbgQueueClose();
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Reads as many whole packet records from the queue as fit into the buffer. Each
+record is a POEDBG_PACKET_RECORD header followed by the packet data, and the
+next record starts Size bytes after the current one. If the queue is empty,
+waits up to Timeout milliseconds for a packet. BytesRead is set to zero if
+none arrived, or to the required size if the buffer can't hold the next record.
+*/
+POEDBG_EXPORT PoeDbgReadPackets(PBYTE Buffer, DWORD BufferSize, PDWORD BytesRead, DWORD Timeout)
+{
+	if (NULL == BytesRead)
+	{
+		return POEDBG_STATUS_BUFFER_TOO_SMALL;
+	}
+
+	*BytesRead = 0;
+
+	if (NULL == _g_QueueBuffer)
+	{
+		return POEDBG_STATUS_QUEUE_NOT_ENABLED;
+	}
+
+	if (NULL == Buffer)
+	{
+		BufferSize = 0;
+	}
+
+	return _PoeDbgQueueRead(Buffer, BufferSize, BytesRead, Timeout);
+}
+
+/*
+Retrieves the number of packets that were dropped because the packet queue was
+full.
+*/
+POEDBG_EXPORT PoeDbgGetQueueDroppedCount(PDWORD64 Count)
+{
+	if (NULL != Count)
+	{
+		*Count = _g_QueueDroppedCount;
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Starts writing every captured packet to a pcapng file at the given path, which
+is replaced if it exists. Packets are written in large blocks by a background
+thread, so the debug loop never waits on the disk. If RotateSize or
+RotateSeconds is non-zero, a new file is started whenever the current one
+reaches that many bytes or has been open that long, and each file has a
+five digit index added before the extension of the path.
+*/
+POEDBG_EXPORT PoeDbgStartPcapng(const wchar_t* Path, DWORD64 RotateSize, DWORD RotateSeconds)
+{
+	if (NULL == Path)
+	{
+		return POEDBG_STATUS_PCAPNG_OPEN_FAILED;
+	}
+
+	return _PoeDbgPcapngStart(Path, RotateSize, RotateSeconds);
+}
+
+/*
+Stops writing packets to the pcapng file, and returns once everything captured
+so far has been written and the file is closed. Returns the last error the
+writer ran into, if any.
+*/
+POEDBG_EXPORT PoeDbgStopPcapng()
+{
+	return _PoeDbgPcapngStop();
+}
+
+/*
+Retrieves how much has been written to pcapng files since the writer was last
+started, and the last error the writer ran into, if any.
+*/
+POEDBG_EXPORT PoeDbgGetPcapngStats(PPOEDBG_PCAPNG_STATS Stats)
+{
+	if (NULL != Stats)
+	{
+		*Stats = _g_PcapngStats;
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Starts a pipeline of worker threads that each call WorkerCallback, a
+POEDBG_PIPELINE_WORKER_CALLBACK, for their share of the captured packets.
+Packets are sharded by the value KeyCallback returns for them, or by packet
+ID if it is NULL, so packets with the same key always go to the same worker
+and are seen in the order they were captured. Each worker has its own queue of
+QueueSize bytes, or a default size if zero, and packets that find it full are
+dropped and counted. If MergeCallback isn't NULL, it is called on a thread of
+its own with each packet's sequence number and what the worker callback
+returned for it, in the order the packets were captured.
+*/
+POEDBG_EXPORT PoeDbgStartPipeline(DWORD Workers, DWORD QueueSize, PVOID WorkerCallback, PVOID KeyCallback, PVOID MergeCallback)
+{
+	return _PoeDbgPipelineStart(Workers, QueueSize, WorkerCallback, KeyCallback, MergeCallback);
+}
+
+/*
+Stops the pipeline, and returns once every packet already given to it has been
+through the worker and merge callbacks. Must not be called from them.
+*/
+POEDBG_EXPORT PoeDbgStopPipeline()
+{
+	return _PoeDbgPipelineStop();
+}
+
+/*
+Retrieves how many packets have been given to the pipeline since it was last
+started, and how many were dropped.
+*/
+POEDBG_EXPORT PoeDbgGetPipelineStats(PPOEDBG_PIPELINE_STATS Stats)
+{
+	if (NULL != Stats)
+	{
+		*Stats = _g_PipelineStats;
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Conflates packets with the given ID in the given direction, or stops if Rule
+is NULL. Rather than being handed to consumers as they arrive, the packets are
+held in a table with only the latest kept for each key, and the table is
+flushed to consumers at the conflation interval. Flushed packets keep their
+own timestamps and sequence numbers, and packets with other IDs are delivered
+in order as usual. The capture file still records every packet.
+*/
+POEDBG_EXPORT PoeDbgSetConflationRule(int Direction, int Id, PPOEDBG_CONFLATION_RULE Rule)
+{
+	if (Direction < 0 || Direction >= POEDBG_DIRECTION_COUNT)
+	{
+		return POEDBG_STATUS_DIRECTION_INVALID;
+	}
+
+	if (Id < 0 || Id >= PACKET_ID_COUNT)
+	{
+		return POEDBG_STATUS_CONFLATION_INVALID;
+	}
+
+	return _PoeDbgConflationSetRule(Direction, Id, Rule);
+}
+
+/*
+Sets how long, in milliseconds, conflated packets may be held before they are
+flushed to consumers, counted from when the first of them arrives. The
+default is 100 milliseconds. Held packets are flushed by the debug loop, which
+stops waiting for the game's next debug event once they fall due.
+*/
+POEDBG_EXPORT PoeDbgSetConflationInterval(DWORD Milliseconds)
+{
+	if (0 == Milliseconds || Milliseconds > CONFLATION_INTERVAL_MAXIMUM)
+	{
+		return POEDBG_STATUS_CONFLATION_INVALID;
+	}
+
+	_g_ConflationInterval = Milliseconds;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Copies the conflation statistics for the given direction. Stats must have
+room for one entry per packet ID (256), and entry N describes packets with ID
+N. Packets that were held and not overwritten are delivered, or still held.
+*/
+POEDBG_EXPORT PoeDbgGetConflationStats(int Direction, PPOEDBG_CONFLATION_STATS Stats)
+{
+	if (Direction < 0 || Direction >= POEDBG_DIRECTION_COUNT)
+	{
+		return POEDBG_STATUS_DIRECTION_INVALID;
+	}
+
+	if (NULL == Stats)
+	{
+		return POEDBG_STATUS_BUFFER_TOO_SMALL;
+	}
+
+	memcpy(Stats, _g_ConflationStats[Direction], sizeof(_g_ConflationStats[Direction]));
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Sets how the debug loop waits for events, and how its thread is scheduled.
+In spin mode, the loop polls for the next event after each one, for up to a
+budget that adapts to the gaps between recent events, before it blocks. This
+picks up closely spaced events without the delay of waking the thread, at the
+cost of the processor time spent spinning. The loop applies the settings
+before it next waits for an event, and its statistics start again then.
+*/
+POEDBG_EXPORT PoeDbgSetLoopSettings(PPOEDBG_LOOP_SETTINGS Settings)
+{
+	return _PoeDbgLoopSetSettings(Settings);
+}
+
+/*
+Retrieves how the debug loop's events have been picked up since its settings
+were last applied, and how long it waited for them.
+*/
+POEDBG_EXPORT PoeDbgGetLoopStats(PPOEDBG_LOOP_STATS Stats)
+{
+	if (NULL == Stats)
+	{
+		return POEDBG_STATUS_BUFFER_TOO_SMALL;
+	}
+
+	_PoeDbgLoopSnapshot(Stats);
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Starts recording a timeline of what the engine spends its time on: each debug
+event, and the time the game spends stopped for it, each hook, every read of
+packet data, every packet handed to consumers, each continue, and the work of
+pipeline threads. Every thread records into a ring of its own holding Events
+spans, or a default number if it is zero, so only the most recent are kept.
+If Path is not NULL, the trace is written there as Chrome trace JSON when it
+is stopped, or when the engine is destroyed.
+*/
+POEDBG_EXPORT PoeDbgStartTrace(DWORD Events, const wchar_t* Path)
+{
+	return _PoeDbgTraceStart(Events, Path);
+}
+
+/*
+Stops recording the trace, and writes it out if it was started with a path.
+What was recorded is kept until the next trace is started.
+*/
+POEDBG_EXPORT PoeDbgStopTrace()
+{
+	return _PoeDbgTraceStop();
+}
+
+/*
+Writes everything recorded so far to the given path as Chrome trace JSON, for
+Perfetto or chrome://tracing. The trace may still be running.
+*/
+POEDBG_EXPORT PoeDbgWriteTrace(const wchar_t* Path)
+{
+	if (NULL == Path)
+	{
+		return POEDBG_STATUS_TRACE_INVALID;
+	}
+
+	AcquireSRWLockExclusive(&_g_TraceLock);
+	POEDBG_STATUS Status = _PoeDbgTraceWrite(Path);
+	ReleaseSRWLockExclusive(&_g_TraceLock);
+
+	return Status;
+}
+
+/*
+Copies the traffic statistics for the given direction. Stats must have room
+for one entry per packet ID (256), and entry N describes packets with ID N.
+Only packets handed to consumers are counted; filtered packets are not.
+*/
+POEDBG_EXPORT PoeDbgGetTrafficStats(int Direction, PPOEDBG_TRAFFIC_STATS Stats)
+{
+	if (Direction < 0 || Direction >= POEDBG_DIRECTION_COUNT)
+	{
+		return POEDBG_STATUS_DIRECTION_INVALID;
+	}
+
+	if (NULL == Stats)
+	{
+		return POEDBG_STATUS_BUFFER_TOO_SMALL;
+	}
+
+	_PoeDbgStatsSnapshot(Direction, Stats);
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Watches the given address in the game with a free hardware breakpoint. Length
+may be 1, 2, 4 or 8 bytes and the address must be aligned to it. Condition is
+POEDBG_WATCH_WRITE or POEDBG_WATCH_READWRITE. Every hit is recorded as an
+event, to be collected with PoeDbgReadWatchEvents.
+*/
+POEDBG_EXPORT PoeDbgAddWatchpoint(ULONG_PTR Address, DWORD Length, int Condition, PDWORD Id)
+{
+	if (NULL == Id)
+	{
+		return POEDBG_STATUS_WATCHPOINT_INVALID;
+	}
+
+	if (!_g_bIsGameHooked)
+	{
+		// The hooks must have their slots before we can take one.
+		return POEDBG_STATUS_GAME_NOT_FOUND;
+	}
+
+	return _PoeDbgWatchAdd(Address, Length, Condition, Id);
+}
 
-	// Stop the debugger.
-	DebugActiveProcessStop(_g_GameId);
+/*
+Removes the watchpoint with the given ID. Events already recorded for it can
+still be read.
+*/
+POEDBG_EXPORT PoeDbgRemoveWatchpoint(DWORD Id)
+{
+	return _PoeDbgWatchRemove(Id);
+}
 
-	if (NULL != _g_GameHandle)
+/*
+Adds a capture point at Offset bytes from the first instance of a signature in
+the given module, or in the game's own image if the module name is NULL, using
+a free hardware breakpoint. Whenever a game thread reaches it, the registers
+and memory named by the recipe are captured and handed to the capture point
+callback. The thread then carries on with the instruction it stopped at, or
+skips ResumeBytes bytes of instructions if that isn't zero, which is only safe
+for instructions the game can do without.
+*/
+POEDBG_EXPORT PoeDbgAddCapturePoint(const wchar_t* ModuleName, PBYTE Pattern, DWORD Offset, DWORD ResumeBytes, PPOEDBG_CAPTURE_RECIPE Recipe, PDWORD Id)
+{
+	if (NULL == Pattern || NULL == Recipe || NULL == Id)
 	{
-		// Release game handle.
-		CloseHandle(_g_GameHandle);
+		return POEDBG_STATUS_CAPTURE_POINT_INVALID;
 	}
 
-	if (NULL != _g_GameCodeCopy)
+	if (!_g_bIsGameHooked)
 	{
-		// Free our code copy.
-		VirtualFree(reinterpret_cast<PVOID>(_g_GameCodeCopy), 0, MEM_FREE);
+		// A capture point takes whichever debug register is free, so it has
+		// to wait until the send and receive hooks have taken theirs.
+		return POEDBG_STATUS_GAME_NOT_FOUND;
+	}
+
+	ULONG_PTR Address = NULL;
 
-		// Reset pointers, etc.
-		_g_GameBaseAddress = NULL;
-		_g_GameCodeCopy = NULL;
-		_g_GameImageSize = NULL;
-		_g_GameBaseOfCode = NULL;
-		_g_GameSizeOfCode = NULL;
+	POEDBG_RETURN_STATUS_ON_FAILURE(_PoeDbgModuleFindPattern(ModuleName, Pattern, &Address));
+
+	return _PoeDbgCaptureAdd(Address + Offset, ResumeBytes, Recipe, Id);
+}
+
+/*
+Removes the capture point with the given ID.
+*/
+POEDBG_EXPORT PoeDbgRemoveCapturePoint(DWORD Id)
+{
+	return _PoeDbgCaptureRemove(Id);
+}
+
+/*
+Copies up to Capacity of the oldest watchpoint events into the given array and
+sets Count to the number copied. This never waits, so it is meant to be
+polled. If Dropped isn't NULL, it is set to the number of events lost because
+they weren't read in time.
+*/
+POEDBG_EXPORT PoeDbgReadWatchEvents(PPOEDBG_WATCH_EVENT Events, DWORD Capacity, PDWORD Count, PDWORD64 Dropped)
+{
+	if (NULL == Count || (NULL == Events && 0 != Capacity))
+	{
+		return POEDBG_STATUS_BUFFER_TOO_SMALL;
+	}
 
-		// Reset state.
-		_g_bIsGameInformationCaptured = false;
-		_g_bIsSteamClient = false;
+	_PoeDbgWatchRead(Events, Capacity, Count);
+
+	if (NULL != Dropped)
+	{
+		*Dropped = _g_WatchEventDroppedCount;
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Adds a packet callback for the given direction, alongside any others. If
+Filter isn't NULL, it is an array of 256 entries indexed by packet ID, and
+packets whose entry is non-zero are not delivered to this callback. Callbacks
+can be added and removed at any time, including from inside a callback.
+*/
+POEDBG_EXPORT PoeDbgAddPacketSubscriber(int Direction, PVOID Callback, PBYTE Filter, PDWORD Id)
+{
+	if (Direction < 0 || Direction >= POEDBG_DIRECTION_COUNT)
+	{
+		return POEDBG_STATUS_DIRECTION_INVALID;
+	}
+
+	if (NULL == Callback || NULL == Id)
+	{
+		return POEDBG_STATUS_CALLBACK_NOT_SUPPORTED;
+	}
+
+	return _PoeDbgSubscribersAdd(Direction, Callback, false, Filter, Id);
+}
+
+/*
+Adds a packet callback in the same way as PoeDbgAddPacketSubscriber, except
+that the callback is a POEDBG_PACKET_EX_CALLBACK and is also given the time
+the packet was captured.
+*/
+POEDBG_EXPORT PoeDbgAddPacketSubscriberEx(int Direction, PVOID Callback, PBYTE Filter, PDWORD Id)
+{
+	if (Direction < 0 || Direction >= POEDBG_DIRECTION_COUNT)
+	{
+		return POEDBG_STATUS_DIRECTION_INVALID;
+	}
+
+	if (NULL == Callback || NULL == Id)
+	{
+		return POEDBG_STATUS_CALLBACK_NOT_SUPPORTED;
+	}
+
+	return _PoeDbgSubscribersAdd(Direction, Callback, true, Filter, Id);
+}
+
+/*
+Removes the packet callback with the given ID. Once this returns the callback
+won't be called again, except to finish a call that is removing itself.
+*/
+POEDBG_EXPORT PoeDbgRemovePacketSubscriber(DWORD Id)
+{
+	return _PoeDbgSubscribersRemove(Id);
+}
+
+/*
+Retrieves the current time on the same clock as packet and watchpoint
+timestamps, which count nanoseconds from when PoeDbgInitialize was called.
+*/
+POEDBG_EXPORT PoeDbgGetTimestamp(PDWORD64 Timestamp)
+{
+	if (0 == _g_ClockMultiplier)
+	{
+		return POEDBG_STATUS_CLOCK_NOT_INITIALIZED;
+	}
+
+	if (NULL != Timestamp)
+	{
+		*Timestamp = _PoeDbgClockNow();
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Converts a timestamp into the wall-clock time it was taken at, in FILETIME
+units (100 nanosecond intervals since January 1, 1601 UTC). The clock is not
+adjusted afterwards, so this drifts from the system time as the engine runs.
+*/
+POEDBG_EXPORT PoeDbgTimestampToSystemTime(DWORD64 Timestamp, PDWORD64 SystemTime)
+{
+	if (0 == _g_ClockMultiplier)
+	{
+		return POEDBG_STATUS_CLOCK_NOT_INITIALIZED;
+	}
+
+	if (NULL != SystemTime)
+	{
+		*SystemTime = _g_ClockBaseSystemTime + (Timestamp / 100);
 	}
 
 	return POEDBG_STATUS_SUCCESS;
@@ -97,3 +938,7 @@ POEDBG_EXPORT PoeDbgDestroy()
 POEDBG_CREATE_CALLBACK_EXPORTS(Error, POEDBG_ERROR_CALLBACK)
 POEDBG_CREATE_CALLBACK_EXPORTS(PacketSend, POEDBG_PACKET_CALLBACK)
 POEDBG_CREATE_CALLBACK_EXPORTS(PacketReceive, POEDBG_PACKET_CALLBACK)
+POEDBG_CREATE_CALLBACK_EXPORTS(PacketSendEx, POEDBG_PACKET_EX_CALLBACK)
+POEDBG_CREATE_CALLBACK_EXPORTS(PacketReceiveEx, POEDBG_PACKET_EX_CALLBACK)
+POEDBG_CREATE_CALLBACK_EXPORTS(PacketEvent, POEDBG_PACKET_EVENT_CALLBACK)
+POEDBG_CREATE_CALLBACK_EXPORTS(CapturePoint, POEDBG_CAPTURE_POINT_CALLBACK)
@@ -0,0 +1,675 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Filter instructions. Tests set the result, NOT flips it, and the jumps skip
+// the rest of an AND or OR once its result is known.
+#define FILTER_OP_LENGTH 0
+#define FILTER_OP_FIELD 1
+#define FILTER_OP_BYTES 2
+#define FILTER_OP_NOT 3
+#define FILTER_OP_JUMP_IF_FALSE 4
+#define FILTER_OP_JUMP_IF_TRUE 5
+
+// Filter comparisons.
+#define FILTER_COMPARE_EQUAL 0
+#define FILTER_COMPARE_NOT_EQUAL 1
+#define FILTER_COMPARE_LESS 2
+#define FILTER_COMPARE_LESS_EQUAL 3
+#define FILTER_COMPARE_GREATER 4
+#define FILTER_COMPARE_GREATER_EQUAL 5
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+// State of a filter expression being compiled.
+typedef struct _POEDBG_FILTER_PARSER
+{
+	const char* Cursor;
+	PPOEDBG_FILTER_PROGRAM Program;
+	DWORD Depth;
+} POEDBG_FILTER_PARSER, *PPOEDBG_FILTER_PARSER;
+
+//////////////////////////////////////////////////////////////////////////
+// Compiler Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Skips any whitespace at the cursor.
+*/
+POEDBG_INLINE void _PoeDbgFilterSkipSpace(PPOEDBG_FILTER_PARSER Parser)
+{
+	while (' ' == Parser->Cursor[0] || '\t' == Parser->Cursor[0] || '\r' == Parser->Cursor[0] || '\n' == Parser->Cursor[0])
+	{
+		Parser->Cursor++;
+	}
+}
+
+/*
+Moves past the given token if it is next, and returns whether it was.
+*/
+POEDBG_INLINE bool _PoeDbgFilterAccept(PPOEDBG_FILTER_PARSER Parser, const char* Token)
+{
+	_PoeDbgFilterSkipSpace(Parser);
+
+	SIZE_T Length = strlen(Token);
+
+	if (0 != strncmp(Parser->Cursor, Token, Length))
+	{
+		return false;
+	}
+
+	Parser->Cursor += Length;
+
+	return true;
+}
+
+/*
+Returns the value of a hexadecimal digit, or -1.
+*/
+POEDBG_INLINE int _PoeDbgFilterHexDigit(const char Character)
+{
+	if (Character >= '0' && Character <= '9')
+	{
+		return Character - '0';
+	}
+
+	if (Character >= 'a' && Character <= 'f')
+	{
+		return Character - 'a' + 10;
+	}
+
+	if (Character >= 'A' && Character <= 'F')
+	{
+		return Character - 'A' + 10;
+	}
+
+	return -1;
+}
+
+/*
+Reads a number, in decimal or with a 0x prefix in hexadecimal.
+*/
+inline bool _PoeDbgFilterParseNumber(PPOEDBG_FILTER_PARSER Parser, PDWORD Number)
+{
+	_PoeDbgFilterSkipSpace(Parser);
+
+	DWORD64 Value = 0;
+	DWORD Base = 10;
+	const char* Start = Parser->Cursor;
+
+	if ('0' == Start[0] && ('x' == Start[1] || 'X' == Start[1]))
+	{
+		Base = 16;
+		Start += 2;
+	}
+
+	const char* Cursor = Start;
+
+	for (;; Cursor++)
+	{
+		int Digit = _PoeDbgFilterHexDigit(Cursor[0]);
+
+		if (Digit < 0 || static_cast<DWORD>(Digit) >= Base)
+		{
+			break;
+		}
+
+		Value = Value * Base + static_cast<DWORD>(Digit);
+
+		if (Value > MAXDWORD)
+		{
+			return false;
+		}
+	}
+
+	if (Cursor == Start)
+	{
+		return false;
+	}
+
+	Parser->Cursor = Cursor;
+	*Number = static_cast<DWORD>(Value);
+
+	return true;
+}
+
+/*
+Reads a comparison operator.
+*/
+inline bool _PoeDbgFilterParseCompare(PPOEDBG_FILTER_PARSER Parser, PBYTE Compare)
+{
+	// Longer operators first, so that "<=" isn't taken for "<".
+	static const struct
+	{
+		const char* Token;
+		BYTE Compare;
+	} Operators[] =
+	{
+		{ "==", FILTER_COMPARE_EQUAL },
+		{ "!=", FILTER_COMPARE_NOT_EQUAL },
+		{ "<=", FILTER_COMPARE_LESS_EQUAL },
+		{ ">=", FILTER_COMPARE_GREATER_EQUAL },
+		{ "<", FILTER_COMPARE_LESS },
+		{ ">", FILTER_COMPARE_GREATER },
+	};
+
+	for (const auto& Operator : Operators)
+	{
+		if (_PoeDbgFilterAccept(Parser, Operator.Token))
+		{
+			*Compare = Operator.Compare;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+Appends an instruction to the program, or returns NULL if it is full.
+*/
+POEDBG_INLINE PPOEDBG_FILTER_INSTRUCTION _PoeDbgFilterEmit(PPOEDBG_FILTER_PARSER Parser, const BYTE Opcode)
+{
+	if (Parser->Program->Count >= FILTER_INSTRUCTION_MAXIMUM)
+	{
+		return NULL;
+	}
+
+	PPOEDBG_FILTER_INSTRUCTION Instruction = &Parser->Program->Instructions[Parser->Program->Count++];
+
+	memset(Instruction, 0, sizeof(POEDBG_FILTER_INSTRUCTION));
+	Instruction->Opcode = Opcode;
+
+	return Instruction;
+}
+
+/*
+Reads the byte list of a byte test, in the same spirit as the signature
+syntax: "0a" must match exactly, "??" matches anything, and "&80" matches
+any byte with all of those bits set.
+*/
+inline bool _PoeDbgFilterParseBytes(PPOEDBG_FILTER_PARSER Parser, PPOEDBG_FILTER_INSTRUCTION Instruction)
+{
+	PPOEDBG_FILTER_PROGRAM Program = Parser->Program;
+
+	Instruction->Value = Program->ByteCount;
+
+	for (;;)
+	{
+		_PoeDbgFilterSkipSpace(Parser);
+
+		const char* Cursor = Parser->Cursor;
+		bool bIsMask = ('&' == Cursor[0] && '&' != Cursor[1]);
+
+		if (bIsMask)
+		{
+			Cursor++;
+		}
+
+		BYTE Value = 0;
+		BYTE Mask = 0xFF;
+
+		if ('?' == Cursor[0] && '?' == Cursor[1] && !bIsMask)
+		{
+			Mask = 0;
+		}
+		else if (_PoeDbgFilterHexDigit(Cursor[0]) >= 0 && _PoeDbgFilterHexDigit(Cursor[1]) >= 0 && _PoeDbgFilterHexDigit(Cursor[2]) < 0)
+		{
+			Value = static_cast<BYTE>((_PoeDbgFilterHexDigit(Cursor[0]) << 4) | _PoeDbgFilterHexDigit(Cursor[1]));
+			Mask = bIsMask ? Value : 0xFF;
+		}
+		else if (bIsMask)
+		{
+			return false;
+		}
+		else
+		{
+			break;
+		}
+
+		if (Program->ByteCount >= FILTER_BYTES_MAXIMUM)
+		{
+			return false;
+		}
+
+		Program->Values[Program->ByteCount] = Value;
+		Program->Masks[Program->ByteCount] = Mask;
+		Program->ByteCount++;
+
+		Parser->Cursor = Cursor + 2;
+	}
+
+	Instruction->Width = static_cast<BYTE>(Program->ByteCount - Instruction->Value);
+
+	return (0 != Instruction->Width);
+}
+
+/*
+Reads a single test:
+
+	len <op> N              the packet's length in the game
+	id <op> N               the packet ID
+	[offset] <op> N         the byte at the offset
+	[offset:width] <op> N   the big-endian field of 1, 2 or 4 bytes there
+	[...] & mask <op> N     either of the above, masked first
+	@offset bytes           bytes at the offset, such as "@3 0a ?? &80"
+
+Tests on bytes past the end of what was captured are false.
+*/
+inline bool _PoeDbgFilterParseTest(PPOEDBG_FILTER_PARSER Parser)
+{
+	_PoeDbgFilterSkipSpace(Parser);
+
+	if (_PoeDbgFilterAccept(Parser, "@"))
+	{
+		PPOEDBG_FILTER_INSTRUCTION Instruction = _PoeDbgFilterEmit(Parser, FILTER_OP_BYTES);
+
+		if (NULL == Instruction || !_PoeDbgFilterParseNumber(Parser, &Instruction->Offset))
+		{
+			return false;
+		}
+
+		// As for fields, no offset can reach past the largest packet.
+		if (Instruction->Offset > DEFAULT_BUFFER_SIZE)
+		{
+			return false;
+		}
+
+		return _PoeDbgFilterParseBytes(Parser, Instruction);
+	}
+
+	PPOEDBG_FILTER_INSTRUCTION Instruction = NULL;
+
+	if (_PoeDbgFilterAccept(Parser, "len"))
+	{
+		Instruction = _PoeDbgFilterEmit(Parser, FILTER_OP_LENGTH);
+
+		if (NULL == Instruction)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		Instruction = _PoeDbgFilterEmit(Parser, FILTER_OP_FIELD);
+
+		if (NULL == Instruction)
+		{
+			return false;
+		}
+
+		Instruction->Width = 1;
+		Instruction->Mask = MAXDWORD;
+
+		if (_PoeDbgFilterAccept(Parser, "id"))
+		{
+			Instruction->Offset = 1;
+		}
+		else
+		{
+			if (!_PoeDbgFilterAccept(Parser, "[") || !_PoeDbgFilterParseNumber(Parser, &Instruction->Offset))
+			{
+				return false;
+			}
+
+			if (_PoeDbgFilterAccept(Parser, ":"))
+			{
+				DWORD Width = 0;
+
+				if (!_PoeDbgFilterParseNumber(Parser, &Width) || (1 != Width && 2 != Width && 4 != Width))
+				{
+					return false;
+				}
+
+				Instruction->Width = static_cast<BYTE>(Width);
+			}
+
+			if (!_PoeDbgFilterAccept(Parser, "]"))
+			{
+				return false;
+			}
+		}
+
+		_PoeDbgFilterSkipSpace(Parser);
+
+		if ('&' == Parser->Cursor[0] && '&' != Parser->Cursor[1])
+		{
+			Parser->Cursor++;
+
+			if (!_PoeDbgFilterParseNumber(Parser, &Instruction->Mask))
+			{
+				return false;
+			}
+		}
+
+		// Offsets are kept small enough that adding the width can't wrap.
+		if (Instruction->Offset > DEFAULT_BUFFER_SIZE)
+		{
+			return false;
+		}
+	}
+
+	return (_PoeDbgFilterParseCompare(Parser, &Instruction->Compare) && _PoeDbgFilterParseNumber(Parser, &Instruction->Value));
+}
+
+inline bool _PoeDbgFilterParseOr(PPOEDBG_FILTER_PARSER Parser);
+
+/*
+Reads a test, a negated term, or a bracketed expression.
+*/
+inline bool _PoeDbgFilterParseTerm(PPOEDBG_FILTER_PARSER Parser)
+{
+	if (_PoeDbgFilterAccept(Parser, "!"))
+	{
+		if (++Parser->Depth > FILTER_DEPTH_MAXIMUM || !_PoeDbgFilterParseTerm(Parser))
+		{
+			return false;
+		}
+
+		Parser->Depth--;
+
+		return (NULL != _PoeDbgFilterEmit(Parser, FILTER_OP_NOT));
+	}
+
+	if (_PoeDbgFilterAccept(Parser, "("))
+	{
+		if (++Parser->Depth > FILTER_DEPTH_MAXIMUM || !_PoeDbgFilterParseOr(Parser) || !_PoeDbgFilterAccept(Parser, ")"))
+		{
+			return false;
+		}
+
+		Parser->Depth--;
+
+		return true;
+	}
+
+	return _PoeDbgFilterParseTest(Parser);
+}
+
+/*
+Reads terms joined by the given operator. Each term but the last is followed
+by a jump past the rest, taken once the result is known, and the jumps are
+pointed at the end once it is.
+*/
+inline bool _PoeDbgFilterParseChain(PPOEDBG_FILTER_PARSER Parser, const char* Operator, const BYTE JumpOpcode, bool (*ParseOperand)(PPOEDBG_FILTER_PARSER))
+{
+	DWORD First = Parser->Program->Count;
+
+	if (!ParseOperand(Parser))
+	{
+		return false;
+	}
+
+	while (_PoeDbgFilterAccept(Parser, Operator))
+	{
+		if (NULL == _PoeDbgFilterEmit(Parser, JumpOpcode) || !ParseOperand(Parser))
+		{
+			return false;
+		}
+	}
+
+	PPOEDBG_FILTER_PROGRAM Program = Parser->Program;
+
+	for (DWORD Index = First; Index < Program->Count; Index++)
+	{
+		PPOEDBG_FILTER_INSTRUCTION Instruction = &Program->Instructions[Index];
+
+		// Only jumps still without a target belong to this chain.
+		if (JumpOpcode == Instruction->Opcode && 0 == Instruction->Offset)
+		{
+			Instruction->Offset = Program->Count;
+		}
+	}
+
+	return true;
+}
+
+/*
+Reads terms joined by "&&".
+*/
+inline bool _PoeDbgFilterParseAnd(PPOEDBG_FILTER_PARSER Parser)
+{
+	return _PoeDbgFilterParseChain(Parser, "&&", FILTER_OP_JUMP_IF_FALSE, _PoeDbgFilterParseTerm);
+}
+
+/*
+Reads terms joined by "||".
+*/
+inline bool _PoeDbgFilterParseOr(PPOEDBG_FILTER_PARSER Parser)
+{
+	return _PoeDbgFilterParseChain(Parser, "||", FILTER_OP_JUMP_IF_TRUE, _PoeDbgFilterParseAnd);
+}
+
+/*
+Compiles a filter expression into a program. Tests are joined with "&&" and
+"||", negated with "!", and grouped with brackets, and "&&" binds tighter
+than "||". The whole expression must be used.
+*/
+inline POEDBG_STATUS _PoeDbgFilterCompile(const char* Expression, PPOEDBG_FILTER_PROGRAM Program)
+{
+	memset(Program, 0, sizeof(POEDBG_FILTER_PROGRAM));
+
+	POEDBG_FILTER_PARSER Parser = { Expression, Program, 0 };
+
+	if (!_PoeDbgFilterParseOr(&Parser))
+	{
+		return POEDBG_STATUS_FILTER_INVALID;
+	}
+
+	_PoeDbgFilterSkipSpace(&Parser);
+
+	return ('\0' == Parser.Cursor[0]) ? POEDBG_STATUS_SUCCESS : POEDBG_STATUS_FILTER_INVALID;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Evaluation Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Compares two values with the given comparison.
+*/
+POEDBG_INLINE bool _PoeDbgFilterCompare(const BYTE Compare, const DWORD Left, const DWORD Right)
+{
+	switch (Compare)
+	{
+	case FILTER_COMPARE_EQUAL:
+		return Left == Right;
+	case FILTER_COMPARE_NOT_EQUAL:
+		return Left != Right;
+	case FILTER_COMPARE_LESS:
+		return Left < Right;
+	case FILTER_COMPARE_LESS_EQUAL:
+		return Left <= Right;
+	case FILTER_COMPARE_GREATER:
+		return Left > Right;
+	default:
+		return Left >= Right;
+	}
+}
+
+/*
+Runs a program against a captured packet, and returns whether the packet
+passes. The program only ever moves forward, so it runs in at most one pass.
+*/
+inline bool _PoeDbgFilterRun(const POEDBG_FILTER_PROGRAM* Program, const BYTE* Data, const DWORD Length, const DWORD OriginalLength)
+{
+	bool bResult = true;
+	DWORD Index = 0;
+
+	while (Index < Program->Count)
+	{
+		const POEDBG_FILTER_INSTRUCTION* Instruction = &Program->Instructions[Index++];
+
+		switch (Instruction->Opcode)
+		{
+		case FILTER_OP_LENGTH:
+			bResult = _PoeDbgFilterCompare(Instruction->Compare, OriginalLength, Instruction->Value);
+			break;
+
+		case FILTER_OP_FIELD:
+		{
+			if (Instruction->Width > Length || Instruction->Offset > Length - Instruction->Width)
+			{
+				bResult = false;
+				break;
+			}
+
+			const BYTE* Field = Data + Instruction->Offset;
+			DWORD Value = Field[0];
+
+			for (DWORD Byte = 1; Byte < Instruction->Width; Byte++)
+			{
+				Value = (Value << 8) | Field[Byte];
+			}
+
+			bResult = _PoeDbgFilterCompare(Instruction->Compare, Value & Instruction->Mask, Instruction->Value);
+			break;
+		}
+
+		case FILTER_OP_BYTES:
+		{
+			if (Instruction->Width > Length || Instruction->Offset > Length - Instruction->Width)
+			{
+				bResult = false;
+				break;
+			}
+
+			const BYTE* Bytes = Data + Instruction->Offset;
+			const BYTE* Values = Program->Values + Instruction->Value;
+			const BYTE* Masks = Program->Masks + Instruction->Value;
+
+			bResult = true;
+
+			for (DWORD Byte = 0; Byte < Instruction->Width && bResult; Byte++)
+			{
+				bResult = ((Bytes[Byte] & Masks[Byte]) == Values[Byte]);
+			}
+
+			break;
+		}
+
+		case FILTER_OP_NOT:
+			bResult = !bResult;
+			break;
+
+		case FILTER_OP_JUMP_IF_FALSE:
+			if (!bResult)
+			{
+				Index = Instruction->Offset;
+			}
+			break;
+
+		case FILTER_OP_JUMP_IF_TRUE:
+			if (bResult)
+			{
+				Index = Instruction->Offset;
+			}
+			break;
+		}
+	}
+
+	return bResult;
+}
+
+/*
+Checks a captured packet against the payload filters for its direction: the
+one for every packet, then the one for its ID. Returns true if either
+rejects it, in which case it should be dropped. Runs on the debug loop.
+*/
+POEDBG_INLINE bool _PoeDbgFilterIsRejected(const int Direction, const BYTE Id, const BYTE* Data, const DWORD Length, const DWORD OriginalLength)
+{
+	// Mark the read with plain stores, which whoever replaces a filter reads
+	// after flushing every processor's write buffer.
+
+	_g_PayloadFilterReadSequence = _g_PayloadFilterReadSequence + 1;
+
+	const POEDBG_FILTER_PROGRAM* All = _g_PayloadFilters[Direction][PACKET_ID_COUNT];
+	const POEDBG_FILTER_PROGRAM* ForId = _g_PayloadFilters[Direction][Id];
+
+	bool bIsRejected = (NULL != All && !_PoeDbgFilterRun(All, Data, Length, OriginalLength)) ||
+		(NULL != ForId && !_PoeDbgFilterRun(ForId, Data, Length, OriginalLength));
+
+	_g_PayloadFilterReadSequence = _g_PayloadFilterReadSequence + 1;
+
+	return bIsRejected;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Control Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Sets the payload filter in the given slot, replacing and freeing any filter
+already there. A NULL or empty expression clears the slot.
+*/
+inline POEDBG_STATUS _PoeDbgFilterSet(const int Direction, const DWORD Slot, const char* Expression)
+{
+	PPOEDBG_FILTER_PROGRAM Program = NULL;
+
+	if (NULL != Expression && '\0' != Expression[0])
+	{
+		Program = reinterpret_cast<PPOEDBG_FILTER_PROGRAM>(HeapAlloc(GetProcessHeap(), 0, sizeof(POEDBG_FILTER_PROGRAM)));
+
+		if (NULL == Program)
+		{
+			return POEDBG_STATUS_FILTER_ALLOCATION_FAILED;
+		}
+
+		POEDBG_STATUS Status = _PoeDbgFilterCompile(Expression, Program);
+
+		if (POEDBG_FAILURE(Status))
+		{
+			HeapFree(GetProcessHeap(), 0, Program);
+			return Status;
+		}
+	}
+
+	AcquireSRWLockExclusive(&_g_PayloadFilterLock);
+
+	PPOEDBG_FILTER_PROGRAM Old = reinterpret_cast<PPOEDBG_FILTER_PROGRAM>(_InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&_g_PayloadFilters[Direction][Slot]), Program));
+
+	bool bIsActive = false;
+
+	for (DWORD Index = 0; Index < FILTER_SLOT_COUNT && !bIsActive; Index++)
+	{
+		bIsActive = (NULL != _g_PayloadFilters[Direction][Index]);
+	}
+
+	_g_bIsPayloadFilterActive[Direction] = bIsActive;
+
+	if (NULL != Old && GetCurrentThreadId() != _g_DebugThreadId)
+	{
+		// The debug loop may still be running the old filter, so make sure we
+		// see its marks, then wait for it to finish.
+
+		FlushProcessWriteBuffers();
+
+		LONG Sequence = _g_PayloadFilterReadSequence;
+
+		if (0 != (Sequence & 1))
+		{
+			while (Sequence == _g_PayloadFilterReadSequence)
+			{
+				Sleep(0);
+			}
+		}
+	}
+
+	// On the debug loop itself, we're inside a callback, and every filter has
+	// already been run for the packet.
+
+	ReleaseSRWLockExclusive(&_g_PayloadFilterLock);
+
+	if (NULL != Old)
+	{
+		HeapFree(GetProcessHeap(), 0, Old);
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
@@ -0,0 +1,444 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Instruction set levels for the formatter.
+#define FORMAT_LEVEL_UNKNOWN -1
+#define FORMAT_LEVEL_SCALAR 0
+#define FORMAT_LEVEL_SSSE3 1
+#define FORMAT_LEVEL_AVX2 2
+
+// Characters per input byte or line for each style.
+#define FORMAT_HEX_WIDTH 3
+#define FORMAT_XXD_LINE_BYTES 16
+#define FORMAT_XXD_LINE_OVERHEAD 52
+
+//////////////////////////////////////////////////////////////////////////
+// Globals
+//////////////////////////////////////////////////////////////////////////
+
+// Best instruction set level supported by this processor.
+__declspec(selectany) int _g_FormatLevel = FORMAT_LEVEL_UNKNOWN;
+
+// Lowercase hex digits, used as a lookup table by the nibble shuffles.
+__declspec(selectany) __declspec(align(16)) BYTE _g_FormatHexDigits[16] =
+{
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+/*
+Shuffle masks that spread 32 hex digits (two registers, A and B) out into the
+48 characters of the "xx xx " style. For each of the three output registers
+there is a mask for A, a mask for B and the spaces to OR into the gaps.
+*/
+__declspec(selectany) __declspec(align(16)) BYTE _g_FormatHexShuffle[3][3][16] =
+{
+	{
+		{ 0x00, 0x01, 0x80, 0x02, 0x03, 0x80, 0x04, 0x05, 0x80, 0x06, 0x07, 0x80, 0x08, 0x09, 0x80, 0x0a },
+		{ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+		{ 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00 }
+	},
+	{
+		{ 0x0b, 0x80, 0x0c, 0x0d, 0x80, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+		{ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x80, 0x02, 0x03, 0x80, 0x04, 0x05 },
+		{ 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00 }
+	},
+	{
+		{ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+		{ 0x80, 0x06, 0x07, 0x80, 0x08, 0x09, 0x80, 0x0a, 0x0b, 0x80, 0x0c, 0x0d, 0x80, 0x0e, 0x0f, 0x80 },
+		{ 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20, 0x00, 0x00, 0x20 }
+	}
+};
+
+/*
+Shuffle masks that spread 32 hex digits out into the 40 character "xxxx xxxx "
+groups of an xxd line. Only the first 8 bytes of the last register are used.
+*/
+__declspec(selectany) __declspec(align(16)) BYTE _g_FormatXxdShuffle[3][3][16] =
+{
+	{
+		{ 0x00, 0x01, 0x02, 0x03, 0x80, 0x04, 0x05, 0x06, 0x07, 0x80, 0x08, 0x09, 0x0a, 0x0b, 0x80, 0x0c },
+		{ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+		{ 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00 }
+	},
+	{
+		{ 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+		{ 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x80, 0x04, 0x05, 0x06, 0x07, 0x80, 0x08, 0x09 },
+		{ 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00 }
+	},
+	{
+		{ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+		{ 0x0a, 0x0b, 0x80, 0x0c, 0x0d, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+		{ 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }
+	}
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Format Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Works out the best instruction set the formatter can use on this processor.
+The result is cached after the first call.
+*/
+POEDBG_INLINE int _PoeDbgFormatGetLevel()
+{
+	if (FORMAT_LEVEL_UNKNOWN != _g_FormatLevel)
+	{
+		return _g_FormatLevel;
+	}
+
+	int Level = FORMAT_LEVEL_SCALAR;
+	int Info[4] = { 0 };
+
+	__cpuid(Info, 0);
+
+	int MaximumLeaf = Info[0];
+
+	__cpuid(Info, 1);
+
+	if (0 != (Info[2] & (1 << 9)))
+	{
+		Level = FORMAT_LEVEL_SSSE3;
+	}
+
+	// AVX2 also requires that the OS saves the upper halves of the registers,
+	// which is the case when OSXSAVE is set and XCR0 enables SSE and AVX state.
+
+	if (MaximumLeaf >= 7 && 0 != (Info[2] & (1 << 27)) && 0 != (Info[2] & (1 << 28)) && 6 == (_xgetbv(0) & 6))
+	{
+		__cpuidex(Info, 7, 0);
+
+		if (0 != (Info[1] & (1 << 5)))
+		{
+			Level = FORMAT_LEVEL_AVX2;
+		}
+	}
+
+	_g_FormatLevel = Level;
+	return Level;
+}
+
+/*
+Calculates the exact number of characters, including the terminating null,
+that formatting the given number of bytes in the given style will produce.
+Returns zero if the style is not valid.
+*/
+POEDBG_INLINE SIZE_T _PoeDbgFormatGetRequiredLength(const int Style, const SIZE_T Length)
+{
+	switch (Style)
+	{
+	case POEDBG_FORMAT_HEX:
+		return (Length * FORMAT_HEX_WIDTH) + 1;
+	case POEDBG_FORMAT_ASCII:
+		return Length + 1;
+	case POEDBG_FORMAT_XXD:
+	{
+		// Every line has a fixed overhead plus one ASCII character per byte,
+		// since the hex area is always padded out to full width.
+
+		SIZE_T Lines = (Length + FORMAT_XXD_LINE_BYTES - 1) / FORMAT_XXD_LINE_BYTES;
+		return (Lines * FORMAT_XXD_LINE_OVERHEAD) + Length + 1;
+	}
+	default:
+		return 0;
+	}
+}
+
+/*
+Turns 16 bytes into 32 hex digits using the nibble lookup shuffle. The digits
+for the first 8 bytes are returned in First and the rest in Second.
+*/
+POEDBG_TARGET_SSSE3 POEDBG_INLINE void _PoeDbgFormatNibbles(const __m128i Bytes, __m128i* First, __m128i* Second)
+{
+	__m128i Digits = _mm_load_si128(reinterpret_cast<const __m128i*>(_g_FormatHexDigits));
+	__m128i Mask = _mm_set1_epi8(0x0f);
+
+	__m128i High = _mm_shuffle_epi8(Digits, _mm_and_si128(_mm_srli_epi16(Bytes, 4), Mask));
+	__m128i Low = _mm_shuffle_epi8(Digits, _mm_and_si128(Bytes, Mask));
+
+	*First = _mm_unpacklo_epi8(High, Low);
+	*Second = _mm_unpackhi_epi8(High, Low);
+}
+
+/*
+Spreads two registers of hex digits into one output register using the given
+row of shuffle masks.
+*/
+POEDBG_TARGET_SSSE3 POEDBG_INLINE __m128i _PoeDbgFormatSpread(const __m128i First, const __m128i Second, BYTE Masks[3][16])
+{
+	__m128i FromFirst = _mm_shuffle_epi8(First, _mm_load_si128(reinterpret_cast<const __m128i*>(Masks[0])));
+	__m128i FromSecond = _mm_shuffle_epi8(Second, _mm_load_si128(reinterpret_cast<const __m128i*>(Masks[1])));
+	__m128i Spaces = _mm_load_si128(reinterpret_cast<const __m128i*>(Masks[2]));
+
+	return _mm_or_si128(_mm_or_si128(FromFirst, FromSecond), Spaces);
+}
+
+/*
+Replaces every byte that isn't printable ASCII with a '.'.
+*/
+POEDBG_INLINE __m128i _PoeDbgFormatPrintable(const __m128i Bytes)
+{
+	// Bytes of 0x80 and above are negative when compared as signed values, so
+	// they fail the first test along with the control characters.
+
+	__m128i Printable = _mm_and_si128(_mm_cmpgt_epi8(Bytes, _mm_set1_epi8(0x1f)), _mm_cmplt_epi8(Bytes, _mm_set1_epi8(0x7f)));
+
+	return _mm_or_si128(_mm_and_si128(Printable, Bytes), _mm_andnot_si128(Printable, _mm_set1_epi8('.')));
+}
+
+/*
+Formats bytes as "xx " triples, 32 bytes at a time. Returns the number of
+bytes that were formatted, which is always a multiple of 32.
+*/
+POEDBG_TARGET_AVX2 inline SIZE_T _PoeDbgFormatHexAvx2(const BYTE* Data, const SIZE_T Length, PCHAR Output)
+{
+	__m256i Digits = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(_g_FormatHexDigits)));
+	__m256i Mask = _mm256_set1_epi8(0x0f);
+
+	__m256i Masks[3][3];
+
+	for (int Row = 0; Row < 3; Row++)
+	{
+		for (int Column = 0; Column < 3; Column++)
+		{
+			Masks[Row][Column] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(_g_FormatHexShuffle[Row][Column])));
+		}
+	}
+
+	SIZE_T Offset = 0;
+
+	for (; Offset + 32 <= Length; Offset += 32)
+	{
+		__m256i Bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Data + Offset));
+
+		__m256i High = _mm256_shuffle_epi8(Digits, _mm256_and_si256(_mm256_srli_epi16(Bytes, 4), Mask));
+		__m256i Low = _mm256_shuffle_epi8(Digits, _mm256_and_si256(Bytes, Mask));
+
+		// Unpacking works within each 128-bit lane, so the low lane holds the
+		// digits for bytes 0-15 and the high lane the digits for bytes 16-31.
+
+		__m256i First = _mm256_unpacklo_epi8(High, Low);
+		__m256i Second = _mm256_unpackhi_epi8(High, Low);
+
+		PCHAR Line = Output + (Offset * FORMAT_HEX_WIDTH);
+
+		for (int Row = 0; Row < 3; Row++)
+		{
+			__m256i Spread = _mm256_or_si256(_mm256_or_si256(
+				_mm256_shuffle_epi8(First, Masks[Row][0]),
+				_mm256_shuffle_epi8(Second, Masks[Row][1])),
+				Masks[Row][2]);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(Line + (Row * 16)), _mm256_castsi256_si128(Spread));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(Line + 48 + (Row * 16)), _mm256_extracti128_si256(Spread, 1));
+		}
+	}
+
+	return Offset;
+}
+
+/*
+Formats bytes as "xx " triples, 16 bytes at a time. Returns the number of
+bytes that were formatted, which is always a multiple of 16.
+*/
+POEDBG_TARGET_SSSE3 inline SIZE_T _PoeDbgFormatHexSsse3(const BYTE* Data, const SIZE_T Length, PCHAR Output)
+{
+	SIZE_T Offset = 0;
+
+	for (; Offset + 16 <= Length; Offset += 16)
+	{
+		__m128i First;
+		__m128i Second;
+
+		_PoeDbgFormatNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Data + Offset)), &First, &Second);
+
+		PCHAR Line = Output + (Offset * FORMAT_HEX_WIDTH);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Line), _PoeDbgFormatSpread(First, Second, _g_FormatHexShuffle[0]));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Line + 16), _PoeDbgFormatSpread(First, Second, _g_FormatHexShuffle[1]));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Line + 32), _PoeDbgFormatSpread(First, Second, _g_FormatHexShuffle[2]));
+	}
+
+	return Offset;
+}
+
+/*
+Formats bytes as "xx " triples, the same as printing each with "%02x ".
+Returns the number of characters written.
+*/
+inline SIZE_T _PoeDbgFormatHex(const BYTE* Data, const SIZE_T Length, PCHAR Output)
+{
+	SIZE_T Offset = 0;
+
+	switch (_PoeDbgFormatGetLevel())
+	{
+	case FORMAT_LEVEL_AVX2:
+		Offset = _PoeDbgFormatHexAvx2(Data, Length, Output);
+		Offset += _PoeDbgFormatHexSsse3(Data + Offset, Length - Offset, Output + (Offset * FORMAT_HEX_WIDTH));
+		break;
+	case FORMAT_LEVEL_SSSE3:
+		Offset = _PoeDbgFormatHexSsse3(Data, Length, Output);
+		break;
+	default:
+		break;
+	}
+
+	// Finish whatever is left one byte at a time.
+
+	for (; Offset < Length; Offset++)
+	{
+		PCHAR Triple = Output + (Offset * FORMAT_HEX_WIDTH);
+
+		Triple[0] = _g_FormatHexDigits[Data[Offset] >> 4];
+		Triple[1] = _g_FormatHexDigits[Data[Offset] & 0x0f];
+		Triple[2] = ' ';
+	}
+
+	return Length * FORMAT_HEX_WIDTH;
+}
+
+/*
+Formats bytes as ASCII, replacing anything that isn't printable with a '.'.
+Returns the number of characters written.
+*/
+inline SIZE_T _PoeDbgFormatAscii(const BYTE* Data, const SIZE_T Length, PCHAR Output)
+{
+	SIZE_T Offset = 0;
+
+	// Only SSE2 is needed here, which every 64-bit processor has.
+
+	for (; Offset + 16 <= Length; Offset += 16)
+	{
+		__m128i Bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Data + Offset));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Output + Offset), _PoeDbgFormatPrintable(Bytes));
+	}
+
+	for (; Offset < Length; Offset++)
+	{
+		Output[Offset] = (Data[Offset] >= 0x20 && Data[Offset] < 0x7f) ? static_cast<CHAR>(Data[Offset]) : '.';
+	}
+
+	return Length;
+}
+
+/*
+Formats the hex and ASCII columns of a whole 'xxd' line of 16 bytes.
+*/
+POEDBG_TARGET_SSSE3 inline void _PoeDbgFormatXxdLineSsse3(const BYTE* Data, PCHAR Line)
+{
+	__m128i Bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Data));
+	__m128i First;
+	__m128i Second;
+
+	_PoeDbgFormatNibbles(Bytes, &First, &Second);
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(Line), _PoeDbgFormatSpread(First, Second, _g_FormatXxdShuffle[0]));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(Line + 16), _PoeDbgFormatSpread(First, Second, _g_FormatXxdShuffle[1]));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(Line + 32), _PoeDbgFormatSpread(First, Second, _g_FormatXxdShuffle[2]));
+
+	Line[40] = ' ';
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(Line + 41), _PoeDbgFormatPrintable(Bytes));
+}
+
+/*
+Formats bytes the same way as 'xxd', with an offset, eight groups of two bytes
+and the ASCII form on each line of 16 bytes. Returns the number of characters
+written.
+*/
+inline SIZE_T _PoeDbgFormatXxd(const BYTE* Data, const SIZE_T Length, PCHAR Output)
+{
+	bool bIsVectorized = (_PoeDbgFormatGetLevel() >= FORMAT_LEVEL_SSSE3);
+
+	PCHAR Line = Output;
+
+	for (SIZE_T Offset = 0; Offset < Length; Offset += FORMAT_XXD_LINE_BYTES)
+	{
+		SIZE_T LineLength = Length - Offset;
+
+		if (LineLength > FORMAT_XXD_LINE_BYTES)
+		{
+			LineLength = FORMAT_XXD_LINE_BYTES;
+		}
+
+		// Write the offset, e.g. "00000010: ".
+
+		for (int Digit = 0; Digit < 8; Digit++)
+		{
+			Line[Digit] = _g_FormatHexDigits[(Offset >> ((7 - Digit) * 4)) & 0x0f];
+		}
+
+		Line[8] = ':';
+		Line[9] = ' ';
+		Line += 10;
+
+		if (bIsVectorized && FORMAT_XXD_LINE_BYTES == LineLength)
+		{
+			_PoeDbgFormatXxdLineSsse3(Data + Offset, Line);
+		}
+		else
+		{
+			// Short lines are padded with spaces so the ASCII column lines up.
+
+			for (SIZE_T i = 0, j = 0; i < FORMAT_XXD_LINE_BYTES; i++)
+			{
+				if (i < LineLength)
+				{
+					Line[j++] = _g_FormatHexDigits[Data[Offset + i] >> 4];
+					Line[j++] = _g_FormatHexDigits[Data[Offset + i] & 0x0f];
+				}
+				else
+				{
+					Line[j++] = ' ';
+					Line[j++] = ' ';
+				}
+
+				if (1 == (i & 1))
+				{
+					Line[j++] = ' ';
+				}
+			}
+
+			Line[40] = ' ';
+
+			_PoeDbgFormatAscii(Data + Offset, LineLength, Line + 41);
+		}
+
+		Line += 41 + LineLength;
+		*Line++ = '\n';
+	}
+
+	return static_cast<SIZE_T>(Line - Output);
+}
+
+/*
+Formats the given bytes in the given style and null terminates the output. The
+output buffer must be at least as large as the required length.
+*/
+POEDBG_INLINE SIZE_T _PoeDbgFormatPacket(const BYTE* Data, const SIZE_T Length, const int Style, PCHAR Output)
+{
+	SIZE_T Written = 0;
+
+	switch (Style)
+	{
+	case POEDBG_FORMAT_HEX:
+		Written = _PoeDbgFormatHex(Data, Length, Output);
+		break;
+	case POEDBG_FORMAT_ASCII:
+		Written = _PoeDbgFormatAscii(Data, Length, Output);
+		break;
+	case POEDBG_FORMAT_XXD:
+		Written = _PoeDbgFormatXxd(Data, Length, Output);
+		break;
+	default:
+		break;
+	}
+
+	Output[Written] = '\0';
+	return Written;
+}
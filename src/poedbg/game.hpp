@@ -31,52 +31,335 @@ POEDBG_INLINE bool _PoeDbgGameSetHookProperties(PBYTE Signature, PULONG_PTR Hook
 	return true;
 }
 
+/*
+Checks whether the given packet ID has been filtered for the given direction. If
+so, the packet is counted and should be dropped without being copied.
+*/
+POEDBG_INLINE bool _PoeDbgGameIsPacketFiltered(const int Direction, const BYTE Id)
+{
+	if (0 == _g_PacketFilters[Direction][Id])
+	{
+		return false;
+	}
+
+	_g_PacketFilteredCount[Direction]++;
+	return true;
+}
+
+/*
+Decides how much of a packet to capture under the capture policy for its ID.
+Returns false if the packet isn't captured at all, in which case it is only
+counted in the traffic statistics.
+*/
+POEDBG_INLINE bool _PoeDbgGameGetCaptureLength(const int Direction, const BYTE Id, const DWORD Length, PDWORD CaptureLength)
+{
+	PPOEDBG_CAPTURE_POLICY Policy = &_g_CapturePolicies[Direction][Id];
+
+	*CaptureLength = Length;
+
+	switch (Policy->Mode)
+	{
+	case POEDBG_CAPTURE_TRUNCATE:
+		if (Length > Policy->Parameter)
+		{
+			*CaptureLength = Policy->Parameter;
+		}
+		return true;
+	case POEDBG_CAPTURE_SAMPLE:
+	{
+		// Count down to the next sampled packet, which saves a division.
+		PDWORD Count = &_g_CaptureSampleCounts[Direction][Id];
+
+		if (0 == *Count)
+		{
+			*Count = Policy->Parameter - 1;
+			return true;
+		}
+
+		(*Count)--;
+		break;
+	}
+	case POEDBG_CAPTURE_COUNT:
+		break;
+	default:
+		return true;
+	}
+
+	_PoeDbgStatsRecord(Direction, Id, Length);
+
+	return false;
+}
+
+/*
+Reads packet data from the game, timing the read if a trace is running.
+*/
+POEDBG_INLINE bool _PoeDbgGameReadPacket(const DWORD64 Address, PBYTE Buffer, const DWORD64 Size)
+{
+	DWORD64 Begin = _PoeDbgTraceBegin();
+
+	bool bIsRead = _PoeDbgMemoryRead(static_cast<ULONG_PTR>(Address), Buffer, static_cast<SIZE_T>(Size));
+
+	_PoeDbgTraceEnd(TRACE_RING_DEBUG, TRACE_SPAN_READ, Begin, static_cast<DWORD>(Size), 0, 0, 0, 0);
+
+	return bIsRead;
+}
+
 /*
 Copies packet data from the game depending on the given buffer and size. Will
-protect against buffer overflows.
+protect against buffer overflows. If a filter or capture policy is active for
+the direction, only the head of the packet (up to the end of its first page)
+is read before the ID is tested, so that filtered packets never have their
+payload copied, and truncated ones only as much of it as is kept. The number
+of bytes captured is returned in CaptureLength.
 */
-inline bool _PoeDbgGameCopyPacket(PBYTE LocalPacketBuffer, const DWORD64 PacketBuffer, const DWORD64 PacketLength)
+inline bool _PoeDbgGameCopyPacket(const int Direction, PBYTE LocalPacketBuffer, const DWORD64 PacketBuffer, const DWORD64 PacketLength, PDWORD CaptureLength)
 {
 	if (PacketLength > DEFAULT_BUFFER_SIZE)
 	{
 		return false;
 	}
 
-	if (!_PoeDbgMemoryRead(static_cast<ULONG_PTR>(PacketBuffer), LocalPacketBuffer, static_cast<SIZE_T>(PacketLength)))
+	*CaptureLength = static_cast<DWORD>(PacketLength);
+
+	// Is the ID needed before deciding how much of the packet to read?
+	bool bIsIdNeeded = (_g_bIsPacketFilterActive[Direction] || _g_bIsCapturePolicyActive[Direction]) && PacketLength >= PACKET_ID_SIZE;
+
+	// By default the whole packet is read at once.
+	DWORD64 HeadLength = PacketLength;
+
+	if (bIsIdNeeded)
+	{
+		// Read no further than the end of the page that holds the ID, which is
+		// cheap for the game and avoids reading a large payload we might drop.
+
+		DWORD64 PageRemaining = DEFAULT_PAGE_SIZE - (PacketBuffer & (DEFAULT_PAGE_SIZE - 1));
+
+		if (PageRemaining < PACKET_ID_SIZE)
+		{
+			PageRemaining += DEFAULT_PAGE_SIZE;
+		}
+
+		if (HeadLength > PageRemaining)
+		{
+			HeadLength = PageRemaining;
+		}
+	}
+
+	if (!_PoeDbgGameReadPacket(PacketBuffer, LocalPacketBuffer, HeadLength))
 	{
 		return false;
 	}
 
+	if (bIsIdNeeded)
+	{
+		if (_g_bIsPacketFilterActive[Direction] && _PoeDbgGameIsPacketFiltered(Direction, LocalPacketBuffer[1]))
+		{
+			return false;
+		}
+
+		if (_g_bIsCapturePolicyActive[Direction] && !_PoeDbgGameGetCaptureLength(Direction, LocalPacketBuffer[1], static_cast<DWORD>(PacketLength), CaptureLength))
+		{
+			return false;
+		}
+
+		if (HeadLength < *CaptureLength)
+		{
+			// Read the remainder of the packet now that we know we want it.
+			if (!_PoeDbgGameReadPacket(PacketBuffer + HeadLength, LocalPacketBuffer + HeadLength, *CaptureLength - HeadLength))
+			{
+				return false;
+			}
+		}
+	}
+
 	return true;
 }
 
 /*
-Actually sets the hooks for the given thread. This function assumes the
-handle provided has permissions to modify the thread context.
+Hands a numbered packet to its consumers: the packet queue and pipeline, if
+enabled, the registered callbacks for its direction, and any subscribers.
+This is also the routine held packets are flushed to, long after they
+arrived, so everything about the packet is passed in.
 */
-POEDBG_INLINE POEDBG_STATUS _PoeDbgGameSetHooksOnThread(const DWORD ThreadId, const HANDLE Thread)
+inline void _PoeDbgGameDeliverPacket(const int Direction, const BYTE Id, PBYTE Data, const DWORD Length, const DWORD OriginalLength, const DWORD64 Timestamp, const DWORD64 Sequence, const BYTE Source)
 {
-	// Save off thread handle.
-	_g_GameThreads[ThreadId] = Thread;
+	if (_g_bIsQueueEnabled)
+	{
+		_PoeDbgQueuePush(Direction, Id, Data, Length, OriginalLength, Timestamp, Sequence, Source);
+	}
+
+	if (_g_bIsPipelineEnabled)
+	{
+		_PoeDbgPipelinePush(Direction, Id, Data, Length, OriginalLength, Timestamp, Sequence, Source);
+	}
+
+	// The registered callbacks and subscribers are user code, so their time
+	// is traced apart from the engine's own.
+	DWORD64 Begin = _PoeDbgTraceBegin();
+
+	POEDBG_NOTIFY_CALLBACK(PacketEvent, Direction, Length, OriginalLength, Id, Data, Timestamp, Sequence, Source);
+
+	if (POEDBG_DIRECTION_SEND == Direction)
+	{
+		POEDBG_NOTIFY_CALLBACK(PacketSend, Length, Id, Data);
+		POEDBG_NOTIFY_CALLBACK(PacketSendEx, Length, Id, Data, Timestamp);
+	}
+	else
+	{
+		POEDBG_NOTIFY_CALLBACK(PacketReceive, Length, Id, Data);
+		POEDBG_NOTIFY_CALLBACK(PacketReceiveEx, Length, Id, Data, Timestamp);
+	}
+
+	_PoeDbgSubscribersNotify(Direction, Length, Id, Data, Timestamp);
 
-	if (!_PoeDbgMemorySetBreakpoint(Thread, _g_PacketSenderHookStart, BP_LENGTH_ONE, BP_CONDITION_EXECUTION, 0))
+	_PoeDbgTraceEnd(TRACE_RING_DEBUG, TRACE_SPAN_CALLBACK, Begin, Length, static_cast<BYTE>(Direction), Id, Source, Sequence);
+}
+
+/*
+Dispatches a captured packet. Every packet that passes the payload filters is
+counted in the traffic statistics, at its length in the game, given the next
+sequence number and written to the capture file, if one is open. It is then
+handed to its consumers, unless its ID is being conflated, in which case it
+is held back until the next flush. The consumers only see the bytes that were
+captured.
+*/
+inline void _PoeDbgGameDispatchPacket(const int Direction, PBYTE Data, const DWORD Length, const DWORD OriginalLength)
+{
+	BYTE Id = (Length >= PACKET_ID_SIZE) ? Data[1] : 0;
+
+	// Every packet from the same debug event shares its timestamp.
+	DWORD64 Timestamp = _g_EventTimestamp;
+
+	// Packets rejected by a payload filter are dropped here, before anything
+	// else sees them.
+	if (_g_bIsPayloadFilterActive[Direction] && _PoeDbgFilterIsRejected(Direction, Id, Data, Length, OriginalLength))
 	{
-		return POEDBG_STATUS_HOOK_SEND_FAILED;
+		_g_PacketFilteredCount[Direction]++;
+		return;
 	}
 
-	if (!_PoeDbgMemorySetBreakpoint(Thread, _g_PacketRecvHookStart, BP_LENGTH_ONE, BP_CONDITION_EXECUTION, 1))
+	_PoeDbgStatsRecord(Direction, Id, OriginalLength);
+
+	// Number the packet across both directions, so that everything it is
+	// handed to can be put back in order.
+	DWORD64 Sequence = ++_g_EventSequence;
+	BYTE Source = _g_EventSource;
+
+	DWORD64 Begin = _PoeDbgTraceBegin();
+
+	// The capture file is a record of the traffic, so it is never conflated.
+	if (_g_bIsPcapngEnabled)
 	{
-		return POEDBG_STATUS_HOOK_RECV_FAILED;
+		_PoeDbgPcapngWritePacket(Direction, Id, Data, Length, OriginalLength, Timestamp, Sequence, Source);
 	}
 
-	if (!_PoeDbgMemorySetBreakpoint(Thread, _g_PacketWsaRecvHookStart, BP_LENGTH_ONE, BP_CONDITION_EXECUTION, 2))
+	if (!_g_bIsConflationActive[Direction] || !_g_bIsConflated[Direction][Id] || !_PoeDbgConflationHold(Direction, Id, Data, Length, OriginalLength, Timestamp, Sequence, Source))
 	{
-		return POEDBG_STATUS_HOOK_WSARECV_FAILED;
+		_PoeDbgGameDeliverPacket(Direction, Id, Data, Length, OriginalLength, Timestamp, Sequence, Source);
+	}
+
+	_PoeDbgTraceEnd(TRACE_RING_DEBUG, TRACE_SPAN_DISPATCH, Begin, Length, static_cast<BYTE>(Direction), Id, Source, Sequence);
+}
+
+/*
+Forwards a single whole message from the receive stream to its consumers,
+unless its ID has been filtered. Its capture policy is applied here as well,
+though the message has already been copied from the game by then.
+*/
+inline void _PoeDbgGameNotifyReceive(PBYTE Data, DWORD Length)
+{
+	DWORD CaptureLength = Length;
+
+	if (Length >= PACKET_ID_SIZE)
+	{
+		if (_PoeDbgGameIsPacketFiltered(POEDBG_DIRECTION_RECEIVE, Data[1]))
+		{
+			return;
+		}
+
+		if (_g_bIsCapturePolicyActive[POEDBG_DIRECTION_RECEIVE] && !_PoeDbgGameGetCaptureLength(POEDBG_DIRECTION_RECEIVE, Data[1], Length, &CaptureLength))
+		{
+			return;
+		}
+	}
+
+	_PoeDbgGameDispatchPacket(POEDBG_DIRECTION_RECEIVE, Data, CaptureLength, Length);
+}
+
+/*
+Handles data received by either of the receive hooks. When the receive stream
+is being framed, the data is fed into the stream of the connection it arrived
+on so that the callback sees whole messages only. Otherwise it is forwarded
+as it is, exactly as it was read from the socket.
+*/
+inline void _PoeDbgGameReceivePacket(const DWORD64 Connection, PBYTE LocalPacketBuffer, const DWORD64 PacketBuffer, const DWORD64 PacketLength)
+{
+	if (_g_bIsStreamFramingActive)
+	{
+		// The filter can't be tested up front here, since a single read may
+		// hold many messages, so the whole chunk is always copied.
+
+		if (0 != PacketLength && PacketLength <= DEFAULT_BUFFER_SIZE && _PoeDbgGameReadPacket(PacketBuffer, LocalPacketBuffer, PacketLength))
+		{
+			_PoeDbgStreamProcess(Connection, LocalPacketBuffer, static_cast<DWORD>(PacketLength), _PoeDbgGameNotifyReceive);
+		}
+		else
+		{
+			// A read of nothing means the connection was closed, and a failed
+			// read, or one we couldn't copy, leaves a gap in the stream. Either
+			// way, whatever was carried over can't be completed.
+			_PoeDbgStreamRelease(Connection);
+		}
+
+		return;
+	}
+
+	DWORD CaptureLength = 0;
+
+	if (_PoeDbgGameCopyPacket(POEDBG_DIRECTION_RECEIVE, LocalPacketBuffer, PacketBuffer, PacketLength, &CaptureLength))
+	{
+		// Forward the packet to its consumers.
+		_PoeDbgGameDispatchPacket(POEDBG_DIRECTION_RECEIVE, LocalPacketBuffer, CaptureLength, static_cast<DWORD>(PacketLength));
+	}
+}
+
+/*
+Actually sets the hooks for the given thread. This function assumes the
+handle provided has permissions to modify the thread context. The whole
+breakpoint table is applied at once, so each thread costs a single pair of
+context reads and writes.
+*/
+POEDBG_INLINE POEDBG_STATUS _PoeDbgGameSetHooksOnThread(const DWORD ThreadId, const HANDLE Thread)
+{
+	// Save off thread handle.
+	AcquireSRWLockExclusive(&_g_GameThreadsLock);
+	_g_GameThreads[ThreadId] = Thread;
+	ReleaseSRWLockExclusive(&_g_GameThreadsLock);
+
+	// The game is stopped while we handle its debug events, so the thread
+	// doesn't need to be suspended.
+
+	if (!_PoeDbgMemoryApplyBreakpoints(Thread))
+	{
+		return POEDBG_STATUS_HOOK_THREAD_FAILED;
 	}
 
 	return POEDBG_STATUS_SUCCESS;
 }
 
+/*
+Forgets a thread that has exited. Its handle is closed by the system once the
+debug event is continued, so it must not be used again.
+*/
+POEDBG_INLINE DWORD _PoeDbgGameReleaseThread(const LPDEBUG_EVENT Event)
+{
+	AcquireSRWLockExclusive(&_g_GameThreadsLock);
+	_g_GameThreads.erase(Event->dwThreadId);
+	ReleaseSRWLockExclusive(&_g_GameThreadsLock);
+
+	return DBG_CONTINUE;
+}
+
 /*
 Initializes any game hacking logic, i.e. performs pattern scans, makes any
 required changes to the process to prepare for hooking. Actual hooks are
@@ -91,21 +374,47 @@ POEDBG_INLINE DWORD _PoeDbgGameInitializeProcess(const LPDEBUG_EVENT Event)
 	// Save off the game base address.
 	_g_GameBaseAddress = reinterpret_cast<ULONG_PTR>(Event->u.CreateProcessInfo.lpBaseOfImage);
 
-	if (!_PoeDbgGameSetHookProperties(_g_PacketSenderPattern, &_g_PacketSenderHookStart, &_g_PacketSenderHookEnd, _g_PacketSenderHookOffset, _g_PacketSenderHookSize))
+	// The game's code may be searched from other threads once it is cached.
+	AcquireSRWLockExclusive(&_g_GameModulesLock);
+
+	if (_PoeDbgGameSetHookProperties(_g_PacketSenderPattern, &_g_PacketSenderHookStart, &_g_PacketSenderHookEnd, _g_PacketSenderHookOffset, _g_PacketSenderHookSize))
+	{
+		_PoeDbgMemoryDefineBreakpoint(BP_SLOT_SEND, _g_PacketSenderHookStart, BP_LENGTH_ONE, BP_CONDITION_EXECUTION);
+	}
+	else
 	{
 		POEDBG_NOTIFY_CALLBACK(Error, POEDBG_STATUS_HOOK_PROPERTIES_SEND_FAILED);
 	}
 
-	if (!_PoeDbgGameSetHookProperties(_g_PacketRecvPattern, &_g_PacketRecvHookStart, &_g_PacketRecvHookEnd, _g_PacketRecvHookOffset, _g_PacketRecvHookSize))
+	if (_PoeDbgGameSetHookProperties(_g_PacketRecvPattern, &_g_PacketRecvHookStart, &_g_PacketRecvHookEnd, _g_PacketRecvHookOffset, _g_PacketRecvHookSize))
+	{
+		_PoeDbgMemoryDefineBreakpoint(BP_SLOT_RECV, _g_PacketRecvHookStart, BP_LENGTH_ONE, BP_CONDITION_EXECUTION);
+	}
+	else
 	{
 		POEDBG_NOTIFY_CALLBACK(Error, POEDBG_STATUS_HOOK_PROPERTIES_RECV_FAILED);
 	}
 
-	if (!_PoeDbgGameSetHookProperties(_g_PacketWsaRecvPattern, &_g_PacketWsaRecvHookStart, &_g_PacketWsaRecvHookEnd, _g_PacketWsaRecvHookOffset, _g_PacketWsaRecvHookSize))
+	if (_PoeDbgGameSetHookProperties(_g_PacketWsaRecvPattern, &_g_PacketWsaRecvHookStart, &_g_PacketWsaRecvHookEnd, _g_PacketWsaRecvHookOffset, _g_PacketWsaRecvHookSize))
+	{
+		_PoeDbgMemoryDefineBreakpoint(BP_SLOT_WSARECV, _g_PacketWsaRecvHookStart, BP_LENGTH_ONE, BP_CONDITION_EXECUTION);
+	}
+	else
 	{
 		POEDBG_NOTIFY_CALLBACK(Error, POEDBG_STATUS_HOOK_PROPERTIES_WSARECV_FAILED);
 	}
 
+	ReleaseSRWLockExclusive(&_g_GameModulesLock);
+
+	// Every hook that was found now holds its slot, so the rest can be handed
+	// out.
+	_ReadWriteBarrier();
+	_g_bIsGameHooked = true;
+
+	// The game's own image is a module like any other. It can't be found when
+	// it isn't a PE image, which only limits searches to the signature cache.
+	_PoeDbgModuleLoad(_g_GameBaseAddress, _g_bIsSteamClient ? GAME_PROCESS_NAME_STEAM : GAME_PROCESS_NAME);
+
 	// Apply hooks on this initial main thread.
 	POEDBG_STATUS Status = _PoeDbgGameSetHooksOnThread(Event->dwThreadId, Event->u.CreateProcessInfo.hThread);
 
@@ -136,6 +445,32 @@ POEDBG_INLINE DWORD _PoeDbgGameInitializeThread(const LPDEBUG_EVENT Event)
 	return DBG_CONTINUE;
 }
 
+/*
+Records a module that the game has loaded, so that signatures can be searched
+for in it later.
+*/
+POEDBG_INLINE DWORD _PoeDbgGameLoadModule(const LPDEBUG_EVENT Event)
+{
+	wchar_t Name[MODULE_NAME_MAXIMUM];
+
+	if (_PoeDbgPlatformGetModuleName(Event, Name, MODULE_NAME_MAXIMUM))
+	{
+		_PoeDbgModuleLoad(reinterpret_cast<ULONG_PTR>(Event->u.LoadDll.lpBaseOfDll), Name);
+	}
+
+	return DBG_CONTINUE;
+}
+
+/*
+Forgets a module that the game has unloaded.
+*/
+POEDBG_INLINE DWORD _PoeDbgGameUnloadModule(const LPDEBUG_EVENT Event)
+{
+	_PoeDbgModuleUnload(reinterpret_cast<ULONG_PTR>(Event->u.UnloadDll.lpBaseOfDll));
+
+	return DBG_CONTINUE;
+}
+
 /*
 Processes a single step exception. Checks to see whether the exception belongs
 to an existing hook, and reacts accordingly.
@@ -146,7 +481,18 @@ POEDBG_INLINE DWORD _PoeDbgGameProcessHooks(const DWORD ThreadId, const EXCEPTIO
 	Context.ContextFlags = CONTEXT_ALL;
 
 	// Get the saved handle for this thread.
-	HANDLE Thread = _g_GameThreads[ThreadId];
+	HANDLE Thread = NULL;
+
+	AcquireSRWLockShared(&_g_GameThreadsLock);
+
+	auto Entry = _g_GameThreads.find(ThreadId);
+
+	if (Entry != _g_GameThreads.end())
+	{
+		Thread = Entry->second;
+	}
+
+	ReleaseSRWLockShared(&_g_GameThreadsLock);
 
 	if (NULL == Thread)
 	{
@@ -156,27 +502,43 @@ POEDBG_INLINE DWORD _PoeDbgGameProcessHooks(const DWORD ThreadId, const EXCEPTIO
 		return DBG_EXCEPTION_NOT_HANDLED;
 	}
 
-	if (FALSE == GetThreadContext(Thread, &Context))
+	if (!_PoeDbgPlatformGetContext(Thread, &Context))
 	{
 		return DBG_EXCEPTION_NOT_HANDLED;
 	}
+
+	if (0 != (Context.Dr6 & BP_DR6_SLOT_MASK))
+	{
+		// Record any watchpoints that were hit. These trap after the access,
+		// so the thread simply carries on from where it is.
+		_PoeDbgWatchProcessHits(ThreadId, &Context);
+	}
 	
 	// Get the address where the exception occurred.
 	ULONG_PTR ExceptionAddress = reinterpret_cast<ULONG_PTR>(Exception.ExceptionRecord.ExceptionAddress);
 
+	// Run any capture point here before a hook can change the registers.
+	_PoeDbgCaptureProcessHits(ThreadId, ExceptionAddress, &Context);
+
 	if (ExceptionAddress == _g_PacketSenderHookStart)
 	{
 		// Is this exception coming from the packet sender hook? If so, 
 		// we should record packet details and then re-execute anything
 		// that we skipped with our hook.
 
+		DWORD64 HookBegin = _PoeDbgTraceBegin();
+
 		DWORD64 PacketBuffer = Context.Rdx;
 		DWORD64 PacketLength = Context.R8;
 
-		if (_PoeDbgGameCopyPacket(_g_PacketSenderBuffer, PacketBuffer, PacketLength))
+		DWORD CaptureLength = 0;
+
+		_g_EventSource = POEDBG_SOURCE_SEND;
+
+		if (_PoeDbgGameCopyPacket(POEDBG_DIRECTION_SEND, _g_PacketSenderBuffer, PacketBuffer, PacketLength, &CaptureLength))
 		{
-			// Forward the packet to the callback.
-			POEDBG_NOTIFY_CALLBACK(PacketSend, static_cast<DWORD>(PacketLength), _g_PacketSenderBuffer[1], _g_PacketSenderBuffer);
+			// Forward the packet to its consumers.
+			_PoeDbgGameDispatchPacket(POEDBG_DIRECTION_SEND, _g_PacketSenderBuffer, CaptureLength, static_cast<DWORD>(PacketLength));
 		}
 
 		// Execute skipped.
@@ -184,6 +546,8 @@ POEDBG_INLINE DWORD _PoeDbgGameProcessHooks(const DWORD ThreadId, const EXCEPTIO
 
 		// Set the instruction pointer.
 		Context.Rip = _g_PacketSenderHookEnd;
+
+		_PoeDbgTraceEnd(TRACE_RING_DEBUG, TRACE_SPAN_HOOK, HookBegin, ThreadId, 0, 0, POEDBG_SOURCE_SEND, 0);
 	}
 
 	if (ExceptionAddress == _g_PacketRecvHookStart)
@@ -192,20 +556,24 @@ POEDBG_INLINE DWORD _PoeDbgGameProcessHooks(const DWORD ThreadId, const EXCEPTIO
 		// we should record packet details and then re-execute anything
 		// that we skipped with our hook.
 
+		DWORD64 HookBegin = _PoeDbgTraceBegin();
+
 		DWORD64 PacketBuffer = Context.R9;
 		DWORD64 PacketLength = Context.Rax;
 
-		if (_PoeDbgGameCopyPacket(_g_PacketRecvBuffer, PacketBuffer, PacketLength))
-		{
-			// Forward the packet to the callback.
-			POEDBG_NOTIFY_CALLBACK(PacketReceive, static_cast<DWORD>(PacketLength), _g_PacketRecvBuffer[1], _g_PacketRecvBuffer);
-		}
+		_g_EventSource = POEDBG_SOURCE_RECV;
+
+		// Both receive hooks share the connection object in RBX, so data from
+		// either one feeds the same stream.
+		_PoeDbgGameReceivePacket(Context.Rbx, _g_PacketRecvBuffer, PacketBuffer, PacketLength);
 
 		// Execute skipped.
 		Context.Rdi = Context.Rax;
 
 		// Set the instruction pointer.
 		Context.Rip = _g_PacketRecvHookEnd;
+
+		_PoeDbgTraceEnd(TRACE_RING_DEBUG, TRACE_SPAN_HOOK, HookBegin, ThreadId, 0, 0, POEDBG_SOURCE_RECV, 0);
 	}
 
 	if (ExceptionAddress == _g_PacketWsaRecvHookStart)
@@ -214,29 +582,44 @@ POEDBG_INLINE DWORD _PoeDbgGameProcessHooks(const DWORD ThreadId, const EXCEPTIO
 		// we should record packet details and then re-execute anything
 		// that we skipped with our hook.
 
+		DWORD64 HookBegin = _PoeDbgTraceBegin();
+
 		DWORD64 PacketBuffer = NULL;
 		DWORD64 PacketLength = Context.Rdi;
 
 		// Get the location of the buffer off the stack.
 		_PoeDbgMemoryRead(static_cast<ULONG_PTR>(Context.Rsp + 0x48), &PacketBuffer, sizeof(DWORD64));
 
-		if (_PoeDbgGameCopyPacket(_g_PacketWsaRecvBuffer, PacketBuffer, PacketLength))
-		{
-			// Forward the packet to the callback.
-			POEDBG_NOTIFY_CALLBACK(PacketReceive, static_cast<DWORD>(PacketLength), _g_PacketWsaRecvBuffer[1], _g_PacketWsaRecvBuffer);
-		}
+		_g_EventSource = POEDBG_SOURCE_WSARECV;
+
+		_PoeDbgGameReceivePacket(Context.Rbx, _g_PacketWsaRecvBuffer, PacketBuffer, PacketLength);
 
 		// Execute skipped.
 		Context.Rax = Context.Rdi;
 
 		// Set the instruction pointer.
 		Context.Rip = _g_PacketWsaRecvHookEnd;
+
+		_PoeDbgTraceEnd(TRACE_RING_DEBUG, TRACE_SPAN_HOOK, HookBegin, ThreadId, 0, 0, POEDBG_SOURCE_WSARECV, 0);
 	}
 
-	// Set the context.
+	// Set the context. A watchpoint or capture point may have been applied
+	// to this thread since its context was read, so the debug registers are
+	// rebuilt from the breakpoint table rather than written back as they
+	// were. DR6 is never cleared by the processor, so reset it for the next
+	// hit.
+	AcquireSRWLockShared(&_g_BreakpointsLock);
+
+	_PoeDbgMemoryBuildDebugRegisters(&Context);
+
 	Context.ContextFlags = CONTEXT_ALL;
+	Context.Dr6 = 0;
+
+	bool bIsSet = _PoeDbgPlatformSetContext(Thread, &Context);
+
+	ReleaseSRWLockShared(&_g_BreakpointsLock);
 
-	if (FALSE == SetThreadContext(Thread, &Context))
+	if (!bIsSet)
 	{
 		return DBG_EXCEPTION_NOT_HANDLED;
 	}
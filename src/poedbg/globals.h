@@ -9,10 +9,324 @@
 // Status type.
 typedef int POEDBG_STATUS;
 
+// Longest module file name kept, in characters, including the terminator.
+#define MODULE_NAME_MAXIMUM 64
+
+// Largest payload filter program, and how deeply its expression may nest.
+#define FILTER_INSTRUCTION_MAXIMUM 64
+#define FILTER_BYTES_MAXIMUM 64
+#define FILTER_DEPTH_MAXIMUM 16
+
+// Most values a capture point can capture.
+#define CAPTURE_ITEM_MAXIMUM 8
+
+// Number of power of two buckets in the debug loop's histograms.
+#define LOOP_HISTOGRAM_BUCKETS 32
+
+// Number of one second buckets kept for traffic rates, and how many of the
+// most recent whole seconds the rates are averaged over.
+#define TRAFFIC_WINDOW_COUNT 8
+#define TRAFFIC_RATE_SECONDS 5
+
+// Describes how the length of a received message with a given ID is found,
+// so that the receive stream can be split into whole messages.
+typedef struct _POEDBG_FRAME_RULE
+{
+	BYTE Type;
+	BYTE LengthOffset;
+	BYTE LengthSize;
+	BYTE Reserved;
+	DWORD Size;
+} POEDBG_FRAME_RULE, *PPOEDBG_FRAME_RULE;
+
+// Header of each packet in the packet queue. The packet data follows the
+// header, and Size covers the header, the data and any alignment padding.
+// OriginalLength is the length of the packet in the game, which is more than
+// Length if the packet was truncated by its capture policy. Timestamp is in
+// nanoseconds, as described for PoeDbgGetTimestamp. Sequence numbers every
+// packet dispatched in either direction, and Source is the hook it came from.
+typedef struct _POEDBG_PACKET_RECORD
+{
+	DWORD Size;
+	DWORD Length;
+	BYTE Direction;
+	BYTE Id;
+	WORD Flags;
+	DWORD OriginalLength;
+	DWORD64 Timestamp;
+	DWORD64 Sequence;
+	DWORD Source;
+	DWORD Reserved;
+} POEDBG_PACKET_RECORD, *PPOEDBG_PACKET_RECORD;
+
+// Traffic statistics for a single packet ID, as returned by
+// PoeDbgGetTrafficStats. Rates are per second, averaged over the last few
+// whole seconds.
+typedef struct _POEDBG_TRAFFIC_STATS
+{
+	DWORD64 Packets;
+	DWORD64 Bytes;
+	DWORD MinimumSize;
+	DWORD MaximumSize;
+	DWORD MeanSize;
+	DWORD PacketRate;
+	DWORD64 ByteRate;
+} POEDBG_TRAFFIC_STATS, *PPOEDBG_TRAFFIC_STATS;
+
+// How packets with a given ID are captured. Parameter is the number of bytes
+// kept for truncated packets, and the sampling interval for sampled ones.
+typedef struct _POEDBG_CAPTURE_POLICY
+{
+	DWORD Mode;
+	DWORD Parameter;
+} POEDBG_CAPTURE_POLICY, *PPOEDBG_CAPTURE_POLICY;
+
+// One step of a compiled payload filter. Tests set the filter's result, and
+// jumps skip ahead to Offset depending on it. Field tests compare the masked
+// big-endian field of Width bytes at Offset with Value, and byte tests match
+// Width bytes at Offset against the program's bytes from Value on.
+typedef struct _POEDBG_FILTER_INSTRUCTION
+{
+	BYTE Opcode;
+	BYTE Compare;
+	BYTE Width;
+	BYTE Reserved;
+	DWORD Offset;
+	DWORD Mask;
+	DWORD Value;
+} POEDBG_FILTER_INSTRUCTION, *PPOEDBG_FILTER_INSTRUCTION;
+
+// A compiled payload filter. A packet byte matches a byte test when it equals
+// the test's value once masked, so wildcards have a mask of zero.
+typedef struct _POEDBG_FILTER_PROGRAM
+{
+	DWORD Count;
+	DWORD ByteCount;
+	POEDBG_FILTER_INSTRUCTION Instructions[FILTER_INSTRUCTION_MAXIMUM];
+	BYTE Values[FILTER_BYTES_MAXIMUM];
+	BYTE Masks[FILTER_BYTES_MAXIMUM];
+} POEDBG_FILTER_PROGRAM, *PPOEDBG_FILTER_PROGRAM;
+
+// Progress of the pcapng writer, as returned by PoeDbgGetPcapngStats. Packets
+// and Bytes count what has been handed to the writer, Dropped the packets
+// that found every buffer still waiting to be written, and Status the last
+// error the writer ran into, if any.
+typedef struct _POEDBG_PCAPNG_STATS
+{
+	DWORD64 Packets;
+	DWORD64 Bytes;
+	DWORD64 Dropped;
+	DWORD Files;
+	POEDBG_STATUS Status;
+} POEDBG_PCAPNG_STATS, *PPOEDBG_PCAPNG_STATS;
+
+// Progress of the pipeline, as returned by PoeDbgGetPipelineStats. Packets
+// counts what was handed to a worker, and Dropped the packets that found
+// their worker's queue, or the merge window, full.
+typedef struct _POEDBG_PIPELINE_STATS
+{
+	DWORD64 Packets;
+	DWORD64 Dropped;
+	DWORD Workers;
+	DWORD Reserved;
+} POEDBG_PIPELINE_STATS, *PPOEDBG_PIPELINE_STATS;
+
+// How packets with a given ID are conflated. A packet replaces any held
+// packet with the same ID and key, which is the KeyLength bytes at KeyOffset.
+// With a KeyLength of zero, every packet with the ID shares a single key.
+typedef struct _POEDBG_CONFLATION_RULE
+{
+	WORD KeyOffset;
+	BYTE KeyLength;
+	BYTE Reserved;
+} POEDBG_CONFLATION_RULE, *PPOEDBG_CONFLATION_RULE;
+
+// Conflation statistics for a single packet ID, as returned by
+// PoeDbgGetConflationStats. Packets counts what was held back, Overwritten
+// the held packets replaced by a later one with the same key, and Delivered
+// the packets handed to consumers when the held packets were flushed.
+typedef struct _POEDBG_CONFLATION_STATS
+{
+	DWORD64 Packets;
+	DWORD64 Overwritten;
+	DWORD64 Delivered;
+} POEDBG_CONFLATION_STATS, *PPOEDBG_CONFLATION_STATS;
+
+// How the debug loop waits for events, and the thread it runs on is
+// scheduled. SpinMaximum caps the spin budget, in microseconds, and zero
+// gives the default. Affinity is a mask of the processors the thread may run
+// on, left as it is if zero, and Priority a Windows thread priority.
+typedef struct _POEDBG_LOOP_SETTINGS
+{
+	DWORD Mode;
+	DWORD SpinMaximum;
+	DWORD64 Affinity;
+	int Priority;
+	DWORD Reserved;
+} POEDBG_LOOP_SETTINGS, *PPOEDBG_LOOP_SETTINGS;
+
+// Progress of the debug loop since its settings were last applied, as
+// returned by PoeDbgGetLoopStats. Events are counted by whether they were
+// caught while spinning or needed a blocking wait, and SpinTime is the total
+// time spent spinning, in nanoseconds, including spins that caught nothing.
+// Gap counts every event by how long the loop waited for it. SpinLatency
+// counts the events caught spinning by the time between the last two polls,
+// which bounds how long each sat waiting to be picked up; the wakeup latency
+// of a blocked event is hidden in its gap. Bucket N of each histogram holds
+// times from 2^N up to 2^(N+1) nanoseconds, with anything longer in the last
+// bucket. Status is the result of applying the settings.
+typedef struct _POEDBG_LOOP_STATS
+{
+	DWORD64 SpinEvents;
+	DWORD64 BlockEvents;
+	DWORD64 SpinTime;
+	DWORD SpinBudget;
+	POEDBG_STATUS Status;
+	DWORD64 Gap[LOOP_HISTOGRAM_BUCKETS];
+	DWORD64 SpinLatency[LOOP_HISTOGRAM_BUCKETS];
+} POEDBG_LOOP_STATS, *PPOEDBG_LOOP_STATS;
+
+// Live traffic counters for a single packet ID. Each is written only by the
+// debug loop and sits on its own cache lines. The sequence is odd while an
+// update is in progress, so readers can tell when they need to retry.
+typedef struct DECLSPEC_ALIGN(64) _POEDBG_TRAFFIC_COUNTER
+{
+	volatile DWORD Sequence;
+	DWORD MinimumSize;
+	DWORD MaximumSize;
+	DWORD Reserved;
+	DWORD64 Packets;
+	DWORD64 Bytes;
+	DWORD WindowSecond[TRAFFIC_WINDOW_COUNT];
+	DWORD WindowPackets[TRAFFIC_WINDOW_COUNT];
+	DWORD WindowBytes[TRAFFIC_WINDOW_COUNT];
+} POEDBG_TRAFFIC_COUNTER, *PPOEDBG_TRAFFIC_COUNTER;
+
+// A hardware breakpoint slot in the breakpoint table, which is applied to
+// every game thread.
+typedef struct _POEDBG_BREAKPOINT
+{
+	ULONG_PTR Address;
+	BYTE Length;
+	BYTE Type;
+	bool bIsEnabled;
+} POEDBG_BREAKPOINT, *PPOEDBG_BREAKPOINT;
+
+// A single hit on a watchpoint, as returned by PoeDbgReadWatchEvents. Rip
+// is the instruction after the one that touched the watched memory, and the
+// timestamp is in nanoseconds, the same as packet timestamps.
+typedef struct _POEDBG_WATCH_EVENT
+{
+	DWORD ThreadId;
+	DWORD Id;
+	DWORD64 Rip;
+	DWORD64 OldValue;
+	DWORD64 NewValue;
+	DWORD64 Timestamp;
+} POEDBG_WATCH_EVENT, *PPOEDBG_WATCH_EVENT;
+
+// State of a watchpoint, indexed by the breakpoint slot it uses.
+typedef struct _POEDBG_WATCHPOINT
+{
+	ULONG_PTR Address;
+	DWORD Length;
+	DWORD64 Value;
+	bool bIsActive;
+} POEDBG_WATCHPOINT, *PPOEDBG_WATCHPOINT;
+
+// One value captured at a capture point: a register, a fixed number of bytes
+// at a register plus a displacement, or as many bytes there as another
+// register holds, up to Length.
+typedef struct _POEDBG_CAPTURE_ITEM
+{
+	BYTE Type;
+	BYTE Register;
+	BYTE LengthRegister;
+	BYTE Reserved;
+	LONG Displacement;
+	DWORD Length;
+} POEDBG_CAPTURE_ITEM, *PPOEDBG_CAPTURE_ITEM;
+
+// What a capture point captures, in order.
+typedef struct _POEDBG_CAPTURE_RECIPE
+{
+	DWORD Count;
+	POEDBG_CAPTURE_ITEM Items[CAPTURE_ITEM_MAXIMUM];
+} POEDBG_CAPTURE_RECIPE, *PPOEDBG_CAPTURE_RECIPE;
+
+// State of a capture point, indexed by the breakpoint slot it uses.
+typedef struct _POEDBG_CAPTURE_POINT
+{
+	ULONG_PTR Address;
+	DWORD ResumeBytes;
+	bool bIsActive;
+	POEDBG_CAPTURE_RECIPE Recipe;
+} POEDBG_CAPTURE_POINT, *PPOEDBG_CAPTURE_POINT;
+
+// A module loaded in the game. Its code is only copied once a signature is
+// searched for in it.
+typedef struct _POEDBG_MODULE
+{
+	ULONG_PTR Base;
+	SIZE_T Size;
+	DWORD TimeDateStamp;
+	DWORD BaseOfCode;
+	DWORD SizeOfCode;
+	PBYTE CodeCopy;
+	wchar_t Name[MODULE_NAME_MAXIMUM];
+} POEDBG_MODULE, *PPOEDBG_MODULE;
+
+// Reassembly state for a single connection in the game.
+typedef struct _POEDBG_STREAM
+{
+	DWORD CarryLength;
+	PBYTE Carry;
+} POEDBG_STREAM, *PPOEDBG_STREAM;
+
 //////////////////////////////////////////////////////////////////////////
 // Status Codes
 //////////////////////////////////////////////////////////////////////////
 
+#define POEDBG_STATUS_LOOP_SETTINGS_FAILED -60
+#define POEDBG_STATUS_LOOP_SETTINGS_INVALID -59
+#define POEDBG_STATUS_CONFLATION_ALLOCATION_FAILED -58
+#define POEDBG_STATUS_CONFLATION_INVALID -57
+#define POEDBG_STATUS_TRACE_WRITE_FAILED -56
+#define POEDBG_STATUS_TRACE_ALLOCATION_FAILED -55
+#define POEDBG_STATUS_TRACE_INVALID -54
+#define POEDBG_STATUS_TRACE_NOT_STARTED -53
+#define POEDBG_STATUS_TRACE_ALREADY_STARTED -52
+#define POEDBG_STATUS_CAPTURE_POINT_SLOTS_FULL -51
+#define POEDBG_STATUS_CAPTURE_POINT_INVALID -50
+#define POEDBG_STATUS_FILTER_ALLOCATION_FAILED -49
+#define POEDBG_STATUS_FILTER_INVALID -48
+#define POEDBG_STATUS_PIPELINE_INVALID -47
+#define POEDBG_STATUS_PIPELINE_ALLOCATION_FAILED -46
+#define POEDBG_STATUS_PIPELINE_NOT_STARTED -45
+#define POEDBG_STATUS_PIPELINE_ALREADY_STARTED -44
+#define POEDBG_STATUS_PCAPNG_WRITE_FAILED -43
+#define POEDBG_STATUS_PCAPNG_OPEN_FAILED -42
+#define POEDBG_STATUS_PCAPNG_ALLOCATION_FAILED -41
+#define POEDBG_STATUS_PCAPNG_NOT_STARTED -40
+#define POEDBG_STATUS_PCAPNG_ALREADY_STARTED -39
+#define POEDBG_STATUS_CAPTURE_POLICY_INVALID -38
+#define POEDBG_STATUS_PATTERN_NOT_FOUND -37
+#define POEDBG_STATUS_MODULE_NOT_FOUND -36
+#define POEDBG_STATUS_SIGNATURE_SOURCE_INVALID -35
+#define POEDBG_STATUS_CLOCK_NOT_INITIALIZED -34
+#define POEDBG_STATUS_SUBSCRIBER_ALLOCATION_FAILED -33
+#define POEDBG_STATUS_SUBSCRIBER_NOT_FOUND -32
+#define POEDBG_STATUS_SUBSCRIBER_LIMIT_REACHED -31
+#define POEDBG_STATUS_WATCHPOINT_SLOTS_FULL -30
+#define POEDBG_STATUS_WATCHPOINT_INVALID -29
+#define POEDBG_STATUS_HOOK_THREAD_FAILED -28
+#define POEDBG_STATUS_QUEUE_NOT_ENABLED -27
+#define POEDBG_STATUS_QUEUE_ALREADY_ENABLED -26
+#define POEDBG_STATUS_QUEUE_ALLOCATION_FAILED -25
+#define POEDBG_STATUS_BUFFER_TOO_SMALL -24
+#define POEDBG_STATUS_FORMAT_STYLE_INVALID -23
+#define POEDBG_STATUS_FRAME_RULE_INVALID -22
+#define POEDBG_STATUS_DIRECTION_INVALID -21
 #define POEDBG_STATUS_HOOK_PROPERTIES_WSARECV_FAILED -20
 #define POEDBG_STATUS_HOOK_PROPERTIES_RECV_FAILED -19
 #define POEDBG_STATUS_HOOK_PROPERTIES_SEND_FAILED -18
@@ -41,8 +355,8 @@ typedef int POEDBG_STATUS;
 
 #define POEDBG_SUCCESS(x) (x >= 0)
 #define POEDBG_FAILURE(x) (x < 0)
-#define POEDBG_RETURN_STATUS_ON_SUCCESS(f) { POEDBG_STATUS _s = f##; if (POEDBG_SUCCESS(_s)) return _s; }
-#define POEDBG_RETURN_STATUS_ON_FAILURE(f) { POEDBG_STATUS _s = f##; if (POEDBG_FAILURE(_s)) return _s; }
+#define POEDBG_RETURN_STATUS_ON_SUCCESS(f) { POEDBG_STATUS _s = f; if (POEDBG_SUCCESS(_s)) return _s; }
+#define POEDBG_RETURN_STATUS_ON_FAILURE(f) { POEDBG_STATUS _s = f; if (POEDBG_FAILURE(_s)) return _s; }
 
 //////////////////////////////////////////////////////////////////////////
 // Configuration
@@ -57,12 +371,189 @@ typedef int POEDBG_STATUS;
 
 // Sizes.
 #define DEFAULT_BUFFER_SIZE 0x100000
+#define DEFAULT_PAGE_SIZE 0x1000
+#define PACKET_ID_COUNT 0x100
+#define QUEUE_MINIMUM_SIZE 0x10000
+#define QUEUE_MAXIMUM_SIZE 0x40000000
+#define QUEUE_RECORD_ALIGNMENT 0x10
+
+// Packet directions.
+#define POEDBG_DIRECTION_SEND 0
+#define POEDBG_DIRECTION_RECEIVE 1
+#define POEDBG_DIRECTION_COUNT 2
+
+// Packet sources, one for each hook. Sent packets all come from the send hook,
+// and received packets from whichever receive hook the game used.
+#define POEDBG_SOURCE_SEND 0
+#define POEDBG_SOURCE_RECV 1
+#define POEDBG_SOURCE_WSARECV 2
+#define POEDBG_SOURCE_COUNT 3
+
+// Frame rule types. Unknown messages run to the end of the received data,
+// fixed messages are always Size bytes long, and prefixed messages carry a
+// big-endian length field whose value plus Size gives the message length.
+#define POEDBG_FRAME_UNKNOWN 0
+#define POEDBG_FRAME_FIXED 1
+#define POEDBG_FRAME_PREFIXED 2
+
+// Capture policies. Full packets are copied whole, truncated packets only up
+// to the given number of bytes, sampled packets only one in every given
+// number, and counted packets not at all. Packets that aren't copied are still
+// counted in the traffic statistics.
+#define POEDBG_CAPTURE_FULL 0
+#define POEDBG_CAPTURE_TRUNCATE 1
+#define POEDBG_CAPTURE_SAMPLE 2
+#define POEDBG_CAPTURE_COUNT 3
+
+// Sets a capture policy for every packet ID at once.
+#define POEDBG_CAPTURE_ALL_IDS -1
+
+// Packet record flags. Truncated packets hold fewer bytes than they had in
+// the game.
+#define POEDBG_RECORD_TRUNCATED 0x0001
+
+// Debug loop modes. Blocking waits in the kernel for every event, and spinning
+// polls for the next event for a while after each one before blocking.
+#define POEDBG_LOOP_BLOCK 0
+#define POEDBG_LOOP_SPIN 1
+
+// Packet formatting styles. Hex prints each byte as "xx ", ASCII prints
+// printable bytes as they are and everything else as '.', and XXD matches
+// the output of the 'xxd' tool.
+#define POEDBG_FORMAT_HEX 0
+#define POEDBG_FORMAT_ASCII 1
+#define POEDBG_FORMAT_XXD 2
+
+// Where signatures are searched for. The game source copies the code out of
+// the running game, and the file source maps the game's executable from disk
+// and searches that instead, falling back to a copy if the two don't match.
+#define POEDBG_SIGNATURE_SOURCE_GAME 0
+#define POEDBG_SIGNATURE_SOURCE_FILE 1
+
+// Longest signature, in bytes, that is checked against the running game
+// after being found in the executable file.
+#define SIGNATURE_VERIFY_MAXIMUM 0x100
+
+// pcapng output. The debug loop writes packets into one of a few large
+// buffers, and a background thread writes out each buffer once it is full, or
+// once it has held packets for the flush interval, in milliseconds.
+#define PCAPNG_BUFFER_SIZE 0x400000
+#define PCAPNG_BUFFER_COUNT 8
+#define PCAPNG_FLUSH_INTERVAL 1000
+#define PCAPNG_PATH_MAXIMUM 0x200
+
+// Pipeline. Packets are sharded across up to the maximum number of workers,
+// each with its own queue of the default size unless told otherwise. At most
+// the merge size of packets can be between the debug loop and the merge
+// callback at once. Idle threads check whether to stop at the wait interval,
+// in milliseconds.
+#define PIPELINE_WORKER_MAXIMUM 64
+#define PIPELINE_DEFAULT_QUEUE_SIZE 0x100000
+#define PIPELINE_MERGE_SIZE 0x10000
+#define PIPELINE_WAIT_INTERVAL 100
+
+// Tracing. Every thread the engine runs on records spans into a ring of its
+// own, holding the default number of spans unless told otherwise. Traces are
+// written out through a buffer of the given size.
+#define TRACE_DEFAULT_EVENTS 0x4000
+#define TRACE_EVENTS_MAXIMUM 0x100000
+#define TRACE_WRITE_BUFFER_SIZE 0x100000
+#define TRACE_LINE_MAXIMUM 0x200
+#define TRACE_PATH_MAXIMUM 0x200
+
+// Conflation. Held packets are flushed to consumers at the default interval,
+// in milliseconds, unless told otherwise. The slot table is flushed early
+// once it holds the limit of keys, and until then packets with new keys are
+// delivered at once. Packets longer than the payload maximum, or too short
+// for their key, are never held.
+#define CONFLATION_DEFAULT_INTERVAL 100
+#define CONFLATION_INTERVAL_MAXIMUM 60000
+#define CONFLATION_SLOT_COUNT 0x1000
+#define CONFLATION_SLOT_LIMIT 0xC00
+#define CONFLATION_PAYLOAD_MAXIMUM 0x200
+#define CONFLATION_KEY_MAXIMUM 8
+
+// Debug loop. In spin mode, the loop polls for the next event for up to its
+// spin budget before blocking. The budget follows twice the recent gaps
+// between events, moving an eighth of the way each event, and is capped at
+// the maximum set, in microseconds, or the default. A shrinking budget that
+// falls below the minimum, in nanoseconds, which is about what a single poll
+// costs, is dropped to zero so that the loop stops polling altogether.
+#define LOOP_DEFAULT_SPIN_MAXIMUM 50
+#define LOOP_SPIN_MAXIMUM 10000
+#define LOOP_BUDGET_SHIFT 3
+#define LOOP_BUDGET_MINIMUM 1000
+
+// Payload filter slots for each direction: one for each packet ID, and one
+// more that applies to every packet.
+#define FILTER_SLOT_COUNT (PACKET_ID_COUNT + 1)
+
+// Size of the ID at the start of every message.
+#define PACKET_ID_SIZE 2
 
 // Breakpoint conditions.
 #define BP_CONDITION_EXECUTION 0
 #define BP_CONDITION_WRITE 1
 #define BP_CONDITION_READWRITE 3
 
+// Breakpoint slots, one for each of DR0 to DR3, and the bits of DR7 that
+// belong to them.
+#define BP_SLOT_COUNT 4
+#define BP_DR7_SLOT_MASK 0xFFFF00FF
+
+// Breakpoint slots used by the packet hooks.
+#define BP_SLOT_SEND 0
+#define BP_SLOT_RECV 1
+#define BP_SLOT_WSARECV 2
+
+// Breakpoint status bits in DR6, one for each slot.
+#define BP_DR6_SLOT_MASK 0xF
+
+// The resume flag in EFLAGS, which lets a thread stopped by an execution
+// breakpoint run the instruction it stopped at without stopping again.
+#define BP_EFLAGS_RESUME 0x10000
+
+// Watchpoint conditions. These are the matching breakpoint conditions.
+#define POEDBG_WATCH_WRITE 1
+#define POEDBG_WATCH_READWRITE 3
+
+// Capture item types. Registers are captured as 8 bytes, and memory as the
+// bytes at the register plus the displacement.
+#define POEDBG_CAPTURE_ITEM_REGISTER 0
+#define POEDBG_CAPTURE_ITEM_MEMORY 1
+#define POEDBG_CAPTURE_ITEM_MEMORY_SIZED 2
+
+// Registers a capture item can name, in the processor's own order.
+#define POEDBG_REGISTER_RAX 0
+#define POEDBG_REGISTER_RCX 1
+#define POEDBG_REGISTER_RDX 2
+#define POEDBG_REGISTER_RBX 3
+#define POEDBG_REGISTER_RSP 4
+#define POEDBG_REGISTER_RBP 5
+#define POEDBG_REGISTER_RSI 6
+#define POEDBG_REGISTER_RDI 7
+#define POEDBG_REGISTER_R8 8
+#define POEDBG_REGISTER_R9 9
+#define POEDBG_REGISTER_R10 10
+#define POEDBG_REGISTER_R11 11
+#define POEDBG_REGISTER_R12 12
+#define POEDBG_REGISTER_R13 13
+#define POEDBG_REGISTER_R14 14
+#define POEDBG_REGISTER_R15 15
+#define POEDBG_REGISTER_RIP 16
+#define POEDBG_REGISTER_COUNT 17
+
+// Most subscribers allowed for each packet direction.
+#define SUBSCRIBER_MAXIMUM 64
+
+// How long the clock is measured against the performance counter for, and the
+// number of fraction bits in the nanoseconds per tick multiplier.
+#define CLOCK_CALIBRATION_MILLISECONDS 20
+#define CLOCK_MULTIPLIER_SHIFT 32
+
+// Number of watchpoint events that can be held until they are read.
+#define WATCH_EVENT_COUNT 0x4000
+
 // Breakpoint sizes.
 #define BP_LENGTH_ONE 0
 #define BP_LENGTH_TWO 1
@@ -78,23 +569,139 @@ typedef int POEDBG_STATUS;
 
 // Maps.
 __declspec(selectany) std::map<DWORD, HANDLE> _g_GameThreads;
+__declspec(selectany) std::map<DWORD64, POEDBG_STREAM> _g_GameStreams;
+
+// Guards the thread map, which is changed by the debug loop and read when
+// breakpoints are applied from other threads.
+__declspec(selectany) SRWLOCK _g_GameThreadsLock = SRWLOCK_INIT;
+
+// Modules loaded in the game, by base address, and the offsets of signatures
+// found in them, by module identity and signature. The lock also guards the
+// game code that signatures are searched for in, since searches can be made
+// from any thread.
+__declspec(selectany) std::map<ULONG_PTR, POEDBG_MODULE> _g_GameModules;
+__declspec(selectany) std::map<DWORD64, ULONG_PTR> _g_ModulePatterns;
+__declspec(selectany) SRWLOCK _g_GameModulesLock = SRWLOCK_INIT;
+
+// Breakpoint table, indexed by debug register. The lock is held exclusively
+// while the table is applied to the game's threads, and shared by the debug
+// loop while it writes back the context of a thread stopped at a hook, so
+// that neither write undoes the other.
+__declspec(selectany) POEDBG_BREAKPOINT _g_Breakpoints[BP_SLOT_COUNT];
+__declspec(selectany) SRWLOCK _g_BreakpointsLock = SRWLOCK_INIT;
+
+// The thread running the debug loop.
+__declspec(selectany) DWORD _g_DebugThreadId;
+
+// Clock calibration. Timestamps are nanoseconds since the base ticks were
+// read, which was at the given system time.
+__declspec(selectany) DWORD64 _g_ClockBaseTicks;
+__declspec(selectany) DWORD64 _g_ClockMultiplier;
+__declspec(selectany) DWORD64 _g_ClockBaseSystemTime;
+__declspec(selectany) bool _g_bIsClockTscInvariant = false;
+
+// Time that the debug event being handled was received.
+__declspec(selectany) DWORD64 _g_EventTimestamp;
+
+// Hook that the packets being dispatched came from, and the sequence number
+// of the last packet dispatched or capture point hit. Both are only used by
+// the debug loop.
+__declspec(selectany) BYTE _g_EventSource;
+__declspec(selectany) DWORD64 _g_EventSequence;
 
 // Information cache about game.
 __declspec(selectany) DWORD _g_GameId;
 __declspec(selectany) HANDLE _g_GameHandle;
+
+// Have the hooks claimed their breakpoint slots? Until they have, no slot can
+// be handed to a watchpoint or capture point.
+__declspec(selectany) volatile bool _g_bIsGameHooked = false;
 __declspec(selectany) ULONG_PTR _g_GameBaseAddress;
 __declspec(selectany) ULONG_PTR _g_GameCodeCopy;
-__declspec(selectany) IMAGE_DOS_HEADER _g_GameDosHeader;
-__declspec(selectany) IMAGE_NT_HEADERS _g_GameNtHeaders;
 __declspec(selectany) SIZE_T _g_GameImageSize;
 __declspec(selectany) SIZE_T _g_GameBaseOfCode;
 __declspec(selectany) SIZE_T _g_GameSizeOfCode;
 
+// Where signatures are searched for, and the view of the game executable when
+// that is where its code is being searched. The code copy then points into
+// the view rather than to memory of its own.
+__declspec(selectany) int _g_SignatureSource = POEDBG_SIGNATURE_SOURCE_FILE;
+__declspec(selectany) PVOID _g_GameImageView;
+__declspec(selectany) SIZE_T _g_GameImageViewSize;
+
 // Local packet buffers.
 __declspec(selectany) BYTE _g_PacketSenderBuffer[DEFAULT_BUFFER_SIZE];
 __declspec(selectany) BYTE _g_PacketRecvBuffer[DEFAULT_BUFFER_SIZE];
 __declspec(selectany) BYTE _g_PacketWsaRecvBuffer[DEFAULT_BUFFER_SIZE];
 
+// Packet filters, indexed by direction and then packet ID. Packets with a
+// non-zero entry are dropped before their payload is copied.
+__declspec(selectany) BYTE _g_PacketFilters[POEDBG_DIRECTION_COUNT][PACKET_ID_COUNT];
+__declspec(selectany) DWORD64 _g_PacketFilteredCount[POEDBG_DIRECTION_COUNT];
+
+// Is any packet ID filtered for the given direction?
+__declspec(selectany) bool _g_bIsPacketFilterActive[POEDBG_DIRECTION_COUNT];
+
+// Payload filters, indexed by direction and then filter slot. NULL lets every
+// packet through.
+__declspec(selectany) PPOEDBG_FILTER_PROGRAM volatile _g_PayloadFilters[POEDBG_DIRECTION_COUNT][FILTER_SLOT_COUNT];
+
+// Is any payload filter set for the given direction? The sequence is odd while
+// the debug loop is running one.
+__declspec(selectany) bool _g_bIsPayloadFilterActive[POEDBG_DIRECTION_COUNT];
+__declspec(selectany) volatile LONG _g_PayloadFilterReadSequence;
+
+// Serializes changes to the payload filters.
+__declspec(selectany) SRWLOCK _g_PayloadFilterLock = SRWLOCK_INIT;
+
+// Capture policies, indexed by direction and then packet ID, and how many
+// packets of each ID have been seen since its policy was set, for sampling.
+__declspec(selectany) POEDBG_CAPTURE_POLICY _g_CapturePolicies[POEDBG_DIRECTION_COUNT][PACKET_ID_COUNT];
+__declspec(selectany) DWORD _g_CaptureSampleCounts[POEDBG_DIRECTION_COUNT][PACKET_ID_COUNT];
+
+// Does any packet ID have a policy other than full capture for the given
+// direction?
+__declspec(selectany) bool _g_bIsCapturePolicyActive[POEDBG_DIRECTION_COUNT];
+
+// Frame rules for received messages, indexed by packet ID.
+__declspec(selectany) POEDBG_FRAME_RULE _g_ReceiveFrameRules[PACKET_ID_COUNT];
+
+// Is the receive stream being split into messages?
+__declspec(selectany) bool _g_bIsStreamFramingActive = false;
+
+// Packet queue, a ring of packet records written only by the debug loop. The
+// head and tail count every byte ever written and read.
+__declspec(selectany) PBYTE _g_QueueBuffer;
+__declspec(selectany) SIZE_T _g_QueueSize;
+__declspec(selectany) volatile LONG64 _g_QueueHead;
+__declspec(selectany) volatile LONG64 _g_QueueTail;
+__declspec(selectany) volatile LONG _g_QueueWaiters;
+__declspec(selectany) volatile LONG _g_QueueWakePending;
+__declspec(selectany) DWORD64 _g_QueueDroppedCount;
+__declspec(selectany) HANDLE _g_QueueSemaphore;
+__declspec(selectany) SRWLOCK _g_QueueReadLock;
+
+// Traffic counters, indexed by direction and then packet ID.
+__declspec(selectany) POEDBG_TRAFFIC_COUNTER _g_TrafficCounters[POEDBG_DIRECTION_COUNT][PACKET_ID_COUNT];
+
+// Watchpoints, indexed by breakpoint slot, and the ring of events recorded
+// by the debug loop when they are hit.
+__declspec(selectany) POEDBG_WATCHPOINT _g_Watchpoints[BP_SLOT_COUNT];
+__declspec(selectany) POEDBG_WATCH_EVENT _g_WatchEvents[WATCH_EVENT_COUNT];
+__declspec(selectany) volatile LONG64 _g_WatchEventHead;
+__declspec(selectany) volatile LONG64 _g_WatchEventTail;
+__declspec(selectany) DWORD64 _g_WatchEventDroppedCount;
+__declspec(selectany) SRWLOCK _g_WatchLock = SRWLOCK_INIT;
+
+// Capture points, indexed by breakpoint slot, and the buffer the debug loop
+// captures into. They take their slots under the watchpoint lock, so the two
+// never take the same one.
+__declspec(selectany) POEDBG_CAPTURE_POINT _g_CapturePoints[BP_SLOT_COUNT];
+__declspec(selectany) BYTE _g_CapturePointBuffer[DEFAULT_BUFFER_SIZE];
+
+// Is the packet queue being written?
+__declspec(selectany) volatile bool _g_bIsQueueEnabled = false;
+
 // Has the information cache been populated?
 __declspec(selectany) bool _g_bIsGameInformationCaptured = false;
 
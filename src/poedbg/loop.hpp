@@ -0,0 +1,279 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Globals
+//////////////////////////////////////////////////////////////////////////
+
+// The settings last asked for, and how many times they have been changed.
+// The debug loop applies them to itself when it sees the count move.
+__declspec(selectany) POEDBG_LOOP_SETTINGS _g_LoopSettings = { POEDBG_LOOP_BLOCK, 0, 0, THREAD_PRIORITY_NORMAL, 0 };
+__declspec(selectany) volatile LONG _g_LoopSettingsVersion;
+__declspec(selectany) SRWLOCK _g_LoopSettingsLock = SRWLOCK_INIT;
+
+// The settings the debug loop is running with, and its spin budget, in
+// nanoseconds. Only the debug loop touches these.
+__declspec(selectany) LONG _g_LoopAppliedVersion;
+__declspec(selectany) DWORD _g_LoopMode = POEDBG_LOOP_BLOCK;
+__declspec(selectany) DWORD64 _g_LoopSpinMaximum;
+__declspec(selectany) DWORD64 _g_LoopSpinBudget;
+
+// Progress, for PoeDbgGetLoopStats. The sequence is odd while the debug loop
+// is part way through an update.
+__declspec(selectany) POEDBG_LOOP_STATS _g_LoopStats;
+__declspec(selectany) volatile DWORD _g_LoopStatsSequence;
+
+//////////////////////////////////////////////////////////////////////////
+// Debug Loop Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Finds the histogram bucket for a time in nanoseconds.
+*/
+POEDBG_INLINE DWORD _PoeDbgLoopBucket(DWORD64 Time)
+{
+	DWORD Bucket = 0;
+
+	while (Time > 1 && Bucket < LOOP_HISTOGRAM_BUCKETS - 1)
+	{
+		Time >>= 1;
+		Bucket++;
+	}
+
+	return Bucket;
+}
+
+/*
+Applies the latest settings to the thread the debug loop runs on, and starts
+its statistics again so that they only describe the new settings.
+*/
+inline void _PoeDbgLoopApplySettings()
+{
+	AcquireSRWLockShared(&_g_LoopSettingsLock);
+	POEDBG_LOOP_SETTINGS Settings = _g_LoopSettings;
+	_g_LoopAppliedVersion = _g_LoopSettingsVersion;
+	ReleaseSRWLockShared(&_g_LoopSettingsLock);
+
+	POEDBG_STATUS Status = POEDBG_STATUS_SUCCESS;
+
+	if (0 != Settings.Affinity && 0 == SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(Settings.Affinity)))
+	{
+		Status = POEDBG_STATUS_LOOP_SETTINGS_FAILED;
+	}
+
+	if (!SetThreadPriority(GetCurrentThread(), Settings.Priority))
+	{
+		Status = POEDBG_STATUS_LOOP_SETTINGS_FAILED;
+	}
+
+	DWORD SpinMaximum = (0 != Settings.SpinMaximum) ? Settings.SpinMaximum : LOOP_DEFAULT_SPIN_MAXIMUM;
+
+	_g_LoopMode = Settings.Mode;
+	_g_LoopSpinMaximum = static_cast<DWORD64>(SpinMaximum) * 1000;
+	_g_LoopSpinBudget = _g_LoopSpinMaximum;
+
+	_g_LoopStatsSequence++;
+	_ReadWriteBarrier();
+
+	memset(&_g_LoopStats, 0, sizeof(_g_LoopStats));
+	_g_LoopStats.SpinBudget = static_cast<DWORD>(_g_LoopSpinBudget);
+	_g_LoopStats.Status = Status;
+
+	_ReadWriteBarrier();
+	_g_LoopStatsSequence++;
+
+	if (POEDBG_FAILURE(Status))
+	{
+		POEDBG_NOTIFY_CALLBACK(Error, Status);
+	}
+}
+
+/*
+Counts an event the loop waited Gap nanoseconds for, and moves the spin
+budget towards twice the gap. Gaps longer than the maximum spin would not
+have been caught by spinning anyway, so they pull the budget towards zero,
+and a run of them stops the loop spinning until events come closer together.
+*/
+inline void _PoeDbgLoopRecord(const bool bIsSpin, const DWORD64 Gap, const DWORD64 Latency, const DWORD64 SpinTime)
+{
+	DWORD64 Target = 0;
+
+	if (Gap <= _g_LoopSpinMaximum)
+	{
+		Target = (Gap * 2 < _g_LoopSpinMaximum) ? Gap * 2 : _g_LoopSpinMaximum;
+	}
+
+	if (Target > _g_LoopSpinBudget)
+	{
+		_g_LoopSpinBudget += (Target - _g_LoopSpinBudget) >> LOOP_BUDGET_SHIFT;
+	}
+	else
+	{
+		_g_LoopSpinBudget -= (_g_LoopSpinBudget - Target) >> LOOP_BUDGET_SHIFT;
+
+		// The shift never takes the budget all the way down, and a budget too
+		// small to wait out even one poll would only add a poll to every event.
+		if (_g_LoopSpinBudget < LOOP_BUDGET_MINIMUM)
+		{
+			_g_LoopSpinBudget = 0;
+		}
+	}
+
+	_g_LoopStatsSequence++;
+	_ReadWriteBarrier();
+
+	if (bIsSpin)
+	{
+		_g_LoopStats.SpinEvents++;
+		_g_LoopStats.SpinLatency[_PoeDbgLoopBucket(Latency)]++;
+	}
+	else
+	{
+		_g_LoopStats.BlockEvents++;
+	}
+
+	_g_LoopStats.SpinTime += SpinTime;
+	_g_LoopStats.SpinBudget = static_cast<DWORD>(_g_LoopSpinBudget);
+	_g_LoopStats.Gap[_PoeDbgLoopBucket(Gap)]++;
+
+	_ReadWriteBarrier();
+	_g_LoopStatsSequence++;
+}
+
+/*
+Waits for the next debug event and stamps it with when it arrived. In spin
+mode the platform is polled until the spin budget runs out, and only then
+does the loop block, so that an event that follows closely on the last is
+picked up without waiting for the thread to be woken. If Deadline isn't
+zero, the wait gives up once the clock reaches it. Returns the result of the
+wait, as for _PoeDbgPlatformWaitForEvent.
+*/
+inline int _PoeDbgLoopWaitForEvent(LPDEBUG_EVENT Event, PDWORD64 Timestamp, const DWORD64 Deadline)
+{
+	if (_g_LoopAppliedVersion != _g_LoopSettingsVersion)
+	{
+		_PoeDbgLoopApplySettings();
+	}
+
+	DWORD64 Start = _PoeDbgClockNow();
+	DWORD64 SpinTime = 0;
+
+	if (POEDBG_LOOP_SPIN == _g_LoopMode && 0 != _g_LoopSpinBudget)
+	{
+		DWORD64 Previous = Start;
+
+		for (;;)
+		{
+			int Result = _PoeDbgPlatformWaitForEvent(Event, 0);
+			DWORD64 Now = _PoeDbgClockNow();
+
+			if (PLATFORM_WAIT_EVENT == Result)
+			{
+				*Timestamp = Now;
+				_PoeDbgLoopRecord(true, Now - Start, Now - Previous, Now - Start);
+				return PLATFORM_WAIT_EVENT;
+			}
+
+			if (PLATFORM_WAIT_DONE == Result || (0 != Deadline && Now >= Deadline))
+			{
+				return Result;
+			}
+
+			if (Now - Start >= _g_LoopSpinBudget)
+			{
+				SpinTime = Now - Start;
+				break;
+			}
+
+			Previous = Now;
+			YieldProcessor();
+		}
+	}
+
+	DWORD Timeout = INFINITE;
+
+	if (0 != Deadline)
+	{
+		// Round up, so that the wait doesn't end just short of the deadline.
+		DWORD64 Now = _PoeDbgClockNow();
+		DWORD64 Remaining = (Deadline > Now) ? (Deadline - Now + 999999) / 1000000 : 0;
+
+		Timeout = (Remaining < INFINITE) ? static_cast<DWORD>(Remaining) : INFINITE - 1;
+	}
+
+	int Result = _PoeDbgPlatformWaitForEvent(Event, Timeout);
+
+	if (PLATFORM_WAIT_EVENT != Result)
+	{
+		return Result;
+	}
+
+	*Timestamp = _PoeDbgClockNow();
+	_PoeDbgLoopRecord(false, *Timestamp - Start, 0, SpinTime);
+
+	return PLATFORM_WAIT_EVENT;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Control Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Stores new settings for the debug loop, which applies them before it next
+waits for an event.
+*/
+inline POEDBG_STATUS _PoeDbgLoopSetSettings(const PPOEDBG_LOOP_SETTINGS Settings)
+{
+	if (NULL == Settings || (POEDBG_LOOP_BLOCK != Settings->Mode && POEDBG_LOOP_SPIN != Settings->Mode))
+	{
+		return POEDBG_STATUS_LOOP_SETTINGS_INVALID;
+	}
+
+	if (Settings->SpinMaximum > LOOP_SPIN_MAXIMUM)
+	{
+		return POEDBG_STATUS_LOOP_SETTINGS_INVALID;
+	}
+
+	// Windows only takes idle, time critical and the five levels in between,
+	// so anything else would only fail once the debug loop tried it.
+	if (THREAD_PRIORITY_IDLE != Settings->Priority && THREAD_PRIORITY_TIME_CRITICAL != Settings->Priority &&
+		(Settings->Priority < THREAD_PRIORITY_LOWEST || Settings->Priority > THREAD_PRIORITY_HIGHEST))
+	{
+		return POEDBG_STATUS_LOOP_SETTINGS_INVALID;
+	}
+
+	AcquireSRWLockExclusive(&_g_LoopSettingsLock);
+	_g_LoopSettings = *Settings;
+	_g_LoopSettings.Reserved = 0;
+	_g_LoopSettingsVersion++;
+	ReleaseSRWLockExclusive(&_g_LoopSettingsLock);
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Copies a consistent view of the debug loop's statistics. If the debug loop
+is part way through updating them, the copy is retried.
+*/
+inline void _PoeDbgLoopSnapshot(PPOEDBG_LOOP_STATS Stats)
+{
+	for (;;)
+	{
+		DWORD Sequence = _g_LoopStatsSequence;
+
+		if (0 == (Sequence & 1))
+		{
+			_ReadWriteBarrier();
+			memcpy(Stats, &_g_LoopStats, sizeof(POEDBG_LOOP_STATS));
+			_ReadWriteBarrier();
+
+			if (Sequence == _g_LoopStatsSequence)
+			{
+				return;
+			}
+		}
+
+		YieldProcessor();
+	}
+}
@@ -18,7 +18,7 @@ POEDBG_INLINE bool _PoeDbgMemoryRead(ULONG_PTR Address, PVOID Buffer, SIZE_T Siz
 	}
 
 	// Try to read from the game.
-	return (TRUE == ReadProcessMemory(_g_GameHandle, reinterpret_cast<LPCVOID>(Address), Buffer, Size, NULL));
+	return _PoeDbgPlatformReadMemory(Address, Buffer, Size);
 }
 
 /*
@@ -32,10 +32,8 @@ POEDBG_INLINE bool _PoeDbgMemoryWrite(ULONG_PTR Address, PVOID Buffer, SIZE_T Si
 		return false;
 	}
 
-	SIZE_T BytesWritten = 0;
-
 	// Try to write to the game.
-	return (TRUE == WriteProcessMemory(_g_GameHandle, reinterpret_cast<PVOID>(Address), Buffer, Size, &BytesWritten));
+	return _PoeDbgPlatformWriteMemory(Address, Buffer, Size);
 }
 
 /*
@@ -71,57 +69,169 @@ POEDBG_INLINE ULONG_PTR _PoeDbgMemoryLocalAddressToGame(ULONG_PTR LocalAddress)
 }
 
 /*
-Retrieves a bunch of information about the target process such as code base,
-dimensions, and other properties read from the PE header.
+Copies the game's code into our process, after reading the game's headers to
+find where it is.
 */
-POEDBG_INLINE POEDBG_STATUS _PoeDbgMemoryInitializeCache()
+POEDBG_INLINE POEDBG_STATUS _PoeDbgMemoryCopyCode()
+{
+	POEDBG_RETURN_STATUS_ON_FAILURE(_PoeDbgPlatformGetImageLayout());
+
+	// Allocate enough memory to store the game's .text section.
+	_g_GameCodeCopy = reinterpret_cast<ULONG_PTR>(VirtualAlloc(NULL, _g_GameSizeOfCode, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+	if (NULL == _g_GameCodeCopy)
+	{
+		return POEDBG_STATUS_CACHE_ALLOCATION_FAILED;
+	}
+
+	// Calculate the address of where the .text section starts.
+	ULONG_PTR CodeBaseAddress = _g_GameBaseAddress + _g_GameBaseOfCode;
+
+	if (!_PoeDbgMemoryRead(CodeBaseAddress, reinterpret_cast<PVOID*>(_g_GameCodeCopy), _g_GameSizeOfCode))
+	{
+		return POEDBG_STATUS_CACHE_COPY_FAILED;
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Maps the game's executable file and points the code copy at the section that
+holds the start of its code, so that nothing needs to be read from the game.
+The section is where the loader put it relative to the image base, so file
+addresses translate to the game through the section's RVA exactly as addresses
+in a copy do. Only the part of the section stored in the file is searched.
+*/
+inline POEDBG_STATUS _PoeDbgMemoryMapImageFile()
 {
-	if (!_PoeDbgMemoryRead(_g_GameBaseAddress, reinterpret_cast<PVOID*>(&_g_GameDosHeader), sizeof(IMAGE_DOS_HEADER)))
+	if (!_PoeDbgPlatformMapImageFile(&_g_GameImageView, &_g_GameImageViewSize))
 	{
+		_g_GameImageView = NULL;
 		return POEDBG_STATUS_CACHE_DOS_HEADER_NOT_FOUND;
 	}
 
-	// Calculate the address of the NT headers within the game.
-	ULONG_PTR NtHeadersAddress = _g_GameBaseAddress + _g_GameDosHeader.e_lfanew;
+	PBYTE File = reinterpret_cast<PBYTE>(_g_GameImageView);
+	SIZE_T FileSize = _g_GameImageViewSize;
+
+	PIMAGE_DOS_HEADER DosHeader = reinterpret_cast<PIMAGE_DOS_HEADER>(File);
+
+	if (FileSize < sizeof(IMAGE_DOS_HEADER) || IMAGE_DOS_SIGNATURE != DosHeader->e_magic)
+	{
+		return POEDBG_STATUS_CACHE_DOS_HEADER_NOT_FOUND;
+	}
 
-	if (!_PoeDbgMemoryRead(NtHeadersAddress, reinterpret_cast<PVOID*>(&_g_GameNtHeaders), sizeof(IMAGE_NT_HEADERS)))
+	if (DosHeader->e_lfanew < 0 || FileSize < sizeof(IMAGE_NT_HEADERS) || static_cast<SIZE_T>(DosHeader->e_lfanew) > FileSize - sizeof(IMAGE_NT_HEADERS))
 	{
 		return POEDBG_STATUS_CACHE_NT_HEADER_NOT_FOUND;
 	}
 
-	if (IMAGE_NT_SIGNATURE != _g_GameNtHeaders.Signature)
+	PIMAGE_NT_HEADERS NtHeaders = reinterpret_cast<PIMAGE_NT_HEADERS>(File + DosHeader->e_lfanew);
+
+	if (IMAGE_NT_SIGNATURE != NtHeaders->Signature || IMAGE_NT_OPTIONAL_HDR64_MAGIC != NtHeaders->OptionalHeader.Magic)
 	{
 		return POEDBG_STATUS_CACHE_NT_HEADER_INVALID;
 	}
 
-	// Save off the game image dimensions.
-	_g_GameImageSize = _g_GameNtHeaders.OptionalHeader.SizeOfImage;
-	_g_GameBaseOfCode = _g_GameNtHeaders.OptionalHeader.BaseOfCode;
-	_g_GameSizeOfCode = _g_GameNtHeaders.OptionalHeader.SizeOfCode;
+	PIMAGE_SECTION_HEADER Sections = IMAGE_FIRST_SECTION(NtHeaders);
+	WORD SectionCount = NtHeaders->FileHeader.NumberOfSections;
 
-	// Allocate enough memory to store the game's .text section.
-	_g_GameCodeCopy = reinterpret_cast<ULONG_PTR>(VirtualAlloc(NULL, _g_GameSizeOfCode, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+	if (reinterpret_cast<ULONG_PTR>(&Sections[SectionCount]) - reinterpret_cast<ULONG_PTR>(File) > FileSize)
+	{
+		return POEDBG_STATUS_CACHE_NT_HEADER_INVALID;
+	}
 
-	if (NULL == _g_GameCodeCopy)
+	DWORD BaseOfCode = NtHeaders->OptionalHeader.BaseOfCode;
+
+	for (WORD Index = 0; Index < SectionCount; Index++)
 	{
-		return POEDBG_STATUS_CACHE_ALLOCATION_FAILED;
+		PIMAGE_SECTION_HEADER Section = &Sections[Index];
+
+		// Sections may be larger in memory than in the file, or the other way
+		// around once padded to the file alignment.
+		DWORD Size = Section->SizeOfRawData;
+
+		if (0 != Section->Misc.VirtualSize && Section->Misc.VirtualSize < Size)
+		{
+			Size = Section->Misc.VirtualSize;
+		}
+
+		if (BaseOfCode < Section->VirtualAddress || BaseOfCode - Section->VirtualAddress >= Size)
+		{
+			continue;
+		}
+
+		if (Section->PointerToRawData > FileSize || Size > FileSize - Section->PointerToRawData)
+		{
+			return POEDBG_STATUS_CACHE_NT_HEADER_INVALID;
+		}
+
+		// Save off the game image dimensions.
+		_g_GameImageSize = NtHeaders->OptionalHeader.SizeOfImage;
+		_g_GameBaseOfCode = Section->VirtualAddress;
+		_g_GameSizeOfCode = Size;
+		_g_GameCodeCopy = reinterpret_cast<ULONG_PTR>(File + Section->PointerToRawData);
+
+		return POEDBG_STATUS_SUCCESS;
 	}
 
-	// Calculate the address of where the .text section starts.
-	ULONG_PTR CodeBaseAddress = _g_GameBaseAddress + _g_GameBaseOfCode;
+	return POEDBG_STATUS_CACHE_NT_HEADER_INVALID;
+}
 
-	if (!_PoeDbgMemoryRead(CodeBaseAddress, reinterpret_cast<PVOID*>(_g_GameCodeCopy), _g_GameSizeOfCode))
+/*
+Releases the code copy, or the view of the executable file that stands in for
+it, and forgets the game image dimensions.
+*/
+inline void _PoeDbgMemoryReleaseCache()
+{
+	if (NULL != _g_GameImageView)
 	{
-		return POEDBG_STATUS_CACHE_COPY_FAILED;
+		_PoeDbgPlatformUnmapImageFile(_g_GameImageView, _g_GameImageViewSize);
+
+		_g_GameImageView = NULL;
+		_g_GameImageViewSize = NULL;
+	}
+	else if (NULL != _g_GameCodeCopy)
+	{
+		VirtualFree(reinterpret_cast<PVOID>(_g_GameCodeCopy), 0, MEM_RELEASE);
 	}
 
-	return POEDBG_STATUS_SUCCESS;
+	_g_GameCodeCopy = NULL;
+	_g_GameImageSize = NULL;
+	_g_GameBaseOfCode = NULL;
+	_g_GameSizeOfCode = NULL;
+
+	_g_bIsGameInformationCaptured = false;
+}
+
+/*
+Retrieves a bunch of information about the target process such as code base,
+dimensions, and other properties of the game image. With the file signature
+source, the code is searched where it sits in the game's executable, and is
+only copied from the game if the file can't be used.
+*/
+POEDBG_INLINE POEDBG_STATUS _PoeDbgMemoryInitializeCache()
+{
+	// Let go of anything left from an earlier attempt.
+	_PoeDbgMemoryReleaseCache();
+
+	if (POEDBG_SIGNATURE_SOURCE_FILE == _g_SignatureSource)
+	{
+		if (POEDBG_SUCCESS(_PoeDbgMemoryMapImageFile()))
+		{
+			return POEDBG_STATUS_SUCCESS;
+		}
+
+		_PoeDbgMemoryReleaseCache();
+	}
+
+	return _PoeDbgMemoryCopyCode();
 }
 
 /*
 Search for the specified byte pattern starting from the given address and
 ending with a null character. A required byte is prefixed by '_'. Also
-supports logical AND-based comparisons if the byte is prefixed by '&'.
+supports logical AND-based comparisons if the byte is prefixed by '&'. Any
+other character, such as '?', matches any byte.
 */
 POEDBG_INLINE ULONG_PTR _PoeDbgMemoryFindPattern(PBYTE Pattern, ULONG_PTR SearchAddress, SIZE_T SearchLength)
 {
@@ -168,16 +278,51 @@ POEDBG_INLINE ULONG_PTR _PoeDbgMemoryFindPattern(PBYTE Pattern, ULONG_PTR Search
 }
 
 /*
-Finds the first instance of a given signature and returns it as a game address.
-If the OverrideStartAddress parameter is used, starts search from that game address.
+Counts the bytes of code that the given signature spans.
 */
-POEDBG_INLINE ULONG_PTR _PoeDbgMemoryFind(PBYTE Pattern, ULONG_PTR OverrideSearchAddress = NULL)
+POEDBG_INLINE SIZE_T _PoeDbgMemoryPatternLength(PBYTE Pattern)
 {
-	if (!_g_bIsGameInformationCaptured)
+	SIZE_T Length = 0;
+
+	for (PBYTE PatternIndex = Pattern; NULL != PatternIndex[0]; PatternIndex++, Length++)
+	{
+		if ('_' == PatternIndex[0] || '&' == PatternIndex[0])
+		{
+			PatternIndex++;
+		}
+	}
+
+	return Length;
+}
+
+/*
+Checks that the given signature matches the running game at the given game
+address. Signatures longer than SIGNATURE_VERIFY_MAXIMUM are not checked.
+*/
+inline bool _PoeDbgMemoryIsPatternInGame(PBYTE Pattern, ULONG_PTR GameAddress)
+{
+	BYTE Code[SIGNATURE_VERIFY_MAXIMUM];
+	SIZE_T Length = _PoeDbgMemoryPatternLength(Pattern);
+
+	if (Length > sizeof(Code))
 	{
-		_g_bIsGameInformationCaptured = _PoeDbgMemoryInitializeCache();
+		return true;
 	}
 
+	if (!_PoeDbgMemoryRead(GameAddress, Code, Length))
+	{
+		return false;
+	}
+
+	return (reinterpret_cast<ULONG_PTR>(Code) == _PoeDbgMemoryFindPattern(Pattern, reinterpret_cast<ULONG_PTR>(Code), 1));
+}
+
+/*
+Searches the code copy for the first instance of a given signature, starting
+from the given game address if there is one. Returns the local address.
+*/
+POEDBG_INLINE ULONG_PTR _PoeDbgMemorySearchCode(PBYTE Pattern, ULONG_PTR OverrideSearchAddress)
+{
 	// Initialize address.
 	ULONG_PTR SearchAddress = NULL;
 
@@ -196,7 +341,37 @@ POEDBG_INLINE ULONG_PTR _PoeDbgMemoryFind(PBYTE Pattern, ULONG_PTR OverrideSearc
 	SIZE_T SearchLength = (_g_GameCodeCopy + _g_GameSizeOfCode) - SearchAddress;
 
 	// Search for the signature.
-	ULONG_PTR FoundAddress = _PoeDbgMemoryFindPattern(Pattern, SearchAddress, SearchLength);
+	return _PoeDbgMemoryFindPattern(Pattern, SearchAddress, SearchLength);
+}
+
+/*
+Finds the first instance of a given signature and returns it as a game address.
+If the OverrideStartAddress parameter is used, starts search from that game address.
+*/
+POEDBG_INLINE ULONG_PTR _PoeDbgMemoryFind(PBYTE Pattern, ULONG_PTR OverrideSearchAddress = NULL)
+{
+	if (!_g_bIsGameInformationCaptured)
+	{
+		_g_bIsGameInformationCaptured = POEDBG_SUCCESS(_PoeDbgMemoryInitializeCache());
+	}
+
+	ULONG_PTR FoundAddress = _PoeDbgMemorySearchCode(Pattern, OverrideSearchAddress);
+
+	if (NULL != _g_GameImageView)
+	{
+		// Code found in the executable file must be the same in the game. If
+		// it isn't, or the signature isn't in the file at all, the file may not
+		// be the one the game was started from, so copy the game's code and
+		// search that instead, from now on.
+
+		if (NULL == FoundAddress || !_PoeDbgMemoryIsPatternInGame(Pattern, _PoeDbgMemoryLocalAddressToGame(FoundAddress)))
+		{
+			_PoeDbgMemoryReleaseCache();
+			_g_bIsGameInformationCaptured = POEDBG_SUCCESS(_PoeDbgMemoryCopyCode());
+
+			FoundAddress = _PoeDbgMemorySearchCode(Pattern, OverrideSearchAddress);
+		}
+	}
 
 	if (NULL != FoundAddress)
 	{
@@ -211,43 +386,92 @@ POEDBG_INLINE ULONG_PTR _PoeDbgMemoryFind(PBYTE Pattern, ULONG_PTR OverrideSearc
 }
 
 /*
-Removes the hardware breakpoint set at the given index for the given thread
-handle, if possible.
+Sets a slot in the breakpoint table. Nothing changes in the game until the
+table is applied to its threads.
 */
-POEDBG_INLINE bool _PoeDbgMemoryResetBreakpoint(HANDLE Thread, USHORT Index)
+POEDBG_INLINE bool _PoeDbgMemoryDefineBreakpoint(USHORT Index, ULONG_PTR Address, SIZE_T Length, SIZE_T Type)
 {
-	if (Thread == NULL)
+	if (Index >= BP_SLOT_COUNT)
 	{
 		return false;
 	}
 
-	CONTEXT Context = { 0 };
-	Context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+	_g_Breakpoints[Index].Address = Address;
+	_g_Breakpoints[Index].Length = static_cast<BYTE>(Length);
+	_g_Breakpoints[Index].Type = static_cast<BYTE>(Type);
+	_g_Breakpoints[Index].bIsEnabled = true;
 
-	if (FALSE == GetThreadContext(Thread, &Context))
-	{
-		// First we need to get the original context so that if any debug registers
-		// have been set, we make sure they stay set.
+	return true;
+}
 
-		return false;
+/*
+Clears a slot in the breakpoint table. As with setting one, the game is only
+changed once the table is applied to its threads.
+*/
+POEDBG_INLINE void _PoeDbgMemoryClearBreakpoint(USHORT Index)
+{
+	if (Index < BP_SLOT_COUNT)
+	{
+		_g_Breakpoints[Index].bIsEnabled = false;
 	}
+}
+
+/*
+Writes the whole breakpoint table into the debug registers of the given
+context. Bits of DR7 that don't belong to the four slots are left alone.
+Returns false if the context already matched the table.
+*/
+POEDBG_INLINE bool _PoeDbgMemoryBuildDebugRegisters(PCONTEXT Context)
+{
+	DWORD64 Addresses[BP_SLOT_COUNT] = { Context->Dr0, Context->Dr1, Context->Dr2, Context->Dr3 };
+	DWORD64 Dr7 = Context->Dr7 & ~static_cast<DWORD64>(BP_DR7_SLOT_MASK);
+
+	bool bIsChanged = false;
+
+	for (USHORT Index = 0; Index < BP_SLOT_COUNT; Index++)
+	{
+		PPOEDBG_BREAKPOINT Breakpoint = &_g_Breakpoints[Index];
+
+		if (!Breakpoint->bIsEnabled)
+		{
+			continue;
+		}
+
+		if (Addresses[Index] != static_cast<DWORD64>(Breakpoint->Address))
+		{
+			Addresses[Index] = static_cast<DWORD64>(Breakpoint->Address);
+			bIsChanged = true;
+		}
 
-	// Reset local enabled bit for this register.
-	_bittestandreset(reinterpret_cast<PLONG>(&Context.Dr7), static_cast<LONG>(Index * 2));
+		// Local enable bit, then the condition and size bits.
+		Dr7 |= static_cast<DWORD64>(1) << (Index * 2);
+		Dr7 |= static_cast<DWORD64>(Breakpoint->Type) << (16 + (Index * 4));
+		Dr7 |= static_cast<DWORD64>(Breakpoint->Length) << (18 + (Index * 4));
+	}
 
-	if (FALSE == SetThreadContext(Thread, &Context))
+	if (!bIsChanged && Dr7 == Context->Dr7)
 	{
 		return false;
 	}
 
+	Context->Dr0 = Addresses[0];
+	Context->Dr1 = Addresses[1];
+	Context->Dr2 = Addresses[2];
+	Context->Dr3 = Addresses[3];
+	Context->Dr7 = Dr7;
+
+	// Reset status register.
+	Context->Dr6 = 0;
+
 	return true;
 }
 
 /*
-Sets the given debug register to monitor the given address, based on certain
-conditions. This will overwrite any existing breakpoint.
+Applies the breakpoint table to a single thread, with one read of its context
+and, only if its debug registers don't already match, one write.
+The thread must not be running.
 */
-POEDBG_INLINE bool _PoeDbgMemorySetBreakpoint(HANDLE Thread, ULONG_PTR Address, SIZE_T Length, SIZE_T Type, USHORT Index)
+POEDBG_INLINE bool _PoeDbgMemoryApplyBreakpoints(HANDLE Thread)
 {
 	if (NULL == Thread)
 	{
@@ -257,112 +481,61 @@ POEDBG_INLINE bool _PoeDbgMemorySetBreakpoint(HANDLE Thread, ULONG_PTR Address,
 	CONTEXT Context = { 0 };
 	Context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
 
-	if (FALSE == GetThreadContext(Thread, &Context))
-	{
-		// First we need to get the original context so that if any debug registers
-		// have been set, we make sure they stay set.
-
-		return false;
-	}
-
-	// Now we can set the correct debug register based on what
-	// index the caller passed in.
-
-	switch (Index)
+	if (!_PoeDbgPlatformGetContext(Thread, &Context))
 	{
-	case 0:
-		Context.Dr0 = static_cast<DWORD64>(Address);
-		break;
-	case 1:
-		Context.Dr1 = static_cast<DWORD64>(Address);
-		break;
-	case 2:
-		Context.Dr2 = static_cast<DWORD64>(Address);
-		break;
-	case 3:
-		Context.Dr3 = static_cast<DWORD64>(Address);
-		break;
-	default:
 		return false;
 	}
 
-	// Set local enabled bit for this register.
-	_bittestandset(reinterpret_cast<PLONG>(&Context.Dr7), static_cast<LONG>(Index * 2));
-
-	// Set condition bits for this register.
-	Context.Dr7 |= (Type << (static_cast<SIZE_T>(16) + (Index * 4)));
-
-	// Set size bits for this register.
-	Context.Dr7 |= (Length << (static_cast<SIZE_T>(18) + (Index * 4)));
-
-	// Reset status register.
-	Context.Dr6 = 0;
-
-	if (FALSE == SetThreadContext(Thread, &Context))
+	if (!_PoeDbgMemoryBuildDebugRegisters(&Context))
 	{
-		return false;
+		// Nothing to do.
+		return true;
 	}
 
-	return true;
+	return _PoeDbgPlatformSetContext(Thread, &Context);
 }
 
 /*
-Sets the given hardware breakpoint on all threads within the process,
-overwriting any existing hardware breakpoint at that index.
+Applies the breakpoint table to every game thread that the debug loop knows
+about, suspending each one while its debug registers are changed. Returns
+false if any thread could not be updated.
 */
-__forceinline bool _PoeDbgMemoryModifyGlobalBreakpoint(ULONG_PTR Address, SIZE_T Length, SIZE_T Type, USHORT Index, bool bSet = true)
+inline bool _PoeDbgMemoryApplyBreakpointsToThreads()
 {
-	// Take a snapshot of all running threads  
-	HANDLE Snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+	bool bIsApplied = true;
 
-	if (INVALID_HANDLE_VALUE == Snapshot)
-	{
-		return false;
-	}
-
-	// Initialize entry.
-	THREADENTRY32 Entry;
-
-	// Set the structure size.
-	Entry.dwSize = sizeof(THREADENTRY32);
+	AcquireSRWLockExclusive(&_g_BreakpointsLock);
+	AcquireSRWLockShared(&_g_GameThreadsLock);
 
-	if (FALSE == Thread32First(Snapshot, &Entry))
+	for (auto& Entry : _g_GameThreads)
 	{
-		// Cleanup.
-		CloseHandle(Snapshot);
-		return false;
-	}
+		HANDLE Thread = Entry.second;
 
-	do
-	{
-		if (Entry.th32OwnerProcessID == _g_GameId)
+		if (!_PoeDbgPlatformSuspendThread(Thread))
 		{
-			// Try to open a handle to the thread.
-			HANDLE Thread = OpenThread(THREAD_GET_CONTEXT | THREAD_SET_CONTEXT | THREAD_SUSPEND_RESUME, FALSE, Entry.th32ThreadID);
+			bIsApplied = false;
+			continue;
+		}
 
-			if (NULL == Thread)
-			{
-				continue;
-			}
+		if (!_PoeDbgMemoryApplyBreakpoints(Thread))
+		{
+			bIsApplied = false;
+		}
 
-			// Suspend the thread.
-			SuspendThread(Thread);
+		_PoeDbgPlatformResumeThread(Thread);
+	}
 
-			if (bSet)
-			{
-				_PoeDbgMemorySetBreakpoint(Thread, Address, Length, Type, Index);
-			}
-			else
-			{
-				_PoeDbgMemoryResetBreakpoint(Thread, Index);
-			}
+	ReleaseSRWLockShared(&_g_GameThreadsLock);
+	ReleaseSRWLockExclusive(&_g_BreakpointsLock);
 
-			// Resume the thread.
-			ResumeThread(Thread);
-		}
-	} while (FALSE != Thread32Next(Snapshot, &Entry));
+	return bIsApplied;
+}
 
-	// Cleanup.
-	CloseHandle(Snapshot);
-	return true;
-}
\ No newline at end of file
+/*
+Applies the breakpoint table to every game thread, from whichever thread the
+platform allows.
+*/
+inline bool _PoeDbgMemoryApplyBreakpointsToAll()
+{
+	return _PoeDbgPlatformRunOnDebugThread(_PoeDbgMemoryApplyBreakpointsToThreads);
+}
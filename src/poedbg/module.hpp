@@ -0,0 +1,334 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Signature cache entry for a signature that a module doesn't contain.
+#define MODULE_PATTERN_NOT_FOUND (static_cast<ULONG_PTR>(-1))
+
+//////////////////////////////////////////////////////////////////////////
+// Module Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Compares two module names, ignoring case.
+*/
+POEDBG_INLINE bool _PoeDbgModuleIsNameEqual(const wchar_t* Name, const wchar_t* Other)
+{
+	for (; towlower(Name[0]) == towlower(Other[0]); Name++, Other++)
+	{
+		if (L'\0' == Name[0])
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+Copies a module name, truncating it to fit the given number of characters.
+Returns false if it had to be truncated.
+*/
+POEDBG_INLINE bool _PoeDbgModuleCopyName(wchar_t* Target, const wchar_t* Source, const SIZE_T Length)
+{
+	if (0 == Length)
+	{
+		return false;
+	}
+
+	SIZE_T Index = 0;
+
+	for (; Index < Length - 1 && L'\0' != Source[Index]; Index++)
+	{
+		Target[Index] = Source[Index];
+	}
+
+	Target[Index] = L'\0';
+
+	return (L'\0' == Source[Index]);
+}
+
+/*
+Adds the bytes of the given buffer to a running FNV-1a hash.
+*/
+POEDBG_INLINE DWORD64 _PoeDbgModuleHash(DWORD64 Hash, const void* Buffer, SIZE_T Size)
+{
+	const BYTE* Bytes = reinterpret_cast<const BYTE*>(Buffer);
+
+	for (SIZE_T Index = 0; Index < Size; Index++)
+	{
+		Hash = (Hash ^ Bytes[Index]) * 0x100000001B3ULL;
+	}
+
+	return Hash;
+}
+
+/*
+Builds the signature cache key of a signature in a module. The key covers the
+module's identity, its name, link time and size, rather than where it was
+loaded, so a search survives the module being unloaded and loaded again.
+*/
+inline DWORD64 _PoeDbgModuleGetPatternKey(const PPOEDBG_MODULE Module, PBYTE Pattern)
+{
+	DWORD64 Hash = 0xCBF29CE484222325ULL;
+
+	for (const wchar_t* Name = Module->Name; L'\0' != Name[0]; Name++)
+	{
+		wchar_t Lower = static_cast<wchar_t>(towlower(Name[0]));
+		Hash = _PoeDbgModuleHash(Hash, &Lower, sizeof(Lower));
+	}
+
+	Hash = _PoeDbgModuleHash(Hash, &Module->TimeDateStamp, sizeof(Module->TimeDateStamp));
+	Hash = _PoeDbgModuleHash(Hash, &Module->Size, sizeof(Module->Size));
+
+	return _PoeDbgModuleHash(Hash, Pattern, strlen(reinterpret_cast<const char*>(Pattern)));
+}
+
+/*
+Finds the module that contains the given game address, or NULL. The caller
+must hold the module lock.
+*/
+inline PPOEDBG_MODULE _PoeDbgModuleFindByAddress(const ULONG_PTR Address)
+{
+	// The module starting nearest below the address is the only one that can
+	// hold it.
+	auto Entry = _g_GameModules.upper_bound(Address);
+
+	if (Entry == _g_GameModules.begin())
+	{
+		return NULL;
+	}
+
+	--Entry;
+
+	if (Address - Entry->second.Base >= Entry->second.Size)
+	{
+		return NULL;
+	}
+
+	return &Entry->second;
+}
+
+/*
+Finds a loaded module by its file name, ignoring case, or NULL. The caller
+must hold the module lock.
+*/
+inline PPOEDBG_MODULE _PoeDbgModuleFindByName(const wchar_t* Name)
+{
+	for (auto& Entry : _g_GameModules)
+	{
+		if (_PoeDbgModuleIsNameEqual(Entry.second.Name, Name))
+		{
+			return &Entry.second;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+Records a module that the game has loaded at the given address. Only its
+headers are read here, for its size and identity, and its code is left until
+a signature is searched for in it.
+*/
+inline POEDBG_STATUS _PoeDbgModuleLoad(const ULONG_PTR Base, const wchar_t* Name)
+{
+	IMAGE_DOS_HEADER DosHeader;
+	IMAGE_NT_HEADERS NtHeaders;
+
+	if (!_PoeDbgMemoryRead(Base, &DosHeader, sizeof(IMAGE_DOS_HEADER)) || IMAGE_DOS_SIGNATURE != DosHeader.e_magic)
+	{
+		return POEDBG_STATUS_CACHE_DOS_HEADER_NOT_FOUND;
+	}
+
+	if (!_PoeDbgMemoryRead(Base + DosHeader.e_lfanew, &NtHeaders, sizeof(IMAGE_NT_HEADERS)))
+	{
+		return POEDBG_STATUS_CACHE_NT_HEADER_NOT_FOUND;
+	}
+
+	if (IMAGE_NT_SIGNATURE != NtHeaders.Signature)
+	{
+		return POEDBG_STATUS_CACHE_NT_HEADER_INVALID;
+	}
+
+	POEDBG_MODULE Module = { 0 };
+	Module.Base = Base;
+	Module.Size = NtHeaders.OptionalHeader.SizeOfImage;
+	Module.TimeDateStamp = NtHeaders.FileHeader.TimeDateStamp;
+	Module.BaseOfCode = NtHeaders.OptionalHeader.BaseOfCode;
+	Module.SizeOfCode = NtHeaders.OptionalHeader.SizeOfCode;
+
+	_PoeDbgModuleCopyName(Module.Name, Name, MODULE_NAME_MAXIMUM);
+
+	AcquireSRWLockExclusive(&_g_GameModulesLock);
+
+	// A module loaded where another one was must have replaced it.
+	auto Entry = _g_GameModules.find(Base);
+
+	if (Entry != _g_GameModules.end() && NULL != Entry->second.CodeCopy)
+	{
+		VirtualFree(Entry->second.CodeCopy, 0, MEM_RELEASE);
+	}
+
+	_g_GameModules[Base] = Module;
+
+	ReleaseSRWLockExclusive(&_g_GameModulesLock);
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Forgets a module that the game has unloaded, and frees its code copy. The
+signatures found in it stay cached in case it is loaded again.
+*/
+inline void _PoeDbgModuleUnload(const ULONG_PTR Base)
+{
+	AcquireSRWLockExclusive(&_g_GameModulesLock);
+
+	auto Entry = _g_GameModules.find(Base);
+
+	if (Entry != _g_GameModules.end())
+	{
+		if (NULL != Entry->second.CodeCopy)
+		{
+			VirtualFree(Entry->second.CodeCopy, 0, MEM_RELEASE);
+		}
+
+		_g_GameModules.erase(Entry);
+	}
+
+	ReleaseSRWLockExclusive(&_g_GameModulesLock);
+}
+
+/*
+Copies the code of a module out of the game, if it hasn't been already. The
+caller must hold the module lock exclusively.
+*/
+inline POEDBG_STATUS _PoeDbgModuleCaptureCode(PPOEDBG_MODULE Module)
+{
+	if (NULL != Module->CodeCopy)
+	{
+		return POEDBG_STATUS_SUCCESS;
+	}
+
+	if (0 == Module->SizeOfCode || Module->BaseOfCode >= Module->Size)
+	{
+		return POEDBG_STATUS_CACHE_NT_HEADER_INVALID;
+	}
+
+	PBYTE CodeCopy = reinterpret_cast<PBYTE>(VirtualAlloc(NULL, Module->SizeOfCode, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+	if (NULL == CodeCopy)
+	{
+		return POEDBG_STATUS_CACHE_ALLOCATION_FAILED;
+	}
+
+	if (!_PoeDbgMemoryRead(Module->Base + Module->BaseOfCode, CodeCopy, Module->SizeOfCode))
+	{
+		VirtualFree(CodeCopy, 0, MEM_RELEASE);
+		return POEDBG_STATUS_CACHE_COPY_FAILED;
+	}
+
+	Module->CodeCopy = CodeCopy;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Finds the first instance of a signature in the given module, and returns it
+as a game address. The game's own image is searched by the memory functions,
+and any other module has its code copied the first time it is searched.
+Results are cached by module identity, so each signature is only ever
+searched for once in each module. The caller must hold the module lock
+exclusively.
+*/
+inline POEDBG_STATUS _PoeDbgModuleFind(PPOEDBG_MODULE Module, PBYTE Pattern, PULONG_PTR Address)
+{
+	*Address = NULL;
+
+	if (Module->Base == _g_GameBaseAddress)
+	{
+		*Address = _PoeDbgMemoryFind(Pattern);
+		return (NULL != *Address) ? POEDBG_STATUS_SUCCESS : POEDBG_STATUS_PATTERN_NOT_FOUND;
+	}
+
+	DWORD64 Key = _PoeDbgModuleGetPatternKey(Module, Pattern);
+
+	auto Cached = _g_ModulePatterns.find(Key);
+
+	if (Cached == _g_ModulePatterns.end())
+	{
+		POEDBG_RETURN_STATUS_ON_FAILURE(_PoeDbgModuleCaptureCode(Module));
+
+		ULONG_PTR CodeCopy = reinterpret_cast<ULONG_PTR>(Module->CodeCopy);
+		ULONG_PTR FoundAddress = _PoeDbgMemoryFindPattern(Pattern, CodeCopy, Module->SizeOfCode);
+
+		// Save the offset from the module base, which holds wherever the
+		// module is loaded.
+		ULONG_PTR Offset = (NULL != FoundAddress) ? Module->BaseOfCode + (FoundAddress - CodeCopy) : MODULE_PATTERN_NOT_FOUND;
+
+		Cached = _g_ModulePatterns.emplace(Key, Offset).first;
+	}
+
+	if (MODULE_PATTERN_NOT_FOUND == Cached->second)
+	{
+		return POEDBG_STATUS_PATTERN_NOT_FOUND;
+	}
+
+	*Address = Module->Base + Cached->second;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Finds the first instance of a signature in the module with the given name, or
+in the game's own image if the name is NULL, and returns it as a game address.
+*/
+inline POEDBG_STATUS _PoeDbgModuleFindPattern(const wchar_t* ModuleName, PBYTE Pattern, PULONG_PTR Address)
+{
+	POEDBG_STATUS Status = POEDBG_STATUS_SUCCESS;
+
+	*Address = NULL;
+
+	AcquireSRWLockExclusive(&_g_GameModulesLock);
+
+	if (NULL == ModuleName)
+	{
+		*Address = _PoeDbgMemoryFind(Pattern);
+		Status = (NULL != *Address) ? POEDBG_STATUS_SUCCESS : POEDBG_STATUS_PATTERN_NOT_FOUND;
+	}
+	else
+	{
+		PPOEDBG_MODULE Module = _PoeDbgModuleFindByName(ModuleName);
+		Status = (NULL != Module) ? _PoeDbgModuleFind(Module, Pattern, Address) : POEDBG_STATUS_MODULE_NOT_FOUND;
+	}
+
+	ReleaseSRWLockExclusive(&_g_GameModulesLock);
+
+	return Status;
+}
+
+/*
+Forgets every module, when detaching from the game. Cached signatures are
+kept, since they hold for the same modules in the next session.
+*/
+inline void _PoeDbgModuleReset()
+{
+	AcquireSRWLockExclusive(&_g_GameModulesLock);
+
+	for (auto& Entry : _g_GameModules)
+	{
+		if (NULL != Entry.second.CodeCopy)
+		{
+			VirtualFree(Entry.second.CodeCopy, 0, MEM_RELEASE);
+		}
+	}
+
+	_g_GameModules.clear();
+
+	ReleaseSRWLockExclusive(&_g_GameModulesLock);
+}
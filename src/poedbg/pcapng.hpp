@@ -0,0 +1,804 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Block types and the options we write.
+#define PCAPNG_BLOCK_SECTION_HEADER 0x0A0D0D0A
+#define PCAPNG_BLOCK_INTERFACE 0x00000001
+#define PCAPNG_BLOCK_ENHANCED_PACKET 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPTION_END 0
+#define PCAPNG_OPTION_COMMENT 1
+#define PCAPNG_OPTION_USER_APPLICATION 4
+#define PCAPNG_OPTION_INTERFACE_NAME 2
+#define PCAPNG_OPTION_TIMESTAMP_RESOLUTION 9
+#define PCAPNG_OPTION_PACKET_ID 5
+#define PCAPNG_OPTION_QUEUE 6
+
+// Packets are written as the game framed them, with no link layer, so every
+// interface uses the first link type set aside for private use.
+#define PCAPNG_LINKTYPE_USER0 147
+
+// Timestamps are in nanoseconds.
+#define PCAPNG_TIMESTAMP_RESOLUTION 9
+
+// Rounds a size up to the 32-bit alignment of everything in a block.
+#define PCAPNG_ALIGN(x) (((x) + 3) & ~static_cast<DWORD>(3))
+
+// Size of an enhanced packet block holding the given number of bytes. The
+// block carries the packet ID as a four character comment, such as "0x1F",
+// the sequence number as the packet identifier, and the source hook as the
+// queue.
+#define PCAPNG_PACKET_BLOCK_SIZE(x) (28 + PCAPNG_ALIGN(x) + 8 + 12 + 8 + 4 + 4)
+
+// Largest set of headers that starts each file.
+#define PCAPNG_HEADERS_MAXIMUM 0x100
+
+// Difference between the Windows and Unix epochs, in 100 nanosecond units.
+#define PCAPNG_FILETIME_UNIX_EPOCH 116444736000000000ULL
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+// One of the buffers packets are written into. A buffer that starts a file
+// begins with the file's headers, and the writer moves on to the next file
+// before writing it.
+typedef struct _POEDBG_PCAPNG_BUFFER
+{
+	PBYTE Data;
+	DWORD Used;
+	bool bStartsFile;
+} POEDBG_PCAPNG_BUFFER, *PPOEDBG_PCAPNG_BUFFER;
+
+//////////////////////////////////////////////////////////////////////////
+// Globals
+//////////////////////////////////////////////////////////////////////////
+
+// The buffers, used in turn. Filled counts every buffer the debug loop has
+// handed to the writer, and Written every buffer the writer has handed back,
+// so the debug loop writes into buffer Filled, if it has been written out.
+__declspec(selectany) POEDBG_PCAPNG_BUFFER _g_PcapngBuffers[PCAPNG_BUFFER_COUNT];
+__declspec(selectany) volatile LONG64 _g_PcapngFilled;
+__declspec(selectany) volatile LONG64 _g_PcapngWritten;
+
+// Is the debug loop writing packets out? The sequence is odd while it is part
+// way through one, and the debug loop waits while the writer is paused.
+__declspec(selectany) volatile bool _g_bIsPcapngEnabled = false;
+__declspec(selectany) volatile bool _g_bIsPcapngPaused = false;
+__declspec(selectany) volatile LONG _g_PcapngSequence;
+
+// Headers that start every file, and the path files are named after.
+__declspec(selectany) BYTE _g_PcapngHeaders[PCAPNG_HEADERS_MAXIMUM];
+__declspec(selectany) DWORD _g_PcapngHeadersSize;
+__declspec(selectany) wchar_t _g_PcapngPath[PCAPNG_PATH_MAXIMUM];
+
+// When to move on to the next file, in bytes and nanoseconds. Zero never does.
+__declspec(selectany) DWORD64 _g_PcapngRotateSize;
+__declspec(selectany) DWORD64 _g_PcapngRotateTime;
+
+// The current file, as the debug loop sees it. A new file is pending when
+// its headers still have to be written.
+__declspec(selectany) DWORD64 _g_PcapngFileSize;
+__declspec(selectany) DWORD64 _g_PcapngFileStart;
+__declspec(selectany) bool _g_bIsPcapngFilePending;
+
+// Wall-clock time of timestamp zero, in nanoseconds since the Unix epoch.
+__declspec(selectany) DWORD64 _g_PcapngEpochOffset;
+
+// The current file, as the writer sees it.
+__declspec(selectany) POEDBG_FILE _g_PcapngFile;
+__declspec(selectany) bool _g_bIsPcapngFileOpen;
+__declspec(selectany) DWORD64 _g_PcapngFileOffset;
+__declspec(selectany) DWORD _g_PcapngFileIndex;
+
+// Progress, for PoeDbgGetPcapngStats.
+__declspec(selectany) POEDBG_PCAPNG_STATS _g_PcapngStats;
+
+// Wakes the writer, and tells whoever stopped it that it has finished.
+__declspec(selectany) HANDLE _g_PcapngSemaphore;
+__declspec(selectany) HANDLE _g_PcapngDoneSemaphore;
+__declspec(selectany) volatile bool _g_bIsPcapngStopping;
+
+// Serializes starting and stopping, and pausing the debug loop.
+__declspec(selectany) SRWLOCK _g_PcapngControlLock = SRWLOCK_INIT;
+__declspec(selectany) SRWLOCK _g_PcapngPauseLock = SRWLOCK_INIT;
+
+//////////////////////////////////////////////////////////////////////////
+// Block Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Writes a block option at the cursor and moves past it.
+*/
+POEDBG_INLINE void _PoeDbgPcapngPutOption(PBYTE* Cursor, const WORD Code, const void* Value, const WORD Length)
+{
+	memcpy(*Cursor, &Code, sizeof(WORD));
+	memcpy(*Cursor + 2, &Length, sizeof(WORD));
+	memset(*Cursor + 4, 0, PCAPNG_ALIGN(Length));
+
+	if (0 != Length)
+	{
+		memcpy(*Cursor + 4, Value, Length);
+	}
+
+	*Cursor += 4 + PCAPNG_ALIGN(Length);
+}
+
+/*
+Writes a block's type and leaves room for its length, which is filled in by
+_PoeDbgPcapngEndBlock.
+*/
+POEDBG_INLINE void _PoeDbgPcapngBeginBlock(PBYTE* Cursor, const DWORD Type)
+{
+	memcpy(*Cursor, &Type, sizeof(DWORD));
+	*Cursor += 8;
+}
+
+/*
+Ends the block that starts at the given address, writing its length at both
+ends.
+*/
+POEDBG_INLINE void _PoeDbgPcapngEndBlock(PBYTE* Cursor, PBYTE Block)
+{
+	DWORD Length = static_cast<DWORD>(*Cursor - Block) + 4;
+
+	memcpy(Block + 4, &Length, sizeof(DWORD));
+	memcpy(*Cursor, &Length, sizeof(DWORD));
+
+	*Cursor += 4;
+}
+
+/*
+Builds the headers that start every file: a section header, and an interface
+for each direction, numbered as the directions are.
+*/
+inline void _PoeDbgPcapngBuildHeaders()
+{
+	PBYTE Cursor = _g_PcapngHeaders;
+	PBYTE Block = Cursor;
+
+	_PoeDbgPcapngBeginBlock(&Cursor, PCAPNG_BLOCK_SECTION_HEADER);
+
+	DWORD Magic = PCAPNG_BYTE_ORDER_MAGIC;
+	WORD Major = 1;
+	WORD Minor = 0;
+	LONG64 SectionLength = -1;
+
+	memcpy(Cursor, &Magic, sizeof(DWORD));
+	memcpy(Cursor + 4, &Major, sizeof(WORD));
+	memcpy(Cursor + 6, &Minor, sizeof(WORD));
+	memcpy(Cursor + 8, &SectionLength, sizeof(LONG64));
+	Cursor += 16;
+
+	_PoeDbgPcapngPutOption(&Cursor, PCAPNG_OPTION_USER_APPLICATION, "poedbg", 6);
+	_PoeDbgPcapngPutOption(&Cursor, PCAPNG_OPTION_END, NULL, 0);
+	_PoeDbgPcapngEndBlock(&Cursor, Block);
+
+	const char* Names[POEDBG_DIRECTION_COUNT] = { "send", "receive" };
+
+	for (int Direction = 0; Direction < POEDBG_DIRECTION_COUNT; Direction++)
+	{
+		Block = Cursor;
+
+		_PoeDbgPcapngBeginBlock(&Cursor, PCAPNG_BLOCK_INTERFACE);
+
+		WORD LinkType = PCAPNG_LINKTYPE_USER0;
+		DWORD SnapLength = 0;
+		BYTE Resolution = PCAPNG_TIMESTAMP_RESOLUTION;
+
+		memcpy(Cursor, &LinkType, sizeof(WORD));
+		memset(Cursor + 2, 0, sizeof(WORD));
+		memcpy(Cursor + 4, &SnapLength, sizeof(DWORD));
+		Cursor += 8;
+
+		_PoeDbgPcapngPutOption(&Cursor, PCAPNG_OPTION_INTERFACE_NAME, Names[Direction], static_cast<WORD>(strlen(Names[Direction])));
+		_PoeDbgPcapngPutOption(&Cursor, PCAPNG_OPTION_TIMESTAMP_RESOLUTION, &Resolution, sizeof(BYTE));
+		_PoeDbgPcapngPutOption(&Cursor, PCAPNG_OPTION_END, NULL, 0);
+		_PoeDbgPcapngEndBlock(&Cursor, Block);
+	}
+
+	_g_PcapngHeadersSize = static_cast<DWORD>(Cursor - _g_PcapngHeaders);
+}
+
+/*
+Writes an enhanced packet block for a packet at the given address, which has
+room for PCAPNG_PACKET_BLOCK_SIZE bytes.
+*/
+POEDBG_INLINE void _PoeDbgPcapngPutPacket(PBYTE Block, const int Direction, const BYTE Id, const BYTE* Data, const DWORD Length, const DWORD OriginalLength, const DWORD64 Timestamp, const DWORD64 Sequence, const BYTE Source)
+{
+	static const char Digits[] = "0123456789ABCDEF";
+
+	DWORD Header[7];
+	DWORD64 Time = _g_PcapngEpochOffset + Timestamp;
+
+	Header[0] = PCAPNG_BLOCK_ENHANCED_PACKET;
+	Header[1] = PCAPNG_PACKET_BLOCK_SIZE(Length);
+	Header[2] = static_cast<DWORD>(Direction);
+	Header[3] = static_cast<DWORD>(Time >> 32);
+	Header[4] = static_cast<DWORD>(Time);
+	Header[5] = Length;
+	Header[6] = OriginalLength;
+
+	memcpy(Block, Header, sizeof(Header));
+
+	PBYTE Cursor = Block + sizeof(Header);
+
+	memcpy(Cursor, Data, Length);
+	memset(Cursor + Length, 0, PCAPNG_ALIGN(Length) - Length);
+	Cursor += PCAPNG_ALIGN(Length);
+
+	// The ID as a comment, the sequence number and source, then the end of the
+	// options and the length again.
+	BYTE Trailer[36] = { PCAPNG_OPTION_COMMENT, 0, 4, 0, '0', 'x', static_cast<BYTE>(Digits[Id >> 4]), static_cast<BYTE>(Digits[Id & 0xF]),
+		PCAPNG_OPTION_PACKET_ID, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		PCAPNG_OPTION_QUEUE, 0, 4, 0, Source, 0, 0, 0 };
+	memcpy(Trailer + 12, &Sequence, sizeof(DWORD64));
+	memcpy(Trailer + 32, &Header[1], sizeof(DWORD));
+
+	memcpy(Cursor, Trailer, sizeof(Trailer));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Debug Loop Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Returns the buffer the debug loop writes into, or NULL if the writer hasn't
+finished with it yet.
+*/
+POEDBG_INLINE PPOEDBG_PCAPNG_BUFFER _PoeDbgPcapngGetOpenBuffer()
+{
+	LONG64 Filled = _g_PcapngFilled;
+
+	if (Filled - _g_PcapngWritten >= PCAPNG_BUFFER_COUNT)
+	{
+		return NULL;
+	}
+
+	return &_g_PcapngBuffers[Filled % PCAPNG_BUFFER_COUNT];
+}
+
+/*
+Hands the open buffer to the writer, if anything has been written into it.
+Whoever calls this must own the open buffer: the debug loop, or a thread that
+has paused it.
+*/
+POEDBG_INLINE void _PoeDbgPcapngHandOff()
+{
+	PPOEDBG_PCAPNG_BUFFER Buffer = _PoeDbgPcapngGetOpenBuffer();
+
+	if (NULL == Buffer || 0 == Buffer->Used)
+	{
+		return;
+	}
+
+	// The exchange is a full barrier, so the writer sees the data before the
+	// buffer is counted.
+	_InterlockedExchange64(&_g_PcapngFilled, _g_PcapngFilled + 1);
+
+	ReleaseSemaphore(_g_PcapngSemaphore, 1, NULL);
+}
+
+/*
+Reserves the given number of bytes in the open buffer, handing it off first if
+they don't fit. Returns NULL if every buffer is waiting to be written.
+*/
+POEDBG_INLINE PBYTE _PoeDbgPcapngReserve(const DWORD Size)
+{
+	PPOEDBG_PCAPNG_BUFFER Buffer = _PoeDbgPcapngGetOpenBuffer();
+
+	if (NULL != Buffer && Buffer->Used + Size > PCAPNG_BUFFER_SIZE)
+	{
+		_PoeDbgPcapngHandOff();
+		Buffer = _PoeDbgPcapngGetOpenBuffer();
+	}
+
+	if (NULL == Buffer)
+	{
+		return NULL;
+	}
+
+	PBYTE Reserved = Buffer->Data + Buffer->Used;
+	Buffer->Used += Size;
+
+	return Reserved;
+}
+
+/*
+Writes a packet into the open buffer, moving on to a new file first if the
+current one is due to be rotated. The packet is dropped and counted if every
+buffer is waiting to be written.
+*/
+inline void _PoeDbgPcapngAppendPacket(const int Direction, const BYTE Id, const BYTE* Data, const DWORD Length, const DWORD OriginalLength, const DWORD64 Timestamp, const DWORD64 Sequence, const BYTE Source)
+{
+	DWORD BlockSize = PCAPNG_PACKET_BLOCK_SIZE(Length);
+
+	if (!_g_bIsPcapngFilePending)
+	{
+		bool bIsFull = (0 != _g_PcapngRotateSize && _g_PcapngFileSize + BlockSize > _g_PcapngRotateSize && _g_PcapngFileSize > _g_PcapngHeadersSize);
+		bool bIsOld = (0 != _g_PcapngRotateTime && Timestamp - _g_PcapngFileStart >= _g_PcapngRotateTime);
+
+		if (bIsFull || bIsOld)
+		{
+			// The next file has to start in a buffer of its own.
+			_PoeDbgPcapngHandOff();
+			_g_bIsPcapngFilePending = true;
+		}
+	}
+
+	if (_g_bIsPcapngFilePending)
+	{
+		PPOEDBG_PCAPNG_BUFFER Buffer = _PoeDbgPcapngGetOpenBuffer();
+		PBYTE Headers = (NULL != Buffer && 0 == Buffer->Used) ? _PoeDbgPcapngReserve(_g_PcapngHeadersSize) : NULL;
+
+		if (NULL == Headers)
+		{
+			_g_PcapngStats.Dropped++;
+			return;
+		}
+
+		memcpy(Headers, _g_PcapngHeaders, _g_PcapngHeadersSize);
+
+		Buffer->bStartsFile = true;
+
+		_g_PcapngFileSize = _g_PcapngHeadersSize;
+		_g_PcapngFileStart = Timestamp;
+		_g_bIsPcapngFilePending = false;
+	}
+
+	PBYTE Block = _PoeDbgPcapngReserve(BlockSize);
+
+	if (NULL == Block)
+	{
+		_g_PcapngStats.Dropped++;
+		return;
+	}
+
+	_PoeDbgPcapngPutPacket(Block, Direction, Id, Data, Length, OriginalLength, Timestamp, Sequence, Source);
+
+	_g_PcapngFileSize += BlockSize;
+	_g_PcapngStats.Packets++;
+	_g_PcapngStats.Bytes += BlockSize;
+}
+
+/*
+Writes a packet out, unless the writer has been stopped. Called by the debug
+loop for every packet dispatched.
+*/
+inline void _PoeDbgPcapngWritePacket(const int Direction, const BYTE Id, const BYTE* Data, const DWORD Length, const DWORD OriginalLength, const DWORD64 Timestamp, const DWORD64 Sequence, const BYTE Source)
+{
+	// Mark the write with plain stores, which the thread pausing us reads
+	// after flushing every processor's write buffer.
+
+	_g_PcapngSequence = _g_PcapngSequence + 1;
+
+	while (_g_bIsPcapngPaused)
+	{
+		_g_PcapngSequence = _g_PcapngSequence + 1;
+		Sleep(0);
+		_g_PcapngSequence = _g_PcapngSequence + 1;
+	}
+
+	if (_g_bIsPcapngEnabled)
+	{
+		_PoeDbgPcapngAppendPacket(Direction, Id, Data, Length, OriginalLength, Timestamp, Sequence, Source);
+	}
+
+	_g_PcapngSequence = _g_PcapngSequence + 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Writer Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Stops the debug loop from writing packets, so that the caller owns the open
+buffer until _PoeDbgPcapngResume is called. Must not be called from the debug
+loop.
+*/
+inline void _PoeDbgPcapngPause()
+{
+	AcquireSRWLockExclusive(&_g_PcapngPauseLock);
+
+	_g_bIsPcapngPaused = true;
+
+	// Make sure we see the debug loop's marks before checking whether it is
+	// part way through a packet.
+
+	FlushProcessWriteBuffers();
+
+	LONG Sequence = _g_PcapngSequence;
+
+	if (0 != (Sequence & 1))
+	{
+		while (Sequence == _g_PcapngSequence)
+		{
+			Sleep(0);
+		}
+	}
+}
+
+/*
+Lets the debug loop write packets again.
+*/
+POEDBG_INLINE void _PoeDbgPcapngResume()
+{
+	_g_bIsPcapngPaused = false;
+
+	ReleaseSRWLockExclusive(&_g_PcapngPauseLock);
+}
+
+/*
+Builds the name of the file with the given index. Without rotation there is
+only ever the one file, named by the path. With it, every file has its index
+added before the extension, so the files sort in order.
+*/
+inline bool _PoeDbgPcapngGetFilePath(const DWORD Index, wchar_t* Path)
+{
+	if (0 == _g_PcapngRotateSize && 0 == _g_PcapngRotateTime)
+	{
+		return _PoeDbgModuleCopyName(Path, _g_PcapngPath, PCAPNG_PATH_MAXIMUM);
+	}
+
+	SIZE_T Length = wcslen(_g_PcapngPath);
+	SIZE_T Extension = Length;
+
+	for (SIZE_T Character = Length; Character > 0; Character--)
+	{
+		wchar_t This = _g_PcapngPath[Character - 1];
+
+		if (L'\\' == This || L'/' == This)
+		{
+			break;
+		}
+
+		if (L'.' == This)
+		{
+			Extension = Character - 1;
+			break;
+		}
+	}
+
+	wchar_t Suffix[16];
+	SIZE_T SuffixLength = 0;
+
+	Suffix[SuffixLength++] = L'_';
+
+	for (DWORD Divisor = 10000; Divisor > 0; Divisor /= 10)
+	{
+		Suffix[SuffixLength++] = static_cast<wchar_t>(L'0' + (Index / Divisor) % 10);
+	}
+
+	if (Length + SuffixLength >= PCAPNG_PATH_MAXIMUM)
+	{
+		return false;
+	}
+
+	memcpy(Path, _g_PcapngPath, Extension * sizeof(wchar_t));
+	memcpy(Path + Extension, Suffix, SuffixLength * sizeof(wchar_t));
+	memcpy(Path + Extension + SuffixLength, _g_PcapngPath + Extension, (Length - Extension + 1) * sizeof(wchar_t));
+
+	return true;
+}
+
+/*
+Opens the file with the given index, closing the current one first. Every
+write to the current file must have completed.
+*/
+inline POEDBG_STATUS _PoeDbgPcapngOpenFile(const DWORD Index)
+{
+	if (_g_bIsPcapngFileOpen)
+	{
+		_PoeDbgPlatformCloseFile(&_g_PcapngFile);
+		_g_bIsPcapngFileOpen = false;
+	}
+
+	wchar_t Path[PCAPNG_PATH_MAXIMUM];
+
+	if (!_PoeDbgPcapngGetFilePath(Index, Path) || !_PoeDbgPlatformOpenFile(&_g_PcapngFile, Path))
+	{
+		return POEDBG_STATUS_PCAPNG_OPEN_FAILED;
+	}
+
+	_g_bIsPcapngFileOpen = true;
+	_g_PcapngFileOffset = 0;
+	_g_PcapngFileIndex = Index;
+	_g_PcapngStats.Files++;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Writes out every buffer the debug loop has handed off, up to the given count.
+Buffers for the same file are written all at once, so that the system can
+work on them together, and the writer moves on to the next file only once
+they have all completed.
+*/
+inline void _PoeDbgPcapngWriteBuffers(const LONG64 Filled)
+{
+	LONG64 Next = _g_PcapngWritten;
+
+	while (Next < Filled)
+	{
+		LONG64 First = Next;
+		DWORD InFlight = 0;
+
+		for (; Next < Filled; Next++)
+		{
+			PPOEDBG_PCAPNG_BUFFER Buffer = &_g_PcapngBuffers[Next % PCAPNG_BUFFER_COUNT];
+
+			if (Buffer->bStartsFile)
+			{
+				if (Next != First)
+				{
+					break;
+				}
+
+				POEDBG_STATUS Status = _PoeDbgPcapngOpenFile(_g_PcapngFileIndex + 1);
+
+				if (POEDBG_FAILURE(Status))
+				{
+					_g_PcapngStats.Status = Status;
+				}
+			}
+
+			if (!_g_bIsPcapngFileOpen)
+			{
+				// Packets for a file that couldn't be opened are lost.
+				continue;
+			}
+
+			if (_PoeDbgPlatformWriteFile(&_g_PcapngFile, Buffer->Data, Buffer->Used, _g_PcapngFileOffset, static_cast<DWORD>(Next % PCAPNG_BUFFER_COUNT)))
+			{
+				InFlight++;
+			}
+			else
+			{
+				_g_PcapngStats.Status = POEDBG_STATUS_PCAPNG_WRITE_FAILED;
+			}
+
+			_g_PcapngFileOffset += Buffer->Used;
+		}
+
+		for (; InFlight > 0; InFlight--)
+		{
+			DWORD Tag = 0;
+
+			if (!_PoeDbgPlatformWaitForFileWrite(&_g_PcapngFile, &Tag))
+			{
+				_g_PcapngStats.Status = POEDBG_STATUS_PCAPNG_WRITE_FAILED;
+			}
+		}
+
+		for (LONG64 Done = First; Done < Next; Done++)
+		{
+			_g_PcapngBuffers[Done % PCAPNG_BUFFER_COUNT].Used = 0;
+			_g_PcapngBuffers[Done % PCAPNG_BUFFER_COUNT].bStartsFile = false;
+		}
+
+		// Hand the buffers back to the debug loop.
+		_InterlockedExchange64(&_g_PcapngWritten, Next);
+	}
+}
+
+/*
+Hands off the open buffer on the debug loop's behalf, for when it has held
+packets for a while without filling up.
+*/
+inline void _PoeDbgPcapngFlush()
+{
+	_PoeDbgPcapngPause();
+
+	if (_g_bIsPcapngEnabled)
+	{
+		_PoeDbgPcapngHandOff();
+	}
+
+	_PoeDbgPcapngResume();
+}
+
+/*
+Writes out buffers as the debug loop hands them off, until the writer is
+stopped and everything has been written.
+*/
+inline DWORD __stdcall _PoeDbgPcapngWriterThread(LPVOID Parameter)
+{
+	UNREFERENCED_PARAMETER(Parameter);
+
+	LONG64 LastFilled = _g_PcapngFilled;
+
+	for (;;)
+	{
+		DWORD Wait = WaitForSingleObject(_g_PcapngSemaphore, PCAPNG_FLUSH_INTERVAL);
+
+		if (WAIT_TIMEOUT == Wait && LastFilled == _g_PcapngFilled)
+		{
+			// Nothing was handed off for a whole interval, so write out
+			// whatever the debug loop is holding.
+			_PoeDbgPcapngFlush();
+		}
+
+		LONG64 Filled = _g_PcapngFilled;
+
+		_PoeDbgPcapngWriteBuffers(Filled);
+
+		LastFilled = Filled;
+
+		if (_g_bIsPcapngStopping && _g_PcapngWritten == _g_PcapngFilled)
+		{
+			break;
+		}
+	}
+
+	if (_g_bIsPcapngFileOpen)
+	{
+		_PoeDbgPlatformCloseFile(&_g_PcapngFile);
+		_g_bIsPcapngFileOpen = false;
+	}
+
+	ReleaseSemaphore(_g_PcapngDoneSemaphore, 1, NULL);
+
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Control Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Allocates the buffers and semaphores, the first time the writer is started.
+They are kept for the life of the process, like the packet queue.
+*/
+inline POEDBG_STATUS _PoeDbgPcapngAllocate()
+{
+	if (NULL != _g_PcapngBuffers[0].Data)
+	{
+		return POEDBG_STATUS_SUCCESS;
+	}
+
+	PBYTE Data = reinterpret_cast<PBYTE>(VirtualAlloc(NULL, static_cast<SIZE_T>(PCAPNG_BUFFER_SIZE) * PCAPNG_BUFFER_COUNT, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+	if (NULL == Data)
+	{
+		return POEDBG_STATUS_PCAPNG_ALLOCATION_FAILED;
+	}
+
+	_g_PcapngSemaphore = CreateSemaphoreW(NULL, 0, MAXLONG, NULL);
+	_g_PcapngDoneSemaphore = CreateSemaphoreW(NULL, 0, MAXLONG, NULL);
+
+	if (NULL == _g_PcapngSemaphore || NULL == _g_PcapngDoneSemaphore)
+	{
+		VirtualFree(Data, 0, MEM_RELEASE);
+		return POEDBG_STATUS_PCAPNG_ALLOCATION_FAILED;
+	}
+
+	for (DWORD Index = 0; Index < PCAPNG_BUFFER_COUNT; Index++)
+	{
+		_g_PcapngBuffers[Index].Data = Data + static_cast<SIZE_T>(PCAPNG_BUFFER_SIZE) * Index;
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Starts writing every dispatched packet to a pcapng file at the given path. The
+file is opened here, so that a bad path is reported straight away, and any
+rotated files are opened by the writer as it reaches them.
+*/
+inline POEDBG_STATUS _PoeDbgPcapngStart(const wchar_t* Path, const DWORD64 RotateSize, const DWORD RotateSeconds)
+{
+	AcquireSRWLockExclusive(&_g_PcapngControlLock);
+
+	if (_g_bIsPcapngEnabled)
+	{
+		ReleaseSRWLockExclusive(&_g_PcapngControlLock);
+		return POEDBG_STATUS_PCAPNG_ALREADY_STARTED;
+	}
+
+	POEDBG_STATUS Status = _PoeDbgPcapngAllocate();
+
+	if (POEDBG_SUCCESS(Status))
+	{
+		Status = _PoeDbgModuleCopyName(_g_PcapngPath, Path, PCAPNG_PATH_MAXIMUM) ? POEDBG_STATUS_SUCCESS : POEDBG_STATUS_PCAPNG_OPEN_FAILED;
+	}
+
+	if (POEDBG_SUCCESS(Status))
+	{
+		_g_PcapngRotateSize = RotateSize;
+		_g_PcapngRotateTime = static_cast<DWORD64>(RotateSeconds) * 1000000000ULL;
+		_g_PcapngStats = { 0 };
+
+		Status = _PoeDbgPcapngOpenFile(0);
+	}
+
+	if (POEDBG_FAILURE(Status))
+	{
+		ReleaseSRWLockExclusive(&_g_PcapngControlLock);
+		return Status;
+	}
+
+	_PoeDbgPcapngBuildHeaders();
+
+	_g_PcapngEpochOffset = (_g_ClockBaseSystemTime - PCAPNG_FILETIME_UNIX_EPOCH) * 100;
+
+	// Every buffer has been written out, so the open one is empty. The first
+	// file is already open, so its headers don't start a new one.
+
+	PPOEDBG_PCAPNG_BUFFER Buffer = _PoeDbgPcapngGetOpenBuffer();
+
+	memcpy(Buffer->Data, _g_PcapngHeaders, _g_PcapngHeadersSize);
+	Buffer->Used = _g_PcapngHeadersSize;
+
+	_g_PcapngFileSize = _g_PcapngHeadersSize;
+	_g_PcapngFileStart = _PoeDbgClockNow();
+	_g_bIsPcapngFilePending = false;
+	_g_bIsPcapngStopping = false;
+
+	HANDLE Thread = CreateThread(NULL, 0, _PoeDbgPcapngWriterThread, NULL, 0, NULL);
+
+	if (NULL == Thread)
+	{
+		Buffer->Used = 0;
+
+		_PoeDbgPlatformCloseFile(&_g_PcapngFile);
+		_g_bIsPcapngFileOpen = false;
+
+		ReleaseSRWLockExclusive(&_g_PcapngControlLock);
+		return POEDBG_STATUS_PCAPNG_ALLOCATION_FAILED;
+	}
+
+	CloseHandle(Thread);
+
+	// Publish the writer to the debug loop last.
+	_g_bIsPcapngEnabled = true;
+
+	ReleaseSRWLockExclusive(&_g_PcapngControlLock);
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Stops writing packets, and waits for the writer to write out everything the
+debug loop has written so far and close the file.
+*/
+inline POEDBG_STATUS _PoeDbgPcapngStop()
+{
+	AcquireSRWLockExclusive(&_g_PcapngControlLock);
+
+	if (!_g_bIsPcapngEnabled)
+	{
+		ReleaseSRWLockExclusive(&_g_PcapngControlLock);
+		return POEDBG_STATUS_PCAPNG_NOT_STARTED;
+	}
+
+	if (GetCurrentThreadId() == _g_DebugThreadId)
+	{
+		// We're inside a callback, so the debug loop is between packets, but
+		// the writer may be flushing.
+		AcquireSRWLockExclusive(&_g_PcapngPauseLock);
+		_PoeDbgPcapngHandOff();
+		_g_bIsPcapngEnabled = false;
+		ReleaseSRWLockExclusive(&_g_PcapngPauseLock);
+	}
+	else
+	{
+		_PoeDbgPcapngPause();
+		_PoeDbgPcapngHandOff();
+		_g_bIsPcapngEnabled = false;
+		_PoeDbgPcapngResume();
+	}
+
+	_g_bIsPcapngStopping = true;
+
+	ReleaseSemaphore(_g_PcapngSemaphore, 1, NULL);
+	WaitForSingleObject(_g_PcapngDoneSemaphore, INFINITE);
+
+	ReleaseSRWLockExclusive(&_g_PcapngControlLock);
+
+	return _g_PcapngStats.Status;
+}
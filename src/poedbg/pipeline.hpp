@@ -0,0 +1,582 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+// A packet waiting in a worker's queue, numbered in the order the pipeline was
+// handed it. Unlike the packet's own sequence number, this one has no gaps for
+// packets dispatched while the pipeline was stopped.
+typedef struct _POEDBG_PIPELINE_RECORD
+{
+	POEDBG_PACKET_RECORD Packet;
+	DWORD64 Sequence;
+} POEDBG_PIPELINE_RECORD, *PPOEDBG_PIPELINE_RECORD;
+
+// A worker and its queue, which the debug loop pushes to and only the worker
+// pops from. The head and tail are each written by one side only, so they sit
+// on cache lines of their own.
+typedef struct DECLSPEC_ALIGN(64) _POEDBG_PIPELINE_WORKER
+{
+	PBYTE Buffer;
+	SIZE_T Size;
+	HANDLE Semaphore;
+	DWORD Index;
+	DECLSPEC_ALIGN(64) volatile LONG64 Head;
+	DECLSPEC_ALIGN(64) volatile LONG64 Tail;
+	volatile LONG Waiters;
+} POEDBG_PIPELINE_WORKER, *PPOEDBG_PIPELINE_WORKER;
+
+// A packet the workers have finished with, waiting for the merge callback.
+// The sequence is the pipeline's own, which the merge thread follows, and is
+// set last, once the result and the packet's sequence are in place.
+typedef struct _POEDBG_PIPELINE_RESULT
+{
+	volatile LONG64 Sequence;
+	DWORD64 PacketSequence;
+	ULONG_PTR Result;
+} POEDBG_PIPELINE_RESULT, *PPOEDBG_PIPELINE_RESULT;
+
+//////////////////////////////////////////////////////////////////////////
+// Globals
+//////////////////////////////////////////////////////////////////////////
+
+// The workers. Their semaphores are created the first time each is used and
+// kept for the life of the process.
+__declspec(selectany) POEDBG_PIPELINE_WORKER _g_PipelineWorkers[PIPELINE_WORKER_MAXIMUM];
+__declspec(selectany) DWORD _g_PipelineWorkerCount;
+
+// The callbacks the pipeline was started with.
+__declspec(selectany) POEDBG_PIPELINE_KEY_CALLBACK _g_PipelineKeyCallback;
+__declspec(selectany) POEDBG_PIPELINE_WORKER_CALLBACK _g_PipelineWorkerCallback;
+__declspec(selectany) POEDBG_PIPELINE_MERGE_CALLBACK _g_PipelineMergeCallback;
+
+// Finished packets, indexed by sequence, for the merge callback. The debug
+// loop numbers packets from one, and the merge thread publishes the last one
+// it has handed on, so the debug loop knows which slots are free.
+__declspec(selectany) PPOEDBG_PIPELINE_RESULT _g_PipelineResults;
+__declspec(selectany) DWORD64 _g_PipelineLastSequence;
+__declspec(selectany) volatile LONG64 _g_PipelineMerged;
+
+// The sequence the merge thread is waiting for, or zero, so that the worker
+// that finishes it knows to wake the merge thread.
+__declspec(selectany) volatile LONG64 _g_PipelineMergeWaiting;
+__declspec(selectany) HANDLE _g_PipelineMergeSemaphore;
+
+// Is the debug loop handing packets to the pipeline? The sequence is odd
+// while it is part way through one.
+__declspec(selectany) volatile bool _g_bIsPipelineEnabled = false;
+__declspec(selectany) volatile LONG _g_PipelinePushSequence;
+
+// Tells every thread to finish what is queued and exit, and counts them out.
+__declspec(selectany) volatile bool _g_bIsPipelineStopping;
+__declspec(selectany) HANDLE _g_PipelineDoneSemaphore;
+
+// Progress, for PoeDbgGetPipelineStats.
+__declspec(selectany) POEDBG_PIPELINE_STATS _g_PipelineStats;
+
+// Serializes starting and stopping the pipeline.
+__declspec(selectany) SRWLOCK _g_PipelineLock = SRWLOCK_INIT;
+
+//////////////////////////////////////////////////////////////////////////
+// Debug Loop Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Pushes a packet onto its shard's queue. This never blocks; if the worker has
+fallen so far behind that there is no room, or the merge callback has, the
+packet is dropped and counted.
+*/
+inline void _PoeDbgPipelineEnqueue(const int Direction, const BYTE Id, PBYTE Data, const DWORD Length, const DWORD OriginalLength, const DWORD64 Timestamp, const DWORD64 Sequence, const BYTE Source)
+{
+	DWORD Key = (NULL != _g_PipelineKeyCallback) ? _g_PipelineKeyCallback(Direction, Length, Id, Data) : Id;
+
+	PPOEDBG_PIPELINE_WORKER Worker = &_g_PipelineWorkers[Key % _g_PipelineWorkerCount];
+
+	SIZE_T RecordSize = QUEUE_ALIGN(sizeof(POEDBG_PIPELINE_RECORD) + Length);
+
+	if (RecordSize > (Worker->Size / 2))
+	{
+		_g_PipelineStats.Dropped++;
+		return;
+	}
+
+	if (NULL != _g_PipelineMergeCallback && _g_PipelineLastSequence - static_cast<DWORD64>(_g_PipelineMerged) >= PIPELINE_MERGE_SIZE)
+	{
+		_g_PipelineStats.Dropped++;
+		return;
+	}
+
+	LONG64 Head = Worker->Head;
+	LONG64 Tail = Worker->Tail;
+
+	SIZE_T Offset = static_cast<SIZE_T>(Head) & (Worker->Size - 1);
+	SIZE_T Contiguous = Worker->Size - Offset;
+
+	// Records never wrap, the same as in the packet queue.
+	SIZE_T Required = (Contiguous < RecordSize) ? (Contiguous + RecordSize) : RecordSize;
+
+	if (static_cast<SIZE_T>(Head - Tail) + Required > Worker->Size)
+	{
+		_g_PipelineStats.Dropped++;
+		return;
+	}
+
+	if (Contiguous < RecordSize)
+	{
+		PPOEDBG_PACKET_RECORD Padding = reinterpret_cast<PPOEDBG_PACKET_RECORD>(Worker->Buffer + Offset);
+
+		Padding->Size = static_cast<DWORD>(Contiguous);
+		Padding->Length = 0;
+		Padding->Flags = QUEUE_RECORD_PADDING;
+
+		Head += Contiguous;
+		Offset = 0;
+	}
+
+	PPOEDBG_PIPELINE_RECORD Record = reinterpret_cast<PPOEDBG_PIPELINE_RECORD>(Worker->Buffer + Offset);
+
+	Record->Packet.Size = static_cast<DWORD>(RecordSize);
+	Record->Packet.Length = Length;
+	Record->Packet.Direction = static_cast<BYTE>(Direction);
+	Record->Packet.Id = Id;
+	Record->Packet.Flags = (Length < OriginalLength) ? POEDBG_RECORD_TRUNCATED : 0;
+	Record->Packet.OriginalLength = OriginalLength;
+	Record->Packet.Timestamp = Timestamp;
+	Record->Packet.Sequence = Sequence;
+	Record->Packet.Source = Source;
+	Record->Packet.Reserved = 0;
+	Record->Sequence = ++_g_PipelineLastSequence;
+
+	memcpy(Record + 1, Data, Length);
+
+	// Publish the record, then wake the worker if it is waiting for one.
+	_InterlockedExchange64(&Worker->Head, Head + static_cast<LONG64>(RecordSize));
+
+	if (0 != Worker->Waiters)
+	{
+		ReleaseSemaphore(Worker->Semaphore, 1, NULL);
+	}
+
+	_g_PipelineStats.Packets++;
+}
+
+/*
+Hands a packet to the pipeline, unless it has been stopped. Called by the
+debug loop for every packet dispatched.
+*/
+POEDBG_INLINE void _PoeDbgPipelinePush(const int Direction, const BYTE Id, PBYTE Data, const DWORD Length, const DWORD OriginalLength, const DWORD64 Timestamp, const DWORD64 Sequence, const BYTE Source)
+{
+	// Mark the push with plain stores, which whoever stops the pipeline reads
+	// after flushing every processor's write buffer.
+
+	_g_PipelinePushSequence = _g_PipelinePushSequence + 1;
+
+	if (_g_bIsPipelineEnabled)
+	{
+		_PoeDbgPipelineEnqueue(Direction, Id, Data, Length, OriginalLength, Timestamp, Sequence, Source);
+	}
+
+	_g_PipelinePushSequence = _g_PipelinePushSequence + 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Worker Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Hands a worker's result to the merge thread, waking it if this is the packet
+it is waiting for.
+*/
+POEDBG_INLINE void _PoeDbgPipelineComplete(const DWORD64 Sequence, const DWORD64 PacketSequence, const ULONG_PTR Result)
+{
+	PPOEDBG_PIPELINE_RESULT Slot = &_g_PipelineResults[Sequence & (PIPELINE_MERGE_SIZE - 1)];
+
+	Slot->PacketSequence = PacketSequence;
+	Slot->Result = Result;
+
+	// The exchange is a full barrier, so the merge thread sees the result
+	// first, and we see the merge thread's wait if it started before.
+
+	_InterlockedExchange64(&Slot->Sequence, static_cast<LONG64>(Sequence));
+
+	if (static_cast<LONG64>(Sequence) == _g_PipelineMergeWaiting)
+	{
+		ReleaseSemaphore(_g_PipelineMergeSemaphore, 1, NULL);
+	}
+}
+
+/*
+Calls the worker callback for every packet in a worker's queue, in the order
+they were pushed, until the pipeline is stopped and the queue is empty.
+*/
+inline DWORD __stdcall _PoeDbgPipelineWorkerThread(LPVOID Parameter)
+{
+	PPOEDBG_PIPELINE_WORKER Worker = reinterpret_cast<PPOEDBG_PIPELINE_WORKER>(Parameter);
+
+	for (;;)
+	{
+		LONG64 Head = Worker->Head;
+		LONG64 Tail = Worker->Tail;
+
+		if (Head != Tail)
+		{
+			while (Tail != Head)
+			{
+				PPOEDBG_PIPELINE_RECORD Record = reinterpret_cast<PPOEDBG_PIPELINE_RECORD>(Worker->Buffer + (static_cast<SIZE_T>(Tail) & (Worker->Size - 1)));
+
+				if (0 == (Record->Packet.Flags & QUEUE_RECORD_PADDING))
+				{
+					DWORD64 Begin = _PoeDbgTraceBegin();
+
+					ULONG_PTR Result = _g_PipelineWorkerCallback(Worker->Index, Record->Packet.Direction, Record->Packet.Length, Record->Packet.OriginalLength, Record->Packet.Id,
+						reinterpret_cast<PBYTE>(Record + 1), Record->Packet.Timestamp, Record->Packet.Sequence, Record->Packet.Source);
+
+					if (NULL != _g_PipelineMergeCallback)
+					{
+						_PoeDbgPipelineComplete(Record->Sequence, Record->Packet.Sequence, Result);
+					}
+
+					_PoeDbgTraceEnd(TRACE_RING_WORKER + Worker->Index, TRACE_SPAN_WORKER, Begin, Record->Packet.Length, Record->Packet.Direction, Record->Packet.Id, static_cast<BYTE>(Record->Packet.Source), Record->Packet.Sequence);
+				}
+
+				Tail += Record->Packet.Size;
+			}
+
+			// Hand the space back to the debug loop.
+			_InterlockedExchange64(&Worker->Tail, Tail);
+
+			continue;
+		}
+
+		if (_g_bIsPipelineStopping)
+		{
+			// The debug loop stopped pushing before we were told to stop, so
+			// one more look at the head is enough to be sure we have it all.
+
+			if (Worker->Head != Tail)
+			{
+				continue;
+			}
+
+			break;
+		}
+
+		// Let the debug loop know we are waiting, then check once more so that
+		// a record pushed in the meantime isn't missed.
+
+		_InterlockedIncrement(&Worker->Waiters);
+
+		if (Worker->Head == Worker->Tail && !_g_bIsPipelineStopping)
+		{
+			WaitForSingleObject(Worker->Semaphore, PIPELINE_WAIT_INTERVAL);
+		}
+
+		_InterlockedDecrement(&Worker->Waiters);
+	}
+
+	ReleaseSemaphore(_g_PipelineDoneSemaphore, 1, NULL);
+
+	return 0;
+}
+
+/*
+Calls the merge callback for every packet in the order the debug loop pushed
+them, waiting for each one's worker to finish with it, until the pipeline is
+stopped and every packet has been merged.
+*/
+inline DWORD __stdcall _PoeDbgPipelineMergeThread(LPVOID Parameter)
+{
+	UNREFERENCED_PARAMETER(Parameter);
+
+	DWORD64 Next = 1;
+
+	for (;;)
+	{
+		PPOEDBG_PIPELINE_RESULT Slot = &_g_PipelineResults[Next & (PIPELINE_MERGE_SIZE - 1)];
+
+		if (static_cast<LONG64>(Next) == Slot->Sequence)
+		{
+			DWORD64 Begin = _PoeDbgTraceBegin();
+
+			_g_PipelineMergeCallback(Slot->PacketSequence, Slot->Result);
+
+			_PoeDbgTraceEnd(TRACE_RING_MERGE, TRACE_SPAN_MERGE, Begin, 0, 0, 0, 0, Slot->PacketSequence);
+
+			// Hand the slot back to the debug loop.
+			_InterlockedExchange64(&_g_PipelineMerged, static_cast<LONG64>(Next));
+
+			Next++;
+			continue;
+		}
+
+		if (_g_bIsPipelineStopping && Next > _g_PipelineLastSequence)
+		{
+			break;
+		}
+
+		// Tell the workers which packet we are waiting for, then check once
+		// more in case it finished in the meantime.
+
+		_InterlockedExchange64(&_g_PipelineMergeWaiting, static_cast<LONG64>(Next));
+
+		if (static_cast<LONG64>(Next) != Slot->Sequence)
+		{
+			WaitForSingleObject(_g_PipelineMergeSemaphore, PIPELINE_WAIT_INTERVAL);
+		}
+
+		_InterlockedExchange64(&_g_PipelineMergeWaiting, 0);
+	}
+
+	ReleaseSemaphore(_g_PipelineDoneSemaphore, 1, NULL);
+
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Control Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Frees the queues and merge slots. Every thread must have exited.
+*/
+inline void _PoeDbgPipelineRelease()
+{
+	for (DWORD Index = 0; Index < PIPELINE_WORKER_MAXIMUM; Index++)
+	{
+		if (NULL != _g_PipelineWorkers[Index].Buffer)
+		{
+			VirtualFree(_g_PipelineWorkers[Index].Buffer, 0, MEM_RELEASE);
+			_g_PipelineWorkers[Index].Buffer = NULL;
+		}
+	}
+
+	if (NULL != _g_PipelineResults)
+	{
+		VirtualFree(_g_PipelineResults, 0, MEM_RELEASE);
+		_g_PipelineResults = NULL;
+	}
+}
+
+/*
+Allocates a queue of the given size for each worker, and the merge slots if
+they are needed, along with any semaphores not already created.
+*/
+inline POEDBG_STATUS _PoeDbgPipelineAllocate(const DWORD Workers, const SIZE_T QueueSize, const bool bIsMerged)
+{
+	if (NULL == _g_PipelineDoneSemaphore)
+	{
+		_g_PipelineDoneSemaphore = CreateSemaphoreW(NULL, 0, MAXLONG, NULL);
+	}
+
+	if (NULL == _g_PipelineMergeSemaphore)
+	{
+		_g_PipelineMergeSemaphore = CreateSemaphoreW(NULL, 0, MAXLONG, NULL);
+	}
+
+	if (NULL == _g_PipelineDoneSemaphore || NULL == _g_PipelineMergeSemaphore)
+	{
+		return POEDBG_STATUS_PIPELINE_ALLOCATION_FAILED;
+	}
+
+	for (DWORD Index = 0; Index < Workers; Index++)
+	{
+		PPOEDBG_PIPELINE_WORKER Worker = &_g_PipelineWorkers[Index];
+
+		if (NULL == Worker->Semaphore)
+		{
+			Worker->Semaphore = CreateSemaphoreW(NULL, 0, MAXLONG, NULL);
+		}
+
+		Worker->Buffer = reinterpret_cast<PBYTE>(VirtualAlloc(NULL, QueueSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+		if (NULL == Worker->Semaphore || NULL == Worker->Buffer)
+		{
+			_PoeDbgPipelineRelease();
+			return POEDBG_STATUS_PIPELINE_ALLOCATION_FAILED;
+		}
+
+		Worker->Size = QueueSize;
+		Worker->Index = Index;
+		Worker->Head = 0;
+		Worker->Tail = 0;
+		Worker->Waiters = 0;
+	}
+
+	if (bIsMerged)
+	{
+		_g_PipelineResults = reinterpret_cast<PPOEDBG_PIPELINE_RESULT>(VirtualAlloc(NULL, PIPELINE_MERGE_SIZE * sizeof(POEDBG_PIPELINE_RESULT), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+		if (NULL == _g_PipelineResults)
+		{
+			_PoeDbgPipelineRelease();
+			return POEDBG_STATUS_PIPELINE_ALLOCATION_FAILED;
+		}
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Waits for the given number of pipeline threads to exit.
+*/
+POEDBG_INLINE void _PoeDbgPipelineJoin(DWORD Threads)
+{
+	for (; Threads > 0; Threads--)
+	{
+		WaitForSingleObject(_g_PipelineDoneSemaphore, INFINITE);
+	}
+}
+
+/*
+Starts the pipeline with the given number of workers, each with a queue of at
+least the given size. Packets are sharded by the key callback, or by packet ID
+if there isn't one, so that packets with the same key are always handled by
+the same worker, in order. If there is a merge callback, a merge thread calls
+it with every worker's results in the order the packets were dispatched.
+*/
+inline POEDBG_STATUS _PoeDbgPipelineStart(const DWORD Workers, const DWORD QueueSize, PVOID WorkerCallback, PVOID KeyCallback, PVOID MergeCallback)
+{
+	if (0 == Workers || Workers > PIPELINE_WORKER_MAXIMUM || NULL == WorkerCallback || QueueSize > QUEUE_MAXIMUM_SIZE)
+	{
+		return POEDBG_STATUS_PIPELINE_INVALID;
+	}
+
+	AcquireSRWLockExclusive(&_g_PipelineLock);
+
+	if (_g_bIsPipelineEnabled)
+	{
+		ReleaseSRWLockExclusive(&_g_PipelineLock);
+		return POEDBG_STATUS_PIPELINE_ALREADY_STARTED;
+	}
+
+	SIZE_T RoundedSize = QUEUE_MINIMUM_SIZE;
+
+	while (RoundedSize < ((0 != QueueSize) ? QueueSize : PIPELINE_DEFAULT_QUEUE_SIZE))
+	{
+		RoundedSize <<= 1;
+	}
+
+	POEDBG_STATUS Status = _PoeDbgPipelineAllocate(Workers, RoundedSize, NULL != MergeCallback);
+
+	if (POEDBG_FAILURE(Status))
+	{
+		ReleaseSRWLockExclusive(&_g_PipelineLock);
+		return Status;
+	}
+
+	_g_PipelineWorkerCount = Workers;
+	_g_PipelineKeyCallback = reinterpret_cast<POEDBG_PIPELINE_KEY_CALLBACK>(KeyCallback);
+	_g_PipelineWorkerCallback = reinterpret_cast<POEDBG_PIPELINE_WORKER_CALLBACK>(WorkerCallback);
+	_g_PipelineMergeCallback = reinterpret_cast<POEDBG_PIPELINE_MERGE_CALLBACK>(MergeCallback);
+
+	_g_PipelineLastSequence = 0;
+	_g_PipelineMerged = 0;
+	_g_PipelineMergeWaiting = 0;
+	_g_PipelineStats = { 0 };
+	_g_PipelineStats.Workers = Workers;
+	_g_bIsPipelineStopping = false;
+
+	DWORD Started = 0;
+
+	for (; Started < Workers; Started++)
+	{
+		HANDLE Thread = CreateThread(NULL, 0, _PoeDbgPipelineWorkerThread, &_g_PipelineWorkers[Started], 0, NULL);
+
+		if (NULL == Thread)
+		{
+			break;
+		}
+
+		CloseHandle(Thread);
+	}
+
+	if (Started == Workers && NULL != MergeCallback)
+	{
+		HANDLE Thread = CreateThread(NULL, 0, _PoeDbgPipelineMergeThread, NULL, 0, NULL);
+
+		if (NULL != Thread)
+		{
+			CloseHandle(Thread);
+			Started++;
+		}
+	}
+
+	if (Started != Workers + ((NULL != MergeCallback) ? 1 : 0))
+	{
+		// Nothing was pushed, so the threads that did start exit straight away.
+		_g_bIsPipelineStopping = true;
+
+		for (DWORD Index = 0; Index < Workers; Index++)
+		{
+			ReleaseSemaphore(_g_PipelineWorkers[Index].Semaphore, 1, NULL);
+		}
+
+		_PoeDbgPipelineJoin(Started);
+		_PoeDbgPipelineRelease();
+
+		ReleaseSRWLockExclusive(&_g_PipelineLock);
+		return POEDBG_STATUS_PIPELINE_ALLOCATION_FAILED;
+	}
+
+	// Publish the pipeline to the debug loop last.
+	_g_bIsPipelineEnabled = true;
+
+	ReleaseSRWLockExclusive(&_g_PipelineLock);
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Stops the pipeline, and waits for the workers and the merge callback to
+finish with every packet already pushed. This must not be called from a
+pipeline callback, since it waits for them to return.
+*/
+inline POEDBG_STATUS _PoeDbgPipelineStop()
+{
+	AcquireSRWLockExclusive(&_g_PipelineLock);
+
+	if (!_g_bIsPipelineEnabled)
+	{
+		ReleaseSRWLockExclusive(&_g_PipelineLock);
+		return POEDBG_STATUS_PIPELINE_NOT_STARTED;
+	}
+
+	_g_bIsPipelineEnabled = false;
+
+	if (GetCurrentThreadId() != _g_DebugThreadId)
+	{
+		// Make sure we see the debug loop's marks, then wait for it to finish
+		// any push already under way.
+
+		FlushProcessWriteBuffers();
+
+		LONG Sequence = _g_PipelinePushSequence;
+
+		if (0 != (Sequence & 1))
+		{
+			while (Sequence == _g_PipelinePushSequence)
+			{
+				Sleep(0);
+			}
+		}
+	}
+
+	_g_bIsPipelineStopping = true;
+
+	for (DWORD Index = 0; Index < _g_PipelineWorkerCount; Index++)
+	{
+		ReleaseSemaphore(_g_PipelineWorkers[Index].Semaphore, 1, NULL);
+	}
+
+	ReleaseSemaphore(_g_PipelineMergeSemaphore, 1, NULL);
+
+	_PoeDbgPipelineJoin(_g_PipelineWorkerCount + ((NULL != _g_PipelineMergeCallback) ? 1 : 0));
+	_PoeDbgPipelineRelease();
+
+	ReleaseSRWLockExclusive(&_g_PipelineLock);
+
+	return POEDBG_STATUS_SUCCESS;
+}
@@ -0,0 +1,77 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Platform Layer
+//////////////////////////////////////////////////////////////////////////
+
+// Everything the engine needs from the operating system's debugging API goes
+// through the functions below, and each platform provides its own version of
+// them. Events are delivered in the shape of the Win32 DEBUG_EVENT, so that the
+// debug loop and the hooks are the same everywhere. Defining
+// POEDBG_PLATFORM_FAKE swaps the real platform for an in-process stand-in,
+// for measuring the engine on its own.
+//
+//   _PoeDbgPlatformAttach(ProcessId)
+//     Starts debugging the game. Called once, from the debug loop.
+//   _PoeDbgPlatformDetach(ProcessId)
+//     Stops debugging the game, leaving it running.
+//   _PoeDbgPlatformWaitForEvent(Event, Timeout)
+//     Waits for the next debug event for up to Timeout milliseconds, forever
+//     with a timeout of INFINITE, or not at all with a timeout of zero.
+//     Returns whether an event arrived, the wait timed out, or there will be
+//     no more events, at which point the debug loop ends.
+//   _PoeDbgPlatformContinueEvent(Event, Status)
+//     Resumes the thread that reported the event.
+//   _PoeDbgPlatformReadMemory / _PoeDbgPlatformWriteMemory
+//     Copies memory from and to the game.
+//   _PoeDbgPlatformGetContext / _PoeDbgPlatformSetContext
+//     Reads and writes the registers of a stopped thread.
+//   _PoeDbgPlatformSuspendThread / _PoeDbgPlatformResumeThread
+//     Stops and restarts a thread that is running.
+//   _PoeDbgPlatformGetImageLayout()
+//     Fills in the size of the game image and the bounds of its code.
+//   _PoeDbgPlatformMapImageFile(View, Size) / _PoeDbgPlatformUnmapImageFile
+//     Maps the game's executable file read-only, and releases the view.
+//   _PoeDbgPlatformGetModuleName(Event, Name, Length)
+//     Finds the file name of the module reported by a DLL load event, and
+//     releases anything the event handed to the debugger. Returns false if
+//     the platform doesn't report modules.
+//   _PoeDbgPlatformRunOnDebugThread(Routine)
+//     Runs a routine that changes game threads from wherever the platform
+//     allows it to, and returns its result.
+
+// Files are written the same way whether or not the game is real, so the fake
+// platform shares the file functions of the system it is built on.
+//
+//   _PoeDbgPlatformOpenFile(File, Path) / _PoeDbgPlatformCloseFile(File)
+//     Creates a file for writing, and closes it once its writes are done.
+//   _PoeDbgPlatformWriteFile(File, Buffer, Size, Offset, Tag)
+//     Starts writing a buffer at an offset, without waiting for the write.
+//     Up to FILE_WRITE_MAXIMUM writes may be in flight, each with its own tag.
+//   _PoeDbgPlatformWaitForFileWrite(File, Tag)
+//     Waits for the next write to complete, and returns its tag and whether
+//     it was written in full.
+
+// Results of _PoeDbgPlatformWaitForEvent.
+#define PLATFORM_WAIT_EVENT 0
+#define PLATFORM_WAIT_TIMEOUT 1
+#define PLATFORM_WAIT_DONE 2
+
+// A routine for _PoeDbgPlatformRunOnDebugThread.
+typedef bool(*POEDBG_PLATFORM_ROUTINE)();
+
+#if defined(POEDBG_PLATFORM_FAKE)
+#include "platform_fake.hpp"
+#elif defined(_WIN32)
+#include "platform_win32.hpp"
+#else
+#include "platform_linux.hpp"
+#endif
+
+#if defined(_WIN32)
+#include "platform_file_win32.hpp"
+#else
+#include "platform_file_linux.hpp"
+#endif
@@ -0,0 +1,669 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+// An in-process stand-in for the game and the debugging API, selected by
+// defining POEDBG_PLATFORM_FAKE. It lets the real debug loop, hooks and
+// callbacks be driven as fast as they can go, without a game or a debugger.
+//
+// The fake game is a single block of our own memory. It holds a code section
+// with the bytes that each hook signature matches, and the buffers, stack and
+// objects the hooks read from. A PE file holding the same code stands in for
+// the game's executable. Once the process and thread events have been
+// handed out, every event is a single step at one of the three hooks, taking
+// the threads and hooks in turn. An event is only raised if the thread's debug
+// registers arm the hook, as the processor would, and the registers the engine
+// writes back are checked against what the game expects to resume with.
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+typedef struct _POEDBG_FAKE_THREAD
+{
+	DWORD Id;
+	DWORD SuspendCount;
+	CONTEXT Context;
+} POEDBG_FAKE_THREAD, *PPOEDBG_FAKE_THREAD;
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Layout of the fake game. The hook sites are spread over the code section,
+// and the data follows the image.
+#define FAKE_GAME_SIZE 0x40000
+#define FAKE_CODE_OFFSET 0x1000
+#define FAKE_CODE_SIZE 0x10000
+#define FAKE_SEND_SITE_OFFSET 0x2340
+#define FAKE_RECV_SITE_OFFSET 0x6120
+#define FAKE_WSARECV_SITE_OFFSET 0xA8F0
+#define FAKE_IMAGE_SIZE (FAKE_CODE_OFFSET + FAKE_CODE_SIZE)
+#define FAKE_SENDER_OFFSET (FAKE_IMAGE_SIZE)
+#define FAKE_CONNECTION_OFFSET (FAKE_IMAGE_SIZE + 0x100)
+#define FAKE_STACK_OFFSET (FAKE_IMAGE_SIZE + 0x400)
+#define FAKE_PACKET_OFFSET (FAKE_IMAGE_SIZE + 0x1000)
+#define FAKE_PACKET_MAX_SIZE (FAKE_GAME_SIZE - FAKE_PACKET_OFFSET)
+
+// Layout of the fake executable file: its headers, then the code section.
+#define FAKE_FILE_NT_HEADERS_OFFSET 0x80
+#define FAKE_FILE_HEADERS_SIZE 0x400
+#define FAKE_FILE_SIZE (FAKE_FILE_HEADERS_SIZE + FAKE_CODE_SIZE)
+
+#define FAKE_MAX_THREADS 16
+#define FAKE_FIRST_THREAD_ID 1000
+
+// Steps of the fake event sequence.
+#define FAKE_STEP_CREATE_PROCESS 0
+#define FAKE_STEP_CREATE_THREADS 1
+#define FAKE_STEP_HOOKS 2
+#define FAKE_STEP_DONE 3
+
+//////////////////////////////////////////////////////////////////////////
+// Globals
+//////////////////////////////////////////////////////////////////////////
+
+// Settings, to be changed before attaching. The event limit counts hook
+// events, and zero means there is no limit. A packet size of zero picks each
+// size from a mix that resembles the game's traffic.
+__declspec(selectany) DWORD64 _g_FakeEventLimit = 0;
+__declspec(selectany) DWORD _g_FakeThreadCount = 4;
+__declspec(selectany) DWORD _g_FakePacketSize = 0;
+
+// Results. Missed events are ones whose hook was not armed on the thread,
+// and bad resumes are hook events the engine did not resume as the game
+// expects.
+__declspec(selectany) DWORD64 _g_FakeEventCount;
+__declspec(selectany) DWORD64 _g_FakeByteCount;
+__declspec(selectany) DWORD64 _g_FakeMissedCount;
+__declspec(selectany) DWORD64 _g_FakeBadResumeCount;
+
+// The fake game's memory and its executable file. Both are kept from one
+// attach to the next.
+__declspec(selectany) PBYTE _g_FakeGame = NULL;
+__declspec(selectany) PBYTE _g_FakeImageFile = NULL;
+
+__declspec(selectany) POEDBG_FAKE_THREAD _g_FakeThreads[FAKE_MAX_THREADS];
+
+// Where the fake event sequence is up to.
+__declspec(selectany) DWORD _g_FakeStep;
+__declspec(selectany) DWORD _g_FakeStepIndex;
+__declspec(selectany) DWORD64 _g_FakeSequence;
+__declspec(selectany) DWORD64 _g_FakeRandom;
+__declspec(selectany) volatile bool _g_bIsFakeAttached = false;
+
+// Packet sizes in the traffic mix. Most game packets are small, with the
+// occasional large one.
+__declspec(selectany) DWORD _g_FakePacketSizes[] =
+{
+	2, 6, 6, 10, 14, 14, 18, 24, 24, 32, 40, 56, 64, 96, 180, 1460
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Fake Game Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Writes the bytes a signature requires at the given offset of the fake game.
+Bytes the signature doesn't care about are left as they are.
+*/
+inline void _PoeDbgFakeWriteSignature(const ULONG_PTR Offset, const BYTE* Pattern)
+{
+	PBYTE Site = _g_FakeGame + Offset;
+
+	for (; NULL != Pattern[0]; Site++, Pattern++)
+	{
+		if ('_' == Pattern[0] || '&' == Pattern[0])
+		{
+			Pattern++;
+			Site[0] = Pattern[0];
+		}
+	}
+}
+
+/*
+Builds the fake game's executable file from its code: a PE image with a single
+code section, loaded at the same place as the fake game's. The headers are
+loaded into the fake game as well, as a loader would.
+*/
+inline bool _PoeDbgFakeBuildImageFile()
+{
+	if (NULL == _g_FakeImageFile)
+	{
+		_g_FakeImageFile = reinterpret_cast<PBYTE>(VirtualAlloc(NULL, FAKE_FILE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+		if (NULL == _g_FakeImageFile)
+		{
+			return false;
+		}
+	}
+
+	memset(_g_FakeImageFile, 0, FAKE_FILE_HEADERS_SIZE);
+
+	PIMAGE_DOS_HEADER DosHeader = reinterpret_cast<PIMAGE_DOS_HEADER>(_g_FakeImageFile);
+	DosHeader->e_magic = IMAGE_DOS_SIGNATURE;
+	DosHeader->e_lfanew = FAKE_FILE_NT_HEADERS_OFFSET;
+
+	PIMAGE_NT_HEADERS NtHeaders = reinterpret_cast<PIMAGE_NT_HEADERS>(_g_FakeImageFile + FAKE_FILE_NT_HEADERS_OFFSET);
+	NtHeaders->Signature = IMAGE_NT_SIGNATURE;
+	NtHeaders->FileHeader.Machine = IMAGE_FILE_MACHINE_AMD64;
+	NtHeaders->FileHeader.NumberOfSections = 1;
+	NtHeaders->FileHeader.SizeOfOptionalHeader = sizeof(NtHeaders->OptionalHeader);
+	NtHeaders->OptionalHeader.Magic = IMAGE_NT_OPTIONAL_HDR64_MAGIC;
+	NtHeaders->OptionalHeader.SizeOfCode = FAKE_CODE_SIZE;
+	NtHeaders->OptionalHeader.BaseOfCode = FAKE_CODE_OFFSET;
+	NtHeaders->OptionalHeader.SizeOfImage = FAKE_IMAGE_SIZE;
+	NtHeaders->OptionalHeader.SizeOfHeaders = FAKE_FILE_HEADERS_SIZE;
+
+	PIMAGE_SECTION_HEADER Section = IMAGE_FIRST_SECTION(NtHeaders);
+	memcpy(Section->Name, ".text", sizeof(".text"));
+	Section->Misc.VirtualSize = FAKE_CODE_SIZE;
+	Section->VirtualAddress = FAKE_CODE_OFFSET;
+	Section->SizeOfRawData = FAKE_CODE_SIZE;
+	Section->PointerToRawData = FAKE_FILE_HEADERS_SIZE;
+	Section->Characteristics = IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ;
+
+	memcpy(_g_FakeImageFile + FAKE_FILE_HEADERS_SIZE, _g_FakeGame + FAKE_CODE_OFFSET, FAKE_CODE_SIZE);
+	memcpy(_g_FakeGame, _g_FakeImageFile, FAKE_FILE_HEADERS_SIZE);
+
+	return true;
+}
+
+/*
+Builds the fake game: the hook sites in its code, its objects and the packets
+it sends. Every packet is framed as the game's are, with a zero byte followed
+by the ID.
+*/
+inline bool _PoeDbgFakeBuildGame()
+{
+	if (NULL == _g_FakeGame)
+	{
+		_g_FakeGame = reinterpret_cast<PBYTE>(VirtualAlloc(NULL, FAKE_GAME_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+		if (NULL == _g_FakeGame)
+		{
+			return false;
+		}
+	}
+
+	memset(_g_FakeGame, 0, FAKE_GAME_SIZE);
+	memset(_g_FakeGame + FAKE_CODE_OFFSET, 0xCC, FAKE_CODE_SIZE);
+
+	_PoeDbgFakeWriteSignature(FAKE_SEND_SITE_OFFSET, _g_PacketSenderPattern);
+	_PoeDbgFakeWriteSignature(FAKE_RECV_SITE_OFFSET, _g_PacketRecvPattern);
+	_PoeDbgFakeWriteSignature(FAKE_WSARECV_SITE_OFFSET, _g_PacketWsaRecvPattern);
+
+	for (DWORD Offset = 0; Offset < FAKE_PACKET_MAX_SIZE; Offset++)
+	{
+		_g_FakeGame[FAKE_PACKET_OFFSET + Offset] = static_cast<BYTE>(Offset * 7);
+	}
+
+	_g_FakeGame[FAKE_PACKET_OFFSET] = 0;
+
+	return _PoeDbgFakeBuildImageFile();
+}
+
+/*
+Returns the next number from a small generator, so that every run sees the
+same traffic.
+*/
+POEDBG_INLINE DWORD _PoeDbgFakeRandom()
+{
+	_g_FakeRandom = _g_FakeRandom * 6364136223846793005ULL + 1442695040888963407ULL;
+	return static_cast<DWORD>(_g_FakeRandom >> 33);
+}
+
+/*
+Returns the game address of the given offset into the fake game.
+*/
+POEDBG_INLINE DWORD64 _PoeDbgFakeAddress(const ULONG_PTR Offset)
+{
+	return reinterpret_cast<DWORD64>(_g_FakeGame + Offset);
+}
+
+/*
+Returns the address of the hook in the given slot.
+*/
+POEDBG_INLINE DWORD64 _PoeDbgFakeHookAddress(const DWORD Slot)
+{
+	switch (Slot)
+	{
+	case BP_SLOT_SEND:
+		return _PoeDbgFakeAddress(FAKE_SEND_SITE_OFFSET + _g_PacketSenderHookOffset);
+	case BP_SLOT_RECV:
+		return _PoeDbgFakeAddress(FAKE_RECV_SITE_OFFSET + _g_PacketRecvHookOffset);
+	default:
+		return _PoeDbgFakeAddress(FAKE_WSARECV_SITE_OFFSET + _g_PacketWsaRecvHookOffset);
+	}
+}
+
+/*
+Returns the address the game must resume from after the hook in the given
+slot, which is past the instructions the engine runs on its behalf.
+*/
+POEDBG_INLINE DWORD64 _PoeDbgFakeHookEndAddress(const DWORD Slot)
+{
+	switch (Slot)
+	{
+	case BP_SLOT_SEND:
+		return _PoeDbgFakeHookAddress(Slot) + _g_PacketSenderHookSize;
+	case BP_SLOT_RECV:
+		return _PoeDbgFakeHookAddress(Slot) + _g_PacketRecvHookSize;
+	default:
+		return _PoeDbgFakeHookAddress(Slot) + _g_PacketWsaRecvHookSize;
+	}
+}
+
+/*
+Checks whether the debug registers of the context arm the hook in the given
+slot, as the processor would.
+*/
+POEDBG_INLINE bool _PoeDbgFakeIsHookArmed(const PCONTEXT Context, const DWORD Slot)
+{
+	DWORD64 Addresses[BP_SLOT_COUNT] = { Context->Dr0, Context->Dr1, Context->Dr2, Context->Dr3 };
+
+	if (0 == (Context->Dr7 & (static_cast<DWORD64>(1) << (Slot * 2))))
+	{
+		return false;
+	}
+
+	return (Addresses[Slot] == _PoeDbgFakeHookAddress(Slot));
+}
+
+/*
+Fills in the registers the game has at the hook in the given slot, for a
+packet of the given length. A fresh ID is written into the packet each time.
+*/
+inline void _PoeDbgFakeSetHookRegisters(PCONTEXT Context, const DWORD Slot, const DWORD Length)
+{
+	DWORD64 Packet = _PoeDbgFakeAddress(FAKE_PACKET_OFFSET);
+
+	_g_FakeGame[FAKE_PACKET_OFFSET + 1] = static_cast<BYTE>(_g_FakeSequence);
+
+	Context->Rip = _PoeDbgFakeHookAddress(Slot);
+	Context->Rsp = _PoeDbgFakeAddress(FAKE_STACK_OFFSET);
+	Context->Rbx = _PoeDbgFakeAddress(FAKE_CONNECTION_OFFSET);
+	Context->Rcx = _PoeDbgFakeAddress(FAKE_SENDER_OFFSET);
+
+	switch (Slot)
+	{
+	case BP_SLOT_SEND:
+		Context->Rdx = Packet;
+		Context->R8 = Length;
+		break;
+	case BP_SLOT_RECV:
+		Context->R9 = Packet;
+		Context->Rax = Length;
+		Context->Rdi = 0;
+		break;
+	default:
+		memcpy(_g_FakeGame + FAKE_STACK_OFFSET + 0x48, &Packet, sizeof(Packet));
+		Context->Rdi = Length;
+		Context->Rax = 0;
+		break;
+	}
+
+	Context->Dr6 = static_cast<DWORD64>(1) << Slot;
+}
+
+/*
+Checks that the engine resumed a hook event the way the game expects: past
+the hook, with the skipped instructions done and DR6 cleared.
+*/
+inline bool _PoeDbgFakeIsResumeValid(const PCONTEXT Context, const DWORD Slot)
+{
+	if (Context->Rip != _PoeDbgFakeHookEndAddress(Slot) || 0 != Context->Dr6)
+	{
+		return false;
+	}
+
+	switch (Slot)
+	{
+	case BP_SLOT_SEND:
+		return (Context->Rcx == _PoeDbgFakeAddress(FAKE_SENDER_OFFSET) + 0x10);
+	case BP_SLOT_RECV:
+		return (Context->Rdi == Context->Rax);
+	default:
+		return (Context->Rax == Context->Rdi);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Platform Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Attaches to the fake game, which starts its event sequence over.
+*/
+inline POEDBG_STATUS _PoeDbgPlatformAttach(const DWORD ProcessId)
+{
+	UNREFERENCED_PARAMETER(ProcessId);
+
+	if (!_PoeDbgFakeBuildGame())
+	{
+		return POEDBG_STATUS_GAME_HOOK_NOT_SET;
+	}
+
+	if (_g_FakeThreadCount < 1 || _g_FakeThreadCount > FAKE_MAX_THREADS)
+	{
+		_g_FakeThreadCount = FAKE_MAX_THREADS;
+	}
+
+	for (DWORD Index = 0; Index < FAKE_MAX_THREADS; Index++)
+	{
+		memset(&_g_FakeThreads[Index], 0, sizeof(POEDBG_FAKE_THREAD));
+		_g_FakeThreads[Index].Id = FAKE_FIRST_THREAD_ID + Index;
+	}
+
+	_g_FakeStep = FAKE_STEP_CREATE_PROCESS;
+	_g_FakeStepIndex = 0;
+	_g_FakeSequence = 0;
+	_g_FakeRandom = 0;
+
+	_g_FakeEventCount = 0;
+	_g_FakeByteCount = 0;
+	_g_FakeMissedCount = 0;
+	_g_FakeBadResumeCount = 0;
+
+	_g_bIsFakeAttached = true;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Detaches from the fake game. The debug loop ends at its next wait.
+*/
+inline void _PoeDbgPlatformDetach(const DWORD ProcessId)
+{
+	UNREFERENCED_PARAMETER(ProcessId);
+
+	_g_bIsFakeAttached = false;
+	_g_GameHandle = NULL;
+}
+
+/*
+Hands out the next event of the fake sequence. The fake game always has an
+event ready, so the wait never times out. Returns PLATFORM_WAIT_DONE once
+the event limit has been reached, or we have detached.
+*/
+inline int _PoeDbgPlatformWaitForEvent(LPDEBUG_EVENT Event, const DWORD Timeout)
+{
+	UNREFERENCED_PARAMETER(Timeout);
+
+	memset(Event, 0, sizeof(DEBUG_EVENT));
+	Event->dwProcessId = FAKE_FIRST_THREAD_ID;
+
+	while (_g_bIsFakeAttached)
+	{
+		switch (_g_FakeStep)
+		{
+		case FAKE_STEP_CREATE_PROCESS:
+
+			_g_FakeStep = FAKE_STEP_CREATE_THREADS;
+			_g_FakeStepIndex = 1;
+
+			Event->dwDebugEventCode = CREATE_PROCESS_DEBUG_EVENT;
+			Event->dwThreadId = _g_FakeThreads[0].Id;
+			Event->u.CreateProcessInfo.hProcess = reinterpret_cast<HANDLE>(_g_FakeGame);
+			Event->u.CreateProcessInfo.hThread = reinterpret_cast<HANDLE>(&_g_FakeThreads[0]);
+			Event->u.CreateProcessInfo.lpBaseOfImage = _g_FakeGame;
+			return PLATFORM_WAIT_EVENT;
+
+		case FAKE_STEP_CREATE_THREADS:
+
+			if (_g_FakeStepIndex >= _g_FakeThreadCount)
+			{
+				_g_FakeStep = FAKE_STEP_HOOKS;
+				break;
+			}
+
+			Event->dwDebugEventCode = CREATE_THREAD_DEBUG_EVENT;
+			Event->dwThreadId = _g_FakeThreads[_g_FakeStepIndex].Id;
+			Event->u.CreateThread.hThread = reinterpret_cast<HANDLE>(&_g_FakeThreads[_g_FakeStepIndex]);
+
+			_g_FakeStepIndex++;
+			return PLATFORM_WAIT_EVENT;
+
+		case FAKE_STEP_HOOKS:
+		{
+			if (0 != _g_FakeEventLimit && _g_FakeEventCount >= _g_FakeEventLimit)
+			{
+				_g_FakeStep = FAKE_STEP_DONE;
+				break;
+			}
+
+			DWORD64 Sequence = _g_FakeSequence++;
+
+			PPOEDBG_FAKE_THREAD Thread = &_g_FakeThreads[Sequence % _g_FakeThreadCount];
+			DWORD Slot = static_cast<DWORD>(Sequence % 3);
+
+			if (!_PoeDbgFakeIsHookArmed(&Thread->Context, Slot))
+			{
+				// The hook isn't set on this thread, so the game runs
+				// straight past it.
+				_g_FakeMissedCount++;
+				_g_FakeEventCount++;
+				break;
+			}
+
+			DWORD Length = _g_FakePacketSize;
+
+			if (0 == Length)
+			{
+				Length = _g_FakePacketSizes[_PoeDbgFakeRandom() % ARRAYSIZE(_g_FakePacketSizes)];
+			}
+
+			if (Length > FAKE_PACKET_MAX_SIZE)
+			{
+				Length = FAKE_PACKET_MAX_SIZE;
+			}
+
+			_PoeDbgFakeSetHookRegisters(&Thread->Context, Slot, Length);
+
+			_g_FakeEventCount++;
+			_g_FakeByteCount += Length;
+
+			Event->dwDebugEventCode = EXCEPTION_DEBUG_EVENT;
+			Event->dwThreadId = Thread->Id;
+			Event->u.Exception.ExceptionRecord.ExceptionCode = EXCEPTION_SINGLE_STEP;
+			Event->u.Exception.ExceptionRecord.ExceptionAddress = reinterpret_cast<PVOID>(Thread->Context.Rip);
+			Event->u.Exception.dwFirstChance = TRUE;
+			return PLATFORM_WAIT_EVENT;
+		}
+
+		default:
+			return PLATFORM_WAIT_DONE;
+		}
+	}
+
+	return PLATFORM_WAIT_DONE;
+}
+
+/*
+Resumes the thread that reported the given event, checking how the engine
+left it if it stopped at a hook.
+*/
+inline void _PoeDbgPlatformContinueEvent(const LPDEBUG_EVENT Event, const DWORD Status)
+{
+	if (EXCEPTION_DEBUG_EVENT != Event->dwDebugEventCode)
+	{
+		return;
+	}
+
+	DWORD Index = Event->dwThreadId - FAKE_FIRST_THREAD_ID;
+
+	if (Index >= FAKE_MAX_THREADS)
+	{
+		return;
+	}
+
+	PCONTEXT Context = &_g_FakeThreads[Index].Context;
+	ULONG_PTR Address = reinterpret_cast<ULONG_PTR>(Event->u.Exception.ExceptionRecord.ExceptionAddress);
+
+	for (DWORD Slot = 0; Slot <= BP_SLOT_WSARECV; Slot++)
+	{
+		if (Address != _PoeDbgFakeHookAddress(Slot))
+		{
+			continue;
+		}
+
+		if (DBG_CONTINUE != Status || !_PoeDbgFakeIsResumeValid(Context, Slot))
+		{
+			_g_FakeBadResumeCount++;
+		}
+	}
+}
+
+/*
+Reads from the given fake game address into the buffer.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformReadMemory(const ULONG_PTR Address, PVOID Buffer, const SIZE_T Size)
+{
+	ULONG_PTR Base = reinterpret_cast<ULONG_PTR>(_g_FakeGame);
+
+	if (Address < Base || Size > FAKE_GAME_SIZE || Address - Base > FAKE_GAME_SIZE - Size)
+	{
+		return false;
+	}
+
+	memcpy(Buffer, reinterpret_cast<PVOID>(Address), Size);
+	return true;
+}
+
+/*
+Writes the buffer to the given fake game address.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformWriteMemory(const ULONG_PTR Address, PVOID Buffer, const SIZE_T Size)
+{
+	ULONG_PTR Base = reinterpret_cast<ULONG_PTR>(_g_FakeGame);
+
+	if (Address < Base || Size > FAKE_GAME_SIZE || Address - Base > FAKE_GAME_SIZE - Size)
+	{
+		return false;
+	}
+
+	memcpy(reinterpret_cast<PVOID>(Address), Buffer, Size);
+	return true;
+}
+
+/*
+Reads the registers of the given fake thread. All of them are always read.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformGetContext(const HANDLE Thread, PCONTEXT Context)
+{
+	DWORD Flags = Context->ContextFlags;
+
+	*Context = reinterpret_cast<PPOEDBG_FAKE_THREAD>(Thread)->Context;
+	Context->ContextFlags = Flags;
+
+	return true;
+}
+
+/*
+Writes the registers named by the context flags to the given fake thread.
+Only the debug registers may be written on their own.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformSetContext(const HANDLE Thread, const PCONTEXT Context)
+{
+	PCONTEXT Target = &reinterpret_cast<PPOEDBG_FAKE_THREAD>(Thread)->Context;
+
+	if (CONTEXT_ALL == (Context->ContextFlags & CONTEXT_ALL))
+	{
+		*Target = *Context;
+		return true;
+	}
+
+	if (CONTEXT_DEBUG_REGISTERS == (Context->ContextFlags & CONTEXT_DEBUG_REGISTERS))
+	{
+		Target->Dr0 = Context->Dr0;
+		Target->Dr1 = Context->Dr1;
+		Target->Dr2 = Context->Dr2;
+		Target->Dr3 = Context->Dr3;
+		Target->Dr6 = Context->Dr6;
+		Target->Dr7 = Context->Dr7;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+Suspends the given fake thread, which only counts the request.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformSuspendThread(const HANDLE Thread)
+{
+	reinterpret_cast<PPOEDBG_FAKE_THREAD>(Thread)->SuspendCount++;
+	return true;
+}
+
+/*
+Resumes a fake thread suspended by _PoeDbgPlatformSuspendThread.
+*/
+POEDBG_INLINE void _PoeDbgPlatformResumeThread(const HANDLE Thread)
+{
+	reinterpret_cast<PPOEDBG_FAKE_THREAD>(Thread)->SuspendCount--;
+}
+
+/*
+Describes the fake game image, which has no headers to read.
+*/
+inline POEDBG_STATUS _PoeDbgPlatformGetImageLayout()
+{
+	if (NULL == _g_FakeGame)
+	{
+		return POEDBG_STATUS_CACHE_DOS_HEADER_NOT_FOUND;
+	}
+
+	_g_GameImageSize = FAKE_IMAGE_SIZE;
+	_g_GameBaseOfCode = FAKE_CODE_OFFSET;
+	_g_GameSizeOfCode = FAKE_CODE_SIZE;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Hands out the fake game's executable file, which is already in memory.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformMapImageFile(PVOID* View, PSIZE_T Size)
+{
+	if (NULL == _g_FakeImageFile)
+	{
+		return false;
+	}
+
+	*View = _g_FakeImageFile;
+	*Size = FAKE_FILE_SIZE;
+
+	return true;
+}
+
+/*
+Releases the fake game's executable file, which is kept for the next attach.
+*/
+POEDBG_INLINE void _PoeDbgPlatformUnmapImageFile(PVOID View, const SIZE_T Size)
+{
+	UNREFERENCED_PARAMETER(View);
+	UNREFERENCED_PARAMETER(Size);
+}
+
+/*
+Finds the file name of the module that a DLL load event is for. The fake game
+loads no modules, so there is never one.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformGetModuleName(const LPDEBUG_EVENT Event, wchar_t* Name, const DWORD Length)
+{
+	UNREFERENCED_PARAMETER(Event);
+	UNREFERENCED_PARAMETER(Name);
+	UNREFERENCED_PARAMETER(Length);
+
+	return false;
+}
+
+/*
+Runs a routine that changes game threads. The fake threads are only ever
+changed in memory, so the routine is simply called.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformRunOnDebugThread(POEDBG_PLATFORM_ROUTINE Routine)
+{
+	return Routine();
+}
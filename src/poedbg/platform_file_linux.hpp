@@ -0,0 +1,349 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Most writes that can be in flight on one file at once.
+#define FILE_WRITE_MAXIMUM 16
+
+// Longest path, in bytes once encoded as UTF-8.
+#define FILE_PATH_MAXIMUM 0x1000
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+// A file opened for writes through an io_uring. Each write in flight has its
+// own slot, named by the tag it was started with. If the kernel won't give us
+// a ring, writes are made straight away with pwrite and their results kept
+// until they are waited for.
+typedef struct _POEDBG_FILE
+{
+	int Descriptor;
+	int Ring;
+
+	PBYTE SubmitRing;
+	SIZE_T SubmitRingSize;
+	PBYTE CompleteRing;
+	SIZE_T CompleteRingSize;
+	struct io_uring_sqe* Entries;
+	SIZE_T EntriesSize;
+
+	unsigned* SubmitTail;
+	unsigned* SubmitArray;
+	unsigned SubmitMask;
+	unsigned* CompleteHead;
+	unsigned* CompleteTail;
+	unsigned CompleteMask;
+	struct io_uring_cqe* Completions;
+
+	struct iovec Vectors[FILE_WRITE_MAXIMUM];
+
+	DWORD Finished[FILE_WRITE_MAXIMUM];
+	bool bIsFinishedOk[FILE_WRITE_MAXIMUM];
+	DWORD FinishedHead;
+	DWORD FinishedCount;
+} POEDBG_FILE, *PPOEDBG_FILE;
+
+//////////////////////////////////////////////////////////////////////////
+// File Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Encodes a path as UTF-8. Returns false if it doesn't fit.
+*/
+inline bool _PoeDbgPlatformEncodePath(const wchar_t* Path, char* Output, const SIZE_T Size)
+{
+	SIZE_T Length = 0;
+
+	for (; L'\0' != Path[0]; Path++)
+	{
+		DWORD Character = static_cast<DWORD>(Path[0]);
+		BYTE Encoded[4];
+		SIZE_T Count = 0;
+
+		if (Character < 0x80)
+		{
+			Encoded[Count++] = static_cast<BYTE>(Character);
+		}
+		else if (Character < 0x800)
+		{
+			Encoded[Count++] = static_cast<BYTE>(0xC0 | (Character >> 6));
+			Encoded[Count++] = static_cast<BYTE>(0x80 | (Character & 0x3F));
+		}
+		else if (Character < 0x10000)
+		{
+			Encoded[Count++] = static_cast<BYTE>(0xE0 | (Character >> 12));
+			Encoded[Count++] = static_cast<BYTE>(0x80 | ((Character >> 6) & 0x3F));
+			Encoded[Count++] = static_cast<BYTE>(0x80 | (Character & 0x3F));
+		}
+		else
+		{
+			Encoded[Count++] = static_cast<BYTE>(0xF0 | (Character >> 18));
+			Encoded[Count++] = static_cast<BYTE>(0x80 | ((Character >> 12) & 0x3F));
+			Encoded[Count++] = static_cast<BYTE>(0x80 | ((Character >> 6) & 0x3F));
+			Encoded[Count++] = static_cast<BYTE>(0x80 | (Character & 0x3F));
+		}
+
+		if (Length + Count >= Size)
+		{
+			return false;
+		}
+
+		memcpy(Output + Length, Encoded, Count);
+		Length += Count;
+	}
+
+	Output[Length] = '\0';
+
+	return true;
+}
+
+/*
+Releases the io_uring of a file, if it has one.
+*/
+inline void _PoeDbgPlatformReleaseFileRing(PPOEDBG_FILE File)
+{
+	if (NULL != File->Entries)
+	{
+		munmap(File->Entries, File->EntriesSize);
+	}
+
+	if (NULL != File->CompleteRing)
+	{
+		munmap(File->CompleteRing, File->CompleteRingSize);
+	}
+
+	if (NULL != File->SubmitRing)
+	{
+		munmap(File->SubmitRing, File->SubmitRingSize);
+	}
+
+	if (File->Ring >= 0)
+	{
+		close(File->Ring);
+	}
+
+	File->Entries = NULL;
+	File->CompleteRing = NULL;
+	File->SubmitRing = NULL;
+	File->Ring = -1;
+}
+
+/*
+Sets up an io_uring for writing to the file. If it can't be set up, the file
+is left to be written with pwrite.
+*/
+inline void _PoeDbgPlatformCreateFileRing(PPOEDBG_FILE File)
+{
+	struct io_uring_params Parameters;
+	memset(&Parameters, 0, sizeof(Parameters));
+
+	File->Ring = static_cast<int>(syscall(__NR_io_uring_setup, FILE_WRITE_MAXIMUM, &Parameters));
+
+	if (File->Ring < 0)
+	{
+		return;
+	}
+
+	File->SubmitRingSize = Parameters.sq_off.array + Parameters.sq_entries * sizeof(unsigned);
+	File->CompleteRingSize = Parameters.cq_off.cqes + Parameters.cq_entries * sizeof(struct io_uring_cqe);
+	File->EntriesSize = Parameters.sq_entries * sizeof(struct io_uring_sqe);
+
+	PVOID SubmitRing = mmap(NULL, File->SubmitRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, File->Ring, IORING_OFF_SQ_RING);
+	PVOID CompleteRing = mmap(NULL, File->CompleteRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, File->Ring, IORING_OFF_CQ_RING);
+	PVOID Entries = mmap(NULL, File->EntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, File->Ring, IORING_OFF_SQES);
+
+	File->SubmitRing = (MAP_FAILED != SubmitRing) ? reinterpret_cast<PBYTE>(SubmitRing) : NULL;
+	File->CompleteRing = (MAP_FAILED != CompleteRing) ? reinterpret_cast<PBYTE>(CompleteRing) : NULL;
+	File->Entries = (MAP_FAILED != Entries) ? reinterpret_cast<struct io_uring_sqe*>(Entries) : NULL;
+
+	if (NULL == File->SubmitRing || NULL == File->CompleteRing || NULL == File->Entries)
+	{
+		_PoeDbgPlatformReleaseFileRing(File);
+		return;
+	}
+
+	File->SubmitTail = reinterpret_cast<unsigned*>(File->SubmitRing + Parameters.sq_off.tail);
+	File->SubmitArray = reinterpret_cast<unsigned*>(File->SubmitRing + Parameters.sq_off.array);
+	File->SubmitMask = *reinterpret_cast<unsigned*>(File->SubmitRing + Parameters.sq_off.ring_mask);
+	File->CompleteHead = reinterpret_cast<unsigned*>(File->CompleteRing + Parameters.cq_off.head);
+	File->CompleteTail = reinterpret_cast<unsigned*>(File->CompleteRing + Parameters.cq_off.tail);
+	File->CompleteMask = *reinterpret_cast<unsigned*>(File->CompleteRing + Parameters.cq_off.ring_mask);
+	File->Completions = reinterpret_cast<struct io_uring_cqe*>(File->CompleteRing + Parameters.cq_off.cqes);
+}
+
+/*
+Creates the given file for writing, replacing any file already there.
+*/
+inline bool _PoeDbgPlatformOpenFile(PPOEDBG_FILE File, const wchar_t* Path)
+{
+	char EncodedPath[FILE_PATH_MAXIMUM];
+
+	memset(File, 0, sizeof(POEDBG_FILE));
+	File->Ring = -1;
+
+	if (!_PoeDbgPlatformEncodePath(Path, EncodedPath, sizeof(EncodedPath)))
+	{
+		return false;
+	}
+
+	File->Descriptor = open(EncodedPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (File->Descriptor < 0)
+	{
+		return false;
+	}
+
+	_PoeDbgPlatformCreateFileRing(File);
+
+	return true;
+}
+
+/*
+Writes the whole buffer at the given offset with pwrite, and keeps the result
+for _PoeDbgPlatformWaitForFileWrite.
+*/
+inline bool _PoeDbgPlatformWriteFileNow(PPOEDBG_FILE File, const void* Buffer, const DWORD Size, const DWORD64 Offset, const DWORD Tag)
+{
+	const BYTE* Data = reinterpret_cast<const BYTE*>(Buffer);
+	DWORD Written = 0;
+
+	while (Written < Size)
+	{
+		ssize_t Result = pwrite(File->Descriptor, Data + Written, Size - Written, static_cast<off_t>(Offset + Written));
+
+		if (Result <= 0)
+		{
+			if (Result < 0 && EINTR == errno)
+			{
+				continue;
+			}
+
+			break;
+		}
+
+		Written += static_cast<DWORD>(Result);
+	}
+
+	DWORD Index = (File->FinishedHead + File->FinishedCount) % FILE_WRITE_MAXIMUM;
+
+	File->Finished[Index] = Tag;
+	File->bIsFinishedOk[Index] = (Written == Size);
+	File->FinishedCount++;
+
+	return true;
+}
+
+/*
+Starts writing the buffer at the given offset in the file. The buffer must
+stay untouched, and the tag unused, until the write has completed.
+*/
+inline bool _PoeDbgPlatformWriteFile(PPOEDBG_FILE File, const void* Buffer, const DWORD Size, const DWORD64 Offset, const DWORD Tag)
+{
+	if (File->Ring < 0)
+	{
+		return _PoeDbgPlatformWriteFileNow(File, Buffer, Size, Offset, Tag);
+	}
+
+	// Vectored writes are the oldest write the ring supports.
+	File->Vectors[Tag].iov_base = const_cast<void*>(Buffer);
+	File->Vectors[Tag].iov_len = Size;
+
+	unsigned Tail = *File->SubmitTail;
+	unsigned Index = Tail & File->SubmitMask;
+
+	struct io_uring_sqe* Entry = &File->Entries[Index];
+	memset(Entry, 0, sizeof(struct io_uring_sqe));
+
+	Entry->opcode = IORING_OP_WRITEV;
+	Entry->fd = File->Descriptor;
+	Entry->addr = reinterpret_cast<DWORD64>(&File->Vectors[Tag]);
+	Entry->len = 1;
+	Entry->off = Offset;
+	Entry->user_data = Tag;
+
+	File->SubmitArray[Index] = Index;
+
+	// Publish the entry before the kernel can see the new tail.
+	__atomic_store_n(File->SubmitTail, Tail + 1, __ATOMIC_RELEASE);
+
+	for (;;)
+	{
+		long Result = syscall(__NR_io_uring_enter, File->Ring, 1, 0, 0, NULL, 0);
+
+		if (1 == Result)
+		{
+			return true;
+		}
+
+		if (Result < 0 && EINTR == errno)
+		{
+			continue;
+		}
+
+		return false;
+	}
+}
+
+/*
+Waits for the next write started on the file to complete, and returns its
+tag. Returns false if the write failed or was cut short.
+*/
+inline bool _PoeDbgPlatformWaitForFileWrite(PPOEDBG_FILE File, PDWORD Tag)
+{
+	if (File->Ring < 0)
+	{
+		if (0 == File->FinishedCount)
+		{
+			return false;
+		}
+
+		DWORD Index = File->FinishedHead;
+
+		File->FinishedHead = (File->FinishedHead + 1) % FILE_WRITE_MAXIMUM;
+		File->FinishedCount--;
+
+		*Tag = File->Finished[Index];
+
+		return File->bIsFinishedOk[Index];
+	}
+
+	for (;;)
+	{
+		unsigned Head = *File->CompleteHead;
+
+		if (Head != __atomic_load_n(File->CompleteTail, __ATOMIC_ACQUIRE))
+		{
+			struct io_uring_cqe* Completion = &File->Completions[Head & File->CompleteMask];
+
+			*Tag = static_cast<DWORD>(Completion->user_data);
+			bool bIsOk = (Completion->res >= 0 && static_cast<SIZE_T>(Completion->res) == File->Vectors[*Tag].iov_len);
+
+			// Hand the entry back to the kernel.
+			__atomic_store_n(File->CompleteHead, Head + 1, __ATOMIC_RELEASE);
+
+			return bIsOk;
+		}
+
+		long Result = syscall(__NR_io_uring_enter, File->Ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+		if (Result < 0 && EINTR != errno)
+		{
+			return false;
+		}
+	}
+}
+
+/*
+Closes a file opened by _PoeDbgPlatformOpenFile. Every write must have
+completed.
+*/
+POEDBG_INLINE void _PoeDbgPlatformCloseFile(PPOEDBG_FILE File)
+{
+	_PoeDbgPlatformReleaseFileRing(File);
+	close(File->Descriptor);
+}
@@ -0,0 +1,107 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Most writes that can be in flight on one file at once.
+#define FILE_WRITE_MAXIMUM 16
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+// A file opened for overlapped writes. Each write in flight has its own slot,
+// named by the tag it was started with, and completes through the port.
+typedef struct _POEDBG_FILE
+{
+	HANDLE Handle;
+	HANDLE Port;
+	OVERLAPPED Writes[FILE_WRITE_MAXIMUM];
+	DWORD Sizes[FILE_WRITE_MAXIMUM];
+} POEDBG_FILE, *PPOEDBG_FILE;
+
+//////////////////////////////////////////////////////////////////////////
+// File Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Creates the given file for writing, replacing any file already there, with
+its writes completing through an I/O completion port.
+*/
+inline bool _PoeDbgPlatformOpenFile(PPOEDBG_FILE File, const wchar_t* Path)
+{
+	File->Handle = CreateFileW(Path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (INVALID_HANDLE_VALUE == File->Handle)
+	{
+		return false;
+	}
+
+	File->Port = CreateIoCompletionPort(File->Handle, NULL, 0, 1);
+
+	if (NULL == File->Port)
+	{
+		CloseHandle(File->Handle);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+Starts writing the buffer at the given offset in the file. The buffer must
+stay untouched, and the tag unused, until the write has completed.
+*/
+inline bool _PoeDbgPlatformWriteFile(PPOEDBG_FILE File, const void* Buffer, const DWORD Size, const DWORD64 Offset, const DWORD Tag)
+{
+	LPOVERLAPPED Overlapped = &File->Writes[Tag];
+
+	memset(Overlapped, 0, sizeof(OVERLAPPED));
+	Overlapped->Offset = static_cast<DWORD>(Offset);
+	Overlapped->OffsetHigh = static_cast<DWORD>(Offset >> 32);
+
+	File->Sizes[Tag] = Size;
+
+	// A write that finishes straight away still posts its completion.
+	if (FALSE == WriteFile(File->Handle, Buffer, Size, NULL, Overlapped) && ERROR_IO_PENDING != GetLastError())
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/*
+Waits for the next write started on the file to complete, and returns its
+tag. Returns false if the write failed or was cut short.
+*/
+inline bool _PoeDbgPlatformWaitForFileWrite(PPOEDBG_FILE File, PDWORD Tag)
+{
+	DWORD BytesWritten = 0;
+	ULONG_PTR Key = 0;
+	LPOVERLAPPED Overlapped = NULL;
+
+	BOOL Result = GetQueuedCompletionStatus(File->Port, &BytesWritten, &Key, &Overlapped, INFINITE);
+
+	if (NULL == Overlapped)
+	{
+		return false;
+	}
+
+	*Tag = static_cast<DWORD>(Overlapped - File->Writes);
+
+	return (FALSE != Result && BytesWritten == File->Sizes[*Tag]);
+}
+
+/*
+Closes a file opened by _PoeDbgPlatformOpenFile. Every write must have
+completed.
+*/
+POEDBG_INLINE void _PoeDbgPlatformCloseFile(PPOEDBG_FILE File)
+{
+	CloseHandle(File->Port);
+	CloseHandle(File->Handle);
+}
@@ -0,0 +1,1084 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+// The Linux platform is built on ptrace. It differs from the Win32 debugging
+// API in a few ways that shape everything below:
+//
+//  - Only the thread that attached may make ptrace calls, so anything that
+//    changes game threads from another thread is handed to the debug loop.
+//    The requester sends the game a SIGWINCH to wake the loop, which the loop
+//    recognizes and swallows.
+//  - Only the thread that reported an event is stopped, rather than the whole
+//    process, so the other threads must be interrupted before they can be
+//    changed.
+//  - Registers can only be read and written one thread at a time, so each
+//    stopped thread's registers are cached until it is continued.
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+typedef struct _POEDBG_LINUX_THREAD
+{
+	bool bIsStopped;
+	bool bIsInterrupted;
+	bool bHasPendingStatus;
+	bool bHasRegisters;
+	int Signal;
+	DWORD SuspendCount;
+	struct user_regs_struct Registers;
+	DWORD64 DebugRegisters[8];
+} POEDBG_LINUX_THREAD, *PPOEDBG_LINUX_THREAD;
+
+typedef struct _POEDBG_LINUX_STATUS
+{
+	pid_t ThreadId;
+	int Status;
+} POEDBG_LINUX_STATUS, *PPOEDBG_LINUX_STATUS;
+
+typedef struct _POEDBG_LINUX_REQUEST
+{
+	POEDBG_PLATFORM_ROUTINE Routine;
+	bool bIsDone;
+	bool bResult;
+} POEDBG_LINUX_REQUEST, *PPOEDBG_LINUX_REQUEST;
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Options for every traced thread. Threads the game starts are traced as well.
+#define LINUX_TRACE_OPTIONS (PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC)
+
+// Signal used to wake the debug loop.
+#define LINUX_WAKE_SIGNAL SIGWINCH
+
+// How long a wait with a timeout sleeps between polls, in nanoseconds.
+#define LINUX_WAIT_POLL_INTERVAL 100000
+
+// Offset of a debug register in the user area.
+#define LINUX_DEBUG_REGISTER_OFFSET(index) (offsetof(struct user, u_debugreg) + (index) * sizeof(DWORD64))
+
+// Do the context flags ask for the given group of registers?
+#define LINUX_CONTEXT_HAS(flags, group) (0 != ((flags) & (group) & ~CONTEXT_AMD64))
+
+//////////////////////////////////////////////////////////////////////////
+// Globals
+//////////////////////////////////////////////////////////////////////////
+
+// Every traced thread. Only the debug loop uses this.
+__declspec(selectany) std::map<DWORD, POEDBG_LINUX_THREAD> _g_LinuxThreads;
+
+// Stops that arrived while waiting for something else, and events made up
+// when attaching, to be handed out before waiting again.
+__declspec(selectany) std::deque<POEDBG_LINUX_STATUS> _g_LinuxPendingStatuses;
+__declspec(selectany) std::deque<DEBUG_EVENT> _g_LinuxPendingEvents;
+
+__declspec(selectany) DWORD _g_LinuxProcessId;
+__declspec(selectany) bool _g_bIsLinuxAttached = false;
+
+// A routine waiting to be run by the debug loop, and the number of wake
+// signals it has yet to swallow.
+__declspec(selectany) pthread_mutex_t _g_LinuxRequestLock = PTHREAD_MUTEX_INITIALIZER;
+__declspec(selectany) pthread_cond_t _g_LinuxRequestChanged = PTHREAD_COND_INITIALIZER;
+__declspec(selectany) PPOEDBG_LINUX_REQUEST _g_LinuxRequest;
+__declspec(selectany) volatile LONG _g_LinuxWakeCount;
+
+//////////////////////////////////////////////////////////////////////////
+// Thread Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Converts a thread handle, which is just the thread ID, back into its state.
+*/
+POEDBG_INLINE PPOEDBG_LINUX_THREAD _PoeDbgPlatformFindThread(const HANDLE Thread)
+{
+	auto Entry = _g_LinuxThreads.find(static_cast<DWORD>(reinterpret_cast<ULONG_PTR>(Thread)));
+
+	return (Entry != _g_LinuxThreads.end()) ? &Entry->second : NULL;
+}
+
+/*
+Starts tracking a newly stopped thread, reading its debug registers once so
+that they can be cached from then on.
+*/
+inline PPOEDBG_LINUX_THREAD _PoeDbgPlatformAddThread(const pid_t ThreadId)
+{
+	PPOEDBG_LINUX_THREAD Thread = &_g_LinuxThreads[static_cast<DWORD>(ThreadId)];
+
+	memset(Thread, 0, sizeof(POEDBG_LINUX_THREAD));
+	Thread->bIsStopped = true;
+
+	for (int Index = 0; Index < 8; Index++)
+	{
+		if (4 == Index || 5 == Index)
+		{
+			// These are aliases of DR6 and DR7.
+			continue;
+		}
+
+		errno = 0;
+		long Value = ptrace(PTRACE_PEEKUSER, ThreadId, LINUX_DEBUG_REGISTER_OFFSET(Index), NULL);
+
+		Thread->DebugRegisters[Index] = (0 == errno) ? static_cast<DWORD64>(Value) : 0;
+	}
+
+	return Thread;
+}
+
+/*
+Continues a stopped thread, delivering the given signal, and forgets its
+cached registers.
+*/
+inline void _PoeDbgPlatformContinueThread(const pid_t ThreadId, PPOEDBG_LINUX_THREAD Thread, const int Signal)
+{
+	ptrace(PTRACE_CONT, ThreadId, NULL, reinterpret_cast<PVOID>(static_cast<ULONG_PTR>(Signal)));
+
+	Thread->bIsStopped = false;
+	Thread->bIsInterrupted = false;
+	Thread->bHasRegisters = false;
+	Thread->Signal = 0;
+}
+
+/*
+Interrupts a running thread and waits for it to stop. If it stops for some
+other reason first, that stop is kept to be reported later. Returns false if
+the thread has gone.
+*/
+inline bool _PoeDbgPlatformInterruptThread(const pid_t ThreadId, PPOEDBG_LINUX_THREAD Thread)
+{
+	if (0 != ptrace(PTRACE_INTERRUPT, ThreadId, NULL, NULL))
+	{
+		return false;
+	}
+
+	for (;;)
+	{
+		int Status = 0;
+
+		if (waitpid(ThreadId, &Status, __WALL) < 0)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+
+			return false;
+		}
+
+		// Whatever happened, report it later along with everything else.
+
+		if (!WIFSTOPPED(Status) || PTRACE_EVENT_STOP != (Status >> 16))
+		{
+			_g_LinuxPendingStatuses.push_back({ ThreadId, Status });
+
+			if (!WIFSTOPPED(Status))
+			{
+				return false;
+			}
+
+			Thread->bIsStopped = true;
+			Thread->bHasPendingStatus = true;
+			return true;
+		}
+
+		Thread->bIsStopped = true;
+		Thread->bIsInterrupted = true;
+		return true;
+	}
+}
+
+/*
+Makes sure the thread's general registers have been read.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformLoadRegisters(const pid_t ThreadId, PPOEDBG_LINUX_THREAD Thread)
+{
+	if (!Thread->bHasRegisters)
+	{
+		if (0 != ptrace(PTRACE_GETREGS, ThreadId, NULL, &Thread->Registers))
+		{
+			return false;
+		}
+
+		Thread->bHasRegisters = true;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Event Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Turns a status from waitpid into a debug event. Returns false if the status
+was handled here and there is nothing to report, in which case the thread has
+already been continued if it should be.
+*/
+inline bool _PoeDbgPlatformTranslateStatus(const pid_t ThreadId, const int Status, LPDEBUG_EVENT Event)
+{
+	memset(Event, 0, sizeof(DEBUG_EVENT));
+
+	Event->dwProcessId = _g_LinuxProcessId;
+	Event->dwThreadId = static_cast<DWORD>(ThreadId);
+
+	if (WIFEXITED(Status) || WIFSIGNALED(Status))
+	{
+		_g_LinuxThreads.erase(static_cast<DWORD>(ThreadId));
+
+		// The main thread is reported last, once the whole process has gone.
+		Event->dwDebugEventCode = (static_cast<DWORD>(ThreadId) == _g_LinuxProcessId) ? EXIT_PROCESS_DEBUG_EVENT : EXIT_THREAD_DEBUG_EVENT;
+		return true;
+	}
+
+	if (!WIFSTOPPED(Status))
+	{
+		return false;
+	}
+
+	int Signal = WSTOPSIG(Status);
+	int TraceEvent = Status >> 16;
+
+	PPOEDBG_LINUX_THREAD Thread = _PoeDbgPlatformFindThread(reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(ThreadId)));
+
+	if (NULL == Thread)
+	{
+		// A thread the game just started. It is attached for us, and its first
+		// stop is where it gets its hooks.
+
+		Thread = _PoeDbgPlatformAddThread(ThreadId);
+
+		if (0 == TraceEvent && SIGTRAP != Signal)
+		{
+			Thread->Signal = Signal;
+		}
+
+		Event->dwDebugEventCode = CREATE_THREAD_DEBUG_EVENT;
+		Event->u.CreateThread.hThread = reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(ThreadId));
+		return true;
+	}
+
+	Thread->bIsStopped = true;
+	Thread->bHasPendingStatus = false;
+	Thread->bHasRegisters = false;
+
+	if (PTRACE_EVENT_STOP == TraceEvent)
+	{
+		if (SIGSTOP == Signal || SIGTSTP == Signal || SIGTTIN == Signal || SIGTTOU == Signal)
+		{
+			// The game was stopped from outside. Leave it stopped until it is
+			// continued from outside, without holding it ourselves.
+
+			ptrace(PTRACE_LISTEN, ThreadId, NULL, NULL);
+			Thread->bIsStopped = false;
+			return false;
+		}
+
+		// An interrupt that arrived after the thread had already stopped.
+		_PoeDbgPlatformContinueThread(ThreadId, Thread, 0);
+		return false;
+	}
+
+	if (0 != TraceEvent)
+	{
+		// Clones are picked up when the new thread first stops, and nothing
+		// else needs handling.
+
+		_PoeDbgPlatformContinueThread(ThreadId, Thread, 0);
+		return false;
+	}
+
+	if (LINUX_WAKE_SIGNAL == Signal && _g_LinuxWakeCount > 0)
+	{
+		// One of ours, which only had to wake us.
+
+		_InterlockedDecrement(&_g_LinuxWakeCount);
+		_PoeDbgPlatformContinueThread(ThreadId, Thread, 0);
+		return false;
+	}
+
+	if (SIGTRAP == Signal)
+	{
+		errno = 0;
+		long Dr6 = ptrace(PTRACE_PEEKUSER, ThreadId, LINUX_DEBUG_REGISTER_OFFSET(6), NULL);
+
+		if (0 == errno && 0 != (Dr6 & BP_DR6_SLOT_MASK) && _PoeDbgPlatformLoadRegisters(ThreadId, Thread))
+		{
+			Thread->DebugRegisters[6] = static_cast<DWORD64>(Dr6);
+			Thread->Signal = SIGTRAP;
+
+			Event->dwDebugEventCode = EXCEPTION_DEBUG_EVENT;
+			Event->u.Exception.dwFirstChance = 1;
+			Event->u.Exception.ExceptionRecord.ExceptionCode = EXCEPTION_SINGLE_STEP;
+			Event->u.Exception.ExceptionRecord.ExceptionAddress = reinterpret_cast<PVOID>(Thread->Registers.rip);
+			return true;
+		}
+	}
+
+	// Any other signal belongs to the game, so pass it straight on.
+	_PoeDbgPlatformContinueThread(ThreadId, Thread, Signal);
+	return false;
+}
+
+/*
+Runs the routine waiting for the debug loop, if there is one.
+*/
+inline void _PoeDbgPlatformServiceRequest()
+{
+	pthread_mutex_lock(&_g_LinuxRequestLock);
+
+	PPOEDBG_LINUX_REQUEST Request = _g_LinuxRequest;
+
+	if (NULL != Request)
+	{
+		Request->bResult = _g_bIsLinuxAttached && Request->Routine();
+		Request->bIsDone = true;
+
+		_g_LinuxRequest = NULL;
+		pthread_cond_broadcast(&_g_LinuxRequestChanged);
+	}
+
+	pthread_mutex_unlock(&_g_LinuxRequestLock);
+}
+
+/*
+Stops taking requests, failing any that is waiting.
+*/
+inline void _PoeDbgPlatformEndRequests()
+{
+	pthread_mutex_lock(&_g_LinuxRequestLock);
+
+	_g_bIsLinuxAttached = false;
+
+	if (NULL != _g_LinuxRequest)
+	{
+		_g_LinuxRequest->bResult = false;
+		_g_LinuxRequest->bIsDone = true;
+		_g_LinuxRequest = NULL;
+	}
+
+	pthread_cond_broadcast(&_g_LinuxRequestChanged);
+	pthread_mutex_unlock(&_g_LinuxRequestLock);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Image Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Finds the game executable in its memory map. Returns the address it is loaded
+at, the bounds of its first executable mapping and the end of its last.
+*/
+inline bool _PoeDbgPlatformFindImage(const DWORD ProcessId, PULONG_PTR Base, PULONG_PTR CodeStart, PULONG_PTR CodeEnd, PULONG_PTR End)
+{
+	char Path[64];
+	char Image[4096];
+
+	snprintf(Path, sizeof(Path), "/proc/%u/exe", ProcessId);
+
+	ssize_t ImageLength = readlink(Path, Image, sizeof(Image) - 1);
+
+	if (ImageLength <= 0)
+	{
+		return false;
+	}
+
+	Image[ImageLength] = '\0';
+
+	snprintf(Path, sizeof(Path), "/proc/%u/maps", ProcessId);
+
+	FILE* Maps = fopen(Path, "r");
+
+	if (NULL == Maps)
+	{
+		return false;
+	}
+
+	*Base = NULL;
+	*CodeStart = NULL;
+	*CodeEnd = NULL;
+	*End = NULL;
+
+	char Line[4096 + 128];
+
+	while (NULL != fgets(Line, sizeof(Line), Maps))
+	{
+		unsigned long Start = 0;
+		unsigned long Finish = 0;
+		char Permissions[8] = { 0 };
+		int PathOffset = 0;
+
+		if (3 > sscanf(Line, "%lx-%lx %7s %*s %*s %*s %n", &Start, &Finish, Permissions, &PathOffset) || 0 == PathOffset)
+		{
+			continue;
+		}
+
+		char* MappedPath = Line + PathOffset;
+		MappedPath[strcspn(MappedPath, "\n")] = '\0';
+
+		if (0 != strcmp(MappedPath, Image))
+		{
+			continue;
+		}
+
+		if (NULL == *Base)
+		{
+			*Base = Start;
+		}
+
+		if (NULL == *CodeStart && 'x' == Permissions[2])
+		{
+			*CodeStart = Start;
+			*CodeEnd = Finish;
+		}
+
+		*End = Finish;
+	}
+
+	fclose(Maps);
+
+	return (NULL != *Base && NULL != *CodeStart);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Platform Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Attaches to every thread of the game and stops them, then queues the events
+that Windows would send on attaching: one for the process, with its main
+thread, and one for each other thread. Each thread stays stopped until its
+event is continued.
+*/
+inline POEDBG_STATUS _PoeDbgPlatformAttach(const DWORD ProcessId)
+{
+	_g_LinuxProcessId = ProcessId;
+
+	char Path[64];
+	snprintf(Path, sizeof(Path), "/proc/%u/task", ProcessId);
+
+	// Threads may be started while we attach. Those started by a thread we
+	// already have are attached for us, so keep going until nothing is new.
+
+	bool bIsChanged = true;
+
+	while (bIsChanged)
+	{
+		bIsChanged = false;
+
+		DIR* Tasks = opendir(Path);
+
+		if (NULL == Tasks)
+		{
+			return POEDBG_STATUS_GAME_HOOK_NOT_SET;
+		}
+
+		struct dirent* Task;
+
+		while (NULL != (Task = readdir(Tasks)))
+		{
+			pid_t ThreadId = static_cast<pid_t>(atoi(Task->d_name));
+
+			if (0 >= ThreadId || _g_LinuxThreads.end() != _g_LinuxThreads.find(static_cast<DWORD>(ThreadId)))
+			{
+				continue;
+			}
+
+			if (0 != ptrace(PTRACE_SEIZE, ThreadId, NULL, reinterpret_cast<PVOID>(static_cast<ULONG_PTR>(LINUX_TRACE_OPTIONS))))
+			{
+				if (static_cast<DWORD>(ThreadId) == ProcessId)
+				{
+					closedir(Tasks);
+					return POEDBG_STATUS_GAME_HOOK_NOT_SET;
+				}
+
+				// It exited while we were looking.
+				continue;
+			}
+
+			PPOEDBG_LINUX_THREAD Thread = &_g_LinuxThreads[static_cast<DWORD>(ThreadId)];
+			memset(Thread, 0, sizeof(POEDBG_LINUX_THREAD));
+
+			bIsChanged = true;
+		}
+
+		closedir(Tasks);
+	}
+
+	ULONG_PTR Base = NULL;
+	ULONG_PTR CodeStart = NULL;
+	ULONG_PTR CodeEnd = NULL;
+	ULONG_PTR End = NULL;
+
+	_PoeDbgPlatformFindImage(ProcessId, &Base, &CodeStart, &CodeEnd, &End);
+
+	for (auto Entry = _g_LinuxThreads.begin(); Entry != _g_LinuxThreads.end();)
+	{
+		pid_t ThreadId = static_cast<pid_t>(Entry->first);
+
+		if (!_PoeDbgPlatformInterruptThread(ThreadId, &Entry->second))
+		{
+			Entry = _g_LinuxThreads.erase(Entry);
+			continue;
+		}
+
+		bool bHasPendingStatus = Entry->second.bHasPendingStatus;
+		PPOEDBG_LINUX_THREAD Thread = _PoeDbgPlatformAddThread(ThreadId);
+
+		Thread->bIsInterrupted = !bHasPendingStatus;
+		Thread->bHasPendingStatus = bHasPendingStatus;
+
+		DEBUG_EVENT Event = { 0 };
+
+		Event.dwProcessId = ProcessId;
+		Event.dwThreadId = static_cast<DWORD>(ThreadId);
+
+		if (static_cast<DWORD>(ThreadId) == ProcessId)
+		{
+			Event.dwDebugEventCode = CREATE_PROCESS_DEBUG_EVENT;
+			Event.u.CreateProcessInfo.hProcess = reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(ProcessId));
+			Event.u.CreateProcessInfo.hThread = reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(ThreadId));
+			Event.u.CreateProcessInfo.lpBaseOfImage = reinterpret_cast<PVOID>(Base);
+
+			// The process comes first.
+			_g_LinuxPendingEvents.push_front(Event);
+		}
+		else
+		{
+			Event.dwDebugEventCode = CREATE_THREAD_DEBUG_EVENT;
+			Event.u.CreateThread.hThread = reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(ThreadId));
+
+			_g_LinuxPendingEvents.push_back(Event);
+		}
+
+		++Entry;
+	}
+
+	_g_bIsLinuxAttached = true;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Stops every thread and detaches from it, handing back any signal that was
+meant for the game. Runs on the debug loop.
+*/
+inline bool _PoeDbgPlatformDetachRoutine()
+{
+	for (auto& Entry : _g_LinuxThreads)
+	{
+		if (!Entry.second.bIsStopped)
+		{
+			_PoeDbgPlatformInterruptThread(static_cast<pid_t>(Entry.first), &Entry.second);
+		}
+	}
+
+	// Stops that were never reported still hold signals for the game.
+
+	for (auto& Pending : _g_LinuxPendingStatuses)
+	{
+		PPOEDBG_LINUX_THREAD Thread = _PoeDbgPlatformFindThread(reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(Pending.ThreadId)));
+
+		if (NULL == Thread || !WIFSTOPPED(Pending.Status) || 0 != (Pending.Status >> 16))
+		{
+			continue;
+		}
+
+		int Signal = WSTOPSIG(Pending.Status);
+
+		if (SIGTRAP != Signal && LINUX_WAKE_SIGNAL != Signal)
+		{
+			Thread->Signal = Signal;
+		}
+	}
+
+	for (auto& Entry : _g_LinuxThreads)
+	{
+		int Signal = (SIGTRAP != Entry.second.Signal) ? Entry.second.Signal : 0;
+
+		ptrace(PTRACE_DETACH, static_cast<pid_t>(Entry.first), NULL, reinterpret_cast<PVOID>(static_cast<ULONG_PTR>(Signal)));
+	}
+
+	_g_LinuxThreads.clear();
+	_g_LinuxPendingStatuses.clear();
+	_g_LinuxPendingEvents.clear();
+
+	// The debug loop ends the next time it waits.
+	_g_bIsLinuxAttached = false;
+
+	return true;
+}
+
+/*
+Waits for the next debug event from the game. Routines handed to the debug
+loop are run here, in between events. waitpid either polls or blocks, so a
+wait with a timeout other than INFINITE polls, sleeping briefly in between,
+until the timeout has passed.
+*/
+inline int _PoeDbgPlatformWaitForEvent(LPDEBUG_EVENT Event, const DWORD Timeout)
+{
+	ULONGLONG Start = (0 != Timeout && INFINITE != Timeout) ? GetTickCount64() : 0;
+
+	for (;;)
+	{
+		_PoeDbgPlatformServiceRequest();
+
+		if (!_g_bIsLinuxAttached)
+		{
+			_PoeDbgPlatformEndRequests();
+			return PLATFORM_WAIT_DONE;
+		}
+
+		if (!_g_LinuxPendingEvents.empty())
+		{
+			*Event = _g_LinuxPendingEvents.front();
+			_g_LinuxPendingEvents.pop_front();
+			return PLATFORM_WAIT_EVENT;
+		}
+
+		if (!_g_LinuxPendingStatuses.empty())
+		{
+			POEDBG_LINUX_STATUS Pending = _g_LinuxPendingStatuses.front();
+			_g_LinuxPendingStatuses.pop_front();
+
+			if (_PoeDbgPlatformTranslateStatus(Pending.ThreadId, Pending.Status, Event))
+			{
+				return PLATFORM_WAIT_EVENT;
+			}
+
+			continue;
+		}
+
+		int Status = 0;
+
+		// Only wait for our own tracees, never for the host's children.
+		pid_t ThreadId = waitpid(-1, &Status, __WALL | __WNOTHREAD | ((INFINITE != Timeout) ? WNOHANG : 0));
+
+		if (0 == ThreadId)
+		{
+			// Nothing has stopped since we last looked.
+			if (0 == Timeout || GetTickCount64() - Start >= Timeout)
+			{
+				return PLATFORM_WAIT_TIMEOUT;
+			}
+
+			struct timespec Duration = { 0, LINUX_WAIT_POLL_INTERVAL };
+			nanosleep(&Duration, NULL);
+			continue;
+		}
+
+		if (ThreadId < 0)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+
+			// The game has gone.
+			_PoeDbgPlatformEndRequests();
+			return PLATFORM_WAIT_DONE;
+		}
+
+		if (_PoeDbgPlatformTranslateStatus(ThreadId, Status, Event))
+		{
+			return PLATFORM_WAIT_EVENT;
+		}
+	}
+}
+
+/*
+Resumes the thread that reported the given event. An exception that wasn't
+handled is delivered to the game as the signal that caused it.
+*/
+inline void _PoeDbgPlatformContinueEvent(const LPDEBUG_EVENT Event, const DWORD Status)
+{
+	if (EXIT_THREAD_DEBUG_EVENT == Event->dwDebugEventCode || EXIT_PROCESS_DEBUG_EVENT == Event->dwDebugEventCode)
+	{
+		return;
+	}
+
+	PPOEDBG_LINUX_THREAD Thread = _PoeDbgPlatformFindThread(reinterpret_cast<HANDLE>(static_cast<ULONG_PTR>(Event->dwThreadId)));
+
+	if (NULL == Thread || !Thread->bIsStopped || 0 != Thread->SuspendCount)
+	{
+		return;
+	}
+
+	int Signal = Thread->Signal;
+
+	if (EXCEPTION_DEBUG_EVENT == Event->dwDebugEventCode && DBG_EXCEPTION_NOT_HANDLED != Status)
+	{
+		Signal = 0;
+	}
+
+	_PoeDbgPlatformContinueThread(static_cast<pid_t>(Event->dwThreadId), Thread, Signal);
+}
+
+/*
+Reads from the given game address into the buffer.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformReadMemory(const ULONG_PTR Address, PVOID Buffer, const SIZE_T Size)
+{
+	struct iovec Local = { Buffer, Size };
+	struct iovec Remote = { reinterpret_cast<PVOID>(Address), Size };
+
+	return (static_cast<ssize_t>(Size) == process_vm_readv(static_cast<pid_t>(_g_LinuxProcessId), &Local, 1, &Remote, 1, 0));
+}
+
+/*
+Writes the buffer to the given game address. This goes through the game's
+memory file, which, unlike process_vm_writev, can also write to code.
+*/
+inline bool _PoeDbgPlatformWriteMemory(const ULONG_PTR Address, PVOID Buffer, const SIZE_T Size)
+{
+	char Path[64];
+	snprintf(Path, sizeof(Path), "/proc/%u/mem", _g_LinuxProcessId);
+
+	int Memory = open(Path, O_RDWR | O_CLOEXEC);
+
+	if (Memory < 0)
+	{
+		return false;
+	}
+
+	ssize_t Written = pwrite(Memory, Buffer, Size, static_cast<off_t>(Address));
+
+	close(Memory);
+
+	return (static_cast<ssize_t>(Size) == Written);
+}
+
+/*
+Reads the registers named by the context flags from the given thread, which
+must be stopped.
+*/
+inline bool _PoeDbgPlatformGetContext(const HANDLE Thread, PCONTEXT Context)
+{
+	PPOEDBG_LINUX_THREAD State = _PoeDbgPlatformFindThread(Thread);
+	pid_t ThreadId = static_cast<pid_t>(reinterpret_cast<ULONG_PTR>(Thread));
+
+	if (NULL == State || !State->bIsStopped)
+	{
+		return false;
+	}
+
+	if (LINUX_CONTEXT_HAS(Context->ContextFlags, CONTEXT_CONTROL | CONTEXT_INTEGER))
+	{
+		if (!_PoeDbgPlatformLoadRegisters(ThreadId, State))
+		{
+			return false;
+		}
+
+		struct user_regs_struct* Registers = &State->Registers;
+
+		Context->EFlags = static_cast<DWORD>(Registers->eflags);
+		Context->Rax = Registers->rax;
+		Context->Rcx = Registers->rcx;
+		Context->Rdx = Registers->rdx;
+		Context->Rbx = Registers->rbx;
+		Context->Rsp = Registers->rsp;
+		Context->Rbp = Registers->rbp;
+		Context->Rsi = Registers->rsi;
+		Context->Rdi = Registers->rdi;
+		Context->R8 = Registers->r8;
+		Context->R9 = Registers->r9;
+		Context->R10 = Registers->r10;
+		Context->R11 = Registers->r11;
+		Context->R12 = Registers->r12;
+		Context->R13 = Registers->r13;
+		Context->R14 = Registers->r14;
+		Context->R15 = Registers->r15;
+		Context->Rip = Registers->rip;
+	}
+
+	if (LINUX_CONTEXT_HAS(Context->ContextFlags, CONTEXT_DEBUG_REGISTERS))
+	{
+		Context->Dr0 = State->DebugRegisters[0];
+		Context->Dr1 = State->DebugRegisters[1];
+		Context->Dr2 = State->DebugRegisters[2];
+		Context->Dr3 = State->DebugRegisters[3];
+		Context->Dr6 = State->DebugRegisters[6];
+		Context->Dr7 = State->DebugRegisters[7];
+	}
+
+	return true;
+}
+
+/*
+Writes the registers named by the context flags to the given thread, which
+must be stopped. Only registers that differ from the cached copy are written,
+and DR7 is written last so that a slot is never enabled before its address.
+*/
+inline bool _PoeDbgPlatformSetContext(const HANDLE Thread, const PCONTEXT Context)
+{
+	PPOEDBG_LINUX_THREAD State = _PoeDbgPlatformFindThread(Thread);
+	pid_t ThreadId = static_cast<pid_t>(reinterpret_cast<ULONG_PTR>(Thread));
+
+	if (NULL == State || !State->bIsStopped)
+	{
+		return false;
+	}
+
+	if (LINUX_CONTEXT_HAS(Context->ContextFlags, CONTEXT_CONTROL | CONTEXT_INTEGER))
+	{
+		if (!_PoeDbgPlatformLoadRegisters(ThreadId, State))
+		{
+			return false;
+		}
+
+		struct user_regs_struct Registers = State->Registers;
+
+		Registers.eflags = Context->EFlags;
+		Registers.rax = Context->Rax;
+		Registers.rcx = Context->Rcx;
+		Registers.rdx = Context->Rdx;
+		Registers.rbx = Context->Rbx;
+		Registers.rsp = Context->Rsp;
+		Registers.rbp = Context->Rbp;
+		Registers.rsi = Context->Rsi;
+		Registers.rdi = Context->Rdi;
+		Registers.r8 = Context->R8;
+		Registers.r9 = Context->R9;
+		Registers.r10 = Context->R10;
+		Registers.r11 = Context->R11;
+		Registers.r12 = Context->R12;
+		Registers.r13 = Context->R13;
+		Registers.r14 = Context->R14;
+		Registers.r15 = Context->R15;
+		Registers.rip = Context->Rip;
+
+		if (0 != memcmp(&Registers, &State->Registers, sizeof(Registers)))
+		{
+			if (0 != ptrace(PTRACE_SETREGS, ThreadId, NULL, &Registers))
+			{
+				return false;
+			}
+
+			State->Registers = Registers;
+		}
+	}
+
+	if (LINUX_CONTEXT_HAS(Context->ContextFlags, CONTEXT_DEBUG_REGISTERS))
+	{
+		const int Indexes[] = { 0, 1, 2, 3, 6, 7 };
+		const DWORD64 Values[] = { Context->Dr0, Context->Dr1, Context->Dr2, Context->Dr3, Context->Dr6, Context->Dr7 };
+
+		bool bIsChanged = false;
+
+		for (int Index = 0; Index < 6; Index++)
+		{
+			int Register = Indexes[Index];
+
+			// A new thread reports the DR7 of the thread that started it, but
+			// none of its breakpoints, so DR7 is always written after any other
+			// change to make the kernel set them up.
+
+			if (Values[Index] == State->DebugRegisters[Register] && !(7 == Register && bIsChanged))
+			{
+				continue;
+			}
+
+			bIsChanged = true;
+
+			if (0 != ptrace(PTRACE_POKEUSER, ThreadId, LINUX_DEBUG_REGISTER_OFFSET(Register), reinterpret_cast<PVOID>(Values[Index])))
+			{
+				return false;
+			}
+
+			State->DebugRegisters[Register] = Values[Index];
+		}
+	}
+
+	return true;
+}
+
+/*
+Stops the given thread, unless it is already stopped.
+*/
+inline bool _PoeDbgPlatformSuspendThread(const HANDLE Thread)
+{
+	PPOEDBG_LINUX_THREAD State = _PoeDbgPlatformFindThread(Thread);
+
+	if (NULL == State)
+	{
+		return false;
+	}
+
+	if (0 != State->SuspendCount++ || State->bIsStopped)
+	{
+		return true;
+	}
+
+	if (!_PoeDbgPlatformInterruptThread(static_cast<pid_t>(reinterpret_cast<ULONG_PTR>(Thread)), State))
+	{
+		State->SuspendCount--;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+Restarts a thread stopped by _PoeDbgPlatformSuspendThread. A thread that
+stopped for its own reasons stays stopped until that has been reported.
+*/
+inline void _PoeDbgPlatformResumeThread(const HANDLE Thread)
+{
+	PPOEDBG_LINUX_THREAD State = _PoeDbgPlatformFindThread(Thread);
+
+	if (NULL == State || 0 == State->SuspendCount || 0 != --State->SuspendCount)
+	{
+		return;
+	}
+
+	if (State->bIsInterrupted && !State->bHasPendingStatus)
+	{
+		_PoeDbgPlatformContinueThread(static_cast<pid_t>(reinterpret_cast<ULONG_PTR>(Thread)), State, 0);
+	}
+}
+
+/*
+Finds the size of the game image and where its code is from the game's
+memory map.
+*/
+inline POEDBG_STATUS _PoeDbgPlatformGetImageLayout()
+{
+	ULONG_PTR Base = NULL;
+	ULONG_PTR CodeStart = NULL;
+	ULONG_PTR CodeEnd = NULL;
+	ULONG_PTR End = NULL;
+
+	if (!_PoeDbgPlatformFindImage(_g_LinuxProcessId, &Base, &CodeStart, &CodeEnd, &End) || Base != _g_GameBaseAddress)
+	{
+		// The image isn't mapped where we were told.
+		return POEDBG_STATUS_CACHE_DOS_HEADER_NOT_FOUND;
+	}
+
+	_g_GameImageSize = End - Base;
+	_g_GameBaseOfCode = CodeStart - Base;
+	_g_GameSizeOfCode = CodeEnd - CodeStart;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Maps the game's executable file into our process, read-only. Under Wine this
+is the loader rather than the game, which the caller will find isn't a PE
+image.
+*/
+inline bool _PoeDbgPlatformMapImageFile(PVOID* View, PSIZE_T Size)
+{
+	char Path[64];
+	snprintf(Path, sizeof(Path), "/proc/%u/exe", _g_LinuxProcessId);
+
+	int File = open(Path, O_RDONLY | O_CLOEXEC);
+
+	if (-1 == File)
+	{
+		return false;
+	}
+
+	struct stat FileStatus;
+
+	if (0 != fstat(File, &FileStatus) || 0 == FileStatus.st_size)
+	{
+		close(File);
+		return false;
+	}
+
+	PVOID Mapping = mmap(NULL, static_cast<size_t>(FileStatus.st_size), PROT_READ, MAP_SHARED, File, 0);
+
+	close(File);
+
+	if (MAP_FAILED == Mapping)
+	{
+		return false;
+	}
+
+	*View = Mapping;
+	*Size = static_cast<SIZE_T>(FileStatus.st_size);
+
+	return true;
+}
+
+/*
+Releases a view made by _PoeDbgPlatformMapImageFile.
+*/
+POEDBG_INLINE void _PoeDbgPlatformUnmapImageFile(PVOID View, const SIZE_T Size)
+{
+	munmap(View, Size);
+}
+
+/*
+Finds the file name of the module that a DLL load event is for. Shared objects
+aren't reported, so there is never one.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformGetModuleName(const LPDEBUG_EVENT Event, wchar_t* Name, const DWORD Length)
+{
+	UNREFERENCED_PARAMETER(Event);
+	UNREFERENCED_PARAMETER(Name);
+	UNREFERENCED_PARAMETER(Length);
+
+	return false;
+}
+
+/*
+Runs a routine that changes game threads on the debug loop, which is the only
+thread allowed to. The caller waits until it has run.
+*/
+inline bool _PoeDbgPlatformRunOnDebugThread(POEDBG_PLATFORM_ROUTINE Routine)
+{
+	if (GetCurrentThreadId() == _g_DebugThreadId)
+	{
+		return Routine();
+	}
+
+	POEDBG_LINUX_REQUEST Request = { Routine, false, false };
+
+	pthread_mutex_lock(&_g_LinuxRequestLock);
+
+	// One request at a time.
+	while (_g_bIsLinuxAttached && NULL != _g_LinuxRequest)
+	{
+		pthread_cond_wait(&_g_LinuxRequestChanged, &_g_LinuxRequestLock);
+	}
+
+	if (!_g_bIsLinuxAttached)
+	{
+		pthread_mutex_unlock(&_g_LinuxRequestLock);
+		return false;
+	}
+
+	_g_LinuxRequest = &Request;
+
+	// Wake the debug loop if it is waiting for the game.
+
+	_InterlockedIncrement(&_g_LinuxWakeCount);
+
+	if (0 != kill(static_cast<pid_t>(_g_LinuxProcessId), LINUX_WAKE_SIGNAL))
+	{
+		_InterlockedDecrement(&_g_LinuxWakeCount);
+	}
+
+	while (!Request.bIsDone)
+	{
+		pthread_cond_wait(&_g_LinuxRequestChanged, &_g_LinuxRequestLock);
+	}
+
+	pthread_mutex_unlock(&_g_LinuxRequestLock);
+
+	return Request.bResult;
+}
+
+/*
+Detaches from the game, leaving it running.
+*/
+inline void _PoeDbgPlatformDetach(const DWORD ProcessId)
+{
+	UNREFERENCED_PARAMETER(ProcessId);
+
+	_PoeDbgPlatformRunOnDebugThread(_PoeDbgPlatformDetachRoutine);
+
+	_g_GameHandle = NULL;
+}
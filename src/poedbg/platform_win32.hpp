@@ -0,0 +1,251 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Globals
+//////////////////////////////////////////////////////////////////////////
+
+// Headers of the game image.
+__declspec(selectany) IMAGE_DOS_HEADER _g_GameDosHeader;
+__declspec(selectany) IMAGE_NT_HEADERS _g_GameNtHeaders;
+
+//////////////////////////////////////////////////////////////////////////
+// Platform Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Attaches to the game as its debugger. This must be done on the same thread that
+waits for debug events.
+*/
+inline POEDBG_STATUS _PoeDbgPlatformAttach(const DWORD ProcessId)
+{
+	if (FALSE == DebugActiveProcess(ProcessId))
+	{
+		return POEDBG_STATUS_GAME_HOOK_NOT_SET;
+	}
+
+	if (FALSE == DebugSetProcessKillOnExit(FALSE))
+	{
+		return POEDBG_STATUS_GAME_HOOK_BEHAVIOR_NOT_SET;
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Detaches from the game and releases our handle to it.
+*/
+inline void _PoeDbgPlatformDetach(const DWORD ProcessId)
+{
+	DebugActiveProcessStop(ProcessId);
+
+	if (NULL != _g_GameHandle)
+	{
+		CloseHandle(_g_GameHandle);
+		_g_GameHandle = NULL;
+	}
+}
+
+/*
+Waits for the next debug event from the game. A wait that runs out of time
+fails with ERROR_SEM_TIMEOUT, and any other failure means we have detached.
+*/
+POEDBG_INLINE int _PoeDbgPlatformWaitForEvent(LPDEBUG_EVENT Event, const DWORD Timeout)
+{
+	if (FALSE != WaitForDebugEvent(Event, Timeout))
+	{
+		return PLATFORM_WAIT_EVENT;
+	}
+
+	return (ERROR_SEM_TIMEOUT == GetLastError()) ? PLATFORM_WAIT_TIMEOUT : PLATFORM_WAIT_DONE;
+}
+
+/*
+Resumes the thread that reported the given event.
+*/
+POEDBG_INLINE void _PoeDbgPlatformContinueEvent(const LPDEBUG_EVENT Event, const DWORD Status)
+{
+	ContinueDebugEvent(Event->dwProcessId, Event->dwThreadId, Status);
+}
+
+/*
+Reads from the given game address into the buffer.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformReadMemory(const ULONG_PTR Address, PVOID Buffer, const SIZE_T Size)
+{
+	return (TRUE == ReadProcessMemory(_g_GameHandle, reinterpret_cast<LPCVOID>(Address), Buffer, Size, NULL));
+}
+
+/*
+Writes the buffer to the given game address.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformWriteMemory(const ULONG_PTR Address, PVOID Buffer, const SIZE_T Size)
+{
+	SIZE_T BytesWritten = 0;
+
+	return (TRUE == WriteProcessMemory(_g_GameHandle, reinterpret_cast<PVOID>(Address), Buffer, Size, &BytesWritten));
+}
+
+/*
+Reads the registers named by the context flags from the given thread.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformGetContext(const HANDLE Thread, PCONTEXT Context)
+{
+	return (FALSE != GetThreadContext(Thread, Context));
+}
+
+/*
+Writes the registers named by the context flags to the given thread.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformSetContext(const HANDLE Thread, const PCONTEXT Context)
+{
+	return (FALSE != SetThreadContext(Thread, Context));
+}
+
+/*
+Suspends the given thread.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformSuspendThread(const HANDLE Thread)
+{
+	return (static_cast<DWORD>(-1) != SuspendThread(Thread));
+}
+
+/*
+Resumes a thread suspended by _PoeDbgPlatformSuspendThread.
+*/
+POEDBG_INLINE void _PoeDbgPlatformResumeThread(const HANDLE Thread)
+{
+	ResumeThread(Thread);
+}
+
+/*
+Reads the game's PE headers to find the size of the image and where its code
+is.
+*/
+inline POEDBG_STATUS _PoeDbgPlatformGetImageLayout()
+{
+	if (!_PoeDbgPlatformReadMemory(_g_GameBaseAddress, &_g_GameDosHeader, sizeof(IMAGE_DOS_HEADER)))
+	{
+		return POEDBG_STATUS_CACHE_DOS_HEADER_NOT_FOUND;
+	}
+
+	// Calculate the address of the NT headers within the game.
+	ULONG_PTR NtHeadersAddress = _g_GameBaseAddress + _g_GameDosHeader.e_lfanew;
+
+	if (!_PoeDbgPlatformReadMemory(NtHeadersAddress, &_g_GameNtHeaders, sizeof(IMAGE_NT_HEADERS)))
+	{
+		return POEDBG_STATUS_CACHE_NT_HEADER_NOT_FOUND;
+	}
+
+	if (IMAGE_NT_SIGNATURE != _g_GameNtHeaders.Signature)
+	{
+		return POEDBG_STATUS_CACHE_NT_HEADER_INVALID;
+	}
+
+	// Save off the game image dimensions.
+	_g_GameImageSize = _g_GameNtHeaders.OptionalHeader.SizeOfImage;
+	_g_GameBaseOfCode = _g_GameNtHeaders.OptionalHeader.BaseOfCode;
+	_g_GameSizeOfCode = _g_GameNtHeaders.OptionalHeader.SizeOfCode;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Maps the game's executable file into our process, read-only. The file handles
+are closed straight away, since the view keeps the file mapped.
+*/
+inline bool _PoeDbgPlatformMapImageFile(PVOID* View, PSIZE_T Size)
+{
+	WCHAR Path[MAX_PATH];
+	DWORD PathLength = MAX_PATH;
+
+	if (FALSE == QueryFullProcessImageNameW(_g_GameHandle, 0, Path, &PathLength))
+	{
+		return false;
+	}
+
+	HANDLE File = CreateFileW(Path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (INVALID_HANDLE_VALUE == File)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER FileSize;
+
+	if (FALSE == GetFileSizeEx(File, &FileSize) || 0 == FileSize.QuadPart)
+	{
+		CloseHandle(File);
+		return false;
+	}
+
+	HANDLE Mapping = CreateFileMappingW(File, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	CloseHandle(File);
+
+	if (NULL == Mapping)
+	{
+		return false;
+	}
+
+	*View = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+	*Size = static_cast<SIZE_T>(FileSize.QuadPart);
+
+	CloseHandle(Mapping);
+
+	return (NULL != *View);
+}
+
+/*
+Releases a view made by _PoeDbgPlatformMapImageFile.
+*/
+POEDBG_INLINE void _PoeDbgPlatformUnmapImageFile(PVOID View, const SIZE_T Size)
+{
+	UNREFERENCED_PARAMETER(Size);
+
+	UnmapViewOfFile(View);
+}
+
+/*
+Finds the file name of the module that a DLL load event is for. The event's
+file handle belongs to the debugger, so it is closed here either way.
+*/
+inline bool _PoeDbgPlatformGetModuleName(const LPDEBUG_EVENT Event, wchar_t* Name, const DWORD Length)
+{
+	HANDLE File = Event->u.LoadDll.hFile;
+
+	if (NULL == File)
+	{
+		return false;
+	}
+
+	WCHAR Path[MAX_PATH];
+	DWORD PathLength = GetFinalPathNameByHandleW(File, Path, MAX_PATH, FILE_NAME_NORMALIZED);
+
+	CloseHandle(File);
+
+	if (0 == PathLength || PathLength >= MAX_PATH)
+	{
+		return false;
+	}
+
+	const wchar_t* FileName = wcsrchr(Path, L'\\');
+	FileName = (NULL != FileName) ? FileName + 1 : Path;
+
+	// The module map only keeps as much of a name as fits, so a long name is
+	// truncated rather than dropped.
+
+	errno_t Error = wcsncpy_s(Name, Length, FileName, _TRUNCATE);
+
+	return (0 == Error || STRUNCATE == Error);
+}
+
+/*
+Runs a routine that changes game threads. Any thread may suspend and change
+another, so the routine is simply called.
+*/
+POEDBG_INLINE bool _PoeDbgPlatformRunOnDebugThread(POEDBG_PLATFORM_ROUTINE Routine)
+{
+	return Routine();
+}
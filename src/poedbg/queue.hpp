@@ -0,0 +1,289 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Rounds a record size up to the record alignment.
+#define QUEUE_ALIGN(x) (((x) + (QUEUE_RECORD_ALIGNMENT - 1)) & ~static_cast<SIZE_T>(QUEUE_RECORD_ALIGNMENT - 1))
+
+// Internal record flag marking the unused space at the end of the ring.
+#define QUEUE_RECORD_PADDING 0x8000
+
+//////////////////////////////////////////////////////////////////////////
+// Queue Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Enables the packet queue. The first time, the queue is allocated with the
+given size rounded up to a power of two. Readers may still hold pointers into
+the queue after it is closed, so it is kept and reused for the life of the
+process rather than being freed.
+*/
+POEDBG_INLINE POEDBG_STATUS _PoeDbgQueueInitialize(SIZE_T Size)
+{
+	if (_g_bIsQueueEnabled)
+	{
+		return POEDBG_STATUS_QUEUE_ALREADY_ENABLED;
+	}
+
+	if (NULL != _g_QueueBuffer)
+	{
+		// Reuse the existing queue, dropping anything left in it. A reader
+		// from before it was closed may still be part way through a read, so
+		// the tail is moved under the same lock.
+
+		AcquireSRWLockExclusive(&_g_QueueReadLock);
+		_g_QueueTail = _g_QueueHead;
+		ReleaseSRWLockExclusive(&_g_QueueReadLock);
+
+		_g_bIsQueueEnabled = true;
+
+		return POEDBG_STATUS_SUCCESS;
+	}
+
+	SIZE_T RoundedSize = QUEUE_MINIMUM_SIZE;
+
+	while (RoundedSize < Size)
+	{
+		RoundedSize <<= 1;
+	}
+
+	_g_QueueBuffer = reinterpret_cast<PBYTE>(VirtualAlloc(NULL, RoundedSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+	if (NULL == _g_QueueBuffer)
+	{
+		return POEDBG_STATUS_QUEUE_ALLOCATION_FAILED;
+	}
+
+	// A semaphore rather than an event, so that closing the queue can wake
+	// every waiting reader at once.
+
+	_g_QueueSemaphore = CreateSemaphoreW(NULL, 0, MAXLONG, NULL);
+
+	if (NULL == _g_QueueSemaphore)
+	{
+		VirtualFree(_g_QueueBuffer, 0, MEM_RELEASE);
+		_g_QueueBuffer = NULL;
+
+		return POEDBG_STATUS_QUEUE_ALLOCATION_FAILED;
+	}
+
+	_g_QueueSize = RoundedSize;
+	_g_QueueHead = 0;
+	_g_QueueTail = 0;
+	_g_QueueDroppedCount = 0;
+
+	InitializeSRWLock(&_g_QueueReadLock);
+
+	// Publish the queue to the debug loop last.
+	_g_bIsQueueEnabled = true;
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Pushes a packet onto the queue. This never blocks; if the readers have fallen
+so far behind that there is no room, the packet is dropped and counted.
+*/
+inline bool _PoeDbgQueuePush(const int Direction, const BYTE Id, const BYTE* Data, const DWORD Length, const DWORD OriginalLength, const DWORD64 Timestamp, const DWORD64 Sequence, const BYTE Source)
+{
+	SIZE_T RecordSize = QUEUE_ALIGN(sizeof(POEDBG_PACKET_RECORD) + Length);
+
+	if (RecordSize > (_g_QueueSize / 2))
+	{
+		_g_QueueDroppedCount++;
+		return false;
+	}
+
+	LONG64 Head = _g_QueueHead;
+	LONG64 Tail = _g_QueueTail;
+
+	SIZE_T Offset = static_cast<SIZE_T>(Head) & (_g_QueueSize - 1);
+	SIZE_T Contiguous = _g_QueueSize - Offset;
+
+	// Records never wrap, so if this one doesn't fit at the end of the ring
+	// the rest of the ring is skipped with a padding record.
+
+	SIZE_T Required = (Contiguous < RecordSize) ? (Contiguous + RecordSize) : RecordSize;
+
+	if (static_cast<SIZE_T>(Head - Tail) + Required > _g_QueueSize)
+	{
+		_g_QueueDroppedCount++;
+		return false;
+	}
+
+	if (Contiguous < RecordSize)
+	{
+		PPOEDBG_PACKET_RECORD Padding = reinterpret_cast<PPOEDBG_PACKET_RECORD>(_g_QueueBuffer + Offset);
+
+		Padding->Size = static_cast<DWORD>(Contiguous);
+		Padding->Length = 0;
+		Padding->Flags = QUEUE_RECORD_PADDING;
+
+		Head += Contiguous;
+		Offset = 0;
+	}
+
+	PPOEDBG_PACKET_RECORD Record = reinterpret_cast<PPOEDBG_PACKET_RECORD>(_g_QueueBuffer + Offset);
+
+	Record->Size = static_cast<DWORD>(RecordSize);
+	Record->Length = Length;
+	Record->Direction = static_cast<BYTE>(Direction);
+	Record->Id = Id;
+	Record->Flags = (Length < OriginalLength) ? POEDBG_RECORD_TRUNCATED : 0;
+	Record->OriginalLength = OriginalLength;
+	Record->Timestamp = Timestamp;
+	Record->Sequence = Sequence;
+	Record->Source = Source;
+	Record->Reserved = 0;
+
+	memcpy(Record + 1, Data, Length);
+
+	// Publish the record. The exchange is a full barrier, so the readers see
+	// the data before the new head, and we see any waiter that arrived before.
+	// A waiter only needs waking once however many records arrive before it
+	// runs, so the semaphore isn't released again until one has woken.
+
+	_InterlockedExchange64(&_g_QueueHead, Head + static_cast<LONG64>(RecordSize));
+
+	if (0 != _g_QueueWaiters && 0 == _InterlockedExchange(&_g_QueueWakePending, 1))
+	{
+		ReleaseSemaphore(_g_QueueSemaphore, 1, NULL);
+	}
+
+	return true;
+}
+
+/*
+Copies as many whole records as will fit from the queue into the buffer and
+returns the number of bytes copied. If the next record is larger than the
+whole buffer, nothing is copied and Required is set to its size. The caller
+must hold the read lock.
+*/
+POEDBG_INLINE DWORD _PoeDbgQueuePop(PBYTE Buffer, const DWORD BufferSize, PDWORD Required)
+{
+	LONG64 Head = _g_QueueHead;
+	LONG64 Tail = _g_QueueTail;
+
+	DWORD Copied = 0;
+
+	while (Tail != Head)
+	{
+		PPOEDBG_PACKET_RECORD Record = reinterpret_cast<PPOEDBG_PACKET_RECORD>(_g_QueueBuffer + (static_cast<SIZE_T>(Tail) & (_g_QueueSize - 1)));
+
+		if (0 != (Record->Flags & QUEUE_RECORD_PADDING))
+		{
+			Tail += Record->Size;
+			continue;
+		}
+
+		if (Record->Size > BufferSize - Copied)
+		{
+			if (0 == Copied)
+			{
+				*Required = Record->Size;
+			}
+
+			break;
+		}
+
+		memcpy(Buffer + Copied, Record, Record->Size);
+
+		Copied += Record->Size;
+		Tail += Record->Size;
+	}
+
+	// Hand the space back to the debug loop.
+	_InterlockedExchange64(&_g_QueueTail, Tail);
+
+	return Copied;
+}
+
+/*
+Reads whole records from the queue into the buffer, waiting up to the given
+number of milliseconds for one to arrive if the queue is empty.
+*/
+inline POEDBG_STATUS _PoeDbgQueueRead(PBYTE Buffer, const DWORD BufferSize, PDWORD BytesRead, const DWORD Timeout)
+{
+	ULONGLONG Start = GetTickCount64();
+
+	for (;;)
+	{
+		DWORD Required = 0;
+
+		AcquireSRWLockExclusive(&_g_QueueReadLock);
+		*BytesRead = _PoeDbgQueuePop(Buffer, BufferSize, &Required);
+		ReleaseSRWLockExclusive(&_g_QueueReadLock);
+
+		if (0 != Required)
+		{
+			*BytesRead = Required;
+			return POEDBG_STATUS_BUFFER_TOO_SMALL;
+		}
+
+		if (0 != *BytesRead)
+		{
+			return POEDBG_STATUS_SUCCESS;
+		}
+
+		if (!_g_bIsQueueEnabled)
+		{
+			// The queue was closed and everything in it has been read.
+			return POEDBG_STATUS_QUEUE_NOT_ENABLED;
+		}
+
+		DWORD Remaining = INFINITE;
+
+		if (INFINITE != Timeout)
+		{
+			ULONGLONG Elapsed = GetTickCount64() - Start;
+
+			if (Elapsed >= Timeout)
+			{
+				return POEDBG_STATUS_SUCCESS;
+			}
+
+			Remaining = Timeout - static_cast<DWORD>(Elapsed);
+		}
+
+		// Let the debug loop know someone is waiting, then check once more so
+		// that a record pushed in the meantime isn't missed.
+
+		_InterlockedIncrement(&_g_QueueWaiters);
+
+		if (_g_QueueHead == _g_QueueTail && _g_bIsQueueEnabled)
+		{
+			if (WAIT_OBJECT_0 == WaitForSingleObject(_g_QueueSemaphore, Remaining))
+			{
+				// Let the next record wake a reader again.
+				_InterlockedExchange(&_g_QueueWakePending, 0);
+			}
+		}
+
+		_InterlockedDecrement(&_g_QueueWaiters);
+	}
+}
+
+/*
+Closes the packet queue. Readers are woken, and see the queue as closed once
+they have read whatever is left in it.
+*/
+POEDBG_INLINE void _PoeDbgQueueClose()
+{
+	if (!_g_bIsQueueEnabled)
+	{
+		return;
+	}
+
+	_g_bIsQueueEnabled = false;
+
+	LONG Waiters = _g_QueueWaiters;
+
+	if (Waiters > 0)
+	{
+		ReleaseSemaphore(_g_QueueSemaphore, Waiters, NULL);
+	}
+}
@@ -6,6 +6,8 @@
 // Security Functions
 //////////////////////////////////////////////////////////////////////////
 
+#ifdef _WIN32
+
 /*
 Tries to elevate the current process's privileges so that we are able to
 attach to any process as a debugger.
@@ -133,3 +135,121 @@ POEDBG_INLINE DWORD _PoeDbgSecurityGetGameId(const wchar_t* Target)
 	CloseHandle(Snapshot);
 	return NULL;
 }
+
+#else
+
+/*
+There is no privilege to enable on Linux. Whether we may trace the game is
+decided when we attach.
+*/
+POEDBG_INLINE POEDBG_STATUS _PoeDbgSecurityChangePrivileges()
+{
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Checks that the Yama security module allows us to trace another process at
+all. Only root may when it is limited to administrators, and nobody may when
+it is disabled.
+*/
+POEDBG_INLINE POEDBG_STATUS _PoeDbgSecurityGetPrivileges()
+{
+	FILE* Scope = fopen("/proc/sys/kernel/yama/ptrace_scope", "r");
+
+	if (NULL == Scope)
+	{
+		// Yama isn't loaded, so only the usual permissions apply.
+		return POEDBG_STATUS_SUCCESS;
+	}
+
+	int Level = 0;
+
+	if (1 != fscanf(Scope, "%d", &Level))
+	{
+		Level = 0;
+	}
+
+	fclose(Scope);
+
+	if (Level >= 3 || (2 == Level && 0 != geteuid()))
+	{
+		return POEDBG_STATUS_PRIVILEGES_INSUFFICIENT;
+	}
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Iterates through all running processes until it finds one whose program name
+matches the target, in which case it returns that process ID. Games run under
+Wine keep their Windows executable name as the program name.
+*/
+POEDBG_INLINE DWORD _PoeDbgSecurityGetGameId(const wchar_t* Target)
+{
+	char Name[256];
+
+	if (static_cast<size_t>(-1) == wcstombs(Name, Target, sizeof(Name)))
+	{
+		return NULL;
+	}
+
+	DIR* Processes = opendir("/proc");
+
+	if (NULL == Processes)
+	{
+		return NULL;
+	}
+
+	DWORD Self = static_cast<DWORD>(getpid());
+	DWORD GameId = NULL;
+
+	struct dirent* Process;
+
+	while (NULL == GameId && NULL != (Process = readdir(Processes)))
+	{
+		DWORD ProcessId = static_cast<DWORD>(strtoul(Process->d_name, NULL, 10));
+
+		if (0 == ProcessId || Self == ProcessId)
+		{
+			continue;
+		}
+
+		char Path[64];
+		char CommandLine[4096] = { 0 };
+
+		snprintf(Path, sizeof(Path), "/proc/%u/cmdline", ProcessId);
+
+		FILE* File = fopen(Path, "r");
+
+		if (NULL == File)
+		{
+			continue;
+		}
+
+		// Only the first argument, which ends at the first null, is needed.
+		fread(CommandLine, 1, sizeof(CommandLine) - 1, File);
+		fclose(File);
+
+		// Wine paths may use either separator.
+		const char* Program = CommandLine;
+
+		for (const char* This = CommandLine; '\0' != *This; This++)
+		{
+			if ('/' == *This || '\\' == *This)
+			{
+				Program = This + 1;
+			}
+		}
+
+		if (0 == strcmp(Program, Name))
+		{
+			GameId = ProcessId;
+		}
+	}
+
+	closedir(Processes);
+
+	return GameId;
+}
+
+#endif
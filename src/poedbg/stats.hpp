@@ -0,0 +1,117 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Stats Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Counts a packet handed to consumers. This is called by the debug loop for
+every packet, so it does no more than a handful of stores.
+*/
+POEDBG_INLINE void _PoeDbgStatsRecord(const int Direction, const BYTE Id, const DWORD Length)
+{
+	PPOEDBG_TRAFFIC_COUNTER Counter = &_g_TrafficCounters[Direction][Id];
+
+	DWORD Second = static_cast<DWORD>(GetTickCount64() / 1000);
+	DWORD Window = Second % TRAFFIC_WINDOW_COUNT;
+
+	Counter->Sequence++;
+	_ReadWriteBarrier();
+
+	if (0 == Counter->Packets || Length < Counter->MinimumSize)
+	{
+		Counter->MinimumSize = Length;
+	}
+
+	if (Length > Counter->MaximumSize)
+	{
+		Counter->MaximumSize = Length;
+	}
+
+	Counter->Packets++;
+	Counter->Bytes += Length;
+
+	if (Counter->WindowSecond[Window] != Second)
+	{
+		// This bucket was last used a whole window ago, so start it again.
+
+		Counter->WindowSecond[Window] = Second;
+		Counter->WindowPackets[Window] = 0;
+		Counter->WindowBytes[Window] = 0;
+	}
+
+	Counter->WindowPackets[Window]++;
+	Counter->WindowBytes[Window] += Length;
+
+	_ReadWriteBarrier();
+	Counter->Sequence++;
+}
+
+/*
+Copies a consistent view of a single counter. If the debug loop is part way
+through updating it, the copy is retried.
+*/
+POEDBG_INLINE void _PoeDbgStatsCopyCounter(const PPOEDBG_TRAFFIC_COUNTER Counter, PPOEDBG_TRAFFIC_COUNTER Copy)
+{
+	for (;;)
+	{
+		DWORD Sequence = Counter->Sequence;
+
+		if (0 == (Sequence & 1))
+		{
+			_ReadWriteBarrier();
+			memcpy(Copy, Counter, sizeof(POEDBG_TRAFFIC_COUNTER));
+			_ReadWriteBarrier();
+
+			if (Sequence == Counter->Sequence)
+			{
+				return;
+			}
+		}
+
+		YieldProcessor();
+	}
+}
+
+/*
+Fills in the statistics for every packet ID in the given direction. Rates are
+averaged over the most recent whole seconds, so the second in progress
+doesn't drag them down.
+*/
+inline void _PoeDbgStatsSnapshot(const int Direction, PPOEDBG_TRAFFIC_STATS Stats)
+{
+	DWORD Second = static_cast<DWORD>(GetTickCount64() / 1000);
+
+	for (int Id = 0; Id < PACKET_ID_COUNT; Id++)
+	{
+		POEDBG_TRAFFIC_COUNTER Counter;
+		_PoeDbgStatsCopyCounter(&_g_TrafficCounters[Direction][Id], &Counter);
+
+		PPOEDBG_TRAFFIC_STATS Entry = &Stats[Id];
+
+		Entry->Packets = Counter.Packets;
+		Entry->Bytes = Counter.Bytes;
+		Entry->MinimumSize = Counter.MinimumSize;
+		Entry->MaximumSize = Counter.MaximumSize;
+		Entry->MeanSize = (0 != Counter.Packets) ? static_cast<DWORD>(Counter.Bytes / Counter.Packets) : 0;
+
+		DWORD64 WindowPackets = 0;
+		DWORD64 WindowBytes = 0;
+
+		for (DWORD Age = 1; Age <= TRAFFIC_RATE_SECONDS; Age++)
+		{
+			DWORD Window = (Second - Age) % TRAFFIC_WINDOW_COUNT;
+
+			if (Counter.WindowSecond[Window] == Second - Age)
+			{
+				WindowPackets += Counter.WindowPackets[Window];
+				WindowBytes += Counter.WindowBytes[Window];
+			}
+		}
+
+		Entry->PacketRate = static_cast<DWORD>(WindowPackets / TRAFFIC_RATE_SECONDS);
+		Entry->ByteRate = WindowBytes / TRAFFIC_RATE_SECONDS;
+	}
+}
@@ -0,0 +1,235 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Type Definitions
+//////////////////////////////////////////////////////////////////////////
+
+// Called once for every whole message split out of a stream.
+typedef void(*POEDBG_STREAM_MESSAGE_ROUTINE)(PBYTE Data, DWORD Length);
+
+//////////////////////////////////////////////////////////////////////////
+// Stream Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Works out the length of the message at the start of the given data using the
+frame rule for its ID. Returns false if more data is required to know the
+length, in which case Required is set to the number of bytes needed. Messages
+that can't be framed have a length of zero, meaning they run to the end of
+the data received so far.
+*/
+POEDBG_INLINE bool _PoeDbgStreamGetFrameLength(PBYTE Data, DWORD Available, PDWORD FrameLength, PDWORD Required)
+{
+	if (Available < PACKET_ID_SIZE)
+	{
+		*Required = PACKET_ID_SIZE;
+		return false;
+	}
+
+	PPOEDBG_FRAME_RULE Rule = &_g_ReceiveFrameRules[Data[1]];
+
+	switch (Rule->Type)
+	{
+	case POEDBG_FRAME_FIXED:
+		*FrameLength = Rule->Size;
+		return true;
+	case POEDBG_FRAME_PREFIXED:
+	{
+		DWORD HeaderLength = static_cast<DWORD>(Rule->LengthOffset) + Rule->LengthSize;
+
+		if (Available < HeaderLength)
+		{
+			*Required = HeaderLength;
+			return false;
+		}
+
+		// Read the big-endian length field.
+		DWORD Value = 0;
+
+		for (DWORD i = Rule->LengthOffset; i < HeaderLength; i++)
+		{
+			Value = (Value << 8) | Data[i];
+		}
+
+		// A four byte length field can overflow a DWORD once the rule's size
+		// is added, so the sum is checked at full width.
+
+		DWORD64 Total = static_cast<DWORD64>(Value) + Rule->Size;
+
+		if (Total < HeaderLength || Total > DEFAULT_BUFFER_SIZE)
+		{
+			// The length field can't be right, so we've lost sync with the
+			// stream. Hand over everything we have and start again.
+
+			*FrameLength = 0;
+		}
+		else
+		{
+			*FrameLength = static_cast<DWORD>(Total);
+		}
+
+		return true;
+	}
+	default:
+		*FrameLength = 0;
+		return true;
+	}
+}
+
+/*
+Finds the reassembly state for the given connection, creating it on first use.
+Returns NULL if the carry-over buffer could not be allocated.
+*/
+POEDBG_INLINE PPOEDBG_STREAM _PoeDbgStreamGet(const DWORD64 Connection)
+{
+	PPOEDBG_STREAM Stream = &_g_GameStreams[Connection];
+
+	if (NULL == Stream->Carry)
+	{
+		// Pages are only committed as they're touched, so in practice the carry-over
+		// buffer stays as small as the largest message that was ever split.
+
+		Stream->Carry = reinterpret_cast<PBYTE>(VirtualAlloc(NULL, DEFAULT_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+		Stream->CarryLength = 0;
+	}
+
+	return (NULL != Stream->Carry) ? Stream : NULL;
+}
+
+/*
+Feeds a chunk of received data into the stream for the given connection and
+calls the routine once for every whole message. Whole messages are passed
+straight out of the chunk; only a message split across chunks is copied into
+the carry-over buffer.
+*/
+inline void _PoeDbgStreamProcess(const DWORD64 Connection, PBYTE Chunk, const DWORD Length, POEDBG_STREAM_MESSAGE_ROUTINE Routine)
+{
+	PPOEDBG_STREAM Stream = _PoeDbgStreamGet(Connection);
+
+	if (NULL == Stream)
+	{
+		// Without somewhere to carry partial messages we can only pass the
+		// chunk through as it is.
+
+		Routine(Chunk, Length);
+		return;
+	}
+
+	DWORD Offset = 0;
+	DWORD FrameLength = 0;
+	DWORD Required = 0;
+
+	// First try to complete a message left over from the previous chunk.
+
+	while (Stream->CarryLength > 0 && Offset < Length)
+	{
+		DWORD Wanted = 0;
+		bool bIsFrameKnown = _PoeDbgStreamGetFrameLength(Stream->Carry, Stream->CarryLength, &FrameLength, &Required);
+
+		if (!bIsFrameKnown)
+		{
+			Wanted = Required - Stream->CarryLength;
+		}
+		else if (0 == FrameLength)
+		{
+			// The message can't be framed, so it takes the rest of this chunk.
+			Wanted = Length - Offset;
+
+			if (Wanted > DEFAULT_BUFFER_SIZE - Stream->CarryLength)
+			{
+				Wanted = DEFAULT_BUFFER_SIZE - Stream->CarryLength;
+			}
+
+			FrameLength = Stream->CarryLength + Wanted;
+		}
+		else
+		{
+			Wanted = FrameLength - Stream->CarryLength;
+		}
+
+		if (Wanted > Length - Offset)
+		{
+			Wanted = Length - Offset;
+		}
+
+		memcpy(Stream->Carry + Stream->CarryLength, Chunk + Offset, Wanted);
+
+		Stream->CarryLength += Wanted;
+		Offset += Wanted;
+
+		if (bIsFrameKnown && FrameLength == Stream->CarryLength)
+		{
+			Routine(Stream->Carry, FrameLength);
+			Stream->CarryLength = 0;
+		}
+	}
+
+	// Now pass along every whole message in the chunk without copying.
+
+	while (Offset < Length)
+	{
+		if (!_PoeDbgStreamGetFrameLength(Chunk + Offset, Length - Offset, &FrameLength, &Required))
+		{
+			break;
+		}
+
+		if (0 == FrameLength)
+		{
+			FrameLength = Length - Offset;
+		}
+
+		if (FrameLength > Length - Offset)
+		{
+			break;
+		}
+
+		Routine(Chunk + Offset, FrameLength);
+		Offset += FrameLength;
+	}
+
+	if (Offset < Length)
+	{
+		// Keep the start of the split message until the next chunk arrives.
+		memcpy(Stream->Carry, Chunk + Offset, Length - Offset);
+		Stream->CarryLength = Length - Offset;
+	}
+}
+
+/*
+Forgets the reassembly state for a connection that has closed, so that a new
+connection that reuses its handle doesn't start with the old one's partial
+message.
+*/
+POEDBG_INLINE void _PoeDbgStreamRelease(const DWORD64 Connection)
+{
+	auto Entry = _g_GameStreams.find(Connection);
+
+	if (Entry != _g_GameStreams.end())
+	{
+		if (NULL != Entry->second.Carry)
+		{
+			VirtualFree(Entry->second.Carry, 0, MEM_RELEASE);
+		}
+
+		_g_GameStreams.erase(Entry);
+	}
+}
+
+/*
+Releases the reassembly state for every connection. Only the debug loop may
+call this, since it is the only one that touches the streams.
+*/
+POEDBG_INLINE void _PoeDbgStreamReset()
+{
+	for (auto& Entry : _g_GameStreams)
+	{
+		if (NULL != Entry.second.Carry)
+		{
+			VirtualFree(Entry.second.Carry, 0, MEM_RELEASE);
+		}
+	}
+
+	_g_GameStreams.clear();
+}
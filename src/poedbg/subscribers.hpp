@@ -0,0 +1,257 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Size of a subscriber list holding the given number of subscribers.
+#define SUBSCRIBER_LIST_SIZE(count) (sizeof(POEDBG_SUBSCRIBER_LIST) + ((count) - 1) * sizeof(POEDBG_SUBSCRIBER))
+
+//////////////////////////////////////////////////////////////////////////
+// Subscriber Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Frees a chain of retired subscriber lists.
+*/
+POEDBG_INLINE void _PoeDbgSubscribersFree(PPOEDBG_SUBSCRIBER_LIST List)
+{
+	while (NULL != List)
+	{
+		PPOEDBG_SUBSCRIBER_LIST Retired = List->Retired;
+		HeapFree(GetProcessHeap(), 0, List);
+		List = Retired;
+	}
+}
+
+/*
+Frees any lists that were replaced from inside a subscriber. Only the debug
+loop retires lists, so only it may call this, and never while it is walking
+a list.
+*/
+POEDBG_INLINE void _PoeDbgSubscribersFreeRetired()
+{
+	if (NULL != _g_SubscriberRetired)
+	{
+		_PoeDbgSubscribersFree(_g_SubscriberRetired);
+		_g_SubscriberRetired = NULL;
+	}
+}
+
+/*
+Swaps in a new subscriber list for the given direction and frees the old one
+once the debug loop is no longer reading it. The caller must hold the
+subscriber lock, which is released here before waiting.
+*/
+inline void _PoeDbgSubscribersPublish(const int Direction, PPOEDBG_SUBSCRIBER_LIST List)
+{
+	PPOEDBG_SUBSCRIBER_LIST Old = reinterpret_cast<PPOEDBG_SUBSCRIBER_LIST>(_InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&_g_SubscriberLists[Direction]), List));
+
+	ReleaseSRWLockExclusive(&_g_SubscriberLock);
+
+	if (NULL == Old)
+	{
+		return;
+	}
+
+	if (GetCurrentThreadId() == _g_DebugThreadId)
+	{
+		// We're inside a subscriber, and the debug loop may still be walking
+		// the old list, so it frees the list itself when it's done.
+
+		Old->Retired = _g_SubscriberRetired;
+		_g_SubscriberRetired = Old;
+		return;
+	}
+
+	// The debug loop marks its reads with plain stores, so make sure we see
+	// them before checking whether it is part way through the old list.
+
+	FlushProcessWriteBuffers();
+
+	LONG Sequence = _g_SubscriberReadSequence;
+
+	if (0 != (Sequence & 1))
+	{
+		while (Sequence == _g_SubscriberReadSequence)
+		{
+			Sleep(0);
+		}
+	}
+
+	Old->Retired = NULL;
+	_PoeDbgSubscribersFree(Old);
+}
+
+/*
+Adds a packet subscriber for the given direction. If a filter is given, packet
+IDs with a non-zero entry are not delivered to the subscriber. Extended
+subscribers are called with a POEDBG_PACKET_EX_CALLBACK.
+*/
+inline POEDBG_STATUS _PoeDbgSubscribersAdd(const int Direction, PVOID Callback, const bool bIsExtended, PBYTE Filter, PDWORD Id)
+{
+	AcquireSRWLockExclusive(&_g_SubscriberLock);
+
+	PPOEDBG_SUBSCRIBER_LIST Current = _g_SubscriberLists[Direction];
+	DWORD Count = (NULL != Current) ? Current->Count : 0;
+
+	if (Count >= SUBSCRIBER_MAXIMUM)
+	{
+		ReleaseSRWLockExclusive(&_g_SubscriberLock);
+		return POEDBG_STATUS_SUBSCRIBER_LIMIT_REACHED;
+	}
+
+	PPOEDBG_SUBSCRIBER_LIST List = reinterpret_cast<PPOEDBG_SUBSCRIBER_LIST>(HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, SUBSCRIBER_LIST_SIZE(Count + 1)));
+
+	if (NULL == List)
+	{
+		ReleaseSRWLockExclusive(&_g_SubscriberLock);
+		return POEDBG_STATUS_SUBSCRIBER_ALLOCATION_FAILED;
+	}
+
+	if (0 != Count)
+	{
+		memcpy(List->Subscribers, Current->Subscribers, Count * sizeof(POEDBG_SUBSCRIBER));
+	}
+
+	PPOEDBG_SUBSCRIBER Subscriber = &List->Subscribers[Count];
+
+	Subscriber->Id = _g_SubscriberNextId++;
+	Subscriber->bIsExtended = bIsExtended;
+
+	if (bIsExtended)
+	{
+		Subscriber->CallbackEx = reinterpret_cast<POEDBG_PACKET_EX_CALLBACK>(Callback);
+	}
+	else
+	{
+		Subscriber->Callback = reinterpret_cast<POEDBG_PACKET_CALLBACK>(Callback);
+	}
+
+	if (NULL != Filter)
+	{
+		for (int PacketId = 0; PacketId < PACKET_ID_COUNT; PacketId++)
+		{
+			Subscriber->Filter[PacketId] = (0 != Filter[PacketId]) ? 1 : 0;
+			Subscriber->bIsFiltered |= (0 != Filter[PacketId]);
+		}
+	}
+
+	List->Count = Count + 1;
+
+	*Id = Subscriber->Id;
+
+	_PoeDbgSubscribersPublish(Direction, List);
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Removes the packet subscriber with the given ID. Once this returns, the
+subscriber will not be called again, unless it is being called from the
+subscriber itself, in which case the current call is allowed to finish.
+*/
+inline POEDBG_STATUS _PoeDbgSubscribersRemove(const DWORD Id)
+{
+	AcquireSRWLockExclusive(&_g_SubscriberLock);
+
+	for (int Direction = 0; Direction < POEDBG_DIRECTION_COUNT; Direction++)
+	{
+		PPOEDBG_SUBSCRIBER_LIST Current = _g_SubscriberLists[Direction];
+
+		if (NULL == Current)
+		{
+			continue;
+		}
+
+		for (DWORD Index = 0; Index < Current->Count; Index++)
+		{
+			if (Id != Current->Subscribers[Index].Id)
+			{
+				continue;
+			}
+
+			PPOEDBG_SUBSCRIBER_LIST List = NULL;
+
+			if (Current->Count > 1)
+			{
+				List = reinterpret_cast<PPOEDBG_SUBSCRIBER_LIST>(HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, SUBSCRIBER_LIST_SIZE(Current->Count - 1)));
+
+				if (NULL == List)
+				{
+					ReleaseSRWLockExclusive(&_g_SubscriberLock);
+					return POEDBG_STATUS_SUBSCRIBER_ALLOCATION_FAILED;
+				}
+
+				// Copy everything except the one being removed.
+				memcpy(List->Subscribers, Current->Subscribers, Index * sizeof(POEDBG_SUBSCRIBER));
+				memcpy(List->Subscribers + Index, Current->Subscribers + Index + 1, (Current->Count - Index - 1) * sizeof(POEDBG_SUBSCRIBER));
+
+				List->Count = Current->Count - 1;
+			}
+
+			_PoeDbgSubscribersPublish(Direction, List);
+
+			return POEDBG_STATUS_SUCCESS;
+		}
+	}
+
+	ReleaseSRWLockExclusive(&_g_SubscriberLock);
+
+	return POEDBG_STATUS_SUBSCRIBER_NOT_FOUND;
+}
+
+/*
+Calls every subscriber for the given direction that hasn't filtered out the
+packet's ID. This runs on the debug loop for every packet, and takes no locks.
+*/
+POEDBG_INLINE void _PoeDbgSubscribersNotify(const int Direction, const DWORD Length, const BYTE Id, PBYTE Data, const DWORD64 Timestamp)
+{
+	if (NULL == _g_SubscriberLists[Direction])
+	{
+		// The last subscriber may have been removed from a callback on the
+		// debug loop since we were last here, leaving its list retired.
+
+		_PoeDbgSubscribersFreeRetired();
+		return;
+	}
+
+	// Let anyone replacing the list know that we're reading it. Only this
+	// thread writes the sequence, so a plain increment is enough.
+
+	_g_SubscriberReadSequence++;
+	_ReadWriteBarrier();
+
+	PPOEDBG_SUBSCRIBER_LIST List = _g_SubscriberLists[Direction];
+
+	if (NULL != List)
+	{
+		for (DWORD Index = 0; Index < List->Count; Index++)
+		{
+			PPOEDBG_SUBSCRIBER Subscriber = &List->Subscribers[Index];
+
+			if (Subscriber->bIsFiltered && 0 != Subscriber->Filter[Id])
+			{
+				continue;
+			}
+
+			if (Subscriber->bIsExtended)
+			{
+				Subscriber->CallbackEx(Length, Id, Data, Timestamp);
+			}
+			else
+			{
+				Subscriber->Callback(Length, Id, Data);
+			}
+		}
+	}
+
+	_ReadWriteBarrier();
+	_g_SubscriberReadSequence++;
+
+	// A subscriber may have changed the list while we were walking it.
+
+	_PoeDbgSubscribersFreeRetired();
+}
@@ -0,0 +1,523 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Macros
+//////////////////////////////////////////////////////////////////////////
+
+// Rings, one for each thread the engine runs on.
+#define TRACE_RING_DEBUG 0
+#define TRACE_RING_MERGE 1
+#define TRACE_RING_WORKER 2
+#define TRACE_RING_COUNT (TRACE_RING_WORKER + PIPELINE_WORKER_MAXIMUM)
+
+// Kinds of span.
+#define TRACE_SPAN_EVENT 0
+#define TRACE_SPAN_CONTINUE 1
+#define TRACE_SPAN_HOOK 2
+#define TRACE_SPAN_READ 3
+#define TRACE_SPAN_DISPATCH 4
+#define TRACE_SPAN_CAPTURE 5
+#define TRACE_SPAN_WORKER 6
+#define TRACE_SPAN_MERGE 7
+#define TRACE_SPAN_FLUSH 8
+#define TRACE_SPAN_CALLBACK 9
+
+// Processes in the written trace. The engine's threads are one, and the game
+// threads that reported debug events are the other.
+#define TRACE_PID_ENGINE 1
+#define TRACE_PID_GAME 2
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+// A span recorded by one of the engine's threads. What the value, ID and
+// sequence hold depends on the kind:
+//
+//   Event, continue, hook   Value is the game thread. An event's ID is its
+//                           debug event code, and a hook's source its hook.
+//   Read                    Value is the number of bytes read.
+//   Dispatch, callback,     Value is the captured length, along with the
+//   worker                  packet's direction, ID and sequence.
+//   Capture                 Value is the game thread, and ID the capture
+//                           point, along with its sequence.
+//   Merge                   Sequence is the pipeline's own.
+//   Flush                   Value is the number of held packets delivered.
+typedef struct _POEDBG_TRACE_EVENT
+{
+	DWORD64 Begin;
+	DWORD64 End;
+	DWORD64 Sequence;
+	DWORD Value;
+	BYTE Kind;
+	BYTE Direction;
+	BYTE Id;
+	BYTE Source;
+} POEDBG_TRACE_EVENT, *PPOEDBG_TRACE_EVENT;
+
+// A thread's ring. Only its own thread writes to it, and the head counts
+// every span it has recorded, so the oldest are overwritten once it is full.
+// The sequence is odd while the thread is part way through a span.
+typedef struct DECLSPEC_ALIGN(64) _POEDBG_TRACE_RING
+{
+	volatile LONG64 Head;
+	volatile LONG Sequence;
+} POEDBG_TRACE_RING, *PPOEDBG_TRACE_RING;
+
+// Where a trace is being written, and how far.
+typedef struct _POEDBG_TRACE_WRITER
+{
+	POEDBG_FILE File;
+	PCHAR Buffer;
+	DWORD Used;
+	DWORD64 Offset;
+	bool bIsFirst;
+	bool bIsFailed;
+} POEDBG_TRACE_WRITER, *PPOEDBG_TRACE_WRITER;
+
+//////////////////////////////////////////////////////////////////////////
+// Globals
+//////////////////////////////////////////////////////////////////////////
+
+// The rings, and the spans they hold, one ring's worth after another. The
+// spans are kept once tracing stops, so that they can still be written.
+__declspec(selectany) POEDBG_TRACE_RING _g_TraceRings[TRACE_RING_COUNT];
+__declspec(selectany) PPOEDBG_TRACE_EVENT _g_TraceEvents;
+__declspec(selectany) DWORD _g_TraceRingSize;
+
+// Is every thread recording spans?
+__declspec(selectany) volatile bool _g_bIsTraceEnabled = false;
+
+// Where the trace is written once it stops, if anywhere.
+__declspec(selectany) wchar_t _g_TracePath[TRACE_PATH_MAXIMUM];
+
+// Serializes starting, stopping and writing traces.
+__declspec(selectany) SRWLOCK _g_TraceLock = SRWLOCK_INIT;
+
+//////////////////////////////////////////////////////////////////////////
+// Recording Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Returns the time a span begins, or zero if nothing is being traced, in which
+case the span isn't recorded.
+*/
+POEDBG_INLINE DWORD64 _PoeDbgTraceBegin()
+{
+	return _g_bIsTraceEnabled ? _PoeDbgClockNow() : 0;
+}
+
+/*
+Records a span that began at the given time, and ends now, into the given
+ring. Only the thread the ring belongs to may call this.
+*/
+POEDBG_INLINE void _PoeDbgTraceEnd(const DWORD Ring, const BYTE Kind, const DWORD64 Begin, const DWORD Value, const BYTE Direction, const BYTE Id, const BYTE Source, const DWORD64 Sequence)
+{
+	if (0 == Begin)
+	{
+		return;
+	}
+
+	PPOEDBG_TRACE_RING This = &_g_TraceRings[Ring];
+
+	// Mark the span with plain stores, which whoever stops tracing reads after
+	// flushing every processor's write buffer.
+
+	This->Sequence = This->Sequence + 1;
+
+	if (_g_bIsTraceEnabled)
+	{
+		LONG64 Head = This->Head;
+
+		PPOEDBG_TRACE_EVENT Event = &_g_TraceEvents[static_cast<SIZE_T>(Ring) * _g_TraceRingSize + (static_cast<SIZE_T>(Head) & (_g_TraceRingSize - 1))];
+
+		Event->Begin = Begin;
+		Event->End = _PoeDbgClockNow();
+		Event->Sequence = Sequence;
+		Event->Value = Value;
+		Event->Kind = Kind;
+		Event->Direction = Direction;
+		Event->Id = Id;
+		Event->Source = Source;
+
+		// Publish the span after it is in place.
+		_ReadWriteBarrier();
+		This->Head = Head + 1;
+	}
+
+	This->Sequence = This->Sequence + 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Writing Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Writes out everything in the writer's buffer, and waits for it to finish.
+*/
+inline void _PoeDbgTraceFlush(PPOEDBG_TRACE_WRITER Writer)
+{
+	if (0 == Writer->Used || Writer->bIsFailed)
+	{
+		return;
+	}
+
+	DWORD Tag = 0;
+
+	if (!_PoeDbgPlatformWriteFile(&Writer->File, Writer->Buffer, Writer->Used, Writer->Offset, 0) || !_PoeDbgPlatformWaitForFileWrite(&Writer->File, &Tag))
+	{
+		Writer->bIsFailed = true;
+	}
+
+	Writer->Offset += Writer->Used;
+	Writer->Used = 0;
+}
+
+/*
+Formats a line of the trace into the writer's buffer, flushing the buffer
+first if the line might not fit.
+*/
+inline void _PoeDbgTracePrint(PPOEDBG_TRACE_WRITER Writer, const char* Format, ...)
+{
+	if (TRACE_WRITE_BUFFER_SIZE - Writer->Used < TRACE_LINE_MAXIMUM)
+	{
+		_PoeDbgTraceFlush(Writer);
+	}
+
+	va_list Arguments;
+	va_start(Arguments, Format);
+
+	int Length = vsnprintf(Writer->Buffer + Writer->Used, TRACE_LINE_MAXIMUM, Format, Arguments);
+
+	va_end(Arguments);
+
+	if (Length > 0)
+	{
+		Writer->Used += (Length < TRACE_LINE_MAXIMUM) ? static_cast<DWORD>(Length) : TRACE_LINE_MAXIMUM - 1;
+	}
+}
+
+/*
+Writes a single complete event in the Chrome trace format. Times are given in
+nanoseconds, and written in microseconds.
+*/
+inline void _PoeDbgTracePrintSpan(PPOEDBG_TRACE_WRITER Writer, const char* Name, const char* Category, const DWORD Pid, const DWORD Tid, const PPOEDBG_TRACE_EVENT Event, const char* Arguments)
+{
+	DWORD64 Duration = (Event->End > Event->Begin) ? (Event->End - Event->Begin) : 0;
+
+	_PoeDbgTracePrint(Writer, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"args\":{%s}}",
+		Writer->bIsFirst ? "" : ",\n", Name, Category, Pid, Tid,
+		static_cast<unsigned long long>(Event->Begin / 1000), static_cast<unsigned long long>(Event->Begin % 1000),
+		static_cast<unsigned long long>(Duration / 1000), static_cast<unsigned long long>(Duration % 1000), Arguments);
+
+	Writer->bIsFirst = false;
+}
+
+/*
+Writes a metadata event that names a process, or a thread if the thread ID is
+not zero.
+*/
+inline void _PoeDbgTracePrintName(PPOEDBG_TRACE_WRITER Writer, const DWORD Pid, const DWORD Tid, const char* Name)
+{
+	_PoeDbgTracePrint(Writer, "%s{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+		Writer->bIsFirst ? "" : ",\n", (0 != Tid) ? "thread_name" : "process_name", Pid, Tid, Name);
+
+	Writer->bIsFirst = false;
+}
+
+/*
+Writes a span recorded by the given ring. Debug events are also written to
+the game thread that reported them, since the game is stopped until the
+event is continued.
+*/
+inline void _PoeDbgTraceWriteEvent(PPOEDBG_TRACE_WRITER Writer, const DWORD Ring, const PPOEDBG_TRACE_EVENT Event)
+{
+	static const char* SourceNames[POEDBG_SOURCE_COUNT] = { "send hook", "recv hook", "WSARecv hook" };
+
+	char Name[0x40];
+	char Arguments[0x80];
+
+	const char* Direction = (POEDBG_DIRECTION_SEND == Event->Direction) ? "send" : "receive";
+
+	DWORD Tid = Ring + 1;
+
+	switch (Event->Kind)
+	{
+	case TRACE_SPAN_EVENT:
+		snprintf(Arguments, sizeof(Arguments), "\"thread\":%u,\"code\":%u", Event->Value, Event->Id);
+		_PoeDbgTracePrintSpan(Writer, "debug event", "debug", TRACE_PID_ENGINE, Tid, Event, Arguments);
+
+		snprintf(Arguments, sizeof(Arguments), "\"code\":%u", Event->Id);
+		_PoeDbgTracePrintSpan(Writer, "stopped", "game", TRACE_PID_GAME, Event->Value, Event, Arguments);
+		break;
+	case TRACE_SPAN_CONTINUE:
+		snprintf(Arguments, sizeof(Arguments), "\"thread\":%u", Event->Value);
+		_PoeDbgTracePrintSpan(Writer, "continue", "debug", TRACE_PID_ENGINE, Tid, Event, Arguments);
+		break;
+	case TRACE_SPAN_HOOK:
+		snprintf(Arguments, sizeof(Arguments), "\"thread\":%u", Event->Value);
+		_PoeDbgTracePrintSpan(Writer, (Event->Source < POEDBG_SOURCE_COUNT) ? SourceNames[Event->Source] : "hook", "hook", TRACE_PID_ENGINE, Tid, Event, Arguments);
+		break;
+	case TRACE_SPAN_READ:
+		snprintf(Arguments, sizeof(Arguments), "\"bytes\":%u", Event->Value);
+		_PoeDbgTracePrintSpan(Writer, "read", "read", TRACE_PID_ENGINE, Tid, Event, Arguments);
+		break;
+	case TRACE_SPAN_DISPATCH:
+	case TRACE_SPAN_WORKER:
+		snprintf(Name, sizeof(Name), "%s 0x%02X", Direction, Event->Id);
+		snprintf(Arguments, sizeof(Arguments), "\"sequence\":%llu,\"bytes\":%u", static_cast<unsigned long long>(Event->Sequence), Event->Value);
+		_PoeDbgTracePrintSpan(Writer, Name, (TRACE_SPAN_DISPATCH == Event->Kind) ? "dispatch" : "worker", TRACE_PID_ENGINE, Tid, Event, Arguments);
+		break;
+	case TRACE_SPAN_CALLBACK:
+		snprintf(Arguments, sizeof(Arguments), "\"sequence\":%llu,\"bytes\":%u", static_cast<unsigned long long>(Event->Sequence), Event->Value);
+		_PoeDbgTracePrintSpan(Writer, "callbacks", "callback", TRACE_PID_ENGINE, Tid, Event, Arguments);
+		break;
+	case TRACE_SPAN_CAPTURE:
+		snprintf(Name, sizeof(Name), "capture point %u", Event->Id);
+		snprintf(Arguments, sizeof(Arguments), "\"thread\":%u,\"sequence\":%llu", Event->Value, static_cast<unsigned long long>(Event->Sequence));
+		_PoeDbgTracePrintSpan(Writer, Name, "callback", TRACE_PID_ENGINE, Tid, Event, Arguments);
+		break;
+	case TRACE_SPAN_MERGE:
+		snprintf(Arguments, sizeof(Arguments), "\"sequence\":%llu", static_cast<unsigned long long>(Event->Sequence));
+		_PoeDbgTracePrintSpan(Writer, "merge", "merge", TRACE_PID_ENGINE, Tid, Event, Arguments);
+		break;
+	case TRACE_SPAN_FLUSH:
+		snprintf(Arguments, sizeof(Arguments), "\"packets\":%u", Event->Value);
+		_PoeDbgTracePrintSpan(Writer, "conflation flush", "callback", TRACE_PID_ENGINE, Tid, Event, Arguments);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+Writes every span still held by the given ring. The ring's thread may still
+be recording, so each span is checked after it is copied, and skipped if the
+thread has since come round and started overwriting it.
+*/
+inline void _PoeDbgTraceWriteRing(PPOEDBG_TRACE_WRITER Writer, const DWORD Ring)
+{
+	PPOEDBG_TRACE_RING This = &_g_TraceRings[Ring];
+	PPOEDBG_TRACE_EVENT Events = &_g_TraceEvents[static_cast<SIZE_T>(Ring) * _g_TraceRingSize];
+
+	LONG64 Head = This->Head;
+
+	if (0 == Head)
+	{
+		return;
+	}
+
+	char Name[0x40];
+
+	switch (Ring)
+	{
+	case TRACE_RING_DEBUG:
+		snprintf(Name, sizeof(Name), "debug loop");
+		break;
+	case TRACE_RING_MERGE:
+		snprintf(Name, sizeof(Name), "pipeline merge");
+		break;
+	default:
+		snprintf(Name, sizeof(Name), "pipeline worker %u", Ring - TRACE_RING_WORKER);
+		break;
+	}
+
+	_PoeDbgTracePrintName(Writer, TRACE_PID_ENGINE, Ring + 1, Name);
+
+	LONG64 Index = (Head > static_cast<LONG64>(_g_TraceRingSize)) ? (Head - _g_TraceRingSize) : 0;
+
+	for (; Index < Head; Index++)
+	{
+		POEDBG_TRACE_EVENT Event = Events[static_cast<SIZE_T>(Index) & (_g_TraceRingSize - 1)];
+
+		_ReadWriteBarrier();
+
+		if (Index + static_cast<LONG64>(_g_TraceRingSize) <= This->Head)
+		{
+			continue;
+		}
+
+		_PoeDbgTraceWriteEvent(Writer, Ring, &Event);
+	}
+}
+
+/*
+Writes every span recorded so far to the given path, as Chrome trace JSON,
+which Perfetto and chrome://tracing both open. Tracing may still be running.
+The caller must hold the trace lock.
+*/
+inline POEDBG_STATUS _PoeDbgTraceWrite(const wchar_t* Path)
+{
+	if (NULL == _g_TraceEvents)
+	{
+		return POEDBG_STATUS_TRACE_NOT_STARTED;
+	}
+
+	PPOEDBG_TRACE_WRITER Writer = reinterpret_cast<PPOEDBG_TRACE_WRITER>(HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(POEDBG_TRACE_WRITER)));
+
+	if (NULL == Writer)
+	{
+		return POEDBG_STATUS_TRACE_ALLOCATION_FAILED;
+	}
+
+	Writer->Buffer = reinterpret_cast<PCHAR>(VirtualAlloc(NULL, TRACE_WRITE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+	if (NULL == Writer->Buffer)
+	{
+		HeapFree(GetProcessHeap(), 0, Writer);
+		return POEDBG_STATUS_TRACE_ALLOCATION_FAILED;
+	}
+
+	if (!_PoeDbgPlatformOpenFile(&Writer->File, Path))
+	{
+		VirtualFree(Writer->Buffer, 0, MEM_RELEASE);
+		HeapFree(GetProcessHeap(), 0, Writer);
+		return POEDBG_STATUS_TRACE_WRITE_FAILED;
+	}
+
+	Writer->bIsFirst = true;
+
+	_PoeDbgTracePrint(Writer, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+	_PoeDbgTracePrintName(Writer, TRACE_PID_ENGINE, 0, "poedbg");
+	_PoeDbgTracePrintName(Writer, TRACE_PID_GAME, 0, "game");
+
+	for (DWORD Ring = 0; Ring < TRACE_RING_COUNT; Ring++)
+	{
+		_PoeDbgTraceWriteRing(Writer, Ring);
+	}
+
+	_PoeDbgTracePrint(Writer, "\n]}\n");
+	_PoeDbgTraceFlush(Writer);
+
+	_PoeDbgPlatformCloseFile(&Writer->File);
+
+	POEDBG_STATUS Status = Writer->bIsFailed ? POEDBG_STATUS_TRACE_WRITE_FAILED : POEDBG_STATUS_SUCCESS;
+
+	VirtualFree(Writer->Buffer, 0, MEM_RELEASE);
+	HeapFree(GetProcessHeap(), 0, Writer);
+
+	return Status;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Control Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Starts recording spans into rings of the given number of spans each, rounded
+up to a power of two, replacing anything recorded before. If a path is given,
+the trace is written there once it stops.
+*/
+inline POEDBG_STATUS _PoeDbgTraceStart(const DWORD Events, const wchar_t* Path)
+{
+	if (Events > TRACE_EVENTS_MAXIMUM)
+	{
+		return POEDBG_STATUS_TRACE_INVALID;
+	}
+
+	AcquireSRWLockExclusive(&_g_TraceLock);
+
+	if (_g_bIsTraceEnabled)
+	{
+		ReleaseSRWLockExclusive(&_g_TraceLock);
+		return POEDBG_STATUS_TRACE_ALREADY_STARTED;
+	}
+
+	_g_TracePath[0] = L'\0';
+
+	if (NULL != Path && !_PoeDbgModuleCopyName(_g_TracePath, Path, TRACE_PATH_MAXIMUM))
+	{
+		_g_TracePath[0] = L'\0';
+
+		ReleaseSRWLockExclusive(&_g_TraceLock);
+		return POEDBG_STATUS_TRACE_INVALID;
+	}
+
+	DWORD RingSize = 1;
+
+	while (RingSize < ((0 != Events) ? Events : TRACE_DEFAULT_EVENTS))
+	{
+		RingSize <<= 1;
+	}
+
+	// No thread records spans while tracing is stopped, so the old ones can be
+	// freed straight away.
+
+	if (NULL != _g_TraceEvents)
+	{
+		VirtualFree(_g_TraceEvents, 0, MEM_RELEASE);
+		_g_TraceEvents = NULL;
+	}
+
+	_g_TraceEvents = reinterpret_cast<PPOEDBG_TRACE_EVENT>(VirtualAlloc(NULL, static_cast<SIZE_T>(RingSize) * TRACE_RING_COUNT * sizeof(POEDBG_TRACE_EVENT), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+	if (NULL == _g_TraceEvents)
+	{
+		ReleaseSRWLockExclusive(&_g_TraceLock);
+		return POEDBG_STATUS_TRACE_ALLOCATION_FAILED;
+	}
+
+	_g_TraceRingSize = RingSize;
+
+	for (DWORD Ring = 0; Ring < TRACE_RING_COUNT; Ring++)
+	{
+		_g_TraceRings[Ring].Head = 0;
+	}
+
+	// Publish the rings to every thread last.
+	_g_bIsTraceEnabled = true;
+
+	ReleaseSRWLockExclusive(&_g_TraceLock);
+
+	return POEDBG_STATUS_SUCCESS;
+}
+
+/*
+Stops recording spans, and waits for any thread part way through one. The
+spans are kept, and written to the path tracing was started with, if any.
+*/
+inline POEDBG_STATUS _PoeDbgTraceStop()
+{
+	AcquireSRWLockExclusive(&_g_TraceLock);
+
+	if (!_g_bIsTraceEnabled)
+	{
+		ReleaseSRWLockExclusive(&_g_TraceLock);
+		return POEDBG_STATUS_TRACE_NOT_STARTED;
+	}
+
+	_g_bIsTraceEnabled = false;
+
+	// Make sure we see every thread's marks, then wait for each to finish any
+	// span already under way. A thread calling us from a callback is never
+	// part way through one.
+
+	FlushProcessWriteBuffers();
+
+	for (DWORD Ring = 0; Ring < TRACE_RING_COUNT; Ring++)
+	{
+		LONG Sequence = _g_TraceRings[Ring].Sequence;
+
+		if (0 != (Sequence & 1))
+		{
+			while (Sequence == _g_TraceRings[Ring].Sequence)
+			{
+				Sleep(0);
+			}
+		}
+	}
+
+	POEDBG_STATUS Status = POEDBG_STATUS_SUCCESS;
+
+	if (L'\0' != _g_TracePath[0])
+	{
+		Status = _PoeDbgTraceWrite(_g_TracePath);
+	}
+
+	ReleaseSRWLockExclusive(&_g_TraceLock);
+
+	return Status;
+}
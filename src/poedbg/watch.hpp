@@ -0,0 +1,219 @@
+// Part of 'poedbg'. Copyright (c) 2018 maper. Copies must retain this attribution.
+
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Watch Functions
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Converts a watched length in bytes into its breakpoint size. Returns false if
+the hardware can't watch that many bytes.
+*/
+POEDBG_INLINE bool _PoeDbgWatchGetBreakpointLength(const DWORD Length, PSIZE_T BreakpointLength)
+{
+	switch (Length)
+	{
+	case 1:
+		*BreakpointLength = BP_LENGTH_ONE;
+		return true;
+	case 2:
+		*BreakpointLength = BP_LENGTH_TWO;
+		return true;
+	case 4:
+		*BreakpointLength = BP_LENGTH_FOUR;
+		return true;
+	case 8:
+		*BreakpointLength = BP_LENGTH_EIGHT;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+Reads the current value of a watchpoint from the game, zero-extended.
+*/
+POEDBG_INLINE DWORD64 _PoeDbgWatchReadValue(const PPOEDBG_WATCHPOINT Watchpoint)
+{
+	DWORD64 Value = 0;
+
+	_PoeDbgMemoryRead(Watchpoint->Address, &Value, Watchpoint->Length);
+
+	return Value;
+}
+
+/*
+Adds a watchpoint in the first free breakpoint slot and applies it to every
+game thread. The ID of the watchpoint is the slot it was given.
+*/
+inline POEDBG_STATUS _PoeDbgWatchAdd(const ULONG_PTR Address, const DWORD Length, const int Condition, PDWORD Id)
+{
+	SIZE_T BreakpointLength = 0;
+
+	if (!_PoeDbgWatchGetBreakpointLength(Length, &BreakpointLength))
+	{
+		return POEDBG_STATUS_WATCHPOINT_INVALID;
+	}
+
+	if (POEDBG_WATCH_WRITE != Condition && POEDBG_WATCH_READWRITE != Condition)
+	{
+		return POEDBG_STATUS_WATCHPOINT_INVALID;
+	}
+
+	if (0 != (Address & (Length - 1)))
+	{
+		// The hardware only watches naturally aligned memory.
+		return POEDBG_STATUS_WATCHPOINT_INVALID;
+	}
+
+	POEDBG_STATUS Status = POEDBG_STATUS_WATCHPOINT_SLOTS_FULL;
+
+	AcquireSRWLockExclusive(&_g_WatchLock);
+
+	// Take slots from the top down, leaving the low slots to the hooks.
+
+	for (USHORT Index = BP_SLOT_COUNT; Index-- > 0;)
+	{
+		if (_g_Breakpoints[Index].bIsEnabled)
+		{
+			continue;
+		}
+
+		PPOEDBG_WATCHPOINT Watchpoint = &_g_Watchpoints[Index];
+
+		Watchpoint->Address = Address;
+		Watchpoint->Length = Length;
+		Watchpoint->Value = _PoeDbgWatchReadValue(Watchpoint);
+		Watchpoint->bIsActive = true;
+
+		_PoeDbgMemoryDefineBreakpoint(Index, Address, BreakpointLength, static_cast<SIZE_T>(Condition));
+
+		if (!_PoeDbgMemoryApplyBreakpointsToAll())
+		{
+			// Give the slot back, and take the watchpoint off whichever
+			// threads it did reach, so that nothing is left half applied.
+			Watchpoint->bIsActive = false;
+			_PoeDbgMemoryClearBreakpoint(Index);
+			_PoeDbgMemoryApplyBreakpointsToAll();
+
+			Status = POEDBG_STATUS_HOOK_THREAD_FAILED;
+			break;
+		}
+
+		Status = POEDBG_STATUS_SUCCESS;
+		*Id = Index;
+		break;
+	}
+
+	ReleaseSRWLockExclusive(&_g_WatchLock);
+
+	return Status;
+}
+
+/*
+Removes the watchpoint with the given ID from every game thread.
+*/
+inline POEDBG_STATUS _PoeDbgWatchRemove(const DWORD Id)
+{
+	if (Id >= BP_SLOT_COUNT)
+	{
+		return POEDBG_STATUS_WATCHPOINT_INVALID;
+	}
+
+	POEDBG_STATUS Status = POEDBG_STATUS_SUCCESS;
+
+	AcquireSRWLockExclusive(&_g_WatchLock);
+
+	if (!_g_Watchpoints[Id].bIsActive)
+	{
+		Status = POEDBG_STATUS_WATCHPOINT_INVALID;
+	}
+	else
+	{
+		_g_Watchpoints[Id].bIsActive = false;
+
+		_PoeDbgMemoryClearBreakpoint(static_cast<USHORT>(Id));
+
+		if (!_PoeDbgMemoryApplyBreakpointsToAll())
+		{
+			Status = POEDBG_STATUS_HOOK_THREAD_FAILED;
+		}
+	}
+
+	ReleaseSRWLockExclusive(&_g_WatchLock);
+
+	return Status;
+}
+
+/*
+Records an event for every watchpoint that the given thread just hit, based on
+the status bits in DR6. This is called by the debug loop, which resumes the
+thread straight afterwards, so it does nothing but read the new value and
+append to the event ring.
+*/
+inline void _PoeDbgWatchProcessHits(const DWORD ThreadId, const PCONTEXT Context)
+{
+	for (USHORT Index = 0; Index < BP_SLOT_COUNT; Index++)
+	{
+		PPOEDBG_WATCHPOINT Watchpoint = &_g_Watchpoints[Index];
+
+		if (0 == (Context->Dr6 & (static_cast<DWORD64>(1) << Index)) || !Watchpoint->bIsActive)
+		{
+			continue;
+		}
+
+		DWORD64 Value = _PoeDbgWatchReadValue(Watchpoint);
+
+		LONG64 Head = _g_WatchEventHead;
+
+		if (Head - _g_WatchEventTail >= WATCH_EVENT_COUNT)
+		{
+			// Nobody has read the events in a while.
+			_g_WatchEventDroppedCount++;
+		}
+		else
+		{
+			PPOEDBG_WATCH_EVENT Event = &_g_WatchEvents[Head % WATCH_EVENT_COUNT];
+
+			Event->ThreadId = ThreadId;
+			Event->Id = Index;
+			Event->Rip = Context->Rip;
+			Event->OldValue = Watchpoint->Value;
+			Event->NewValue = Value;
+			Event->Timestamp = _g_EventTimestamp;
+
+			// Publish the event.
+			_InterlockedExchange64(&_g_WatchEventHead, Head + 1);
+		}
+
+		Watchpoint->Value = Value;
+	}
+}
+
+/*
+Copies up to Capacity of the oldest watchpoint events into the given array,
+without waiting. Count is set to the number copied.
+*/
+inline void _PoeDbgWatchRead(PPOEDBG_WATCH_EVENT Events, const DWORD Capacity, PDWORD Count)
+{
+	AcquireSRWLockExclusive(&_g_WatchLock);
+
+	LONG64 Head = _g_WatchEventHead;
+	LONG64 Tail = _g_WatchEventTail;
+
+	DWORD Copied = 0;
+
+	while (Tail != Head && Copied < Capacity)
+	{
+		Events[Copied++] = _g_WatchEvents[Tail % WATCH_EVENT_COUNT];
+		Tail++;
+	}
+
+	// Hand the space back to the debug loop.
+	_InterlockedExchange64(&_g_WatchEventTail, Tail);
+
+	ReleaseSRWLockExclusive(&_g_WatchLock);
+
+	*Count = Copied;
+}